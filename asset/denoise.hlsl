@@ -0,0 +1,145 @@
+// edge-avoiding a-trous wavelet filter of the accumulated radiance of
+// asset/raw.hlsl, gpu counterpart of src/core/denoiser.cpp
+
+cbuffer CSParams
+{
+    int   OutputWidth;
+    int   OutputHeight;
+    int   StepSize;
+    int   IsLastPass;
+    float SigmaLuminance;
+    float SigmaDepth;
+    float SigmaAlbedo;
+    float SigmaTransmittance;
+}
+
+// CSResolve
+
+Texture2D<float4> Output;
+Texture2D<float4> Features;
+Texture2D<float4> Moments;
+
+RWTexture2D<float4> ResolvedColor;
+RWTexture2D<float4> ResolvedGuide;
+RWTexture2D<float>  ResolvedTransmittance;
+
+// CSFilter
+
+Texture2D<float4> Color;
+Texture2D<float4> Guide;
+Texture2D<float>  Transmittance;
+
+RWTexture2D<float4> FilteredColor;
+
+static const float KERNEL[5] = { 1.0 / 16, 1.0 / 4, 3.0 / 8, 1.0 / 4, 1.0 / 16 };
+
+static const float GAUSSIAN3[3] = { 0.25, 0.5, 0.25 };
+
+float luminance(float3 c)
+{
+    return 0.2126 * c.r + 0.7152 * c.g + 0.0722 * c.b;
+}
+
+// variance of the luminance mean of a pixel. a single sample tells nothing
+// about it, so it is taken as 100%
+float computeVariance(int2 pixel)
+{
+    float n = Output[pixel].a;
+    if(n <= 0)
+        return 0;
+
+    float2 moments = Moments[pixel].xy / n;
+    if(n <= 1)
+        return moments.x * moments.x;
+    return max(0.0, moments.y - moments.x * moments.x) / (n - 1);
+}
+
+// per-pixel means, and the variance of the luminance mean blurred once
+[numthreads(16, 16, 1)]
+void CSResolve(int2 threadIdx : SV_DispatchThreadID)
+{
+    if(threadIdx.x >= OutputWidth || threadIdx.y >= OutputHeight)
+        return;
+
+    float variance = 0;
+    for(int dy = -1; dy <= 1; ++dy)
+    {
+        for(int dx = -1; dx <= 1; ++dx)
+        {
+            int2 q = clamp(threadIdx + int2(dx, dy), int2(0, 0), int2(OutputWidth - 1, OutputHeight - 1));
+            variance += GAUSSIAN3[dy + 1] * GAUSSIAN3[dx + 1] * computeVariance(q);
+        }
+    }
+
+    float n = Output[threadIdx].a;
+    if(n <= 0)
+    {
+        ResolvedColor[threadIdx]         = float4(0, 0, 0, 0);
+        ResolvedGuide[threadIdx]         = float4(0, 0, 0, 0);
+        ResolvedTransmittance[threadIdx] = 1;
+        return;
+    }
+
+    ResolvedColor[threadIdx]         = float4(Output[threadIdx].rgb / n, variance);
+    ResolvedGuide[threadIdx]         = Features[threadIdx] / n;
+    ResolvedTransmittance[threadIdx] = Moments[threadIdx].z / n;
+}
+
+// one 5x5 pass at StepSize. color is (radiance, variance) until the last
+// pass, which writes a sample count of 1 for asset/display.hlsl
+[numthreads(16, 16, 1)]
+void CSFilter(int2 threadIdx : SV_DispatchThreadID)
+{
+    if(threadIdx.x >= OutputWidth || threadIdx.y >= OutputHeight)
+        return;
+
+    float4 cp = Color[threadIdx];
+    float4 gp = Guide[threadIdx];
+    float  tp = Transmittance[threadIdx];
+
+    float lumP = luminance(cp.rgb);
+    float invSigmaLum = 1 / (SigmaLuminance * sqrt(cp.a) + 1e-6);
+
+    float3 colorSum = float3(0, 0, 0);
+    float varianceSum = 0, weightSum = 0;
+
+    for(int ky = 0; ky < 5; ++ky)
+    {
+        int qy = threadIdx.y + (ky - 2) * StepSize;
+        if(qy < 0 || qy >= OutputHeight)
+            continue;
+
+        for(int kx = 0; kx < 5; ++kx)
+        {
+            int qx = threadIdx.x + (kx - 2) * StepSize;
+            if(qx < 0 || qx >= OutputWidth)
+                continue;
+
+            int2 q = int2(qx, qy);
+            float4 cq = Color[q];
+            float4 gq = Guide[q];
+
+            float3 da = abs(gp.rgb - gq.rgb);
+            float maxDepth = max(gp.a, gq.a);
+
+            float exponent =
+                abs(lumP - luminance(cq.rgb)) * invSigmaLum +
+                abs(gp.a - gq.a) / (SigmaDepth * maxDepth + 1e-6) +
+                (da.x + da.y + da.z) / SigmaAlbedo +
+                abs(tp - Transmittance[q]) / SigmaTransmittance;
+
+            float weight = KERNEL[kx] * KERNEL[ky] * exp(-exponent);
+
+            colorSum    += weight * cq.rgb;
+            varianceSum += weight * weight * cq.a;
+            weightSum   += weight;
+        }
+    }
+
+    // the center has weight KERNEL[2]^2 > 0
+    float3 color = colorSum / weightSum;
+    if(IsLastPass)
+        FilteredColor[threadIdx] = float4(color, 1);
+    else
+        FilteredColor[threadIdx] = float4(color, varianceSum / (weightSum * weightSum));
+}
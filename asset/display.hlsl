@@ -15,6 +15,7 @@ VSOutput VSMain(uint vertexID : SV_VertexID)
 cbuffer PSParams
 {
     float Exposure;
+    int   FillRadius;
 };
 
 #define A 2.51
@@ -32,9 +33,45 @@ float3 tonemap(float3 x)
 Texture2D<float4> Tex;
 SamplerState      TexSampler;
 
+// inverse squared distance weighted mean of the pixels with samples around
+// a pixel without, like CPUVolumeRenderer::getUpsampledOutput
+float3 fillHole(float2 texCoord)
+{
+    int width, height;
+    Tex.GetDimensions(width, height);
+    int2 pixel = int2(texCoord * float2(width, height));
+
+    float3 sum = float3(0, 0, 0);
+    float weightSum = 0;
+    for(int dy = -FillRadius; dy <= FillRadius; ++dy)
+    {
+        for(int dx = -FillRadius; dx <= FillRadius; ++dx)
+        {
+            int2 q = pixel + int2(dx, dy);
+            if(any(q < 0) || q.x >= width || q.y >= height)
+                continue;
+
+            float4 val = Tex.Load(int3(q, 0));
+            if(val.a <= 0)
+                continue;
+
+            float weight = 1.0 / (dx * dx + dy * dy);
+            sum       += weight * val.rgb / val.a;
+            weightSum += weight;
+        }
+    }
+    return weightSum > 0 ? sum / weightSum : float3(0, 0, 0);
+}
+
 float4 PSMain(VSOutput input): SV_TARGET
 {
     float4 val = Tex.SampleLevel(TexSampler, input.texCoord, 0);
-    float3 result = val.a > 0 ? val.rgb / val.a : float3(0, 0, 0);
+    float3 result;
+    if(val.a > 0)
+        result = val.rgb / val.a;
+    else if(FillRadius > 0)
+        result = fillHole(input.texCoord);
+    else
+        result = float3(0, 0, 0);
     return float4(pow(tonemap(result), 1 / 2.2f), 1);
 }
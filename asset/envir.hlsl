@@ -9,8 +9,15 @@ cbuffer EnvirLightParams
     int   EnvirTableWidth;
     int   EnvirTableHeight;
     int   EnvirTableSize;
+    int   EnvirSamplingMode;
+    int   EnvirWarpSize;
+    int   EnvirWarpLevels;
+    float EnvirWarpTotal;
 };
 
+#define ENVIR_SAMPLING_ALIAS   0
+#define ENVIR_SAMPLING_MIPWARP 1
+
 struct EnvirAliasTableUnit
 {
     float acceptProb;
@@ -20,6 +27,9 @@ struct EnvirAliasTableUnit
 StructuredBuffer<EnvirAliasTableUnit> EnvirAliasTable;
 Texture2D<float>                      EnvirAliasProbs;
 
+// mip k holds the importance sums of (EnvirWarpSize >> k)^2 patches
+Texture2D<float> EnvirWarp;
+
 Texture2D<float3> EnvirLight;
 SamplerState      EnvirSampler;
 
@@ -35,18 +45,55 @@ int sampleEnvirAliasTable(inout uint rng)
     return u2 <= unit.acceptProb ? i : unit.anotherIndex;
 }
 
-void sampleEnvirLight(inout uint rng, out float3 refToLight, out float pdf)
+// descends the EnvirWarp pyramid like EnvirMipWarp::sample, with one random
+// number per level
+int2 sampleEnvirMipWarp(inout uint rng, out float prob)
 {
-    int patchIdx = sampleEnvirAliasTable(rng);
-    int patchY = patchIdx / EnvirTableWidth;
-    int patchX = patchIdx % EnvirTableWidth;
-    
-    float patchPDF = EnvirAliasProbs[int2(patchX, patchY)];
+    if(EnvirWarpTotal <= 0)
+    {
+        prob = 1.0 / (EnvirWarpSize * EnvirWarpSize);
+        return min(int2(rand_float(rng) * EnvirWarpSize, rand_float(rng) * EnvirWarpSize),
+                   EnvirWarpSize - 1);
+    }
+
+    int2 p = int2(0, 0);
+    prob = 1;
+    for(int level = EnvirWarpLevels - 2; level >= 0; --level)
+    {
+        p *= 2;
+
+        float4 w = float4(
+            EnvirWarp.Load(int3(p,              level)),
+            EnvirWarp.Load(int3(p + int2(1, 0), level)),
+            EnvirWarp.Load(int3(p + int2(0, 1), level)),
+            EnvirWarp.Load(int3(p + int2(1, 1), level)));
+        float total = w.x + w.y + w.z + w.w;
+
+        float r = rand_float(rng) * total;
+        int pick = 0;
+        [unroll] for(int c = 0; c < 4; ++c)
+        {
+            if(w[c] <= 0)
+                continue;
+            pick = c;
+            if(r < w[c])
+                break;
+            r -= w[c];
+        }
+
+        p += int2(pick & 1, pick >> 1);
+        prob *= w[pick] / total;
+    }
+    return p;
+}
 
-    float u0 = float(patchX)     / EnvirTableWidth;
-    float u1 = float(patchX + 1) / EnvirTableWidth;
-    float v0 = float(patchY)     / EnvirTableHeight;
-    float v1 = float(patchY + 1) / EnvirTableHeight;
+// uniform direction in a patch of a tableWidth * tableHeight table
+float3 sampleEnvirPatch(int2 patch, int tableWidth, int tableHeight, inout uint rng, out float pdf)
+{
+    float u0 = float(patch.x)     / tableWidth;
+    float u1 = float(patch.x + 1) / tableWidth;
+    float v0 = float(patch.y)     / tableHeight;
+    float v1 = float(patch.y + 1) / tableHeight;
 
     float cv0 = cos(PI * v0), cv1 = cos(PI * v1);
     float cvmin = min(cv0, cv1), cvmax = max(cv0, cv1);
@@ -56,11 +103,86 @@ void sampleEnvirLight(inout uint rng, out float3 refToLight, out float pdf)
     float u = lerp(u0, u1, rand_float(rng));
     float phi = 2 * PI * u;
 
-    float3 dir = float3(sinTheta * cos(phi), cosTheta, sinTheta * sin(phi));
-    float inPatchPDF = 1 / (2 * PI * ((u1 - u0) * (cvmax - cvmin)));
+    pdf = 1 / (2 * PI * ((u1 - u0) * (cvmax - cvmin)));
+    return float3(sinTheta * cos(phi), cosTheta, sinTheta * sin(phi));
+}
+
+void sampleEnvirLight(inout uint rng, out float3 refToLight, out float pdf)
+{
+    float patchPDF, inPatchPDF;
+    if(EnvirSamplingMode == ENVIR_SAMPLING_MIPWARP)
+    {
+        int2 patch = sampleEnvirMipWarp(rng, patchPDF);
+        refToLight = sampleEnvirPatch(patch, EnvirWarpSize, EnvirWarpSize, rng, inPatchPDF);
+    }
+    else
+    {
+        int patchIdx = sampleEnvirAliasTable(rng);
+        int2 patch = int2(patchIdx % EnvirTableWidth, patchIdx / EnvirTableWidth);
+
+        patchPDF   = EnvirAliasProbs[patch];
+        refToLight = sampleEnvirPatch(patch, EnvirTableWidth, EnvirTableHeight, rng, inPatchPDF);
+    }
+    pdf = patchPDF * inPatchPDF;
+}
 
-    refToLight = dir;
-    pdf        = patchPDF * inPatchPDF;
+// the patch of a tableWidth * tableHeight table containing a direction,
+// with the mapping of evalEnvirLight
+int2 getEnvirPatch(float3 dir, int tableWidth, int tableHeight)
+{
+    float u = atan2(dir.z, dir.x) / (2 * PI);
+    if(u < 0)
+        u += 1;
+    float v = 0.5 - asin(clamp(dir.y, -1.0, 1.0)) / PI;
+    return min(int2(u * tableWidth, v * tableHeight), int2(tableWidth - 1, tableHeight - 1));
+}
+
+float getEnvirPatchPDF(int2 patch, int tableWidth, int tableHeight)
+{
+    float u0 = float(patch.x)     / tableWidth;
+    float u1 = float(patch.x + 1) / tableWidth;
+    float cv0 = cos(PI * float(patch.y)     / tableHeight);
+    float cv1 = cos(PI * float(patch.y + 1) / tableHeight);
+    return 1 / (2 * PI * ((u1 - u0) * abs(cv0 - cv1)));
+}
+
+// probability of sampleEnvirMipWarp picking p, like EnvirMipWarp::getProb
+float getEnvirMipWarpProb(int2 p)
+{
+    if(EnvirWarpTotal <= 0)
+        return 1.0 / (EnvirWarpSize * EnvirWarpSize);
+
+    float prob = 1;
+    for(int level = EnvirWarpLevels - 2; level >= 0; --level)
+    {
+        int2 q = (p >> level) & ~1;
+        int pick = (((p.y >> level) & 1) << 1) | ((p.x >> level) & 1);
+
+        float4 w = float4(
+            EnvirWarp.Load(int3(q,              level)),
+            EnvirWarp.Load(int3(q + int2(1, 0), level)),
+            EnvirWarp.Load(int3(q + int2(0, 1), level)),
+            EnvirWarp.Load(int3(q + int2(1, 1), level)));
+
+        if(w[pick] <= 0)
+            return 0;
+        prob *= w[pick] / (w.x + w.y + w.z + w.w);
+    }
+    return prob;
+}
+
+// solid angle pdf of sampleEnvirLight drawing a direction
+float pdfEnvirLight(float3 refToLight)
+{
+    float3 dir = normalize(refToLight);
+    if(EnvirSamplingMode == ENVIR_SAMPLING_MIPWARP)
+    {
+        int2 patch = getEnvirPatch(dir, EnvirWarpSize, EnvirWarpSize);
+        return getEnvirMipWarpProb(patch) * getEnvirPatchPDF(patch, EnvirWarpSize, EnvirWarpSize);
+    }
+
+    int2 patch = getEnvirPatch(dir, EnvirTableWidth, EnvirTableHeight);
+    return EnvirAliasProbs[patch] * getEnvirPatchPDF(patch, EnvirTableWidth, EnvirTableHeight);
 }
 
 float3 evalEnvirLight(float3 refToLight)
@@ -7,7 +7,18 @@ cbuffer CSParams
     float3 FrustumA; int OutputWidth;
     float3 FrustumB; int OutputHeight;
     float3 FrustumC; int DiscardHistory;
-    float3 FrustumD;
+    float3 FrustumD; int ReprojectHistory;
+
+    // camera of the history when ReprojectHistory is set
+    float3 PrevEye;      int   MaxHistorySamples;
+    float3 PrevFrustumA; float DepthTolerance;
+    float3 PrevFrustumB; int   InterleaveStride;
+    float3 PrevFrustumC; int   InterleavePhase;
+
+    // the light sample of each scattering is combined with the phase sample
+    // of the next bounce, see DirectLightParams
+    int DirectLightMIS;
+    int MISPowerHeuristic;
 }
 
 Texture2D<uint>   OldRandomSeeds;
@@ -16,10 +27,36 @@ RWTexture2D<uint> NewRandomSeeds;
 Texture2D<float4>   History;
 RWTexture2D<float4> Output;
 
-float3 estimateDirectIllum(float3 o, float3 wo, inout uint rng)
+// guides of asset/denoise.hlsl, summed over samples like Output:
+// (first scattering albedo, its distance from the eye) and
+// (luminance, squared luminance, transmittance of the camera ray, 0)
+Texture2D<float4>   FeatureHistory;
+RWTexture2D<float4> FeatureOutput;
+
+Texture2D<float4>   MomentHistory;
+RWTexture2D<float4> MomentOutput;
+
+float luminance(float3 c)
+{
+    return 0.2126 * c.r + 0.7152 * c.g + 0.0722 * c.b;
+}
+
+float computeMISWeight(float pdf, float otherPdf)
+{
+    if(MISPowerHeuristic)
+    {
+        pdf *= pdf;
+        otherPdf *= otherPdf;
+    }
+    return pdf / (pdf + otherPdf);
+}
+
+float3 estimateDirectIllum(float3 o, float3 wo, bool mis, inout uint rng)
 {
     float3 wi; float pdf;
     sampleEnvirLight(rng, wi, pdf);
+    if(pdf <= 0)
+        return float3(0, 0, 0);
 
     float trans = 1;
     float2 incts = intersectRayBox(o, wi);
@@ -29,22 +66,42 @@ float3 estimateDirectIllum(float3 o, float3 wo, inout uint rng)
     float phase = evalPhaseFunction(-dot(wo, wi));
 
     float3 rad = evalEnvirLight(wi);
-    
-    return rad * trans * phase / pdf;
+
+    float weight = mis ? computeMISWeight(pdf, phase) : 1;
+    return rad * (weight * trans * phase / pdf);
 }
 
-float3 trace(float3 o, float3 d, inout uint rng)
+float3 trace(float3 o, float3 d, inout uint rng, out float4 feature, out float trans)
 {
+    feature = float4(0, 0, 0, 0);
+    trans   = 1;
+
     float3 coef   = float3(1, 1, 1);
     float3 result = float3(0, 0, 0);
 
+    // footprint width in voxels, grown by the pixel cone along the camera
+    // ray and by the scattering lobe after each scattering
+    float pixelAngle = length(FrustumB - FrustumA) / OutputWidth;
+    float footprint  = pixelAngle * length(o - Eye) * VolumeInvVoxelSize;
+
+    // with mis, the phase sample of d gets the envir light it escapes to.
+    // 0 when the light of the scattering it left was not mis weighted
+    float phasePDF = 0;
+
     for(int i = 0; i < MaxTraceDepth; ++i)
     {
+        VolumeLod = computeDensityLod(i, footprint);
+
         float2 incts = intersectRayBox(o, d);
         if(incts.x + 0.001 >= incts.y)
         {
             if(i == 0)
-                result = evalEnvirLight(d);
+            {
+                result  = evalEnvirLight(d);
+                feature = float4(0, 0, 0, length(o - Eye));
+            }
+            else if(phasePDF > 0)
+                result += coef * evalEnvirLight(d) * computeMISWeight(phasePDF, pdfEnvirLight(d));
             break;
         }
 
@@ -54,7 +111,12 @@ float3 trace(float3 o, float3 d, inout uint rng)
         if(!deltaTrack(a, b, rng, scatter_pos))
         {
             if(i == 0)
-                result = evalEnvirLight(d);
+            {
+                result  = evalEnvirLight(d);
+                feature = float4(0, 0, 0, length(b - Eye));
+            }
+            else if(phasePDF > 0)
+                result += coef * evalEnvirLight(d) * computeMISWeight(phasePDF, pdfEnvirLight(d));
             break;
         }
 
@@ -62,27 +124,146 @@ float3 trace(float3 o, float3 d, inout uint rng)
         float3 albedo = sampleAlbedo(uvw);
         coef *= albedo;
 
-        result += coef * estimateDirectIllum(scatter_pos, -d, rng);
+        if(i == 0)
+        {
+            feature = float4(albedo, length(scatter_pos - Eye));
+            trans   = 0;
+        }
+
+        // the next bounce starts with the footprint at the scattering. shadow
+        // rays track the full resolution, which the majorants of the residual
+        // estimator bound, rather than the filtered density of a coarser level
+        footprint += (i ? VolumeLodScatterSpread : pixelAngle) *
+                     length(scatter_pos - o) * VolumeInvVoxelSize;
+        VolumeLod = 0;
+
+        bool mis = DirectLightMIS && i + 1 < MaxTraceDepth;
+        result += coef * estimateDirectIllum(scatter_pos, -d, mis, rng);
 
+        float3 wo = -d;
         o = scatter_pos;
-        d = samplePhaseFunction(-d, rng);
+        d = samplePhaseFunction(wo, rng);
+        phasePDF = mis ? evalPhaseFunction(-dot(wo, d)) : 0;
     }
 
     return result;
 }
 
-float4 accumulate(float3 d, inout uint rng)
+float4 accumulate(float3 d, inout uint rng, out float4 features, out float4 moments)
 {
     float3 o;
     if(!findEntry(Eye, d, o))
-        return float4(evalEnvirLight(d), 1);
+    {
+        float3 rad = evalEnvirLight(d);
+        float lum = luminance(rad);
+        features = float4(0, 0, 0, 0);
+        moments  = float4(lum, lum * lum, 1, 0);
+        return float4(rad, 1);
+    }
     
     float4 result = float4(0, 0, 0, 0);
+    features = float4(0, 0, 0, 0);
+    moments  = float4(0, 0, 0, 0);
     for(int i = 0; i < 2; ++i)
-        result += float4(trace(o, d, rng), 1);
+    {
+        float4 feature; float trans;
+        float3 rad = trace(o, d, rng, feature, trans);
+        float lum = luminance(rad);
+        result   += float4(rad, 1);
+        features += feature;
+        moments  += float4(lum, lum * lum, trans, 0);
+    }
     return result;
 }
 
+// history of the camera ray d from the previous camera, found through the
+// mean first scattering distance of the new samples, like
+// CPUVolumeRenderer::reprojectHistory
+void reproject(
+    float3 d, float depth,
+    out float4 history, out float4 featureHistory, out float4 momentHistory)
+{
+    history        = float4(0, 0, 0, 0);
+    featureHistory = float4(0, 0, 0, 0);
+    momentHistory  = float4(0, 0, 0, 0);
+
+    float3 prevDir = d;
+    float prevDepth = 0;
+    if(depth > 0)
+    {
+        float3 toPos = Eye + depth * d - PrevEye;
+        prevDepth = length(toPos);
+        prevDir   = toPos / prevDepth;
+    }
+
+    // the normalized corner directions lie in a plane
+    float3 right = PrevFrustumB - PrevFrustumA;
+    float3 down  = PrevFrustumC - PrevFrustumA;
+    float3 nor   = cross(right, down);
+
+    float t = dot(PrevFrustumA, nor) / dot(prevDir, nor);
+    if(!(t > 0))
+        return;
+
+    float3 onPlane = t * prevDir - PrevFrustumA;
+    float2 p = float2(
+        dot(onPlane, right) / dot(right, right) * OutputWidth,
+        dot(onPlane, down) / dot(down, down) * OutputHeight) - 0.5;
+
+    int2 p0 = int2(floor(p));
+    float2 f = p - p0;
+
+    float samples = 0, weightSum = 0;
+    for(int ty = 0; ty < 2; ++ty)
+    {
+        for(int tx = 0; tx < 2; ++tx)
+        {
+            int2 q = p0 + int2(tx, ty);
+            if(any(q < 0) || q.x >= OutputWidth || q.y >= OutputHeight)
+                continue;
+
+            float4 h = History[q];
+            if(h.a <= 0)
+                continue;
+
+            float4 hf = FeatureHistory[q];
+            float histDepth = hf.a / h.a;
+            if((histDepth > 0) != (prevDepth > 0) ||
+               abs(histDepth - prevDepth) > DepthTolerance * histDepth)
+                continue;
+
+            float weight = (tx ? f.x : 1 - f.x) * (ty ? f.y : 1 - f.y);
+            float scale  = weight / h.a;
+
+            history        += float4(scale * h.rgb, 0);
+            featureHistory += scale * hf;
+            momentHistory  += scale * MomentHistory[q];
+            samples        += weight * h.a;
+            weightSum      += weight;
+        }
+    }
+
+    if(weightSum <= 0)
+        return;
+
+    // a partly rejected footprint is less trusted
+    float count = weightSum * min(samples / weightSum, float(MaxHistorySamples));
+    float scale = count / weightSum;
+
+    history        = float4(scale * history.rgb, count);
+    featureHistory = scale * featureHistory;
+    momentHistory  = scale * momentHistory;
+}
+
+// see getInterleaveRank in src/core/resolution.h
+int getInterleaveRank(int2 p, int stride)
+{
+    int rank = 0;
+    for(int bit = 1; bit < stride; bit <<= 1)
+        rank = (rank << 2) | (((p.x ^ p.y) & bit) ? 2 : 0) | ((p.y & bit) ? 1 : 0);
+    return rank;
+}
+
 [numthreads(16, 16, 1)]
 void CSMain(int2 threadIdx : SV_DispatchThreadID)
 {
@@ -96,14 +277,46 @@ void CSMain(int2 threadIdx : SV_DispatchThreadID)
 
     uint rng = OldRandomSeeds.Load(int3(threadIdx, 0));
 
-    float4 accu = accumulate(d, rng);
+    // pixels between the interleaved ones get no samples of the frame
+
+    bool traced = InterleaveStride <= 1 ||
+                  getInterleaveRank(threadIdx % InterleaveStride, InterleaveStride) == InterleavePhase;
 
-    float4 history;
-    if(!DiscardHistory)
-        history = History[threadIdx];
+    float4 features = float4(0, 0, 0, 0), moments = float4(0, 0, 0, 0);
+    float4 accu = float4(0, 0, 0, 0);
+    if(traced)
+        accu = accumulate(d, rng, features, moments);
+
+    float4 history, featureHistory, momentHistory;
+    if(!DiscardHistory && ReprojectHistory)
+    {
+        // the traced pixel of the block is being written by another thread,
+        // so the others take the distance of the history at their position
+        float depth;
+        if(traced)
+            depth = features.a / accu.a;
+        else
+        {
+            float n = History[threadIdx].a;
+            depth = n > 0 ? FeatureHistory[threadIdx].a / n : 0;
+        }
+        reproject(d, depth, history, featureHistory, momentHistory);
+    }
+    else if(!DiscardHistory)
+    {
+        history        = History[threadIdx];
+        featureHistory = FeatureHistory[threadIdx];
+        momentHistory  = MomentHistory[threadIdx];
+    }
     else
-        history = float4(0, 0, 0, 0);
+    {
+        history        = float4(0, 0, 0, 0);
+        featureHistory = float4(0, 0, 0, 0);
+        momentHistory  = float4(0, 0, 0, 0);
+    }
 
     NewRandomSeeds[threadIdx] = rng;
-    Output[threadIdx] = history + accu;
+    Output[threadIdx]        = history + accu;
+    FeatureOutput[threadIdx] = featureHistory + features;
+    MomentOutput[threadIdx]  = momentHistory + moments;
 }
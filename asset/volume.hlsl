@@ -3,18 +3,54 @@
 
 #include "rng.hlsl"
 
+#define TRANSMITTANCE_RATIO_CUTOFF   0
+#define TRANSMITTANCE_RATIO_ROULETTE 1
+#define TRANSMITTANCE_RESIDUAL_RATIO 2
+
+#define ROULETTE_THRESHOLD 0.1f
+
 cbuffer VolumeParams
 {
     float3 VolumeLower;        float VolumeMaxDensity;
     float3 VolumeUpper;        float VolumeInvMaxDensity;
     float3 VolumeInvExtent;    float VolumePhaseG;
     float  VolumeDensityScale; float VolumePhaseG2;
+    int    VolumeTransmittanceEstimator;
+    int3   VolumeMajorantRes;  int VolumeBrickedDensity;
+    int3   VolumeDensityRes;
+    int3   VolumeBrickPoolRes;   float VolumeDensityDecodeScale;
+    float3 VolumeConstantAlbedo; int   VolumeAlbedoIsConstant;
+    float  VolumeDensityDecodeOffset;
+    int    VolumeLodMode;
+    int    VolumeLodStartDepth;
+    float  VolumeLodPerBounce;
+    float  VolumeLodScatterSpread;
+    float  VolumeLodMax;
+    float  VolumeInvVoxelSize;
+    int    VolumeMipCount;
 }
 
+#define LOD_OFF       0
+#define LOD_DEPTH     1
+#define LOD_FOOTPRINT 2
+
+#define BRICK_SIZE         8
+#define BRICK_STORAGE_SIZE 9
+
 Texture3D<float>  Density;
+Texture3D<float>  DensityMips; // mean mips of Density from level 1 on
 Texture3D<float3> Albedo;
 SamplerState      VolumeSampler;
 
+// bricked density: occupied BRICK_SIZE^3 bricks with a one voxel apron on
+// the upper side, packed into BrickPool. BrickIndices holds the pool index of
+// each brick, or -1 for empty bricks
+Texture3D<float> BrickPool;
+Texture3D<int>   BrickIndices;
+
+// raw (majorant, minorant) of each majorant grid cell
+Texture3D<float2> MajorantBounds;
+
 float volumeMax3(float x, float y, float z)
 {
     return max(x, max(y, z));
@@ -63,24 +99,103 @@ float3 toTexCoord(float3 worldPos)
     return (worldPos - VolumeLower) * VolumeInvExtent;
 }
 
+// VolumeConstantAlbedo is already linear
 float3 sampleAlbedo(float3 uvw)
 {
+    if(VolumeAlbedoIsConstant)
+        return VolumeConstantAlbedo;
     return pow(Albedo.SampleLevel(VolumeSampler, uvw, 0), 2.2f);
 }
 
+// quantized densities are stored as (value - offset) / scale. decoding is
+// linear, so it can be applied after filtering
+float decodeDensity(float stored)
+{
+    return VolumeDensityDecodeOffset + VolumeDensityDecodeScale * stored;
+}
+
+float sampleBrickedDensity(float3 uvw)
+{
+    // clamping the voxel coordinate is equivalent to clamp addressing, and
+    // keeps the lower trilinear voxel in the brick that stores the footprint
+    float3 x = clamp(uvw * VolumeDensityRes - 0.5f, 0, float3(VolumeDensityRes - 1));
+    int3 brick = min(int3(x), VolumeDensityRes - 1) / BRICK_SIZE;
+
+    int index = BrickIndices.Load(int4(brick, 0));
+    if(index < 0)
+        return 0;
+
+    int3 poolBrick = int3(
+        index % VolumeBrickPoolRes.x,
+        index / VolumeBrickPoolRes.x % VolumeBrickPoolRes.y,
+        index / (VolumeBrickPoolRes.x * VolumeBrickPoolRes.y));
+
+    float3 local = x - brick * BRICK_SIZE;
+    float3 poolCoord = (poolBrick * BRICK_STORAGE_SIZE + local + 0.5f)
+                     / (VolumeBrickPoolRes * BRICK_STORAGE_SIZE);
+    return decodeDensity(BrickPool.SampleLevel(VolumeSampler, poolCoord, 0));
+}
+
+float sampleFullResDensity(float3 uvw)
+{
+    if(VolumeBrickedDensity)
+        return sampleBrickedDensity(uvw);
+    return decodeDensity(Density.SampleLevel(VolumeSampler, uvw, 0));
+}
+
+// density level of the current path segment, set by the tracer
+static float VolumeLod = 0;
+
+// level of bounce depth, given the footprint width at its start in voxels
+float computeDensityLod(int depth, float footprintVoxels)
+{
+    float lod = 0;
+    if(VolumeLodMode == LOD_DEPTH)
+        lod = (depth - VolumeLodStartDepth + 1) * VolumeLodPerBounce;
+    else if(VolumeLodMode == LOD_FOOTPRINT)
+        lod = log2(max(1, footprintVoxels));
+    return VolumeMipCount > 0 ? clamp(lod, 0, min(VolumeLodMax, VolumeMipCount)) : 0;
+}
+
+// mean mips never exceed the max density, so tracking against the global
+// majorant stays valid at any level
 float sampleDensity(float3 uvw)
 {
-    float raw = Density.SampleLevel(VolumeSampler, uvw, 0);
+    float raw;
+    if(VolumeLod <= 0)
+        raw = sampleFullResDensity(uvw);
+    else if(VolumeLod >= 1)
+        raw = DensityMips.SampleLevel(VolumeSampler, uvw, VolumeLod - 1);
+    else
+        raw = lerp(sampleFullResDensity(uvw), DensityMips.SampleLevel(VolumeSampler, uvw, 0), VolumeLod);
     return VolumeDensityScale * raw;
 }
 
-float estimateTransmittance(float3 a, float3 b, inout uint rng)
+// estimates below the threshold survive with probability
+// estimate / threshold and continue as the threshold
+bool roulette(inout float estimate, inout uint rng)
+{
+    if(estimate >= ROULETTE_THRESHOLD)
+        return true;
+
+    if(rand_float(rng) * ROULETTE_THRESHOLD >= estimate)
+    {
+        estimate = 0;
+        return false;
+    }
+
+    estimate = ROULETTE_THRESHOLD;
+    return true;
+}
+
+float estimateTransmittanceRatio(float3 a, float3 b, inout uint rng)
 {
     float t_max = distance(a, b);
 
     float result = 1, t = 0;
 
-    for(int i = 0; i < 10000; ++i)
+    int i = 0;
+    for(; i < 10000; ++i)
     {
         float dt = -log(1 - rand_float(rng)) * VolumeInvMaxDensity;
         t += dt;
@@ -93,13 +208,211 @@ float estimateTransmittance(float3 a, float3 b, inout uint rng)
         float density = sampleDensity(uvw);
         result *= 1 - density * VolumeInvMaxDensity;
 
-        if(result < 0.001f)
+        if(VolumeTransmittanceEstimator == TRANSMITTANCE_RATIO_CUTOFF)
+        {
+            if(result < 0.001f)
+                return 0;
+        }
+        else if(!roulette(result, rng))
             return 0;
     }
 
+    // cut off by the step cap
+    if(i == 10000)
+        return 0;
     return result;
 }
 
+// dda walk over the majorant grid cells of a segment of length t_max
+struct MajorantWalk
+{
+    int3   cell;
+    int3   step;
+    float3 t_next;
+    float3 t_delta;
+    int    axis; // crossed at the exit of the current cell
+};
+
+MajorantWalk beginMajorantWalk(float3 uvw_a, float3 uvw_b, float t_max)
+{
+    float3 p   = uvw_a * VolumeMajorantRes;
+    float3 dir = (uvw_b - uvw_a) * VolumeMajorantRes / t_max;
+
+    MajorantWalk walk;
+    walk.cell = clamp(int3(floor(p)), int3(0, 0, 0), VolumeMajorantRes - 1);
+    walk.step = int3(sign(dir));
+    walk.axis = 0;
+    for(int k = 0; k < 3; ++k)
+    {
+        if(walk.step[k] != 0)
+        {
+            walk.t_next[k]  = (walk.cell[k] + max(walk.step[k], 0) - p[k]) / dir[k];
+            walk.t_delta[k] = abs(1 / dir[k]);
+        }
+        else
+        {
+            walk.t_next[k]  = 1e30f;
+            walk.t_delta[k] = 1e30f;
+        }
+    }
+    return walk;
+}
+
+// where the segment leaves the current cell, within [t, t_max]
+float getMajorantCellExit(inout MajorantWalk walk, float t, float t_max)
+{
+    int axis = walk.t_next.x < walk.t_next.y ? 0 : 1;
+    walk.axis = walk.t_next.z < walk.t_next[axis] ? 2 : axis;
+    return max(t, min(walk.t_next[walk.axis], t_max));
+}
+
+// false once the walk leaves the grid
+bool nextMajorantCell(inout MajorantWalk walk)
+{
+    int axis = walk.axis;
+    walk.cell[axis] += walk.step[axis];
+    if(walk.cell[axis] < 0 || walk.cell[axis] >= VolumeMajorantRes[axis])
+        return false;
+    walk.t_next[axis] += walk.t_delta[axis];
+    return true;
+}
+
+// scaled (majorant, minorant) of the current cell
+float2 loadMajorantBounds(MajorantWalk walk)
+{
+    return VolumeDensityScale * MajorantBounds.Load(int4(walk.cell, 0));
+}
+
+// walks the majorant grid cells with DDA. the minorant of each cell is the
+// control density, integrated analytically, and ratio tracking only
+// estimates the residual density
+float estimateTransmittanceResidual(float3 a, float3 b, inout uint rng)
+{
+    float t_max = distance(a, b);
+
+    float3 uvw_a = toTexCoord(a);
+    float3 uvw_b = toTexCoord(b);
+
+    MajorantWalk walk = beginMajorantWalk(uvw_a, uvw_b, t_max);
+
+    float result = 1, t = 0;
+    int steps = 0;
+
+    [loop]
+    while(t < t_max)
+    {
+        float t_exit = getMajorantCellExit(walk, t, t_max);
+
+        float2 bounds   = loadMajorantBounds(walk);
+        float  control  = bounds.y;
+        float  residual = bounds.x - bounds.y;
+
+        result *= exp(-control * (t_exit - t));
+        if(!roulette(result, rng))
+            return 0;
+
+        if(residual > 0)
+        {
+            float inv_residual = 1 / residual;
+            float s = t;
+
+            [loop]
+            for(;;)
+            {
+                if(++steps > 10000)
+                    return 0;
+
+                s += -log(1 - rand_float(rng)) * inv_residual;
+                if(s >= t_exit)
+                    break;
+
+                float density = sampleDensity(lerp(uvw_a, uvw_b, s / t_max));
+                result *= 1 - (density - control) * inv_residual;
+
+                if(!roulette(result, rng))
+                    return 0;
+            }
+        }
+
+        t = t_exit;
+        if(!nextMajorantCell(walk))
+            break;
+    }
+
+    return result;
+}
+
+// ratio tracking against the majorant of each cell. cells without density,
+// such as those of empty bricks, are crossed without lookups
+float estimateTransmittanceCells(float3 a, float3 b, inout uint rng)
+{
+    float t_max = distance(a, b);
+
+    float3 uvw_a = toTexCoord(a);
+    float3 uvw_b = toTexCoord(b);
+
+    MajorantWalk walk = beginMajorantWalk(uvw_a, uvw_b, t_max);
+
+    float result = 1, t = 0;
+    int steps = 0;
+
+    [loop]
+    while(t < t_max)
+    {
+        float t_exit   = getMajorantCellExit(walk, t, t_max);
+        float majorant = loadMajorantBounds(walk).x;
+
+        if(majorant > 0)
+        {
+            float inv_majorant = 1 / majorant;
+            float s = t;
+
+            [loop]
+            for(;;)
+            {
+                if(++steps > 10000)
+                    return 0;
+
+                s += -log(1 - rand_float(rng)) * inv_majorant;
+                if(s >= t_exit)
+                    break;
+
+                float density = sampleDensity(lerp(uvw_a, uvw_b, s / t_max));
+                result *= 1 - density * inv_majorant;
+
+                if(VolumeTransmittanceEstimator == TRANSMITTANCE_RATIO_CUTOFF)
+                {
+                    if(result < 0.001f)
+                        return 0;
+                }
+                else if(!roulette(result, rng))
+                    return 0;
+            }
+        }
+
+        t = t_exit;
+        if(!nextMajorantCell(walk))
+            break;
+    }
+
+    return result;
+}
+
+// the majorant bounds hold for level 0 only, so coarser levels fall back to
+// ratio tracking against the global majorant. bricked densities skip empty
+// cells
+float estimateTransmittance(float3 a, float3 b, inout uint rng)
+{
+    if(VolumeLod <= 0)
+    {
+        if(VolumeTransmittanceEstimator == TRANSMITTANCE_RESIDUAL_RATIO)
+            return estimateTransmittanceResidual(a, b, rng);
+        if(VolumeBrickedDensity)
+            return estimateTransmittanceCells(a, b, rng);
+    }
+    return estimateTransmittanceRatio(a, b, rng);
+}
+
 float evalPhaseFunction(float u)
 {
     float dem = 1 + VolumePhaseG2 - 2 * VolumePhaseG * u;
@@ -139,7 +452,7 @@ float3 samplePhaseFunction(float3 wo, inout uint rng)
     return localWi.z * localZ + localWi.x * localX + localWi.y * localY;
 }
 
-bool deltaTrack(float3 a, float3 b, inout uint rng, out float3 scatter_pos)
+bool deltaTrackGlobal(float3 a, float3 b, inout uint rng, out float3 scatter_pos)
 {
     float t_max = distance(a, b), t = 0;
 
@@ -163,4 +476,65 @@ bool deltaTrack(float3 a, float3 b, inout uint rng, out float3 scatter_pos)
     return false;
 }
 
+// delta tracking against the majorant of each cell, crossing empty cells
+// without lookups like estimateTransmittanceCells
+bool deltaTrackCells(float3 a, float3 b, inout uint rng, out float3 scatter_pos)
+{
+    scatter_pos = b;
+
+    float t_max = distance(a, b);
+
+    float3 uvw_a = toTexCoord(a);
+    float3 uvw_b = toTexCoord(b);
+
+    MajorantWalk walk = beginMajorantWalk(uvw_a, uvw_b, t_max);
+
+    float t = 0;
+    int steps = 0;
+
+    [loop]
+    while(t < t_max)
+    {
+        float t_exit   = getMajorantCellExit(walk, t, t_max);
+        float majorant = loadMajorantBounds(walk).x;
+
+        if(majorant > 0)
+        {
+            float inv_majorant = 1 / majorant;
+            float s = t;
+
+            [loop]
+            for(;;)
+            {
+                if(++steps > 10000)
+                    return false;
+
+                s += -log(1 - rand_float(rng)) * inv_majorant;
+                if(s >= t_exit)
+                    break;
+
+                float3 pos = lerp(a, b, s / t_max);
+                if(rand_float(rng) < sampleDensity(toTexCoord(pos)) * inv_majorant)
+                {
+                    scatter_pos = pos;
+                    return true;
+                }
+            }
+        }
+
+        t = t_exit;
+        if(!nextMajorantCell(walk))
+            break;
+    }
+
+    return false;
+}
+
+bool deltaTrack(float3 a, float3 b, inout uint rng, out float3 scatter_pos)
+{
+    if(VolumeBrickedDensity && VolumeLod <= 0)
+        return deltaTrackCells(a, b, rng, scatter_pos);
+    return deltaTrackGlobal(a, b, rng, scatter_pos);
+}
+
 #endif // #ifndef VOLUME_HLSL
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <utility>
+
+#include "core/task_scheduler.h"
+
+// an asset loaded on a worker thread and handed over to the render thread at
+// a frame boundary. the render thread keeps using its current instance until
+// a new one is complete, then publish swaps them.
+//
+// loaders run as background tasks of the global task scheduler, so that
+// interactive work goes first. they create their own d3d resources: device
+// calls are free-threaded, and the immediate context is only used by the
+// render thread
+template<typename T>
+class AsyncAsset
+{
+public:
+
+    using Loader = std::function<void(T &)>;
+
+    ~AsyncAsset();
+
+    // starts loading a new instance. a load requested while another one is
+    // in flight starts when that one is published, and only the latest
+    // such request is kept
+    void load(Loader loader);
+
+    bool isLoading() const;
+
+    // blocks until the load in flight, if any, is complete
+    void wait() const;
+
+    // if a load is complete, replaces current with its instance and returns
+    // true. load errors are rethrown here, leaving current untouched
+    bool publish(std::unique_ptr<T> &current);
+
+private:
+
+    void start(Loader loader);
+
+    std::future<std::unique_ptr<T>> pending_;
+    Loader                          queued_;
+};
+
+template<typename T>
+AsyncAsset<T>::~AsyncAsset()
+{
+    wait();
+}
+
+template<typename T>
+void AsyncAsset<T>::load(Loader loader)
+{
+    if(pending_.valid())
+        queued_ = std::move(loader);
+    else
+        start(std::move(loader));
+}
+
+template<typename T>
+bool AsyncAsset<T>::isLoading() const
+{
+    return pending_.valid() || queued_;
+}
+
+template<typename T>
+void AsyncAsset<T>::wait() const
+{
+    if(pending_.valid())
+        pending_.wait();
+}
+
+template<typename T>
+bool AsyncAsset<T>::publish(std::unique_ptr<T> &current)
+{
+    if(!pending_.valid() ||
+       pending_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+
+    // the queued load starts even if this one failed
+    auto future = std::move(pending_);
+    if(queued_)
+        start(std::exchange(queued_, Loader()));
+
+    current = future.get();
+    return true;
+}
+
+template<typename T>
+void AsyncAsset<T>::start(Loader loader)
+{
+    auto promise = std::make_shared<std::promise<std::unique_ptr<T>>>();
+    pending_ = promise->get_future();
+
+    TaskScheduler::getGlobal().submit([promise, loader = std::move(loader)]
+    {
+        try
+        {
+            auto result = std::make_unique<T>();
+            loader(*result);
+            promise->set_value(std::move(result));
+        }
+        catch(...)
+        {
+            promise->set_exception(std::current_exception());
+        }
+    }, TaskPriority::Background);
+}
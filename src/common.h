@@ -2,6 +2,6 @@
 
 #include <agz-utils/graphics_api.h>
 
-using namespace agz::d3d11;
+#include "core/common.h"
 
-constexpr float PI = agz::math::PI_f;
+using namespace agz::d3d11;
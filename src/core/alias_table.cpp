@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <numeric>
+
+#include "alias_table.h"
+
+void AliasTable::initialize(const float *weights, int count)
+{
+    table_.resize(count);
+    if(!count)
+        return;
+
+    const double sum = std::accumulate(weights, weights + count, 0.0);
+
+    // vose's method, with weights scaled to average 1
+
+    std::vector<double> scaled(count);
+    std::vector<int> small, large;
+    for(int i = 0; i < count; ++i)
+    {
+        scaled[i] = sum > 0 ? weights[i] * count / sum : 1.0;
+        (scaled[i] < 1 ? small : large).push_back(i);
+    }
+
+    while(!small.empty() && !large.empty())
+    {
+        const int s = small.back(); small.pop_back();
+        const int l = large.back();
+
+        table_[s] = { static_cast<float>(scaled[s]), l };
+
+        scaled[l] -= 1 - scaled[s];
+        if(scaled[l] < 1)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // leftovers are 1 up to rounding errors
+    for(int i : small)
+        table_[i] = { 1, i };
+    for(int i : large)
+        table_[i] = { 1, i };
+}
+
+void AliasTable::initialize(const AliasTableUnit *table, int count)
+{
+    table_.assign(table, table + count);
+}
+
+int AliasTable::sample(float u1, float u2) const
+{
+    const int size = static_cast<int>(table_.size());
+    const int i = (std::min)(static_cast<int>(size * u1), size - 1);
+    const auto &unit = table_[i];
+    return u2 <= unit.acceptProb ? i : unit.anotherIndex;
+}
+
+const std::vector<AliasTableUnit> &AliasTable::getTable() const
+{
+    return table_;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+// layout matches EnvirAliasTableUnit in asset/envir.hlsl
+struct AliasTableUnit
+{
+    float acceptProb;
+    int   anotherIndex;
+};
+
+class AliasTable
+{
+public:
+
+    // weights need not be normalized. all-zero weights give a uniform table
+    void initialize(const float *weights, int count);
+
+    // copies a table built before
+    void initialize(const AliasTableUnit *table, int count);
+
+    int sample(float u1, float u2) const;
+
+    const std::vector<AliasTableUnit> &getTable() const;
+
+private:
+
+    std::vector<AliasTableUnit> table_;
+};
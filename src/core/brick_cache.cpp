@@ -0,0 +1,469 @@
+#include <chrono>
+
+#include "brick_cache.h"
+
+namespace
+{
+    constexpr int    MAX_SHARD_COUNT = 16;
+    constexpr size_t BRICK_BYTES     = BRICK_VOXEL_COUNT * sizeof(float);
+
+    uint64_t elapsedNs(std::chrono::steady_clock::time_point start)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    Float2 intersectBox(
+        const Float3 &o, const Float3 &d, const Float3 &lower, const Float3 &upper)
+    {
+        const Float3 invD = Float3(1) / d;
+        const Float3 n = invD * (lower - o);
+        const Float3 f = invD * (upper - o);
+
+        const float t0 = (std::max)({
+            (std::min)(n.x, f.x), (std::min)(n.y, f.y), (std::min)(n.z, f.z) });
+        const float t1 = (std::min)({
+            (std::max)(n.x, f.x), (std::max)(n.y, f.y), (std::max)(n.z, f.z) });
+
+        return Float2((std::max)(0.0f, t0), t1);
+    }
+}
+
+BrickCache::~BrickCache()
+{
+    stopPrefetchThreads();
+}
+
+void BrickCache::initialize(
+    const BrickFile &file, size_t capacityBytes, int prefetchThreadCount)
+{
+    stopPrefetchThreads();
+
+    file_ = &file;
+
+    // no more slots than bricks, and at least one per shard
+
+    const int brickCount = file.getBrickCount();
+    const size_t capacitySlots = (std::max<size_t>)(1, (std::min)(
+        capacityBytes / BRICK_BYTES, static_cast<size_t>((std::max)(1, brickCount))));
+
+    shardCount_    = static_cast<int>((std::min<size_t>)(MAX_SHARD_COUNT, capacitySlots));
+    slotsPerShard_ = static_cast<int>(capacitySlots / shardCount_);
+
+    shards_ = std::make_unique<Shard[]>(shardCount_);
+    for(int i = 0; i < shardCount_; ++i)
+    {
+        Shard &shard = shards_[i];
+        shard.slots = std::make_unique<Slot[]>(slotsPerShard_);
+        shard.voxels.resize(size_t(slotsPerShard_) * BRICK_VOXEL_COUNT);
+        shard.freeSlots.resize(slotsPerShard_);
+        for(int s = 0; s < slotsPerShard_; ++s)
+            shard.freeSlots[s] = slotsPerShard_ - 1 - s;
+    }
+
+    brickToSlot_ = std::make_unique<std::atomic<int32_t>[]>((std::max)(1, brickCount));
+    std::fill_n(brickToSlot_.get(), (std::max)(1, brickCount), -1);
+
+    resident_ = 0;
+    resetStats();
+
+    for(int i = 0; i < prefetchThreadCount; ++i)
+        prefetchThreads_.emplace_back([this] { prefetchWorker(); });
+}
+
+const BrickFile &BrickCache::getFile() const
+{
+    return *file_;
+}
+
+size_t BrickCache::getCapacity() const
+{
+    return size_t(shardCount_) * slotsPerShard_ * BRICK_BYTES;
+}
+
+size_t BrickCache::getResidentBytes() const
+{
+    return size_t(resident_) * BRICK_BYTES;
+}
+
+float BrickCache::sample(const Float3 &uvw) const
+{
+    const BrickLookup lookup = computeBrickLookup(file_->getSize(), uvw);
+
+    const int brick = file_->getBrickIndex(
+        lookup.brick[0], lookup.brick[1], lookup.brick[2]);
+    if(brick < 0)
+        return 0;
+
+    int slot;
+    if(const float *voxels = tryPin(brick, slot))
+    {
+        const float result = interpolateBrick(voxels, lookup);
+        unpin(brick, slot);
+        return result;
+    }
+
+    // the lock keeps the slot from being evicted while it is read
+
+    std::unique_lock<std::mutex> lock;
+    slot = acquire(brick, lock, false);
+    const Shard &shard = shards_[brick % shardCount_];
+    return interpolateBrick(&shard.voxels[size_t(slot) * BRICK_VOXEL_COUNT], lookup);
+}
+
+void BrickCache::prefetch(std::vector<int> bricks)
+{
+    std::lock_guard lock(prefetchMutex_);
+    prefetchQueue_.assign(bricks.begin(), bricks.end());
+    prefetchWake_.notify_all();
+}
+
+void BrickCache::prefetchFrustum(
+    const Float3 &eye, const Camera::FrustumDirections &frustum,
+    const Float3 &lower, const Float3 &upper, int raysPerAxis)
+{
+    const Int3 &size = file_->getSize();
+    const Int3 &res  = file_->getBrickResolution();
+    const Float3 invExtent = Float3(1) / (upper - lower);
+
+    // (distance of the first visit, brick)
+    std::vector<std::pair<float, int>> visits;
+
+    for(int j = 0; j < raysPerAxis; ++j)
+    {
+        const float v = (j + 0.5f) / raysPerAxis;
+        for(int i = 0; i < raysPerAxis; ++i)
+        {
+            const float u = (i + 0.5f) / raysPerAxis;
+            const Float3 top    = frustum.frustumA + u * (frustum.frustumB - frustum.frustumA);
+            const Float3 bottom = frustum.frustumC + u * (frustum.frustumD - frustum.frustumC);
+            const Float3 d = (top + v * (bottom - top)).normalize();
+
+            const Float2 incts = intersectBox(eye, d, lower, upper);
+            if(incts.x >= incts.y)
+                continue;
+
+            const Float3 uvwA = (eye + incts.x * d - lower) * invExtent;
+            const Float3 uvwB = (eye + incts.y * d - lower) * invExtent;
+            traverseBricks(
+                size, res, uvwA, uvwB, incts.y - incts.x,
+                [&](float t0, float, int x, int y, int z)
+            {
+                const int brick = file_->getBrickIndex(x, y, z);
+                if(brick >= 0)
+                    visits.push_back({ incts.x + t0, brick });
+                return true;
+            });
+        }
+    }
+
+    std::sort(visits.begin(), visits.end());
+
+    // half of the capacity is left to the bricks in use, which prefetching
+    // must not evict
+
+    const size_t budget = (std::max<size_t>)(1, getCapacity() / BRICK_BYTES / 2);
+
+    std::vector<uint8_t> requested(file_->getBrickCount(), 0);
+    std::vector<int> bricks;
+    for(auto &visit : visits)
+    {
+        if(bricks.size() >= budget)
+            break;
+        if(!requested[visit.second])
+        {
+            requested[visit.second] = 1;
+            bricks.push_back(visit.second);
+        }
+    }
+
+    prefetch(std::move(bricks));
+}
+
+void BrickCache::waitForPrefetch()
+{
+    std::unique_lock lock(prefetchMutex_);
+    prefetchIdle_.wait(lock, [&]
+    {
+        return prefetchThreads_.empty() || (prefetchQueue_.empty() && !prefetchBusy_);
+    });
+}
+
+BrickCacheStats BrickCache::getStats() const
+{
+    BrickCacheStats stats;
+    for(int i = 0; i < shardCount_; ++i)
+        stats.hits += shards_[i].hits;
+    stats.misses     = misses_;
+    stats.prefetches = prefetches_;
+    stats.evictions  = evictions_;
+    stats.bytesPaged = pagedIn_ * BRICK_BYTES;
+    stats.stallMs    = stallNs_ / 1e6;
+    return stats;
+}
+
+void BrickCache::resetStats()
+{
+    for(int i = 0; i < shardCount_; ++i)
+        shards_[i].hits = 0;
+    misses_     = 0;
+    prefetches_ = 0;
+    evictions_  = 0;
+    pagedIn_    = 0;
+    stallNs_    = 0;
+}
+
+const float *BrickCache::tryPin(int brick, int &slot) const
+{
+    slot = brickToSlot_[brick];
+    if(slot < 0)
+        return nullptr;
+
+    Shard &shard = shards_[brick % shardCount_];
+    Slot &s = shard.slots[slot];
+
+    // eviction clears ready before it checks the pins, so either it sees
+    // this pin or the slot may already hold another brick. ready is read
+    // before brick: once it is set again, brick is the reloaded one, which
+    // the pin then keeps from being evicted
+    ++s.pins;
+    if(s.ready && s.brick == brick)
+    {
+        shard.hits.fetch_add(1, std::memory_order_relaxed);
+        return &shard.voxels[size_t(slot) * BRICK_VOXEL_COUNT];
+    }
+    --s.pins;
+    return nullptr;
+}
+
+void BrickCache::unpin(int brick, int slot) const
+{
+    Slot &s = shards_[brick % shardCount_].slots[slot];
+    if(!s.referenced.load(std::memory_order_relaxed))
+        s.referenced.store(true, std::memory_order_relaxed);
+    s.pins.fetch_sub(1, std::memory_order_release);
+}
+
+int BrickCache::acquire(
+    int brick, std::unique_lock<std::mutex> &lock, bool isPrefetch) const
+{
+    Shard &shard = shards_[brick % shardCount_];
+    lock = std::unique_lock(shard.mutex);
+
+    bool stalled = false;
+    std::chrono::steady_clock::time_point stallStart;
+
+    for(;;)
+    {
+        const int slot = brickToSlot_[brick];
+
+        if(slot >= 0 && shard.slots[slot].ready)
+        {
+            unlink(shard, slot);
+            pushFront(shard, slot);
+
+            if(stalled)
+            {
+                ++misses_;
+                stallNs_ += elapsedNs(stallStart);
+            }
+            else if(!isPrefetch)
+            {
+                shard.hits.fetch_add(1, std::memory_order_relaxed);
+            }
+            return slot;
+        }
+
+        // lookups wait for bricks being paged in by other threads or for a
+        // slot to become evictable. prefetching never waits
+
+        if(!stalled && !isPrefetch)
+        {
+            stalled = true;
+            stallStart = std::chrono::steady_clock::now();
+        }
+
+        if(slot >= 0)
+        {
+            if(isPrefetch)
+                return -1;
+            shard.loaded.wait(lock);
+            continue;
+        }
+
+        // slots being paged in are not linked
+
+        int victim;
+        if(!shard.freeSlots.empty())
+        {
+            victim = shard.freeSlots.back();
+            shard.freeSlots.pop_back();
+        }
+        else if((victim = evict(shard)) >= 0)
+        {
+            brickToSlot_[shard.slots[victim].brick] = -1;
+            --resident_;
+            ++evictions_;
+        }
+        else
+        {
+            if(isPrefetch)
+                return -1;
+
+            // pinned slots are released without a notification
+            shard.loaded.wait_for(lock, std::chrono::microseconds(100));
+            continue;
+        }
+
+        shard.slots[victim].brick = brick;
+        shard.slots[victim].ready = false;
+        brickToSlot_[brick] = victim;
+
+        // the slot is owned by this thread until it is ready
+
+        lock.unlock();
+        try
+        {
+            file_->readBrick(brick, &shard.voxels[size_t(victim) * BRICK_VOXEL_COUNT]);
+        }
+        catch(...)
+        {
+            lock.lock();
+            brickToSlot_[brick] = -1;
+            shard.slots[victim].brick = -1;
+            shard.freeSlots.push_back(victim);
+            shard.loaded.notify_all();
+            throw;
+        }
+        lock.lock();
+
+        shard.slots[victim].ready = true;
+        pushFront(shard, victim);
+        ++resident_;
+        ++pagedIn_;
+        shard.loaded.notify_all();
+
+        if(isPrefetch)
+        {
+            ++prefetches_;
+        }
+        else
+        {
+            ++misses_;
+            stallNs_ += elapsedNs(stallStart);
+        }
+        return victim;
+    }
+}
+
+int BrickCache::evict(Shard &shard)
+{
+    // referenced slots move to the front once, so the walk ends at the
+    // head at the latest
+    for(int slot = shard.tail; slot >= 0;)
+    {
+        Slot &s = shard.slots[slot];
+        const int prev = s.prev;
+
+        if(s.referenced.exchange(false, std::memory_order_relaxed))
+        {
+            unlink(shard, slot);
+            pushFront(shard, slot);
+        }
+        else
+        {
+            s.ready = false;
+            if(!s.pins)
+            {
+                unlink(shard, slot);
+                return slot;
+            }
+            s.ready = true;
+        }
+
+        slot = prev;
+    }
+    return -1;
+}
+
+void BrickCache::unlink(Shard &shard, int slot)
+{
+    Slot &s = shard.slots[slot];
+    if(s.prev >= 0)
+        shard.slots[s.prev].next = s.next;
+    else if(shard.head == slot)
+        shard.head = s.next;
+    else
+        return; // not linked
+
+    if(s.next >= 0)
+        shard.slots[s.next].prev = s.prev;
+    else
+        shard.tail = s.prev;
+
+    s.prev = s.next = -1;
+}
+
+void BrickCache::pushFront(Shard &shard, int slot)
+{
+    Slot &s = shard.slots[slot];
+    s.prev = -1;
+    s.next = shard.head;
+    if(shard.head >= 0)
+        shard.slots[shard.head].prev = slot;
+    else
+        shard.tail = slot;
+    shard.head = slot;
+}
+
+void BrickCache::stopPrefetchThreads()
+{
+    {
+        std::lock_guard lock(prefetchMutex_);
+        stop_ = true;
+        prefetchQueue_.clear();
+    }
+    prefetchWake_.notify_all();
+
+    for(auto &t : prefetchThreads_)
+        t.join();
+    prefetchThreads_.clear();
+
+    std::lock_guard lock(prefetchMutex_);
+    stop_ = false;
+    prefetchBusy_ = 0;
+    prefetchIdle_.notify_all();
+}
+
+void BrickCache::prefetchWorker()
+{
+    for(;;)
+    {
+        int brick;
+        {
+            std::unique_lock lock(prefetchMutex_);
+            prefetchWake_.wait(lock, [&] { return stop_ || !prefetchQueue_.empty(); });
+            if(stop_)
+                return;
+
+            brick = prefetchQueue_.front();
+            prefetchQueue_.pop_front();
+            ++prefetchBusy_;
+        }
+
+        // a failed read is retried and reported by the lookup needing the brick
+        try
+        {
+            std::unique_lock<std::mutex> lock;
+            acquire(brick, lock, true);
+        }
+        catch(...)
+        {
+        }
+
+        std::lock_guard lock(prefetchMutex_);
+        --prefetchBusy_;
+        if(prefetchQueue_.empty() && !prefetchBusy_)
+            prefetchIdle_.notify_all();
+    }
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "brick_file.h"
+#include "camera.h"
+
+struct BrickCacheStats
+{
+    uint64_t hits       = 0;
+    uint64_t misses     = 0; // lookups that waited for their brick
+    uint64_t prefetches = 0; // bricks paged in by the prefetch threads
+    uint64_t evictions  = 0;
+    uint64_t bytesPaged = 0;
+    double   stallMs    = 0; // summed over threads waiting for bricks
+};
+
+// bounded LRU cache of the bricks of a .vbrick file. bricks are paged in on
+// demand by lookups, or ahead of time by background prefetch threads.
+//
+// the cache is split into shards by brick index, each with its own lock and
+// LRU list. lookups of resident bricks take no lock: they pin the slot,
+// check that it still holds the brick and read it. eviction, under the
+// lock, skips pinned slots. such hits only mark the slot as referenced, and
+// eviction gives referenced slots a second chance instead of an exact LRU
+// order
+class BrickCache
+{
+public:
+
+    BrickCache() = default;
+
+    BrickCache(const BrickCache &) = delete;
+
+    BrickCache &operator=(const BrickCache &) = delete;
+
+    ~BrickCache();
+
+    // capacityBytes is the working set of brick voxels. at least one brick
+    // per shard is kept
+    void initialize(
+        const BrickFile &file, size_t capacityBytes, int prefetchThreadCount = 1);
+
+    const BrickFile &getFile() const;
+
+    // in bytes
+    size_t getCapacity() const;
+
+    size_t getResidentBytes() const;
+
+    // trilinear filtering with clamp addressing, bit-identical to
+    // BrickGrid::sample. thread-safe
+    float sample(const Float3 &uvw) const;
+
+    // replaces the pending prefetch requests by bricks (indices into the
+    // file's payload), which are paged in in order
+    void prefetch(std::vector<int> bricks);
+
+    // requests the occupied bricks seen through a raysPerAxis^2 grid of rays
+    // spanning the frustum, nearest first, up to half of the capacity
+    void prefetchFrustum(
+        const Float3 &eye, const Camera::FrustumDirections &frustum,
+        const Float3 &lower, const Float3 &upper, int raysPerAxis = 16);
+
+    // blocks until the pending prefetch requests are done
+    void waitForPrefetch();
+
+    BrickCacheStats getStats() const;
+
+    void resetStats();
+
+private:
+
+    struct Slot
+    {
+        std::atomic<int>  brick = -1;
+        std::atomic<bool> ready = false;
+
+        std::atomic<int>  pins       = 0;     // lookups reading it without the lock
+        std::atomic<bool> referenced = false; // hit without the lock since the last eviction
+
+        int prev = -1; // towards the most recently used slot
+        int next = -1;
+    };
+
+    struct alignas(64) Shard
+    {
+        std::mutex              mutex;
+        std::condition_variable loaded;
+
+        std::unique_ptr<Slot[]> slots;
+        std::vector<float>      voxels;
+        std::vector<int>        freeSlots;
+
+        int head = -1; // most recently used
+        int tail = -1; // least recently used
+
+        std::atomic<uint64_t> hits = 0;
+    };
+
+    // the voxels of brick if it is resident, without locking. the slot
+    // stays pinned until unpin
+    const float *tryPin(int brick, int &slot) const;
+
+    void unpin(int brick, int slot) const;
+
+    // locks the brick's shard and returns its resident slot, paging the brick
+    // in first if needed
+    int acquire(int brick, std::unique_lock<std::mutex> &lock, bool isPrefetch) const;
+
+    // the least recently used slot that is not pinned, unlinked, or -1
+    static int evict(Shard &shard);
+
+    static void unlink(Shard &shard, int slot);
+
+    static void pushFront(Shard &shard, int slot);
+
+    void stopPrefetchThreads();
+
+    void prefetchWorker();
+
+    const BrickFile *file_ = nullptr;
+
+    int slotsPerShard_ = 0;
+    int shardCount_    = 0;
+
+    std::unique_ptr<Shard[]> shards_;
+
+    // slot of each brick in its shard, -1 if not resident. written under
+    // the lock of the brick's shard
+    std::unique_ptr<std::atomic<int32_t>[]> brickToSlot_;
+
+    mutable std::atomic<uint64_t> misses_     = 0;
+    mutable std::atomic<uint64_t> prefetches_ = 0;
+    mutable std::atomic<uint64_t> evictions_  = 0;
+    mutable std::atomic<uint64_t> pagedIn_    = 0;
+    mutable std::atomic<uint64_t> stallNs_    = 0;
+    mutable std::atomic<int>      resident_   = 0;
+
+    std::mutex              prefetchMutex_;
+    std::condition_variable prefetchWake_;
+    std::condition_variable prefetchIdle_;
+    std::deque<int>         prefetchQueue_;
+    int                     prefetchBusy_ = 0;
+    bool                    stop_         = false;
+
+    std::vector<std::thread> prefetchThreads_;
+};
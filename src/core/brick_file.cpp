@@ -0,0 +1,274 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "brick_file.h"
+#include "task_scheduler.h"
+
+void saveBrickFile(const Grid &density, const std::string &filename)
+{
+    if(density.getFormat() != GridFormat::R32F)
+        throw std::runtime_error("brick file requires a R32F density grid: " + filename);
+
+    const Int3 &size = density.getSize();
+    const Int3 res(
+        (size.x + BRICK_SIZE - 1) / BRICK_SIZE,
+        (size.y + BRICK_SIZE - 1) / BRICK_SIZE,
+        (size.z + BRICK_SIZE - 1) / BRICK_SIZE);
+    const size_t cellCount = res.product();
+
+    // first pass: occupancy and bounds
+
+    std::vector<int32_t> indices(cellCount, -1);
+    std::vector<float>   bounds(2 * cellCount, 0.0f);
+
+    parallelFor(0, res.z, [&](int bz)
+    {
+        std::vector<float> voxels(BRICK_VOXEL_COUNT);
+        for(int by = 0; by < res.y; ++by)
+        {
+            for(int bx = 0; bx < res.x; ++bx)
+            {
+                const size_t cell = (size_t(bz) * res.y + by) * res.x + bx;
+                if(!extractBrick(density, bx, by, bz, voxels.data()))
+                    continue;
+
+                const auto [minorant, majorant] =
+                    std::minmax_element(voxels.begin(), voxels.end());
+                bounds[2 * cell]     = *majorant;
+                bounds[2 * cell + 1] = *minorant;
+                indices[cell] = 0;
+            }
+        }
+    });
+
+    int brickCount = 0;
+    for(auto &index : indices)
+    {
+        if(index >= 0)
+            index = brickCount++;
+    }
+
+    BrickFileHeader header = {};
+    std::memcpy(header.magic, BRICK_FILE_MAGIC, sizeof(BRICK_FILE_MAGIC));
+    header.version      = BRICK_FILE_VERSION;
+    header.brickSize    = BRICK_SIZE;
+    header.width        = size.x;
+    header.height       = size.y;
+    header.depth        = size.z;
+    header.brickCount   = brickCount;
+    header.maxValue     = density.getMaxValue();
+    header.indexOffset  = sizeof(BrickFileHeader);
+    header.boundsOffset = header.indexOffset + cellCount * sizeof(int32_t);
+
+    const uint64_t tableEnd = header.boundsOffset + bounds.size() * sizeof(float);
+    header.payloadOffset =
+        (tableEnd + GRID_FILE_ALIGNMENT - 1) / GRID_FILE_ALIGNMENT * GRID_FILE_ALIGNMENT;
+
+    std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+    if(!fout)
+        throw std::runtime_error("failed to create file: " + filename);
+
+    fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    fout.write(
+        reinterpret_cast<const char *>(indices.data()),
+        static_cast<std::streamsize>(indices.size() * sizeof(int32_t)));
+    fout.write(
+        reinterpret_cast<const char *>(bounds.data()),
+        static_cast<std::streamsize>(bounds.size() * sizeof(float)));
+
+    const std::vector<char> padding(header.payloadOffset - tableEnd, 0);
+    fout.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+
+    // second pass: payload, one brick in memory at a time
+
+    std::vector<float> voxels(BRICK_VOXEL_COUNT);
+    for(int bz = 0, cell = 0; bz < res.z; ++bz)
+    {
+        for(int by = 0; by < res.y; ++by)
+        {
+            for(int bx = 0; bx < res.x; ++bx, ++cell)
+            {
+                if(indices[cell] < 0)
+                    continue;
+                extractBrick(density, bx, by, bz, voxels.data());
+                fout.write(
+                    reinterpret_cast<const char *>(voxels.data()),
+                    BRICK_VOXEL_COUNT * sizeof(float));
+            }
+        }
+    }
+
+    if(!fout)
+        throw std::runtime_error("failed to write file: " + filename);
+}
+
+bool BrickFile::isBrickFile(const std::string &filename)
+{
+    std::ifstream fin(filename, std::ios::binary);
+    char magic[sizeof(BRICK_FILE_MAGIC)] = {};
+    fin.read(magic, sizeof(magic));
+    return fin && !std::memcmp(magic, BRICK_FILE_MAGIC, sizeof(magic));
+}
+
+BrickFile::~BrickFile()
+{
+    close();
+}
+
+void BrickFile::open(const std::string &filename)
+{
+    close();
+
+    std::ifstream fin(filename, std::ios::binary);
+    if(!fin)
+        throw std::runtime_error("failed to open file: " + filename);
+
+    BrickFileHeader header;
+    fin.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if(!fin || std::memcmp(header.magic, BRICK_FILE_MAGIC, sizeof(BRICK_FILE_MAGIC)))
+        throw std::runtime_error("invalid brick file: " + filename);
+    if(header.version != BRICK_FILE_VERSION || header.brickSize != BRICK_SIZE)
+        throw std::runtime_error("unsupported brick file version: " + filename);
+
+    size_ = Int3(header.width, header.height, header.depth);
+    res_  = Int3(
+        (size_.x + BRICK_SIZE - 1) / BRICK_SIZE,
+        (size_.y + BRICK_SIZE - 1) / BRICK_SIZE,
+        (size_.z + BRICK_SIZE - 1) / BRICK_SIZE);
+    brickCount_    = header.brickCount;
+    maxValue_      = header.maxValue;
+    payloadOffset_ = header.payloadOffset;
+
+    indices_.resize(res_.product());
+    bounds_.resize(2 * indices_.size());
+
+    fin.seekg(static_cast<std::streamoff>(header.indexOffset));
+    fin.read(
+        reinterpret_cast<char *>(indices_.data()),
+        static_cast<std::streamsize>(indices_.size() * sizeof(int32_t)));
+    fin.seekg(static_cast<std::streamoff>(header.boundsOffset));
+    fin.read(
+        reinterpret_cast<char *>(bounds_.data()),
+        static_cast<std::streamsize>(bounds_.size() * sizeof(float)));
+    if(!fin)
+        throw std::runtime_error("failed to read brick table: " + filename);
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(
+        filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("failed to open file: " + filename);
+    file_ = file;
+#else
+    fd_ = ::open(filename.c_str(), O_RDONLY);
+    if(fd_ < 0)
+        throw std::runtime_error("failed to open file: " + filename);
+#endif
+
+    filename_ = filename;
+}
+
+void BrickFile::close()
+{
+#ifdef _WIN32
+    if(file_)
+        CloseHandle(file_);
+    file_ = nullptr;
+#else
+    if(fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+#endif
+
+    filename_.clear();
+    indices_.clear();
+    bounds_.clear();
+    brickCount_ = 0;
+}
+
+const Int3 &BrickFile::getSize() const
+{
+    return size_;
+}
+
+const Int3 &BrickFile::getBrickResolution() const
+{
+    return res_;
+}
+
+int BrickFile::getBrickCount() const
+{
+    return brickCount_;
+}
+
+int BrickFile::getBrickIndex(int x, int y, int z) const
+{
+    return indices_[toCellIndex(x, y, z)];
+}
+
+float BrickFile::getBrickMajorant(int x, int y, int z) const
+{
+    return bounds_[2 * toCellIndex(x, y, z)];
+}
+
+float BrickFile::getBrickMinorant(int x, int y, int z) const
+{
+    return bounds_[2 * toCellIndex(x, y, z) + 1];
+}
+
+float BrickFile::getMaxValue() const
+{
+    return maxValue_;
+}
+
+size_t BrickFile::getTableByteSize() const
+{
+    return indices_.size() * sizeof(int32_t) + bounds_.size() * sizeof(float);
+}
+
+void BrickFile::readBrick(int index, float *dst) const
+{
+    constexpr size_t BRICK_BYTES = BRICK_VOXEL_COUNT * sizeof(float);
+    const uint64_t offset = payloadOffset_ + uint64_t(index) * BRICK_BYTES;
+
+    // positioned reads share no file pointer, so concurrent reads are safe
+
+#ifdef _WIN32
+    OVERLAPPED overlapped = {};
+    overlapped.Offset     = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    DWORD bytesRead = 0;
+    if(!ReadFile(file_, dst, static_cast<DWORD>(BRICK_BYTES), &bytesRead, &overlapped) ||
+       bytesRead != BRICK_BYTES)
+        throw std::runtime_error("failed to read brick from file: " + filename_);
+#else
+    size_t bytesRead = 0;
+    while(bytesRead < BRICK_BYTES)
+    {
+        const ssize_t n = pread(
+            fd_, reinterpret_cast<char *>(dst) + bytesRead, BRICK_BYTES - bytesRead,
+            static_cast<off_t>(offset + bytesRead));
+        if(n <= 0)
+            throw std::runtime_error("failed to read brick from file: " + filename_);
+        bytesRead += static_cast<size_t>(n);
+    }
+#endif
+}
+
+size_t BrickFile::toCellIndex(int x, int y, int z) const
+{
+    return (size_t(z) * res_.y + y) * res_.x + x;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "brick_grid.h"
+
+/*
+bricked grid file (.vbrick) layout:
+
+    BrickFileHeader
+    int32 brick indices, one per brick cell, x-major. -1 for empty bricks
+    float (majorant, minorant) pairs of the stored voxels of each brick cell
+    zero padding up to payloadOffset (a multiple of GRID_FILE_ALIGNMENT)
+    payload: brickCount bricks of BRICK_VOXEL_COUNT little-endian floats
+
+bricks are stored like BrickGrid bricks, apron included, so each brick can
+be paged in with a single read
+*/
+struct BrickFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t brickSize;
+    int32_t  width;
+    int32_t  height;
+    int32_t  depth;
+    int32_t  brickCount;
+    float    maxValue;
+    uint32_t pad0;
+    uint64_t indexOffset;
+    uint64_t boundsOffset;
+    uint64_t payloadOffset;
+};
+
+constexpr char     BRICK_FILE_MAGIC[8] = { 'A', 'G', 'Z', 'V', 'B', 'R', 'C', 'K' };
+constexpr uint32_t BRICK_FILE_VERSION  = 1;
+
+// streams the bricks of a R32F grid to a .vbrick file one at a time, so that
+// a mapped .vgrid larger than memory can be converted
+void saveBrickFile(const Grid &density, const std::string &filename);
+
+// a .vbrick file with its indirection table in memory and its bricks on disk
+class BrickFile
+{
+public:
+
+    static bool isBrickFile(const std::string &filename);
+
+    BrickFile() = default;
+
+    BrickFile(const BrickFile &) = delete;
+
+    BrickFile &operator=(const BrickFile &) = delete;
+
+    ~BrickFile();
+
+    void open(const std::string &filename);
+
+    void close();
+
+    // in voxels
+    const Int3 &getSize() const;
+
+    // in bricks
+    const Int3 &getBrickResolution() const;
+
+    int getBrickCount() const;
+
+    // -1 for empty bricks
+    int getBrickIndex(int x, int y, int z) const;
+
+    // max and min of the voxels stored by a brick cell, 0 for empty ones
+    float getBrickMajorant(int x, int y, int z) const;
+
+    float getBrickMinorant(int x, int y, int z) const;
+
+    float getMaxValue() const;
+
+    // bytes of the indirection table and bounds kept in memory
+    size_t getTableByteSize() const;
+
+    // reads the BRICK_VOXEL_COUNT voxels of a brick. thread-safe
+    void readBrick(int index, float *dst) const;
+
+private:
+
+    size_t toCellIndex(int x, int y, int z) const;
+
+    std::string filename_;
+
+    Int3     size_          = Int3(0);
+    Int3     res_           = Int3(0);
+    int      brickCount_    = 0;
+    float    maxValue_      = 0;
+    uint64_t payloadOffset_ = 0;
+
+    std::vector<int32_t> indices_;
+    std::vector<float>   bounds_;
+
+#ifdef _WIN32
+    void *file_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
@@ -0,0 +1,233 @@
+#include "brick_grid.h"
+#include "task_scheduler.h"
+
+namespace
+{
+    // first voxel stored by brick c along one axis
+    int brickBegin(int c)
+    {
+        return c * BRICK_SIZE;
+    }
+
+    void toVoxel(float coord, int size, int &voxel, float &weight)
+    {
+        const float x  = (std::max)(0.0f, (std::min)(float(size - 1), coord * size - 0.5f));
+        const float fx = std::floor(x);
+
+        voxel  = static_cast<int>(fx);
+        weight = x - fx;
+    }
+}
+
+bool extractBrick(const Grid &density, int bx, int by, int bz, float *dst)
+{
+    const Int3 &size = density.getSize();
+    const float *data = density.getData();
+
+    bool nonZero = false;
+    for(int z = 0; z < BRICK_STORAGE_SIZE; ++z)
+    {
+        const int gz = (std::min)(brickBegin(bz) + z, size.z - 1);
+        for(int y = 0; y < BRICK_STORAGE_SIZE; ++y)
+        {
+            const int gy = (std::min)(brickBegin(by) + y, size.y - 1);
+            const float *row = data + (size_t(gz) * size.y + gy) * size.x;
+            for(int x = 0; x < BRICK_STORAGE_SIZE; ++x)
+            {
+                const float value = row[(std::min)(brickBegin(bx) + x, size.x - 1)];
+                nonZero |= value != 0;
+                *dst++ = value;
+            }
+        }
+    }
+
+    return nonZero;
+}
+
+BrickLookup computeBrickLookup(const Int3 &size, const Float3 &uvw)
+{
+    int voxel[3];
+    BrickLookup lookup;
+    toVoxel(uvw.x, size.x, voxel[0], lookup.weight[0]);
+    toVoxel(uvw.y, size.y, voxel[1], lookup.weight[1]);
+    toVoxel(uvw.z, size.z, voxel[2], lookup.weight[2]);
+
+    for(int i = 0; i < 3; ++i)
+        lookup.brick[i] = voxel[i] / BRICK_SIZE;
+
+    constexpr int S = BRICK_STORAGE_SIZE;
+    lookup.offset = ((voxel[2] % BRICK_SIZE) * S + voxel[1] % BRICK_SIZE) * S
+                  + voxel[0] % BRICK_SIZE;
+    return lookup;
+}
+
+float interpolateBrick(const float *brickVoxels, const BrickLookup &lookup)
+{
+    constexpr int S = BRICK_STORAGE_SIZE;
+    const float *v000 = brickVoxels + lookup.offset;
+    const float *v001 = v000 + S * S;
+
+    const float fx = lookup.weight[0], fy = lookup.weight[1], fz = lookup.weight[2];
+
+    const float x00 = v000[0] + fx * (v000[1]     - v000[0]);
+    const float x10 = v000[S] + fx * (v000[S + 1] - v000[S]);
+    const float x01 = v001[0] + fx * (v001[1]     - v001[0]);
+    const float x11 = v001[S] + fx * (v001[S + 1] - v001[S]);
+    const float y0  = x00 + fy * (x10 - x00);
+    const float y1  = x01 + fy * (x11 - x01);
+    return y0 + fz * (y1 - y0);
+}
+
+void BrickGrid::build(const Grid &density)
+{
+    if(density.getFormat() != GridFormat::R32F)
+        throw std::runtime_error("brick grid requires a R32F density grid");
+
+    size_     = density.getSize();
+    maxValue_ = density.getMaxValue();
+    res_      = Int3(
+        (size_.x + BRICK_SIZE - 1) / BRICK_SIZE,
+        (size_.y + BRICK_SIZE - 1) / BRICK_SIZE,
+        (size_.z + BRICK_SIZE - 1) / BRICK_SIZE);
+
+    // a brick is empty if every voxel it stores is zero, as trilinear
+    // filtering inside it can only return zero then
+
+    std::vector<uint8_t> occupied(res_.product(), 0);
+    parallelFor(0, res_.z, [&](int bz)
+    {
+        std::vector<float> voxels(BRICK_VOXEL_COUNT);
+        for(int by = 0; by < res_.y; ++by)
+        {
+            for(int bx = 0; bx < res_.x; ++bx)
+            {
+                occupied[toCellIndex(bx, by, bz)] =
+                    extractBrick(density, bx, by, bz, voxels.data());
+            }
+        }
+    });
+
+    indices_.assign(res_.product(), -1);
+    occupancy_.assign((res_.product() + 63) / 64, 0);
+
+    int brickCount = 0;
+    for(size_t i = 0; i < occupied.size(); ++i)
+    {
+        if(!occupied[i])
+            continue;
+        indices_[i] = brickCount++;
+        occupancy_[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    bricks_.resize(size_t(brickCount) * BRICK_VOXEL_COUNT);
+
+    parallelFor(0, res_.z, [&](int bz)
+    {
+        for(int by = 0; by < res_.y; ++by)
+        {
+            for(int bx = 0; bx < res_.x; ++bx)
+            {
+                const int index = indices_[toCellIndex(bx, by, bz)];
+                if(index >= 0)
+                {
+                    extractBrick(
+                        density, bx, by, bz, &bricks_[size_t(index) * BRICK_VOXEL_COUNT]);
+                }
+            }
+        }
+    });
+}
+
+const Int3 &BrickGrid::getSize() const
+{
+    return size_;
+}
+
+const Int3 &BrickGrid::getBrickResolution() const
+{
+    return res_;
+}
+
+int BrickGrid::getBrickCount() const
+{
+    return static_cast<int>(bricks_.size() / BRICK_VOXEL_COUNT);
+}
+
+bool BrickGrid::isOccupied(int x, int y, int z) const
+{
+    const size_t i = toCellIndex(x, y, z);
+    return (occupancy_[i / 64] >> (i % 64)) & 1;
+}
+
+int BrickGrid::getBrickIndex(int x, int y, int z) const
+{
+    return indices_[toCellIndex(x, y, z)];
+}
+
+const float *BrickGrid::getBrickData(int index) const
+{
+    return &bricks_[size_t(index) * BRICK_VOXEL_COUNT];
+}
+
+const std::vector<uint64_t> &BrickGrid::getOccupancy() const
+{
+    return occupancy_;
+}
+
+size_t BrickGrid::getByteSize() const
+{
+    return bricks_.size()    * sizeof(float) +
+           indices_.size()   * sizeof(int32_t) +
+           occupancy_.size() * sizeof(uint64_t);
+}
+
+float BrickGrid::getMaxValue() const
+{
+    return maxValue_;
+}
+
+float BrickGrid::sample(const Float3 &uvw) const
+{
+    const BrickLookup lookup = computeBrickLookup(size_, uvw);
+
+    const int index = indices_[toCellIndex(
+        lookup.brick[0], lookup.brick[1], lookup.brick[2])];
+    if(index < 0)
+        return 0;
+
+    return interpolateBrick(getBrickData(index), lookup);
+}
+
+float BrickGrid::march(
+    const Float3 &uvwA, const Float3 &uvwB, float tMax, float dt,
+    uint64_t *lookups) const
+{
+    const float invTMax = 1 / tMax;
+
+    double opticalDepth = 0;
+    uint64_t count = 0;
+
+    traverse(uvwA, uvwB, tMax, [&](float t0, float t1)
+    {
+        const int kBeg = (std::max)(0, static_cast<int>(std::ceil(t0 / dt - 0.5f)));
+        for(int k = kBeg;; ++k)
+        {
+            const float t = (k + 0.5f) * dt;
+            if(t >= t1)
+                break;
+
+            opticalDepth += sample(uvwA + (t * invTMax) * (uvwB - uvwA));
+            ++count;
+        }
+        return true;
+    });
+
+    if(lookups)
+        *lookups += count;
+    return static_cast<float>(opticalDepth * dt);
+}
+
+size_t BrickGrid::toCellIndex(int x, int y, int z) const
+{
+    return (size_t(z) * res_.y + y) * res_.x + x;
+}
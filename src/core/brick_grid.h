@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "grid.h"
+
+constexpr int BRICK_SIZE = 8;
+
+// stored voxels per axis of a brick. the extra voxel on the upper side
+// holds the neighbor values trilinear filtering reads at the brick border
+constexpr int BRICK_STORAGE_SIZE  = BRICK_SIZE + 1;
+constexpr int BRICK_VOXEL_COUNT   = BRICK_STORAGE_SIZE * BRICK_STORAGE_SIZE * BRICK_STORAGE_SIZE;
+
+// copies the BRICK_VOXEL_COUNT voxels stored by brick (bx, by, bz) of a R32F
+// grid to dst, with clamp addressing beyond the grid. returns false if they
+// are all zero, in which case the brick needs not be stored
+bool extractBrick(const Grid &density, int bx, int by, int bz, float *dst);
+
+// where trilinear filtering at a texture coordinate reads a brick grid
+struct BrickLookup
+{
+    int   brick[3];   // brick coordinate
+    int   offset;     // of the lower voxel in the brick's stored voxels
+    float weight[3];
+};
+
+// with the voxel coordinate clamped, which is equivalent to clamp addressing
+// and keeps the lower voxel inside the grid
+BrickLookup computeBrickLookup(const Int3 &size, const Float3 &uvw);
+
+// same operation order as the dense trilinear sampler
+float interpolateBrick(const float *brickVoxels, const BrickLookup &lookup);
+
+// visits the brick cells along the segment from uvwA to uvwB of a grid of
+// the given size, parameterized by t in [0, tMax]. func(t0, t1, x, y, z) is
+// called for each cell in order and returns false to stop the traversal
+template<typename Func>
+void traverseBricks(
+    const Int3 &size, const Int3 &res,
+    const Float3 &uvwA, const Float3 &uvwB, float tMax, Func &&func);
+
+// sparse representation of a R32F grid: BRICK_SIZE^3 voxel bricks with a
+// top-level indirection table and an occupancy bitmask. bricks whose
+// voxels (including the apron) are all zero are not stored.
+//
+// brick (bx, by, bz) covers the trilinear footprints whose lower voxel
+// is in [bx * BRICK_SIZE, (bx + 1) * BRICK_SIZE) on each axis
+class BrickGrid
+{
+public:
+
+    void build(const Grid &density);
+
+    // in voxels
+    const Int3 &getSize() const;
+
+    // in bricks
+    const Int3 &getBrickResolution() const;
+
+    // number of stored (occupied) bricks
+    int getBrickCount() const;
+
+    bool isOccupied(int x, int y, int z) const;
+
+    // index of the brick's voxels in the brick pool, or -1 for empty bricks
+    int getBrickIndex(int x, int y, int z) const;
+
+    // BRICK_VOXEL_COUNT voxels, x-major
+    const float *getBrickData(int index) const;
+
+    const std::vector<uint64_t> &getOccupancy() const;
+
+    // bytes of the brick pool, the indirection table and the bitmask
+    size_t getByteSize() const;
+
+    float getMaxValue() const;
+
+    // trilinear filtering with clamp addressing, bit-identical to sampling
+    // the dense grid. returns 0 without touching voxels in empty bricks
+    float sample(const Float3 &uvw) const;
+
+    // visits occupied bricks along the segment from uvwA to uvwB,
+    // parameterized by t in [0, tMax]. func(t0, t1) is called for each
+    // overlapped occupied brick in order and returns false to stop
+    template<typename Func>
+    void traverse(
+        const Float3 &uvwA, const Float3 &uvwB, float tMax, Func &&func) const;
+
+    // raw optical depth of the segment with midpoint steps at t = (k + 0.5) * dt.
+    // steps in empty bricks are skipped
+    float march(
+        const Float3 &uvwA, const Float3 &uvwB, float tMax, float dt,
+        uint64_t *lookups = nullptr) const;
+
+private:
+
+    size_t toCellIndex(int x, int y, int z) const;
+
+    Int3  size_     = Int3(0);
+    Int3  res_      = Int3(0);
+    float maxValue_ = 0;
+
+    std::vector<int32_t>  indices_;
+    std::vector<uint64_t> occupancy_;
+    std::vector<float>    bricks_;
+};
+
+template<typename Func>
+void traverseBricks(
+    const Int3 &size, const Int3 &res,
+    const Float3 &uvwA, const Float3 &uvwB, float tMax, Func &&func)
+{
+    if(tMax <= 0 || res.product() <= 0)
+        return;
+
+    constexpr float INF = std::numeric_limits<float>::infinity();
+
+    // brick coordinates of the lower trilinear voxel
+
+    const int   sizes[3] = { size.x, size.y, size.z };
+    const int   ress[3]  = { res.x, res.y, res.z };
+    const float a[3]     = { uvwA.x, uvwA.y, uvwA.z };
+    const float b[3]     = { uvwB.x, uvwB.y, uvwB.z };
+
+    int   cell[3], step[3];
+    float tNext[3], tDelta[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        const float p = (a[i] * sizes[i] - 0.5f) / BRICK_SIZE;
+        const float q = (b[i] * sizes[i] - 0.5f) / BRICK_SIZE;
+        cell[i] = (std::max)(0, (std::min)(ress[i] - 1, static_cast<int>(std::floor(p))));
+
+        const float dir = (q - p) / tMax;
+        if(dir > 0)
+        {
+            step[i]   = 1;
+            tNext[i]  = (cell[i] + 1 - p) / dir;
+            tDelta[i] = 1 / dir;
+        }
+        else if(dir < 0)
+        {
+            step[i]   = -1;
+            tNext[i]  = (cell[i] - p) / dir;
+            tDelta[i] = -1 / dir;
+        }
+        else
+        {
+            step[i]   = 0;
+            tNext[i]  = INF;
+            tDelta[i] = INF;
+        }
+
+        // clamp addressing keeps samples beyond the border in the border brick
+        if(cell[i] + step[i] < 0 || cell[i] + step[i] >= ress[i])
+            tNext[i] = INF;
+    }
+
+    float t = 0;
+    while(t < tMax)
+    {
+        int axis = tNext[0] < tNext[1] ? 0 : 1;
+        axis = tNext[2] < tNext[axis] ? 2 : axis;
+
+        const float tExit = (std::max)(t, (std::min)(tNext[axis], tMax));
+        if(!func(t, tExit, cell[0], cell[1], cell[2]))
+            return;
+        t = tExit;
+        if(t >= tMax)
+            return;
+
+        cell[axis] += step[axis];
+        tNext[axis] += tDelta[axis];
+        if(cell[axis] + step[axis] < 0 || cell[axis] + step[axis] >= ress[axis])
+            tNext[axis] = INF;
+    }
+}
+
+template<typename Func>
+void BrickGrid::traverse(
+    const Float3 &uvwA, const Float3 &uvwB, float tMax, Func &&func) const
+{
+    traverseBricks(size_, res_, uvwA, uvwB, tMax, [&](float t0, float t1, int x, int y, int z)
+    {
+        return !isOccupied(x, y, z) || func(t0, t1);
+    });
+}
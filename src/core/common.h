@@ -0,0 +1,17 @@
+#pragma once
+
+#include <agz-utils/math.h>
+
+// d3d-independent aliases, kept identical to the ones in agz::d3d11 so that
+// code in src/core can be shared by the renderer and the headless tools
+
+using Float2 = agz::math::vec2f;
+using Float3 = agz::math::vec3f;
+using Float4 = agz::math::vec4f;
+using Int2   = agz::math::vec2i;
+using Int3   = agz::math::vec3i;
+
+using Mat4   = agz::math::mat4f_c;
+using Trans4 = Mat4::left_transform;
+
+constexpr float PI = agz::math::PI_f;
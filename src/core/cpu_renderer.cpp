@@ -0,0 +1,1444 @@
+#include <chrono>
+
+#include "cpu_renderer.h"
+#include "rng.h"
+#include "task_scheduler.h"
+
+namespace
+{
+    float luminance(const Float3 &c)
+    {
+        return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+    }
+
+    void addFeatures(PixelFeatures &sum, const PixelFeatures &features)
+    {
+        sum.albedo        += features.albedo;
+        sum.depth         += features.depth;
+        sum.transmittance += features.transmittance;
+    }
+
+    struct GuidedVertex
+    {
+        Float3 pos;
+        Float3 dir;
+        Float3 coef;   // of the contributions along dir
+        Float3 result; // before them
+        float  pdf;
+    };
+
+    uint32_t getPixelSeed(int index, uint32_t seed)
+    {
+        uint32_t result = static_cast<uint32_t>(index + 1);
+        if(seed)
+        {
+            result ^= seed * 0x9e3779b9u;
+            randUint(result);
+        }
+        return result;
+    }
+
+    void sampleEnvirLightCallback(
+        const void *envir, uint32_t &rng, float dir[3], float &pdf)
+    {
+        Float3 refToLight;
+        static_cast<const EnvirMap *>(envir)->sampleEnvirLight(rng, refToLight, pdf);
+        dir[0] = refToLight.x; dir[1] = refToLight.y; dir[2] = refToLight.z;
+    }
+
+    void evalEnvirLightCallback(const void *envir, const float dir[3], float rad[3])
+    {
+        const Float3 result = static_cast<const EnvirMap *>(envir)
+            ->evalEnvirLight(Float3(dir[0], dir[1], dir[2]));
+        rad[0] = result.x; rad[1] = result.y; rad[2] = result.z;
+    }
+}
+
+const char *getDirectLightSamplingName(DirectLightSampling sampling)
+{
+    switch(sampling)
+    {
+    case DirectLightSampling::Light:   return "light";
+    case DirectLightSampling::MIS:     return "mis";
+    case DirectLightSampling::Product: return "product";
+    }
+    return "unknown";
+}
+
+const char *getMISHeuristicName(MISHeuristic heuristic)
+{
+    switch(heuristic)
+    {
+    case MISHeuristic::Balance: return "balance";
+    case MISHeuristic::Power:   return "power";
+    }
+    return "unknown";
+}
+
+CPUVolumeRenderer::~CPUVolumeRenderer()
+{
+    if(transCacheBuild_)
+        transCacheBuild_->cancel = true;
+}
+
+void CPUVolumeRenderer::initialize(const Int2 &size)
+{
+    setSimdLevel(detectSimdLevel());
+    resize(size);
+}
+
+void CPUVolumeRenderer::resize(const Int2 &size)
+{
+    size_ = size;
+
+    seeds_.resize(size.product());
+    for(int i = 0; i < size.product(); ++i)
+        seeds_[i] = getPixelSeed(i, seed_);
+
+    output_.assign(size.product(), Float4(0));
+    moments_.assign(size.product(), Float2(0));
+    features_.assign(size.product(), PixelFeatures{});
+    historyOutput_.assign(size.product(), Float4(0));
+    historyMoments_.assign(size.product(), Float2(0));
+    historyFeatures_.assign(size.product(), PixelFeatures{});
+    discardHistory_ = true;
+}
+
+void CPUVolumeRenderer::setThreadCount(int count)
+{
+    threadCount_ = count;
+}
+
+void CPUVolumeRenderer::setSimdLevel(SimdLevel level)
+{
+    while(!isSimdLevelSupported(level))
+        level = static_cast<SimdLevel>(static_cast<int>(level) / 2);
+
+    simdLevel_  = level;
+    packetFunc_ = getPacketTraceFunc(level);
+}
+
+SimdLevel CPUVolumeRenderer::getSimdLevel() const
+{
+    return simdLevel_;
+}
+
+void CPUVolumeRenderer::setTracer(int maxDepth)
+{
+    maxDepth_ = maxDepth;
+}
+
+void CPUVolumeRenderer::setTransmittanceEstimator(TransmittanceEstimator estimator)
+{
+    discardHistory_ |= estimator_ != estimator;
+    estimator_ = estimator;
+}
+
+void CPUVolumeRenderer::setFreeFlightSampler(FreeFlightSampler sampler)
+{
+    discardHistory_ |= freeFlight_ != sampler;
+    freeFlight_ = sampler;
+}
+
+void CPUVolumeRenderer::setDensityLod(const DensityLodParams &params)
+{
+    discardHistory_ = true;
+    lod_ = params;
+}
+
+void CPUVolumeRenderer::setAdaptiveSampling(const AdaptiveSamplingParams &params)
+{
+    adaptive_ = params;
+}
+
+void CPUVolumeRenderer::setDirectLight(const DirectLightParams &params)
+{
+    direct_ = params;
+}
+
+void CPUVolumeRenderer::setPathGuiding(const PathGuidingParams &params)
+{
+    guiding_     = params;
+    guideVolume_ = nullptr;
+}
+
+void CPUVolumeRenderer::setTransmittanceCache(const TransmittanceCacheParams &params)
+{
+    transCache_ = params;
+}
+
+const TransmittanceCache *CPUVolumeRenderer::getTransmittanceCache() const
+{
+    return transCache_.enabled && transCacheBuild_ && transCacheBuild_->done ?
+        &transCacheBuild_->cache : nullptr;
+}
+
+void CPUVolumeRenderer::waitTransmittanceCache()
+{
+    if(transCache_.enabled && volume_ && envir_)
+        updateTransmittanceCache();
+    if(transCacheTasks_)
+        transCacheTasks_->wait();
+}
+
+void CPUVolumeRenderer::updateTransmittanceCache()
+{
+    const TransmittanceCacheKey key = {
+        volume_->getDensitySource(), volume_->getLod(), volume_->getDensityScale(),
+        volume_->getLower(), volume_->getUpper(), envirGeneration_,
+        transCache_.lobeCount, transCache_.lobeAngle, transCache_.resolution
+    };
+    if(transCacheBuild_ && key == transCacheKey_)
+        return;
+
+    cancelTransmittanceCache();
+
+    // the lobes are picked here, as the envir may change during the build.
+    // the task works on a copy of the medium for the same reason
+
+    auto build = std::make_shared<TransmittanceCacheBuild>();
+    build->cache.initialize(*envir_, transCache_);
+    transCacheBuild_ = build;
+    transCacheKey_   = key;
+
+    if(!transCacheTasks_)
+        transCacheTasks_ = std::make_unique<TaskGroup>(TaskPriority::Background);
+    transCacheTasks_->run([build, medium = *volume_]
+    {
+        build->cache.build(medium, &build->cancel);
+        build->done = build->cache.isBuilt();
+    });
+}
+
+void CPUVolumeRenderer::cancelTransmittanceCache()
+{
+    if(!transCacheBuild_ || transCacheBuild_->done)
+        return;
+
+    // a cancelled build stops at its next slice
+    transCacheBuild_->cancel = true;
+    transCacheTasks_->wait();
+    transCacheBuild_.reset();
+}
+
+void CPUVolumeRenderer::setTemporalReprojection(const TemporalReprojectionParams &params)
+{
+    temporal_ = params;
+}
+
+void CPUVolumeRenderer::setDynamicResolution(const DynamicResolutionParams &params)
+{
+    resolution_.setParams(params);
+}
+
+void CPUVolumeRenderer::setReSTIR(const ReSTIRParams &params)
+{
+    discardHistory_ |= restir_.enabled != params.enabled;
+    restir_ = params;
+}
+
+void CPUVolumeRenderer::setSeed(uint32_t seed)
+{
+    seed_ = seed;
+    for(int i = 0; i < size_.product(); ++i)
+        seeds_[i] = getPixelSeed(i, seed_);
+    discardHistory_ = true;
+}
+
+void CPUVolumeRenderer::setSampler(SamplerType type)
+{
+    discardHistory_ |= sampler_.getType() != type;
+    sampler_.setType(type);
+}
+
+void CPUVolumeRenderer::setCamera(const Camera &camera)
+{
+    const auto fD = camera.getFrustumDirections();
+
+    const bool moved =
+        eye_ != camera.getPosition() ||
+        frustum_.frustumA != fD.frustumA ||
+        frustum_.frustumB != fD.frustumB ||
+        frustum_.frustumC != fD.frustumC ||
+        frustum_.frustumD != fD.frustumD;
+
+    if(moved && !cameraMoved_)
+    {
+        prevEye_     = eye_;
+        prevFrustum_ = frustum_;
+    }
+    cameraMoved_    |= moved;
+    discardHistory_ |= moved && !temporal_.enabled;
+
+    eye_     = camera.getPosition();
+    frustum_ = fD;
+}
+
+void CPUVolumeRenderer::setEnvir(const EnvirMap &envir)
+{
+    envir_ = &envir;
+    ++envirGeneration_;
+}
+
+void CPUVolumeRenderer::setVolume(const VolumeMedium &volume)
+{
+    cancelTransmittanceCache();
+    volume_      = &volume;
+    guideVolume_ = nullptr;
+}
+
+void CPUVolumeRenderer::discardHistory()
+{
+    discardHistory_ = true;
+}
+
+const Int2 &CPUVolumeRenderer::getSize() const
+{
+    return size_;
+}
+
+const std::vector<Float4> &CPUVolumeRenderer::getOutput() const
+{
+    return output_;
+}
+
+const std::vector<Float2> &CPUVolumeRenderer::getMoments() const
+{
+    return moments_;
+}
+
+const std::vector<PixelFeatures> &CPUVolumeRenderer::getFeatures() const
+{
+    return features_;
+}
+
+uint64_t CPUVolumeRenderer::getPathCount() const
+{
+    return pathCount_;
+}
+
+int CPUVolumeRenderer::getConvergedPixelCount() const
+{
+    return convergedCount_;
+}
+
+double CPUVolumeRenderer::getFrameMs() const
+{
+    return frameMs_;
+}
+
+bool CPUVolumeRenderer::usedPackets() const
+{
+    return usedPackets_;
+}
+
+int CPUVolumeRenderer::getInterleaveStride() const
+{
+    return resolution_.getStride();
+}
+
+int CPUVolumeRenderer::getGuidingIteration() const
+{
+    return guideIteration_;
+}
+
+const PathGuide &CPUVolumeRenderer::getPathGuide() const
+{
+    return guide_;
+}
+
+void CPUVolumeRenderer::getUpsampledOutput(std::vector<Float4> &result) const
+{
+    const int radius = resolution_.getStride();
+
+    result.resize(size_.product());
+    parallelFor(0, size_.y, [&](int y)
+    {
+        for(int x = 0; x < size_.x; ++x)
+        {
+            const int index = y * size_.x + x;
+            const Float4 &o = output_[index];
+            if(o.w > 0)
+            {
+                result[index] = Float4(Float3(o.x, o.y, o.z) / o.w, 1);
+                continue;
+            }
+
+            // inverse squared distance weights
+
+            Float3 sum = Float3(0);
+            float weightSum = 0;
+            for(int qy = (std::max)(y - radius, 0); qy <= (std::min)(y + radius, size_.y - 1); ++qy)
+            {
+                for(int qx = (std::max)(x - radius, 0); qx <= (std::min)(x + radius, size_.x - 1); ++qx)
+                {
+                    const Float4 &q = output_[qy * size_.x + qx];
+                    if(q.w <= 0)
+                        continue;
+
+                    const float weight = 1.0f / ((qx - x) * (qx - x) + (qy - y) * (qy - y));
+                    sum       += weight / q.w * Float3(q.x, q.y, q.z);
+                    weightSum += weight;
+                }
+            }
+            result[index] = Float4(weightSum > 0 ? sum / weightSum : Float3(0), 1);
+        }
+    });
+}
+
+void CPUVolumeRenderer::render()
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    const int tileCountX = (size_.x + TILE_SIZE - 1) / TILE_SIZE;
+    const int tileCountY = (size_.y + TILE_SIZE - 1) / TILE_SIZE;
+    const int tileCount  = tileCountX * tileCountY;
+
+    // the frame is traced into fresh buffers and the history added after
+
+    const bool reproject = temporal_.enabled && cameraMoved_ && !discardHistory_;
+    if(reproject)
+    {
+        historyOutput_.swap(output_);
+        historyMoments_.swap(moments_);
+        historyFeatures_.swap(features_);
+        discardHistory_ = true;
+    }
+
+    // pixels between the interleaved ones get no samples of the frame, so
+    // they are cleared when the history is not kept
+
+    resolution_.beginFrame(cameraMoved_);
+    if(discardHistory_ && resolution_.getStride() > 1)
+    {
+        std::fill(output_.begin(), output_.end(), Float4(0));
+        std::fill(moments_.begin(), moments_.end(), Float2(0));
+        std::fill(features_.begin(), features_.end(), PixelFeatures{});
+    }
+
+    if(direct_.sampling == DirectLightSampling::Product &&
+       (productEnvir_ != envir_ || productSize_ != direct_.productTableSize))
+    {
+        product_.build(*envir_, direct_.productTableSize);
+        productEnvir_ = envir_;
+        productSize_  = direct_.productTableSize;
+    }
+
+    if(guiding_.enabled && guideVolume_ != volume_)
+    {
+        guide_.initialize(volume_->getLower(), volume_->getUpper(), guiding_);
+        guideVolume_    = volume_;
+        guideIteration_ = 0;
+        guideFrames_    = 0;
+    }
+
+    if(transCache_.enabled)
+        updateTransmittanceCache();
+    transCacheReady_ = getTransmittanceCache();
+
+    if(adaptive_.enabled)
+        computeSampleCounts();
+    else
+    {
+        sampleCounts_.clear();
+        convergedCount_ = 0;
+    }
+
+    // frames are interactive work, ahead of background asset loads
+
+    TaskGroup group(TaskPriority::Interactive);
+    const int workerCount = group.getScheduler().getWorkerCount();
+    const int threadCount = threadCount_ > 0 ? (std::min)(threadCount_, workerCount) : workerCount;
+
+    // tiles are handed out dynamically, as their costs vary a lot
+    // between pixels seeing the environment and pixels seeing the volume
+
+    const bool usePackets =
+        packetFunc_ && volume_->getDensity() &&
+        estimator_ != TransmittanceEstimator::ResidualRatio &&
+        freeFlight_ == FreeFlightSampler::Delta &&
+        lod_.mode == DensityLodMode::Off &&
+        sampler_.getType() == SamplerType::Random &&
+        direct_.sampling == DirectLightSampling::Light &&
+        !guiding_.enabled &&
+        !transCache_.enabled;
+    const PacketTraceContext packetCtx =
+        usePackets ? createPacketTraceContext() : PacketTraceContext{};
+
+    std::atomic<int> nextTile = 0;
+    auto worker = [&]
+    {
+        uint64_t pathCount = 0;
+        for(int tile = nextTile++; tile < tileCount; tile = nextTile++)
+        {
+            pathCount += usePackets ?
+                renderTilePackets(tile, packetCtx) : renderTile(tile);
+        }
+        pathCount_ += pathCount;
+    };
+
+    if(restir_.enabled)
+        renderReSTIR();
+    else
+    {
+        for(int i = 0; i < threadCount; ++i)
+            group.run(worker);
+        group.wait();
+    }
+    usedPackets_ = usePackets && !restir_.enabled;
+
+    if(reproject)
+        reprojectHistory();
+
+    if(guiding_.enabled && guideIteration_ < guiding_.trainingIterations &&
+       ++guideFrames_ >= guiding_.firstIterationFrames << guideIteration_)
+    {
+        guide_.finishIteration(guideFrames_);
+        ++guideIteration_;
+        guideFrames_ = 0;
+    }
+
+    cameraMoved_    = false;
+    discardHistory_ = false;
+
+    frameMs_ = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    resolution_.endFrame(frameMs_);
+}
+
+Float3 CPUVolumeRenderer::estimateDirectIllum(
+    const VolumeMedium &medium, const Float3 &o, const Float3 &wo,
+    const Float3 &wi, float pdf, uint32_t &rng) const
+{
+    float trans = 1;
+    if(!transCacheReady_ || !transCacheReady_->lookup(o, wi, trans))
+    {
+        const Float2 incts = volume_->intersectRayBox(o, wi);
+        if(incts.x < incts.y)
+        {
+            trans = medium.estimateTransmittance(
+                estimator_, o + incts.x * wi, o + incts.y * wi, rng);
+        }
+    }
+
+    const float phase = volume_->evalPhaseFunction(-dot(wo, wi));
+
+    const Float3 rad = envir_->evalEnvirLight(wi);
+
+    return rad * (trans * phase / pdf);
+}
+
+float CPUVolumeRenderer::pdfDirectLight(const Float3 &wo, const Float3 &wi) const
+{
+    if(direct_.sampling == DirectLightSampling::Product)
+        return product_.pdf(*volume_, wo, wi);
+    return envir_->pdfEnvirLight(wi);
+}
+
+float CPUVolumeRenderer::pdfScattering(
+    const DirectionalTree *guideTree, const Float3 &wo, const Float3 &wi) const
+{
+    const float phase = volume_->evalPhaseFunction(-dot(wo, wi));
+    if(!guideTree)
+        return phase;
+    const float fraction = guiding_.guideFraction;
+    return fraction * guideTree->pdf(wi) + (1 - fraction) * phase;
+}
+
+float CPUVolumeRenderer::computeMISWeight(float pdf, float otherPdf) const
+{
+    if(direct_.heuristic == MISHeuristic::Power)
+    {
+        pdf *= pdf;
+        otherPdf *= otherPdf;
+    }
+    return pdf / (pdf + otherPdf);
+}
+
+float CPUVolumeRenderer::evalEnvirTarget(const PrimaryVertex &vertex, const Float3 &wi) const
+{
+    return luminance(envir_->evalEnvirLight(wi)) *
+           volume_->evalPhaseFunction(-dot(vertex.wo, wi));
+}
+
+Float3 CPUVolumeRenderer::trace(
+    Float3 o, Float3 d, uint32_t &rng, const PathSample &sample,
+    PixelFeatures &features, PrimaryVertex *primary) const
+{
+    Float3 coef   = Float3(1);
+    Float3 result = Float3(0);
+
+    // footprint width in voxels, grown by the pixel cone along the camera
+    // ray and by the scattering lobe after each scattering
+
+    const bool useLod = lod_.mode != DensityLodMode::Off && volume_->getDensity();
+
+    float invVoxelSize = 0, pixelAngle = 0, footprint = 0;
+    if(useLod)
+    {
+        const Int3 &size = volume_->getDensity()->getSize();
+        const Float3 extent = volume_->getUpper() - volume_->getLower();
+        invVoxelSize = (std::max)({ size.x / extent.x, size.y / extent.y, size.z / extent.z });
+        pixelAngle   = (frustum_.frustumB - frustum_.frustumA).length() / size_.x;
+        footprint    = pixelAngle * (o - eye_).length() * invVoxelSize;
+    }
+
+    VolumeMedium lodMedium;
+    const VolumeMedium *medium = volume_;
+
+    const int sampledDepth = sampler_.getType() != SamplerType::Random ? SAMPLE_MAX_BOUNCES : 0;
+
+    auto get2D = [&](int depth, int dim)
+    {
+        return sampler_.get2D(sample.pixel, sample.index, depth * SAMPLE_DIMS_PER_BOUNCE + dim);
+    };
+
+    // with mis, the phase sample of d gets the envir light it escapes to,
+    // weighted against the light sample of the scattering it left
+
+    const bool mis = direct_.sampling != DirectLightSampling::Light;
+    float phasePDF = 0;
+    Float3 phaseWo;
+
+    // vertices whose sampled directions train the guide once the path is done
+
+    const bool training = guiding_.enabled && guideIteration_ < guiding_.trainingIterations;
+    thread_local std::vector<GuidedVertex> vertices;
+    vertices.clear();
+
+    auto addEscaped = [&]
+    {
+        if(phasePDF > 0)
+        {
+            result += coef * envir_->evalEnvirLight(d) *
+                      computeMISWeight(phasePDF, pdfDirectLight(phaseWo, d));
+        }
+    };
+
+    for(int i = 0; i < maxDepth_; ++i)
+    {
+        const bool useSampler = i < sampledDepth;
+
+        if(useLod)
+        {
+            lodMedium = volume_->atLod(computeDensityLod(lod_, i, footprint));
+            medium = &lodMedium;
+        }
+
+        const Float2 incts = volume_->intersectRayBox(o, d);
+        if(incts.x + 0.001f >= incts.y)
+        {
+            if(i == 0)
+            {
+                result   = envir_->evalEnvirLight(d);
+                features = { Float3(0), (o - eye_).length(), 1 };
+            }
+            else
+                addEscaped();
+            break;
+        }
+
+        const Float3 a = o, b = o + (incts.y - 0.001f) * d;
+
+        Float3 scatterPos;
+        bool scattered;
+        if(freeFlight_ == FreeFlightSampler::Decomposition)
+        {
+            scattered = useSampler ?
+                medium->deltaTrackDecomposition(a, b, get2D(i, SAMPLE_DIM_FREE_FLIGHT), rng, scatterPos) :
+                medium->deltaTrackDecomposition(a, b, rng, scatterPos);
+        }
+        else
+        {
+            scattered = useSampler ?
+                medium->deltaTrack(a, b, get2D(i, SAMPLE_DIM_FREE_FLIGHT), rng, scatterPos) :
+                medium->deltaTrack(a, b, rng, scatterPos);
+        }
+        if(!scattered)
+        {
+            if(i == 0)
+            {
+                result   = envir_->evalEnvirLight(d);
+                features = { Float3(0), (b - eye_).length(), 1 };
+            }
+            else
+                addEscaped();
+            break;
+        }
+
+        const Float3 uvw    = volume_->toTexCoord(scatterPos);
+        const Float3 albedo = volume_->sampleAlbedo(uvw);
+        coef *= albedo;
+
+        if(i == 0)
+            features = { albedo, (scatterPos - eye_).length(), 0 };
+
+        // the next bounce starts with the footprint at the scattering. shadow
+        // rays track the full resolution, which the majorants of the residual
+        // estimator bound, rather than the filtered density of a coarser level
+        if(useLod)
+        {
+            footprint += (i ? lod_.scatterSpread : pixelAngle) *
+                         (scatterPos - o).length() * invVoxelSize;
+        }
+
+        const Float3 wo = -d;
+        const DirectionalTree *guideTree =
+            guiding_.enabled ? guide_.getSamplingTree(scatterPos) : nullptr;
+
+        // the light sample is left to reservoir resampling at the primary
+        // vertex, so there is nothing to weigh the phase sample against
+        const bool skipLight = i == 0 && primary;
+        const bool misHere   = mis && !skipLight && i + 1 < maxDepth_;
+
+        if(skipLight)
+            *primary = { scatterPos, wo, coef, true };
+        else
+        {
+            Float3 wi; float pdf;
+            if(direct_.sampling == DirectLightSampling::Product)
+                wi = product_.sample(*volume_, wo, rng, pdf);
+            else if(useSampler)
+            {
+                envir_->sampleEnvirLight(
+                    get2D(i, SAMPLE_DIM_LIGHT_SELECT), get2D(i, SAMPLE_DIM_LIGHT), rng, wi, pdf);
+            }
+            else
+                envir_->sampleEnvirLight(rng, wi, pdf);
+
+            if(pdf > 0)
+            {
+                const float weight = misHere ?
+                    computeMISWeight(pdf, pdfScattering(guideTree, wo, wi)) : 1.0f;
+                result += coef * weight * estimateDirectIllum(*volume_, scatterPos, wo, wi, pdf, rng);
+            }
+        }
+
+        o = scatterPos;
+        if(guideTree && randFloat(rng) < guiding_.guideFraction)
+        {
+            const float u1 = randFloat(rng);
+            const float u2 = randFloat(rng);
+            float guidePDF;
+            d = guideTree->sample(Float2(u1, u2), guidePDF);
+        }
+        else
+        {
+            d = useSampler ?
+                volume_->samplePhaseFunction(wo, get2D(i, SAMPLE_DIM_PHASE)) :
+                volume_->samplePhaseFunction(wo, rng);
+        }
+
+        // the phase function alone is sampled exactly, with weight 1
+        float scatterPDF = 0;
+        if(guideTree)
+        {
+            scatterPDF = pdfScattering(guideTree, wo, d);
+            coef *= volume_->evalPhaseFunction(-dot(wo, d)) / scatterPDF;
+        }
+        else if(misHere || training)
+            scatterPDF = volume_->evalPhaseFunction(-dot(wo, d));
+
+        phaseWo  = wo;
+        phasePDF = misHere ? scatterPDF : 0;
+
+        if(training && i + 1 < maxDepth_)
+            vertices.push_back({ scatterPos, d, coef, result, scatterPDF });
+    }
+
+    // the radiance each vertex got along its sampled direction
+    for(auto &v : vertices)
+    {
+        const float coefLum = luminance(v.coef);
+        const float value = coefLum > 0 ?
+            luminance(result - v.result) / (coefLum * v.pdf) : 0.0f;
+        guide_.record(v.pos, v.dir, value);
+    }
+
+    return result;
+}
+
+Float4 CPUVolumeRenderer::accumulate(
+    const Int2 &pixel, const Float3 &d, int sampleCount,
+    uint32_t &rng, Float2 &moments, PixelFeatures &features) const
+{
+    Float3 o;
+    if(!volume_->findEntry(eye_, d, o))
+    {
+        const Float3 rad = envir_->evalEnvirLight(d);
+        const float lum = luminance(rad);
+        moments  = Float2(lum, lum * lum);
+        features = { Float3(0), 0, 1 };
+        return Float4(rad, 1);
+    }
+
+    // sample indices continue where the accumulated samples of the pixel end
+    const uint32_t firstSample = discardHistory_ ?
+        0 : static_cast<uint32_t>(output_[pixel.y * size_.x + pixel.x].w);
+
+    Float4 result = Float4(0);
+    moments  = Float2(0);
+    features = {};
+    for(int i = 0; i < sampleCount; ++i)
+    {
+        PixelFeatures pathFeatures;
+        const Float3 rad = trace(o, d, rng, { pixel, firstSample + i }, pathFeatures, nullptr);
+        const float lum = luminance(rad);
+        result    += Float4(rad, 1);
+        moments.x += lum;
+        moments.y += lum * lum;
+        addFeatures(features, pathFeatures);
+    }
+    return result;
+}
+
+void CPUVolumeRenderer::addToOutput(
+    int index, const Float4 &accu, const Float2 &moments, const PixelFeatures &features)
+{
+    if(discardHistory_)
+    {
+        output_[index]   = accu;
+        moments_[index]  = moments;
+        features_[index] = features;
+        return;
+    }
+
+    output_[index]  += accu;
+    moments_[index].x += moments.x;
+    moments_[index].y += moments.y;
+    addFeatures(features_[index], features);
+}
+
+void CPUVolumeRenderer::computeSampleCounts()
+{
+    const int pixelCount = size_.product();
+    sampleCounts_.resize(pixelCount);
+    convergedCount_ = 0;
+
+    if(discardHistory_)
+    {
+        std::fill(sampleCounts_.begin(), sampleCounts_.end(), uint8_t(UNIFORM_SAMPLES));
+        return;
+    }
+
+    // weight of each pixel: -1 while it warms up, 0 once the relative
+    // standard error of its mean is below threshold (the 1e-4 keeps dark
+    // pixels from chasing invisible noise), else var / n^2, the squared
+    // error one more sample removes. following it approaches samples in
+    // proportion to the standard deviations, the least total squared error
+
+    std::vector<float> weights(pixelCount);
+    std::vector<double> rowWeights(size_.y);
+    std::vector<int> rowWarmups(size_.y), rowConverged(size_.y);
+
+    const float threshold2 = adaptive_.threshold * adaptive_.threshold;
+
+    parallelFor(0, size_.y, [&](int y)
+    {
+        double weight = 0;
+        int warmups = 0, converged = 0;
+        for(int x = 0; x < size_.x; ++x)
+        {
+            const int index = y * size_.x + x;
+            const float n = output_[index].w;
+
+            float pixelWeight = -1;
+            if(n >= (std::max)(2, adaptive_.minSamples))
+            {
+                const Float2 &m = moments_[index];
+                const float mean = m.x / n;
+                const float variance = (std::max)(0.0f, m.y / n - mean * mean) * n / (n - 1);
+                pixelWeight = variance / n < threshold2 * (mean * mean + 1e-4f) ? 0.0f : variance / (n * n);
+            }
+            weights[index] = pixelWeight;
+
+            if(pixelWeight < 0)
+                ++warmups;
+            else if(pixelWeight == 0)
+                ++converged;
+            else
+                weight += pixelWeight;
+        }
+        rowWeights[y]   = weight;
+        rowWarmups[y]   = warmups;
+        rowConverged[y] = converged;
+    });
+
+    double weightSum = 0;
+    int warmupCount = 0;
+    for(int y = 0; y < size_.y; ++y)
+    {
+        weightSum       += rowWeights[y];
+        warmupCount     += rowWarmups[y];
+        convergedCount_ += rowConverged[y];
+    }
+
+    // the samples of a uniform frame left after the warming up pixels go
+    // to the unconverged ones, at least one each
+
+    const double budget = double(UNIFORM_SAMPLES) * (pixelCount - warmupCount);
+    const double ratio = weightSum > 0 ? budget / weightSum : 0;
+    const int maxSamples = (std::min)(255, adaptive_.maxSamples);
+
+    parallelFor(0, size_.y, [&](int y)
+    {
+        for(int x = 0; x < size_.x; ++x)
+        {
+            const int index = y * size_.x + x;
+            const float weight = weights[index];
+
+            int count = UNIFORM_SAMPLES;
+            if(weight == 0)
+                count = 0;
+            else if(weight > 0)
+            {
+                count = static_cast<int>((std::min)(double(maxSamples), weight * ratio + 0.5));
+                count = (std::max)(1, count);
+            }
+            sampleCounts_[index] = static_cast<uint8_t>(count);
+        }
+    });
+}
+
+void CPUVolumeRenderer::reprojectHistory()
+{
+    // the normalized corner directions of a frustum lie in a plane, so the
+    // previous view coordinates of a direction come from its intersection
+    // with the plane of the previous corners
+
+    const Float3 prevA     = prevFrustum_.frustumA;
+    const Float3 prevRight = prevFrustum_.frustumB - prevFrustum_.frustumA;
+    const Float3 prevDown  = prevFrustum_.frustumC - prevFrustum_.frustumA;
+    const Float3 prevNor   = cross(prevRight, prevDown);
+
+    const float prevPlane       = dot(prevA, prevNor);
+    const float invRightLength2 = 1 / prevRight.length_square();
+    const float invDownLength2  = 1 / prevDown.length_square();
+
+    // pixels between the interleaved ones take the distance of the history
+    // at their position, like the shader, where the traced pixel of their
+    // block is written by another thread
+
+    const int stride = resolution_.getStride();
+    const int phase  = resolution_.getPhase();
+
+    parallelFor(0, size_.y, [&](int y)
+    {
+        for(int x = 0; x < size_.x; ++x)
+        {
+            const int index = y * size_.x + x;
+
+            float depth;
+            if(stride <= 1 || getInterleaveRank(x % stride, y % stride, stride) == phase)
+            {
+                const float n = output_[index].w;
+                if(n <= 0)
+                    continue;
+                depth = features_[index].depth / n;
+            }
+            else
+            {
+                const float n = historyOutput_[index].w;
+                depth = n > 0 ? historyFeatures_[index].depth / n : 0;
+            }
+
+            // direction and distance of the samples from the previous eye.
+            // 0 is a miss of the volume, like the depth feature
+
+            const Float3 d = computeCameraRay(x, y);
+            Float3 prevDir = d;
+            float prevDepth = 0;
+            if(depth > 0)
+            {
+                const Float3 toPos = eye_ + depth * d - prevEye_;
+                prevDepth = toPos.length();
+                prevDir   = toPos / prevDepth;
+            }
+
+            const float t = prevPlane / dot(prevDir, prevNor);
+            if(!(t > 0))
+                continue;
+            const Float3 onPlane = t * prevDir - prevA;
+            const float px = dot(onPlane, prevRight) * invRightLength2 * size_.x - 0.5f;
+            const float py = dot(onPlane, prevDown) * invDownLength2 * size_.y - 0.5f;
+            if(px <= -1 || py <= -1 || px >= size_.x || py >= size_.y)
+                continue;
+
+            // bilinear taps of the per-sample means, without the rejected ones
+
+            const int x0 = static_cast<int>(std::floor(px));
+            const int y0 = static_cast<int>(std::floor(py));
+            const float fx = px - x0, fy = py - y0;
+
+            Float3 radiance = Float3(0);
+            Float2 moments = Float2(0);
+            PixelFeatures features;
+            float samples = 0, weightSum = 0;
+
+            for(int ty = 0; ty < 2; ++ty)
+            {
+                const int qy = y0 + ty;
+                if(qy < 0 || qy >= size_.y)
+                    continue;
+
+                for(int tx = 0; tx < 2; ++tx)
+                {
+                    const int qx = x0 + tx;
+                    if(qx < 0 || qx >= size_.x)
+                        continue;
+
+                    const int q = qy * size_.x + qx;
+                    const Float4 &h = historyOutput_[q];
+                    if(h.w <= 0)
+                        continue;
+
+                    const float histDepth = historyFeatures_[q].depth / h.w;
+                    if((histDepth > 0) != (prevDepth > 0) ||
+                       std::abs(histDepth - prevDepth) > temporal_.depthTolerance * histDepth)
+                        continue;
+
+                    const float weight = (tx ? fx : 1 - fx) * (ty ? fy : 1 - fy);
+                    const float scale  = weight / h.w;
+
+                    radiance.x += scale * h.x;
+                    radiance.y += scale * h.y;
+                    radiance.z += scale * h.z;
+                    moments.x  += scale * historyMoments_[q].x;
+                    moments.y  += scale * historyMoments_[q].y;
+                    addFeatures(features, {
+                        scale * historyFeatures_[q].albedo,
+                        scale * historyFeatures_[q].depth,
+                        scale * historyFeatures_[q].transmittance });
+                    samples   += weight * h.w;
+                    weightSum += weight;
+                }
+            }
+
+            if(weightSum <= 0)
+                continue;
+
+            // a partly rejected footprint is less trusted
+
+            const float count = weightSum *
+                (std::min)(samples / weightSum, float(temporal_.maxHistorySamples));
+            const float scale = count / weightSum;
+
+            output_[index] += Float4(scale * radiance, count);
+            moments_[index].x += scale * moments.x;
+            moments_[index].y += scale * moments.y;
+            addFeatures(features_[index], {
+                scale * features.albedo, scale * features.depth, scale * features.transmittance });
+        }
+    });
+}
+
+void CPUVolumeRenderer::renderReSTIR()
+{
+    const int pixelCount = size_.product();
+    const int pathCount  = pixelCount * UNIFORM_SAMPLES;
+
+    if(static_cast<int>(restirHistory_.size()) != pathCount || discardHistory_)
+        restirHistoryValid_ = false;
+
+    restirPaths_.resize(pixelCount);
+    restirVertices_.resize(pathCount);
+    restirRadiance_.resize(pathCount);
+    restirFeatures_.resize(pathCount);
+    restirReservoirs_.resize(pathCount);
+    restirTemporal_.resize(pathCount);
+    restirHistory_.resize(pathCount);
+
+    // paths without the direct light of their first scattering, and
+    // candidates for it
+
+    parallelFor(0, size_.y, [&](int y)
+    {
+        for(int x = 0; x < size_.x; ++x)
+        {
+            const int index = y * size_.x + x;
+            restirPaths_[index] = 0;
+            if(!getSampleCount(x, y))
+                continue;
+
+            uint32_t &rng = seeds_[index];
+            const Float3 d = computeCameraRay(x, y);
+            const int firstPath = index * UNIFORM_SAMPLES;
+
+            for(int s = 0; s < UNIFORM_SAMPLES; ++s)
+                restirVertices_[firstPath + s].valid = false;
+
+            Float3 o;
+            if(!volume_->findEntry(eye_, d, o))
+            {
+                restirPaths_[index]        = 1;
+                restirRadiance_[firstPath] = envir_->evalEnvirLight(d);
+                restirFeatures_[firstPath] = { Float3(0), 0, 1 };
+                continue;
+            }
+
+            const uint32_t firstSample = discardHistory_ ?
+                0 : static_cast<uint32_t>(output_[index].w);
+            restirPaths_[index] = UNIFORM_SAMPLES;
+
+            for(int s = 0; s < UNIFORM_SAMPLES; ++s)
+            {
+                const int path = firstPath + s;
+                PrimaryVertex &vertex = restirVertices_[path];
+                restirRadiance_[path] = trace(
+                    o, d, rng, { { x, y }, firstSample + s }, restirFeatures_[path], &vertex);
+
+                EnvirReservoir reservoir;
+                if(vertex.valid)
+                {
+                    for(int c = 0; c < restir_.candidates; ++c)
+                    {
+                        Float3 wi; float pdf;
+                        envir_->sampleEnvirLight(rng, wi, pdf);
+                        const float target = evalEnvirTarget(vertex, wi);
+                        reservoir.update(wi, pdf > 0 ? target / pdf : 0, target, randFloat(rng));
+                    }
+                }
+                reservoir.finalize();
+                restirReservoirs_[path] = reservoir;
+            }
+        }
+    });
+
+    // temporal reuse, with the history of the same path slot
+
+    const bool temporal = restir_.temporalReuse && restirHistoryValid_;
+    const float maxHistoryM = static_cast<float>(restir_.historyLimit * restir_.candidates);
+
+    parallelFor(0, size_.y, [&](int y)
+    {
+        for(int x = 0; x < size_.x; ++x)
+        {
+            const int index = y * size_.x + x;
+            uint32_t &rng = seeds_[index];
+
+            for(int s = 0; s < restirPaths_[index]; ++s)
+            {
+                const int path = index * UNIFORM_SAMPLES + s;
+                const PrimaryVertex &vertex = restirVertices_[path];
+                if(!vertex.valid)
+                    continue;
+
+                const EnvirReservoir &fresh = restirReservoirs_[path];
+
+                EnvirReservoir reservoir;
+                reservoir.merge(fresh, fresh.targetPdf, randFloat(rng));
+                if(temporal)
+                {
+                    EnvirReservoir history = restirHistory_[path];
+                    history.M = (std::min)(history.M, maxHistoryM);
+                    if(history.M > 0)
+                        reservoir.merge(history, evalEnvirTarget(vertex, history.dir), randFloat(rng));
+                }
+                reservoir.finalize();
+                restirTemporal_[path] = reservoir;
+            }
+        }
+    });
+
+    // spatial reuse of the temporal reservoirs of neighbors, then the shadow
+    // ray of the surviving direction. the results are the next history
+
+    std::atomic<uint64_t> tracedPaths = 0;
+    parallelFor(0, size_.y, [&](int y)
+    {
+        uint64_t rowPaths = 0;
+        for(int x = 0; x < size_.x; ++x)
+        {
+            const int index = y * size_.x + x;
+            const int firstPath = index * UNIFORM_SAMPLES;
+
+            // pixels between interleaved ones keep their history
+            if(!restirPaths_[index])
+            {
+                for(int s = 0; s < UNIFORM_SAMPLES; ++s)
+                    restirReservoirs_[firstPath + s] = restirHistory_[firstPath + s];
+                continue;
+            }
+            for(int s = restirPaths_[index]; s < UNIFORM_SAMPLES; ++s)
+                restirReservoirs_[firstPath + s] = {};
+
+            uint32_t &rng = seeds_[index];
+
+            Float4 accu = Float4(0);
+            Float2 moments = Float2(0);
+            PixelFeatures features;
+
+            for(int s = 0; s < restirPaths_[index]; ++s)
+            {
+                const int path = firstPath + s;
+                const PrimaryVertex &vertex = restirVertices_[path];
+
+                Float3 rad = restirRadiance_[path];
+                EnvirReservoir reservoir;
+                if(vertex.valid)
+                {
+                    const EnvirReservoir &own = restirTemporal_[path];
+                    reservoir.merge(own, own.targetPdf, randFloat(rng));
+
+                    const int radius = restir_.spatialRadius;
+                    for(int n = 0; n < restir_.spatialNeighbors; ++n)
+                    {
+                        const int qx = x + static_cast<int>(randFloat(rng) * (2 * radius + 0.999f)) - radius;
+                        const int qy = y + static_cast<int>(randFloat(rng) * (2 * radius + 0.999f)) - radius;
+                        if(qx < 0 || qy < 0 || qx >= size_.x || qy >= size_.y || (qx == x && qy == y))
+                            continue;
+
+                        const int neighbor = (qy * size_.x + qx) * UNIFORM_SAMPLES + s;
+                        if(!restirPaths_[qy * size_.x + qx] || !restirVertices_[neighbor].valid)
+                            continue;
+
+                        const EnvirReservoir &other = restirTemporal_[neighbor];
+                        reservoir.merge(other, evalEnvirTarget(vertex, other.dir), randFloat(rng));
+                    }
+                    reservoir.finalize();
+
+                    if(reservoir.W > 0)
+                    {
+                        rad += vertex.coef * estimateDirectIllum(
+                            *volume_, vertex.pos, vertex.wo, reservoir.dir, 1 / reservoir.W, rng);
+                    }
+                }
+                restirReservoirs_[path] = reservoir;
+
+                const float lum = luminance(rad);
+                accu      += Float4(rad, 1);
+                moments.x += lum;
+                moments.y += lum * lum;
+                addFeatures(features, restirFeatures_[path]);
+            }
+
+            rowPaths += static_cast<uint64_t>(accu.w);
+            addToOutput(index, accu, moments, features);
+        }
+        tracedPaths += rowPaths;
+    });
+
+    restirHistory_.swap(restirReservoirs_);
+    restirHistoryValid_ = true;
+    pathCount_ += tracedPaths;
+}
+
+int CPUVolumeRenderer::getSampleCount(int x, int y) const
+{
+    const int stride = resolution_.getStride();
+    if(stride > 1 && getInterleaveRank(x % stride, y % stride, stride) != resolution_.getPhase())
+        return 0;
+    return sampleCounts_.empty() ? UNIFORM_SAMPLES : sampleCounts_[y * size_.x + x];
+}
+
+Float3 CPUVolumeRenderer::computeCameraRay(int x, int y) const
+{
+    const float u = (x + 0.5f) / size_.x;
+    const float v = (y + 0.5f) / size_.y;
+
+    const Float3 top    = frustum_.frustumA + u * (frustum_.frustumB - frustum_.frustumA);
+    const Float3 bottom = frustum_.frustumC + u * (frustum_.frustumD - frustum_.frustumC);
+    return (top + v * (bottom - top)).normalize();
+}
+
+PacketTraceContext CPUVolumeRenderer::createPacketTraceContext() const
+{
+    PacketTraceContext ctx = {};
+
+    const Grid *density = volume_->getDensity();
+    const Grid *albedo  = volume_->getAlbedo();
+
+    ctx.density        = density->getData();
+    ctx.densitySize[0] = density->getSize().x;
+    ctx.densitySize[1] = density->getSize().y;
+    ctx.densitySize[2] = density->getSize().z;
+    ctx.densityScale   = volume_->getDensityScale();
+    ctx.invMaxDensity  = 1 / (std::max)(0.001f, volume_->getMaxDensity());
+
+    ctx.albedo        = albedo->getData();
+    ctx.albedoSize[0] = albedo->getSize().x;
+    ctx.albedoSize[1] = albedo->getSize().y;
+    ctx.albedoSize[2] = albedo->getSize().z;
+
+    const Float3 &lower = volume_->getLower(), &upper = volume_->getUpper();
+    const Float3 invExtent = Float3(1) / (upper - lower);
+    for(int i = 0; i < 3; ++i)
+    {
+        ctx.lower[i]     = lower[i];
+        ctx.upper[i]     = upper[i];
+        ctx.invExtent[i] = invExtent[i];
+    }
+
+    ctx.g  = volume_->getG();
+    ctx.g2 = ctx.g * ctx.g;
+
+    ctx.maxDepth = maxDepth_;
+
+    ctx.transmittanceRoulette = estimator_ == TransmittanceEstimator::RatioRoulette;
+
+    ctx.envir            = envir_;
+    ctx.sampleEnvirLight = &sampleEnvirLightCallback;
+    ctx.evalEnvirLight   = &evalEnvirLightCallback;
+
+    return ctx;
+}
+
+uint64_t CPUVolumeRenderer::renderTile(int tileIndex)
+{
+    const int tileCountX = (size_.x + TILE_SIZE - 1) / TILE_SIZE;
+    const int xBeg = (tileIndex % tileCountX) * TILE_SIZE;
+    const int yBeg = (tileIndex / tileCountX) * TILE_SIZE;
+    const int xEnd = (std::min)(xBeg + TILE_SIZE, size_.x);
+    const int yEnd = (std::min)(yBeg + TILE_SIZE, size_.y);
+
+    uint64_t pathCount = 0;
+    for(int y = yBeg; y < yEnd; ++y)
+    {
+        for(int x = xBeg; x < xEnd; ++x)
+        {
+            const int index = y * size_.x + x;
+            const int sampleCount = getSampleCount(x, y);
+            if(!sampleCount)
+                continue;
+
+            const Float3 d = computeCameraRay(x, y);
+
+            Float2 moments;
+            PixelFeatures features;
+            const Float4 accu = accumulate(
+                { x, y }, d, sampleCount, seeds_[index], moments, features);
+            pathCount += static_cast<uint64_t>(accu.w);
+
+            addToOutput(index, accu, moments, features);
+        }
+    }
+
+    return pathCount;
+}
+
+uint64_t CPUVolumeRenderer::renderTilePackets(int tileIndex, const PacketTraceContext &ctx)
+{
+    const int width = static_cast<int>(simdLevel_);
+
+    const int tileCountX = (size_.x + TILE_SIZE - 1) / TILE_SIZE;
+    const int xBeg = (tileIndex % tileCountX) * TILE_SIZE;
+    const int yBeg = (tileIndex / tileCountX) * TILE_SIZE;
+    const int xEnd = (std::min)(xBeg + TILE_SIZE, size_.x);
+    const int yEnd = (std::min)(yBeg + TILE_SIZE, size_.y);
+
+    uint64_t pathCount = 0;
+
+    // pixels missing the volume see the environment only. the others are
+    // queued, and each lane traces all samples of one pixel before taking
+    // the next, so that lanes stay busy when adaptive sample counts differ
+
+    struct PixelPaths
+    {
+        int    index;
+        int    sampleCount;
+        Float3 o, d;
+    };
+
+    PixelPaths pixels[TILE_SIZE * TILE_SIZE];
+    int pixelCount = 0;
+
+    for(int y = yBeg; y < yEnd; ++y)
+    {
+        for(int x = xBeg; x < xEnd; ++x)
+        {
+            const int index = y * size_.x + x;
+            const int sampleCount = getSampleCount(x, y);
+            if(!sampleCount)
+                continue;
+
+            const Float3 d = computeCameraRay(x, y);
+
+            Float3 o;
+            if(!volume_->findEntry(eye_, d, o))
+            {
+                const Float3 rad = envir_->evalEnvirLight(d);
+                const float lum = luminance(rad);
+                ++pathCount;
+                addToOutput(index, Float4(rad, 1), Float2(lum, lum * lum), { Float3(0), 0, 1 });
+                continue;
+            }
+
+            pixels[pixelCount++] = { index, sampleCount, o, d };
+        }
+    }
+
+    PacketRays rays;
+    int    lanePixels[MAX_PACKET_WIDTH];
+    int    laneSamples[MAX_PACKET_WIDTH];
+    Float4 accu[MAX_PACKET_WIDTH];
+    Float2 moments[MAX_PACKET_WIDTH];
+    PixelFeatures features[MAX_PACKET_WIDTH];
+
+    for(int l = 0; l < width; ++l)
+    {
+        rays.ox[l] = rays.oy[l] = rays.oz[l] = 0;
+        rays.dx[l] = rays.dz[l] = 0;
+        rays.dy[l] = 1;
+        rays.rng[l] = 1;
+        lanePixels[l] = -1;
+    }
+
+    for(int nextPixel = 0;;)
+    {
+        rays.activeMask = 0;
+        for(int l = 0; l < width; ++l)
+        {
+            if(lanePixels[l] < 0 && nextPixel < pixelCount)
+            {
+                const PixelPaths &pixel = pixels[nextPixel];
+                lanePixels[l]  = nextPixel++;
+                laneSamples[l] = pixel.sampleCount;
+                accu[l]        = Float4(0);
+                moments[l]     = Float2(0);
+                features[l]    = {};
+
+                rays.ox[l] = pixel.o.x; rays.oy[l] = pixel.o.y; rays.oz[l] = pixel.o.z;
+                rays.dx[l] = pixel.d.x; rays.dy[l] = pixel.d.y; rays.dz[l] = pixel.d.z;
+                rays.rng[l] = seeds_[pixel.index];
+            }
+
+            if(lanePixels[l] >= 0)
+                rays.activeMask |= 1 << l;
+        }
+
+        if(!rays.activeMask)
+            break;
+
+        packetFunc_(ctx, rays);
+
+        for(int l = 0; l < width; ++l)
+        {
+            if(!(rays.activeMask & (1 << l)))
+                continue;
+
+            const float lum = luminance(Float3(rays.r[l], rays.g[l], rays.b[l]));
+            accu[l]      += Float4(rays.r[l], rays.g[l], rays.b[l], 1);
+            moments[l].x += lum;
+            moments[l].y += lum * lum;
+
+            const PixelPaths &pixel = pixels[lanePixels[l]];
+            addFeatures(features[l], {
+                Float3(rays.albedoR[l], rays.albedoG[l], rays.albedoB[l]),
+                (pixel.o - eye_).length() + rays.firstDistance[l],
+                rays.transmittance[l] });
+
+            if(--laneSamples[l])
+                continue;
+
+            const int index = pixel.index;
+            seeds_[index] = rays.rng[l];
+
+            pathCount += static_cast<uint64_t>(accu[l].w);
+            addToOutput(index, accu[l], moments[l], features[l]);
+
+            lanePixels[l] = -1;
+        }
+    }
+
+    return pathCount;
+}
@@ -0,0 +1,411 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "camera.h"
+#include "denoiser.h"
+#include "envir_map.h"
+#include "envir_product.h"
+#include "medium.h"
+#include "packet_tracer.h"
+#include "path_guiding.h"
+#include "resolution.h"
+#include "restir.h"
+#include "sampler.h"
+#include "task_scheduler.h"
+#include "transmittance_cache.h"
+
+// per-pixel sample counts from the luminance variance of the samples so
+// far. each frame spreads the samples of a uniform frame (two per pixel)
+// over the pixels that have not converged, in proportion to the squared
+// error one more sample removes from their mean. pixels whose relative
+// standard error is below threshold get none
+struct AdaptiveSamplingParams
+{
+    bool enabled = false;
+
+    // relative standard error of the pixel mean at which a pixel stops
+    float threshold = 0.02f;
+
+    // traced at two per frame before the variance of a pixel is trusted
+    int minSamples = 8;
+
+    // per pixel and frame
+    int maxSamples = 16;
+};
+
+// keeps the accumulated output when the camera moves: each pixel of the
+// first frame after the move is traced as usual, then finds its history in
+// the previous view through the mean first scattering distance of its new
+// samples (the direction alone for pixels missing the volume). bilinear
+// taps whose own distance differs by more than depthTolerance are taken as
+// disoccluded, and the history gets the weights of the accepted taps
+struct TemporalReprojectionParams
+{
+    bool enabled = false;
+
+    // history samples kept per pixel at a move, so that resampled history
+    // fades out instead of dominating the new samples
+    int maxHistorySamples = 32;
+
+    // relative to the distance
+    float depthTolerance = 0.25f;
+};
+
+// how the direct light of a scattering is sampled
+enum class DirectLightSampling
+{
+    Light   = 0, // envir importance only
+    MIS     = 1, // envir importance and the phase sample of the next bounce, combined by mis
+    Product = 2  // envir importance x phase lobe, combined with the phase sample by mis
+};
+
+// "light", "mis" or "product"
+const char *getDirectLightSamplingName(DirectLightSampling sampling);
+
+enum class MISHeuristic
+{
+    Balance = 0,
+    Power   = 1 // exponent 2
+};
+
+// "balance" or "power"
+const char *getMISHeuristicName(MISHeuristic heuristic);
+
+// with mis, the phase sample of the next bounce also counts when it leaves
+// the volume. the last scattering of a path has no next bounce and keeps
+// its light sample alone
+struct DirectLightParams
+{
+    DirectLightSampling sampling  = DirectLightSampling::Light;
+    MISHeuristic        heuristic = MISHeuristic::Power;
+
+    // of the importance pyramid of product sampling, see EnvirProductSampler
+    int productTableSize = 256;
+};
+
+// multithreaded cpu counterpart of RawVolumeRenderer and asset/raw.hlsl
+class CPUVolumeRenderer
+{
+public:
+
+    // cancels and waits for a transmittance cache build, which reads the
+    // grids of the volume
+    ~CPUVolumeRenderer();
+
+    void initialize(const Int2 &size);
+
+    void resize(const Int2 &size);
+
+    // tiles are rendered by up to count workers of the global task
+    // scheduler. 0 means all of them
+    void setThreadCount(int count);
+
+    // packets of 4/8/16 paths when above Scalar. the level is clamped to
+    // the widest one supported by the cpu. initialize uses the widest
+    void setSimdLevel(SimdLevel level);
+
+    SimdLevel getSimdLevel() const;
+
+    // whether the last render traced packets. features only the scalar
+    // tracer implements fall back to it whatever the simd level
+    bool usedPackets() const;
+
+    void setTracer(int maxDepth);
+
+    // residual ratio tracking is only implemented by the scalar tracer,
+    // so packets are not used with it
+    void setTransmittanceEstimator(TransmittanceEstimator estimator);
+
+    // decomposition tracking is only implemented by the scalar tracer too
+    void setFreeFlightSampler(FreeFlightSampler sampler);
+
+    // coarser density levels by path depth or ray footprint. the volume
+    // needs a mip chain, and packets are not used with a lod mode
+    void setDensityLod(const DensityLodParams &params);
+
+    void setAdaptiveSampling(const AdaptiveSamplingParams &params);
+
+    // trains from the paths of the following frames, and restarts with
+    // setVolume. scalar tracer only
+    void setPathGuiding(const PathGuidingParams &params);
+
+    // training iterations finished so far
+    int getGuidingIteration() const;
+
+    const PathGuide &getPathGuide() const;
+
+    // light samples toward the dominant envir directions read the cached
+    // transmittance once it is built on background tasks, and track shadow
+    // rays until then. it is rebuilt only when the density or its lod, the
+    // density scale, the volume bounds, params or setEnvir change, not on
+    // camera moves. scalar tracer only
+    void setTransmittanceCache(const TransmittanceCacheParams &params);
+
+    // nullptr until a build is done
+    const TransmittanceCache *getTransmittanceCache() const;
+
+    // starts the build if it is due, and blocks until it is done
+    void waitTransmittanceCache();
+
+    // packets are only used with DirectLightSampling::Light. the product
+    // sampler is built at the next render after a change of envir
+    void setDirectLight(const DirectLightParams &params);
+
+    // camera moves discard the history when disabled
+    void setTemporalReprojection(const TemporalReprojectionParams &params);
+
+    // interleaved frames under the budget, controlled by the time of render
+    void setDynamicResolution(const DynamicResolutionParams &params);
+
+    // reservoir resampling of the envir light at the first scattering of
+    // camera paths. scalar tracer only, with two paths per traced pixel
+    // whatever the adaptive sample counts, and resampled shadow rays
+    // through the full resolution density
+    void setReSTIR(const ReSTIRParams &params);
+
+    // scrambles the per-pixel random seeds. 0 gives the seeds of raw.hlsl
+    void setSeed(uint32_t seed);
+
+    // low-discrepancy samples for the first draws of each bounce, see
+    // SampleDimension. only the scalar tracer reads them, so packets are
+    // used with SamplerType::Random only
+    void setSampler(SamplerType type);
+
+    void setCamera(const Camera &camera);
+
+    // also invalidates what is derived from the envir, even if it is the
+    // same object
+    void setEnvir(const EnvirMap &envir);
+
+    // packets need the dense grid, so streamed densities are traced by the
+    // scalar tracer. a running transmittance cache build is cancelled and
+    // waited for, so the previous volume may be released afterwards
+    void setVolume(const VolumeMedium &volume);
+
+    void discardHistory();
+
+    const Int2 &getSize() const;
+
+    // per-pixel (accumulated radiance, sample count), like the Output texture
+    const std::vector<Float4> &getOutput() const;
+
+    // per-pixel (luminance sum, squared luminance sum) of the samples in
+    // the output
+    const std::vector<Float2> &getMoments() const;
+
+    // per-pixel sums of the denoiser guides of the samples in the output
+    const std::vector<PixelFeatures> &getFeatures() const;
+
+    // number of traced camera paths since initialization
+    uint64_t getPathCount() const;
+
+    // pixels that got no samples in the last frame of adaptive sampling
+    int getConvergedPixelCount() const;
+
+    // of the last render
+    double getFrameMs() const;
+
+    // of the last render, 1 for whole frames
+    int getInterleaveStride() const;
+
+    // per-pixel (mean radiance, 1), where pixels without samples yet take
+    // the mean of the pixels with samples around them, up to the stride of
+    // the last frame away
+    void getUpsampledOutput(std::vector<Float4> &result) const;
+
+    void render();
+
+private:
+
+    static constexpr int TILE_SIZE = 16;
+
+    // per pixel and frame, like raw.hlsl
+    static constexpr int UNIFORM_SAMPLES = 2;
+
+    // where the sampler is asked for the dimensions of a path
+    struct PathSample
+    {
+        Int2     pixel;
+        uint32_t index;
+    };
+
+    // what the transmittance cache depends on
+    struct TransmittanceCacheKey
+    {
+        const void *density         = nullptr; // VolumeMedium::getDensitySource
+        float       lod             = 0;
+        float       densityScale    = 0;
+        Float3      lower;
+        Float3      upper;
+        uint64_t    envirGeneration = 0;
+        int         lobeCount       = 0;
+        float       lobeAngle       = 0;
+        int         resolution      = 0;
+
+        bool operator==(const TransmittanceCacheKey &) const = default;
+    };
+
+    // shared with the task building it
+    struct TransmittanceCacheBuild
+    {
+        TransmittanceCache cache;
+        std::atomic<bool>  done   = false;
+        std::atomic<bool>  cancel = false;
+    };
+
+    // starts a background build when the key changed
+    void updateTransmittanceCache();
+
+    // cancels an unfinished build and waits for its task, which reads the
+    // grids of the volume it started with. rethrows what the build threw,
+    // e.g. a failed brick read
+    void cancelTransmittanceCache();
+
+    // of the light sample wi, drawn with solid angle pdf
+    Float3 estimateDirectIllum(
+        const VolumeMedium &medium, const Float3 &o, const Float3 &wo,
+        const Float3 &wi, float pdf, uint32_t &rng) const;
+
+    // first scattering of a camera path, whose direct light is left to
+    // reservoir resampling
+    struct PrimaryVertex
+    {
+        Float3 pos;
+        Float3 wo;
+        Float3 coef;
+        bool   valid = false;
+    };
+
+    // features gets the denoiser guides of the path. with primary, the
+    // direct light of the first scattering is not estimated, and primary
+    // gets its vertex instead
+    Float3 trace(
+        Float3 o, Float3 d, uint32_t &rng, const PathSample &sample,
+        PixelFeatures &features, PrimaryVertex *primary) const;
+
+    // of the envir sampling of the direct light mode
+    float pdfDirectLight(const Float3 &wo, const Float3 &wi) const;
+
+    float computeMISWeight(float pdf, float otherPdf) const;
+
+    // of the next bounce, drawn from the phase function or the guide
+    float pdfScattering(const DirectionalTree *guideTree, const Float3 &wo, const Float3 &wi) const;
+
+    // envir luminance x phase function, the target pdf of the reservoirs
+    float evalEnvirTarget(const PrimaryVertex &vertex, const Float3 &wi) const;
+
+    // the tiles of a frame with reservoir resampling
+    void renderReSTIR();
+
+    // sampleCount paths, or a single envir lookup if the ray misses the
+    // volume. moments and features get the sums over the samples
+    Float4 accumulate(
+        const Int2 &pixel, const Float3 &d, int sampleCount,
+        uint32_t &rng, Float2 &moments, PixelFeatures &features) const;
+
+    void addToOutput(
+        int index, const Float4 &accu, const Float2 &moments, const PixelFeatures &features);
+
+    // fills sampleCounts_ for the next frame
+    void computeSampleCounts();
+
+    // paths of a pixel in the current frame, 0 between interleaved pixels
+    int getSampleCount(int x, int y) const;
+
+    // adds the history buffers, seen from prevEye_ / prevFrustum_, to the
+    // fresh samples of the current frame
+    void reprojectHistory();
+
+    Float3 computeCameraRay(int x, int y) const;
+
+    PacketTraceContext createPacketTraceContext() const;
+
+    // returns the number of traced paths
+    uint64_t renderTile(int tileIndex);
+
+    uint64_t renderTilePackets(int tileIndex, const PacketTraceContext &ctx);
+
+    Int2 size_;
+    int  threadCount_ = 0;
+
+    SimdLevel       simdLevel_  = SimdLevel::Scalar;
+    PacketTraceFunc packetFunc_ = nullptr;
+
+    int    maxDepth_ = 1;
+    TransmittanceEstimator estimator_ = TransmittanceEstimator::RatioCutoff;
+    FreeFlightSampler      freeFlight_ = FreeFlightSampler::Delta;
+    DensityLodParams       lod_;
+    AdaptiveSamplingParams adaptive_;
+    DirectLightParams      direct_;
+    TemporalReprojectionParams temporal_;
+    ResolutionController       resolution_;
+    ReSTIRParams               restir_;
+    uint32_t               seed_ = 0;
+    PixelSampler           sampler_;
+    Float3 eye_;
+    Camera::FrustumDirections frustum_ = {};
+    bool   discardHistory_ = true;
+
+    // camera of the output before the first move since the last frame
+    bool   cameraMoved_ = false;
+    Float3 prevEye_;
+    Camera::FrustumDirections prevFrustum_ = {};
+
+    const EnvirMap     *envir_  = nullptr;
+    const VolumeMedium *volume_ = nullptr;
+
+    uint64_t envirGeneration_ = 0; // of setEnvir calls
+
+    // trained by the paths of the const tracer, with lock-free splats
+    PathGuidingParams   guiding_;
+    mutable PathGuide   guide_;
+    const VolumeMedium *guideVolume_    = nullptr;
+    int                 guideIteration_ = 0;
+    int                 guideFrames_    = 0;
+
+    EnvirProductSampler product_;
+    const EnvirMap     *productEnvir_ = nullptr;
+    int                 productSize_  = 0;
+
+    TransmittanceCacheParams                 transCache_;
+    TransmittanceCacheKey                    transCacheKey_;
+    std::shared_ptr<TransmittanceCacheBuild> transCacheBuild_;
+    const TransmittanceCache                *transCacheReady_ = nullptr; // of the frame
+
+    std::vector<uint32_t> seeds_;
+    std::vector<Float4>   output_;
+    std::vector<Float2>   moments_;
+    std::vector<PixelFeatures> features_;
+
+    // the output of the previous view while reprojecting
+    std::vector<Float4>        historyOutput_;
+    std::vector<Float2>        historyMoments_;
+    std::vector<PixelFeatures> historyFeatures_;
+
+    // of the paths of the frame with reservoir resampling, UNIFORM_SAMPLES
+    // per pixel. restirPaths_ has the paths of each pixel: 0 if it is not
+    // traced, 1 if it misses the volume
+    std::vector<uint8_t>        restirPaths_;
+    std::vector<PrimaryVertex>  restirVertices_;
+    std::vector<Float3>         restirRadiance_;
+    std::vector<PixelFeatures>  restirFeatures_;
+    std::vector<EnvirReservoir> restirReservoirs_;
+    std::vector<EnvirReservoir> restirTemporal_;
+    std::vector<EnvirReservoir> restirHistory_;
+    bool                        restirHistoryValid_ = false;
+
+    // of the current frame with adaptive sampling
+    std::vector<uint8_t> sampleCounts_;
+    int                  convergedCount_ = 0;
+
+    double frameMs_     = 0;
+    bool   usedPackets_ = false;
+
+    std::atomic<uint64_t> pathCount_ = 0;
+
+    // background priority. last, so that it is destroyed first
+    std::unique_ptr<TaskGroup> transCacheTasks_;
+};
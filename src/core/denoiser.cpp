@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cmath>
+
+#include "denoiser.h"
+#include "task_scheduler.h"
+
+namespace
+{
+    // b3 spline, the 1d factor of the 5x5 a-trous kernel
+    constexpr float KERNEL[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+
+    constexpr float GAUSSIAN3[3] = { 0.25f, 0.5f, 0.25f };
+
+    float luminance(const Float3 &c)
+    {
+        return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+    }
+}
+
+void Denoiser::setParams(const DenoiserParams &params)
+{
+    params_ = params;
+}
+
+const DenoiserParams &Denoiser::getParams() const
+{
+    return params_;
+}
+
+void Denoiser::denoise(
+    const Int2                       &size,
+    const std::vector<Float4>        &output,
+    const std::vector<Float2>        &moments,
+    const std::vector<PixelFeatures> &features,
+    std::vector<Float4>              &result)
+{
+    const int pixelCount = size.product();
+
+    size_ = size;
+    guides_.resize(pixelCount);
+    color_.resize(pixelCount);
+    nextColor_.resize(pixelCount);
+    variance_.resize(pixelCount);
+    nextVariance_.resize(pixelCount);
+
+    // per-pixel means, and the variance of the luminance mean. a single
+    // sample tells nothing about it, so it is taken as 100%
+
+    parallelFor(0, size.y, [&](int y)
+    {
+        for(int x = 0; x < size.x; ++x)
+        {
+            const int index = y * size.x + x;
+            const float n = output[index].w;
+            if(n <= 0)
+            {
+                guides_[index]       = { Float3(0), 0, 1 };
+                color_[index]        = Float3(0);
+                nextVariance_[index] = 0;
+                continue;
+            }
+
+            const Float4 &o = output[index];
+            const PixelFeatures &f = features[index];
+
+            guides_[index] = { f.albedo / n, f.depth / n, f.transmittance / n };
+            color_[index]  = Float3(o.x, o.y, o.z) / n;
+
+            const float mean = moments[index].x / n;
+            nextVariance_[index] = n > 1 ?
+                (std::max)(0.0f, moments[index].y / n - mean * mean) / (n - 1) : mean * mean;
+        }
+    });
+
+    // the variance of few samples is noisy itself, and is blurred once
+
+    parallelFor(0, size.y, [&](int y)
+    {
+        for(int x = 0; x < size.x; ++x)
+        {
+            float sum = 0;
+            for(int dy = -1; dy <= 1; ++dy)
+            {
+                const int qy = (std::min)((std::max)(y + dy, 0), size.y - 1);
+                for(int dx = -1; dx <= 1; ++dx)
+                {
+                    const int qx = (std::min)((std::max)(x + dx, 0), size.x - 1);
+                    sum += GAUSSIAN3[dy + 1] * GAUSSIAN3[dx + 1] * nextVariance_[qy * size.x + qx];
+                }
+            }
+            variance_[y * size.x + x] = sum;
+        }
+    });
+
+    for(int i = 0; i < params_.iterations; ++i)
+    {
+        filterPass(1 << i);
+        color_.swap(nextColor_);
+        variance_.swap(nextVariance_);
+    }
+
+    result.resize(pixelCount);
+    for(int i = 0; i < pixelCount; ++i)
+        result[i] = Float4(color_[i], 1);
+}
+
+void Denoiser::filterPass(int step)
+{
+    const float invSigmaAlbedo        = 1 / params_.sigmaAlbedo;
+    const float invSigmaTransmittance = 1 / params_.sigmaTransmittance;
+
+    parallelFor(0, size_.y, [&](int y)
+    {
+        for(int x = 0; x < size_.x; ++x)
+        {
+            const int index = y * size_.x + x;
+            const Guide &gp = guides_[index];
+            const float lumP = luminance(color_[index]);
+            const float invSigmaLum = 1 / (params_.sigmaLuminance * std::sqrt(variance_[index]) + 1e-6f);
+
+            Float3 colorSum = Float3(0);
+            float varianceSum = 0, weightSum = 0;
+
+            for(int ky = 0; ky < 5; ++ky)
+            {
+                const int qy = y + (ky - 2) * step;
+                if(qy < 0 || qy >= size_.y)
+                    continue;
+
+                for(int kx = 0; kx < 5; ++kx)
+                {
+                    const int qx = x + (kx - 2) * step;
+                    if(qx < 0 || qx >= size_.x)
+                        continue;
+
+                    const int q = qy * size_.x + qx;
+                    const Guide &gq = guides_[q];
+
+                    const Float3 da = gp.albedo - gq.albedo;
+                    const float maxDepth = (std::max)(gp.depth, gq.depth);
+
+                    const float exponent =
+                        std::abs(lumP - luminance(color_[q])) * invSigmaLum +
+                        std::abs(gp.depth - gq.depth) / (params_.sigmaDepth * maxDepth + 1e-6f) +
+                        (std::abs(da.x) + std::abs(da.y) + std::abs(da.z)) * invSigmaAlbedo +
+                        std::abs(gp.transmittance - gq.transmittance) * invSigmaTransmittance;
+
+                    const float weight = KERNEL[kx] * KERNEL[ky] * std::exp(-exponent);
+
+                    colorSum.x  += weight * color_[q].x;
+                    colorSum.y  += weight * color_[q].y;
+                    colorSum.z  += weight * color_[q].z;
+                    varianceSum += weight * weight * variance_[q];
+                    weightSum   += weight;
+                }
+            }
+
+            // the center has weight KERNEL[2]^2 > 0
+            nextColor_[index]    = colorSum / weightSum;
+            nextVariance_[index] = varianceSum / (weightSum * weightSum);
+        }
+    });
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "common.h"
+
+// guides of the denoiser, summed over the samples of a pixel like the
+// radiance of CPUVolumeRenderer::getOutput: the albedo at the first
+// scattering of each camera path, its distance from the eye (the box exit
+// if the path leaves the volume unscattered), and the fraction of paths
+// leaving unscattered, i.e. the transmittance of the camera ray. pixels
+// missing the volume have a depth of 0 and a transmittance of 1
+struct PixelFeatures
+{
+    Float3 albedo        = Float3(0);
+    float  depth         = 0;
+    float  transmittance = 0;
+};
+
+struct DenoiserParams
+{
+    // passes of the 5x5 kernel, at steps 1, 2, 4, ...
+    int iterations = 5;
+
+    // luminance differences in standard deviations of the pixel mean
+    float sigmaLuminance = 4;
+
+    // depth differences relative to the depth
+    float sigmaDepth = 0.2f;
+
+    float sigmaAlbedo        = 0.1f;
+    float sigmaTransmittance = 0.3f;
+};
+
+// edge-avoiding a-trous wavelet filter (Dammertz et al.) of accumulated
+// radiance. like the spatial filter of SVGF, the luminance weight is scaled
+// by the standard deviation of each pixel mean, estimated from the
+// luminance moments and filtered along, so that converged pixels stay
+// sharp. cpu counterpart of asset/denoise.hlsl
+class Denoiser
+{
+public:
+
+    void setParams(const DenoiserParams &params);
+
+    const DenoiserParams &getParams() const;
+
+    // output, moments and features as accumulated by CPUVolumeRenderer.
+    // result gets the denoised radiance with a sample count of 1, so that it
+    // can be saved like an accumulated output
+    void denoise(
+        const Int2                       &size,
+        const std::vector<Float4>        &output,
+        const std::vector<Float2>        &moments,
+        const std::vector<PixelFeatures> &features,
+        std::vector<Float4>              &result);
+
+private:
+
+    struct Guide
+    {
+        Float3 albedo;
+        float  depth;
+        float  transmittance;
+    };
+
+    // one pass at the given step from color_ / variance_ into the back buffers
+    void filterPass(int step);
+
+    DenoiserParams params_;
+
+    Int2 size_;
+
+    std::vector<Guide>  guides_;
+    std::vector<Float3> color_,    nextColor_;
+    std::vector<float>  variance_, nextVariance_;
+};
@@ -0,0 +1,154 @@
+#include "density_mips.h"
+#include "task_scheduler.h"
+
+const char *getDensityLodModeName(DensityLodMode mode)
+{
+    switch(mode)
+    {
+    case DensityLodMode::Off:       return "off";
+    case DensityLodMode::Depth:     return "depth";
+    case DensityLodMode::Footprint: return "footprint";
+    }
+    return "unknown";
+}
+
+float computeDensityLod(const DensityLodParams &params, int depth, float footprintVoxels)
+{
+    float lod = 0;
+    if(params.mode == DensityLodMode::Depth)
+        lod = (depth - params.startDepth + 1) * params.perBounce;
+    else if(params.mode == DensityLodMode::Footprint)
+        lod = std::log2((std::max)(1.0f, footprintVoxels));
+    return (std::max)(0.0f, (std::min)(params.maxLod, lod));
+}
+
+void DensityMipChain::build(const Grid &density)
+{
+    if(density.getFormat() != GridFormat::R32F)
+        throw std::runtime_error("density mip chain requires a R32F density grid");
+
+    density_ = &density;
+    levels_.clear();
+
+    // level 0 is stored by the grid. its max level is the grid too
+
+    levels_.push_back({ density.getSize(), {}, {} });
+
+    while(true)
+    {
+        const Int3 src = levels_.back().size;
+        if(src.x == 1 && src.y == 1 && src.z == 1)
+            break;
+
+        const Int3 dst(
+            (std::max)(1, src.x / 2), (std::max)(1, src.y / 2), (std::max)(1, src.z / 2));
+
+        const float *srcMean = levels_.size() == 1 ? density.getData() : levels_.back().mean.data();
+        const float *srcMax  = levels_.size() == 1 ? density.getData() : levels_.back().max.data();
+
+        Level level;
+        level.size = dst;
+        level.mean.resize(dst.product());
+        level.max.resize(dst.product());
+
+        parallelFor(0, dst.z, [&](int z)
+        {
+            const int z0 = z * src.z / dst.z, z1 = (z + 1) * src.z / dst.z;
+            for(int y = 0; y < dst.y; ++y)
+            {
+                const int y0 = y * src.y / dst.y, y1 = (y + 1) * src.y / dst.y;
+                for(int x = 0; x < dst.x; ++x)
+                {
+                    const int x0 = x * src.x / dst.x, x1 = (x + 1) * src.x / dst.x;
+
+                    double sum = 0;
+                    float  maxValue = 0;
+                    for(int sz = z0; sz < z1; ++sz)
+                    {
+                        for(int sy = y0; sy < y1; ++sy)
+                        {
+                            const size_t row = (size_t(sz) * src.y + sy) * src.x;
+                            for(int sx = x0; sx < x1; ++sx)
+                            {
+                                sum     += srcMean[row + sx];
+                                maxValue = (std::max)(maxValue, srcMax[row + sx]);
+                            }
+                        }
+                    }
+
+                    const size_t index = (size_t(z) * dst.y + y) * dst.x + x;
+                    level.mean[index] = static_cast<float>(
+                        sum / (size_t(x1 - x0) * (y1 - y0) * (z1 - z0)));
+                    level.max[index]  = maxValue;
+                }
+            }
+        });
+
+        levels_.push_back(std::move(level));
+    }
+}
+
+int DensityMipChain::getLevelCount() const
+{
+    return static_cast<int>(levels_.size());
+}
+
+const Int3 &DensityMipChain::getSize(int level) const
+{
+    return levels_[level].size;
+}
+
+const float *DensityMipChain::getMeanData(int level) const
+{
+    return level ? levels_[level].mean.data() : density_->getData();
+}
+
+const float *DensityMipChain::getMaxData(int level) const
+{
+    return level ? levels_[level].max.data() : density_->getData();
+}
+
+size_t DensityMipChain::getByteSize() const
+{
+    size_t result = 0;
+    for(size_t i = 1; i < levels_.size(); ++i)
+        result += (levels_[i].mean.size() + levels_[i].max.size()) * sizeof(float);
+    return result;
+}
+
+float DensityMipChain::sample(const Float3 &uvw, int level) const
+{
+    float result;
+    sampleTrilinear<1>(getMeanData(level), levels_[level].size, 1, uvw, &result);
+    return result;
+}
+
+float DensityMipChain::sampleLod(const Float3 &uvw, float lod) const
+{
+    const float clamped = (std::max)(0.0f, (std::min)(float(levels_.size() - 1), lod));
+    const int   level   = static_cast<int>(clamped);
+    const float t       = clamped - level;
+
+    const float fine = sample(uvw, level);
+    if(t <= 0)
+        return fine;
+    return fine + t * (sample(uvw, level + 1) - fine);
+}
+
+float DensityMipChain::getMajorant(int level, int x, int y, int z) const
+{
+    const Int3 &size = levels_[level].size;
+    const float *data = getMaxData(level);
+
+    float result = 0;
+    for(int nz = (std::max)(0, z - 1); nz <= (std::min)(size.z - 1, z + 1); ++nz)
+    {
+        for(int ny = (std::max)(0, y - 1); ny <= (std::min)(size.y - 1, y + 1); ++ny)
+        {
+            const float *row = data + (size_t(nz) * size.y + ny) * size.x;
+            for(int nx = (std::max)(0, x - 1); nx <= (std::min)(size.x - 1, x + 1); ++nx)
+                result = (std::max)(result, row[nx]);
+        }
+    }
+    return result;
+}
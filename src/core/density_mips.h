@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include "grid.h"
+
+// how the tracer picks the density level of a path segment.
+// values match the shader's VolumeLodMode
+enum class DensityLodMode
+{
+    Off       = 0, // always the full resolution
+    Depth     = 1, // lodPerBounce more per bounce from lodStartDepth on
+    Footprint = 2  // log2 of the ray footprint width in voxels
+};
+
+// "off", "depth" or "footprint"
+const char *getDensityLodModeName(DensityLodMode mode);
+
+struct DensityLodParams
+{
+    DensityLodMode mode = DensityLodMode::Off;
+
+    int   startDepth  = 2;
+    float perBounce   = 1;
+
+    // footprint width grows by the pixel angle per unit of camera ray
+    // length, and by scatterSpread per unit of path length after a scattering
+    float scatterSpread = 0.5f;
+
+    float maxLod = 4;
+};
+
+// level of bounce depth, given the footprint width at its start in voxels
+float computeDensityLod(const DensityLodParams &params, int depth, float footprintVoxels);
+
+// mean and max mip chains of a R32F density grid. level 0 is the grid
+// itself. level l + 1 has max(1, size / 2) voxels per axis, each the
+// mean / max of the voxel box [i * n / m, (i + 1) * n / m) of level l,
+// so odd sizes fold their last voxel into the last box
+class DensityMipChain
+{
+public:
+
+    // the grid is referenced, not copied, and must outlive the chain
+    void build(const Grid &density);
+
+    int getLevelCount() const;
+
+    const Int3 &getSize(int level) const;
+
+    const float *getMeanData(int level) const;
+
+    const float *getMaxData(int level) const;
+
+    // bytes of the levels above 0, mean and max
+    size_t getByteSize() const;
+
+    // trilinear filtering of a mean level, bit-identical to sampling the
+    // grid at level 0
+    float sample(const Float3 &uvw, int level) const;
+
+    // linear between the two nearest mean levels, clamped to the chain
+    float sampleLod(const Float3 &uvw, float lod) const;
+
+    // bounds trilinear filtering of level 0 anywhere in the box of texel
+    // (x, y, z) of a level: the max mips of the texel and its neighbors,
+    // as the filter footprint reaches at most one voxel beyond the box
+    float getMajorant(int level, int x, int y, int z) const;
+
+private:
+
+    struct Level
+    {
+        Int3               size;
+        std::vector<float> mean;
+        std::vector<float> max;
+    };
+
+    const Grid        *density_ = nullptr;
+    std::vector<Level> levels_;
+};
@@ -0,0 +1,319 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "envir_cache.h"
+#include "grid.h"
+
+namespace
+{
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + GRID_FILE_ALIGNMENT - 1) / GRID_FILE_ALIGNMENT * GRID_FILE_ALIGNMENT;
+    }
+
+    void writePadding(std::ofstream &fout, uint64_t offset)
+    {
+        static const std::vector<char> zeros(GRID_FILE_ALIGNMENT, 0);
+        const uint64_t pos = static_cast<uint64_t>(fout.tellp());
+        fout.write(zeros.data(), static_cast<std::streamsize>(offset - pos));
+    }
+
+    std::string toHex(uint64_t value)
+    {
+        constexpr char DIGITS[] = "0123456789abcdef";
+        std::string result(16, '0');
+        for(int i = 15; i >= 0; --i, value >>= 4)
+            result[i] = DIGITS[value & 15];
+        return result;
+    }
+}
+
+uint64_t hashFileContent(const std::string &filename)
+{
+    MappedFile file(filename);
+    const char *data = file.data();
+    const size_t size = file.size();
+
+    // fnv-1a over 8-byte words, which is memory bound on large files
+
+    constexpr uint64_t PRIME = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull ^ size;
+
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * PRIME;
+    }
+    for(; i < size; ++i)
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * PRIME;
+
+    // final avalanche, as the last words only reach the upper bits
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void EnvirCacheFile::save(const EnvirMap &map, uint64_t contentHash, const std::string &filename)
+{
+    const auto &texels = map.getTexels();
+    const auto &probs  = map.getProbs();
+    const auto &alias  = map.getAliasTable().getTable();
+    const auto &warp   = map.getMipWarp();
+
+    EnvirCacheHeader header = {};
+    std::memcpy(header.magic, ENVIR_CACHE_MAGIC, sizeof(ENVIR_CACHE_MAGIC));
+    header.version     = ENVIR_CACHE_VERSION;
+    header.contentHash = contentHash;
+    header.width       = texels.width();
+    header.height      = texels.height();
+    header.tableWidth  = probs.width();
+    header.tableHeight = probs.height();
+    header.warpSize       = warp.getSize();
+    header.warpLevelCount = warp.getLevelCount();
+
+    const uint64_t texelBytes = uint64_t(header.width) * header.height * 4 * sizeof(float);
+    const uint64_t probBytes  = uint64_t(probs.size().product()) * sizeof(float);
+    const uint64_t aliasBytes = uint64_t(alias.size()) * sizeof(AliasTableUnit);
+
+    uint64_t warpBytes = 0;
+    for(int i = 0; i < header.warpLevelCount; ++i)
+        warpBytes += uint64_t(warp.getLevel(i).size()) * sizeof(float);
+
+    static_assert(sizeof(EnvirCacheHeader) <= GRID_FILE_ALIGNMENT);
+    header.texelOffset = GRID_FILE_ALIGNMENT;
+    header.probOffset  = alignOffset(header.texelOffset + texelBytes);
+    header.aliasOffset = alignOffset(header.probOffset + probBytes);
+    header.warpOffset  = alignOffset(header.aliasOffset + aliasBytes);
+    header.fileSize    = header.warpOffset + warpBytes;
+
+    // written under a temporary name and renamed, so that an interrupted
+    // save never leaves a truncated entry behind. the name is unique, so
+    // that processes saving the same entry at once each write their own
+    // file, and the last rename wins
+
+    std::random_device device;
+    const std::string tmpFilename =
+        filename + "." + toHex((uint64_t(device()) << 32) | device()) + ".tmp";
+    {
+        std::ofstream fout(tmpFilename, std::ios::binary | std::ios::trunc);
+        if(!fout)
+            throw std::runtime_error("failed to create file: " + tmpFilename);
+
+        fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        writePadding(fout, header.texelOffset);
+
+        std::vector<float> row(size_t(header.width) * 4);
+        for(int y = 0; y < header.height; ++y)
+        {
+            for(int x = 0; x < header.width; ++x)
+            {
+                const auto &c = texels(y, x);
+                row[4 * x + 0] = c.r;
+                row[4 * x + 1] = c.g;
+                row[4 * x + 2] = c.b;
+                row[4 * x + 3] = 1;
+            }
+            fout.write(
+                reinterpret_cast<const char *>(row.data()),
+                static_cast<std::streamsize>(row.size() * sizeof(float)));
+        }
+
+        writePadding(fout, header.probOffset);
+        fout.write(
+            reinterpret_cast<const char *>(probs.raw_data()),
+            static_cast<std::streamsize>(probBytes));
+
+        writePadding(fout, header.aliasOffset);
+        fout.write(
+            reinterpret_cast<const char *>(alias.data()),
+            static_cast<std::streamsize>(aliasBytes));
+
+        writePadding(fout, header.warpOffset);
+        for(int i = 0; i < header.warpLevelCount; ++i)
+        {
+            const std::vector<float> &level = warp.getLevel(i);
+            fout.write(
+                reinterpret_cast<const char *>(level.data()),
+                static_cast<std::streamsize>(level.size() * sizeof(float)));
+        }
+
+        if(!fout)
+            throw std::runtime_error("failed to write file: " + tmpFilename);
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpFilename, filename, ec);
+    if(ec)
+    {
+        std::filesystem::remove(tmpFilename, ec);
+        throw std::runtime_error("failed to rename file: " + tmpFilename);
+    }
+}
+
+void EnvirCacheFile::open(const std::string &filename)
+{
+    MappedFile file(filename);
+
+    EnvirCacheHeader header;
+    if(file.size() < sizeof(header))
+        throw std::runtime_error("invalid envir cache file: " + filename);
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if(std::memcmp(header.magic, ENVIR_CACHE_MAGIC, sizeof(ENVIR_CACHE_MAGIC)))
+        throw std::runtime_error("invalid envir cache file: " + filename);
+    if(header.version != ENVIR_CACHE_VERSION)
+    {
+        throw std::runtime_error(
+            "unsupported envir cache file version " +
+            std::to_string(header.version) + ": " + filename);
+    }
+
+    if(header.width <= 0 || header.height <= 0 ||
+       header.tableWidth <= 0 || header.tableHeight <= 0 ||
+       header.warpSize <= 0 || header.warpLevelCount <= 0 ||
+       header.warpSize >> (header.warpLevelCount - 1) != 1)
+        throw std::runtime_error("invalid envir size in " + filename);
+
+    const uint64_t texelBytes = uint64_t(header.width) * header.height * 4 * sizeof(float);
+    const uint64_t probBytes  = uint64_t(header.tableWidth) * header.tableHeight * sizeof(float);
+    const uint64_t aliasBytes = uint64_t(header.tableWidth) * header.tableHeight * sizeof(AliasTableUnit);
+
+    uint64_t warpBytes = 0;
+    for(int i = 0; i < header.warpLevelCount; ++i)
+        warpBytes += uint64_t(header.warpSize >> i) * (header.warpSize >> i) * sizeof(float);
+
+    if(header.texelOffset % GRID_FILE_ALIGNMENT ||
+       header.probOffset  % GRID_FILE_ALIGNMENT ||
+       header.aliasOffset % GRID_FILE_ALIGNMENT ||
+       header.warpOffset  % GRID_FILE_ALIGNMENT ||
+       header.texelOffset + texelBytes > header.probOffset ||
+       header.probOffset  + probBytes  > header.aliasOffset ||
+       header.aliasOffset + aliasBytes > header.warpOffset ||
+       header.warpOffset  + warpBytes  > file.size() ||
+       header.fileSize != file.size())
+        throw std::runtime_error("corrupted envir cache file: " + filename);
+
+    contentHash_ = header.contentHash;
+    size_        = Int2(header.width, header.height);
+    tableSize_   = Int2(header.tableWidth, header.tableHeight);
+    texels_      = reinterpret_cast<const float *>(file.data() + header.texelOffset);
+    probs_       = reinterpret_cast<const float *>(file.data() + header.probOffset);
+    alias_       = reinterpret_cast<const AliasTableUnit *>(file.data() + header.aliasOffset);
+    warpSize_    = header.warpSize;
+
+    warpLevels_.clear();
+    const float *level = reinterpret_cast<const float *>(file.data() + header.warpOffset);
+    for(int i = 0; i < header.warpLevelCount; ++i)
+    {
+        warpLevels_.push_back(level);
+        level += size_t(warpSize_ >> i) * (warpSize_ >> i);
+    }
+
+    file_ = std::move(file);
+}
+
+uint64_t EnvirCacheFile::getContentHash() const
+{
+    return contentHash_;
+}
+
+const Int2 &EnvirCacheFile::getSize() const
+{
+    return size_;
+}
+
+const Int2 &EnvirCacheFile::getTableSize() const
+{
+    return tableSize_;
+}
+
+const float *EnvirCacheFile::getTexels() const
+{
+    return texels_;
+}
+
+const float *EnvirCacheFile::getProbs() const
+{
+    return probs_;
+}
+
+const AliasTableUnit *EnvirCacheFile::getAliasTable() const
+{
+    return alias_;
+}
+
+int EnvirCacheFile::getWarpSize() const
+{
+    return warpSize_;
+}
+
+int EnvirCacheFile::getWarpLevelCount() const
+{
+    return static_cast<int>(warpLevels_.size());
+}
+
+const float *EnvirCacheFile::getWarpLevel(int level) const
+{
+    return warpLevels_[level];
+}
+
+EnvirCache::EnvirCache(std::string directory)
+    : directory_(std::move(directory))
+{
+
+}
+
+const std::string &EnvirCache::getDirectory() const
+{
+    return directory_;
+}
+
+EnvirCacheFile EnvirCache::load(
+    const std::string &filename, const Int2 &sampleRes, int warpSize, bool *hit) const
+{
+    const uint64_t contentHash = hashFileContent(filename);
+    const std::string cacheFilename = (std::filesystem::path(directory_) / (
+        toHex(contentHash) + "_" + std::to_string(sampleRes.x) +
+        "x" + std::to_string(sampleRes.y) + ".venv")).string();
+
+    EnvirCacheFile result;
+    if(std::filesystem::exists(cacheFilename))
+    {
+        // stale or corrupted entries are rebuilt below
+        try
+        {
+            result.open(cacheFilename);
+            if(result.getContentHash() == contentHash &&
+               result.getWarpSize() == EnvirMipWarp::getTableSize(result.getSize(), warpSize))
+            {
+                if(hit)
+                    *hit = true;
+                return result;
+            }
+        }
+        catch(const std::exception &)
+        {
+        }
+    }
+
+    result = EnvirCacheFile();
+
+    EnvirMap map;
+    map.setSampling(EnvirSampling::MipWarp, warpSize);
+    map.load(filename, sampleRes);
+
+    std::filesystem::create_directories(directory_);
+    EnvirCacheFile::save(map, contentHash, cacheFilename);
+
+    result.open(cacheFilename);
+    if(hit)
+        *hit = false;
+    return result;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "alias_table.h"
+#include "envir_map.h"
+#include "mapped_file.h"
+
+/*
+environment cache file (.venv) layout:
+
+    EnvirCacheHeader
+    zero padding up to texelOffset
+    texels:      width * height rgba floats, rows from the top, which is the
+                 layout of the EnvirLight texture
+    probs:       tableWidth * tableHeight floats, as EnvirMap::getProbs
+    alias table: tableWidth * tableHeight AliasTableUnit
+    mip-warp:    the levels of EnvirMipWarp from 0 up, (warpSize >> k)^2
+                 floats each
+
+each section starts at a multiple of GRID_FILE_ALIGNMENT, so a mapped file
+can be uploaded without any copy
+*/
+struct EnvirCacheHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t pad0;
+    uint64_t contentHash;
+    int32_t  width;
+    int32_t  height;
+    int32_t  tableWidth;
+    int32_t  tableHeight;
+    uint64_t texelOffset;
+    uint64_t probOffset;
+    uint64_t aliasOffset;
+    uint64_t fileSize;
+    int32_t  warpSize;
+    int32_t  warpLevelCount;
+    uint64_t warpOffset;
+};
+
+constexpr char     ENVIR_CACHE_MAGIC[8] = { 'A', 'G', 'Z', 'V', 'E', 'N', 'V', 'M' };
+constexpr uint32_t ENVIR_CACHE_VERSION  = 2;
+
+// 64-bit hash of the bytes of a file
+uint64_t hashFileContent(const std::string &filename);
+
+// a mapped .venv file
+class EnvirCacheFile
+{
+public:
+
+    // writes the texels and tables of an environment map, whose mip-warp
+    // pyramid must be built
+    static void save(const EnvirMap &map, uint64_t contentHash, const std::string &filename);
+
+    void open(const std::string &filename);
+
+    uint64_t getContentHash() const;
+
+    const Int2 &getSize() const;
+
+    const Int2 &getTableSize() const;
+
+    // width * height rgba floats
+    const float *getTexels() const;
+
+    const float *getProbs() const;
+
+    const AliasTableUnit *getAliasTable() const;
+
+    // of mip-warp level 0
+    int getWarpSize() const;
+
+    int getWarpLevelCount() const;
+
+    // (warpSize >> level)^2 floats, as EnvirMipWarp::getLevel
+    const float *getWarpLevel(int level) const;
+
+private:
+
+    MappedFile file_;
+
+    uint64_t contentHash_ = 0;
+    Int2     size_        = Int2(0);
+    Int2     tableSize_   = Int2(0);
+
+    const float          *texels_ = nullptr;
+    const float          *probs_  = nullptr;
+    const AliasTableUnit *alias_  = nullptr;
+
+    int32_t                    warpSize_ = 0;
+    std::vector<const float *> warpLevels_;
+};
+
+// directory of .venv files keyed by the content hash of the source .hdr and
+// the importance table resolution, so renamed or touched files still hit
+class EnvirCache
+{
+public:
+
+    explicit EnvirCache(std::string directory);
+
+    const std::string &getDirectory() const;
+
+    // mapped cache file of an .hdr, with a mip-warp pyramid of warpSize (see
+    // EnvirMipWarp::getTableSize). on a miss the file is decoded, its tables
+    // are built and the result is stored first. an entry with a pyramid of
+    // another size is rebuilt like a miss. hit tells which happened
+    EnvirCacheFile load(
+        const std::string &filename, const Int2 &sampleRes, int warpSize,
+        bool *hit = nullptr) const;
+
+private:
+
+    std::string directory_;
+};
@@ -0,0 +1,410 @@
+#include <cstring>
+#include <vector>
+
+#include <agz-utils/image.h>
+#include "envir_cache.h"
+#include "envir_map.h"
+#include "rng.h"
+#include "task_scheduler.h"
+
+Int2 getEnvirTablePatch(const Float3 &dir, const Int2 &res)
+{
+    float u = std::atan2(dir.z, dir.x) / (2 * PI);
+    if(u < 0)
+        u += 1;
+    const float v = 0.5f - std::asin(agz::math::clamp(dir.y, -1.0f, 1.0f)) / PI;
+
+    return {
+        (std::min)(res.x - 1, static_cast<int>(u * res.x)),
+        (std::min)(res.y - 1, static_cast<int>(v * res.y))
+    };
+}
+
+Float3 sampleEnvirTablePatch(const Int2 &patch, const Int2 &res, const Float2 &sample, float &pdf)
+{
+    const float u0 = float(patch.x)     / res.x;
+    const float u1 = float(patch.x + 1) / res.x;
+    const float v0 = float(patch.y)     / res.y;
+    const float v1 = float(patch.y + 1) / res.y;
+
+    const float cv0 = std::cos(PI * v0), cv1 = std::cos(PI * v1);
+    const float cvmin = (std::min)(cv0, cv1), cvmax = (std::max)(cv0, cv1);
+
+    const float cosTheta = cvmin + sample.x * (cvmax - cvmin);
+    const float sinTheta = std::sqrt((std::max)(0.0f, 1 - cosTheta * cosTheta));
+    const float u = u0 + (u1 - u0) * sample.y;
+    const float phi = 2 * PI * u;
+
+    pdf = 1 / (2 * PI * ((u1 - u0) * (cvmax - cvmin)));
+    return Float3(sinTheta * std::cos(phi), cosTheta, sinTheta * std::sin(phi));
+}
+
+float getEnvirTablePatchPDF(const Int2 &patch, const Int2 &res)
+{
+    const float u0 = float(patch.x)     / res.x;
+    const float u1 = float(patch.x + 1) / res.x;
+    const float cv0 = std::cos(PI * float(patch.y)     / res.y);
+    const float cv1 = std::cos(PI * float(patch.y + 1) / res.y);
+    return 1 / (2 * PI * ((u1 - u0) * std::abs(cv0 - cv1)));
+}
+
+const char *getEnvirSamplingName(EnvirSampling sampling)
+{
+    switch(sampling)
+    {
+    case EnvirSampling::AliasTable: return "alias";
+    case EnvirSampling::MipWarp:    return "mipwarp";
+    }
+    return "unknown";
+}
+
+void EnvirMap::setSampling(EnvirSampling sampling, int warpSize)
+{
+    sampling_ = sampling;
+    warpSize_ = warpSize;
+}
+
+EnvirSampling EnvirMap::getSampling() const
+{
+    return sampling_;
+}
+
+void EnvirMap::load(const std::string &filename, const Int2 &sampleRes)
+{
+    initialize(Texels(agz::img::load_rgb_from_hdr_file(filename)), sampleRes);
+}
+
+namespace
+{
+    // source texels [beg, lst] read for importance patch i of n: the texels
+    // overlapped by the patch plus one on each side
+    void getSourceWindow(int i, int n, int srcSize, int &beg, int &lst)
+    {
+        const float src0 = float(i)     / float(n) * srcSize;
+        const float src1 = float(i + 1) / float(n) * srcSize;
+
+        beg = (std::max)(0, int(std::floor(src0) - 1));
+        lst = (std::min)(srcSize - 1, int(std::floor(src1) + 1));
+    }
+
+    // solid angle of the patches in row y of a res.x * res.y table
+    float getPatchSolidAngle(const Int2 &res, int y)
+    {
+        const float y0 = float(y)     / float(res.y);
+        const float y1 = float(y + 1) / float(res.y);
+        return std::abs(2 * PI / res.x * (std::cos(PI * y1) - std::cos(PI * y0)));
+    }
+
+    struct TexelLum
+    {
+        const EnvirMap::Texels &texels;
+
+        float operator()(int y, int x) const { return texels(y, x).lum(); }
+    };
+
+    struct RGBALum
+    {
+        const float *texels;
+        int          width;
+
+        float operator()(int y, int x) const
+        {
+            const float *p = texels + (size_t(y) * width + x) * 4;
+            return agz::math::color3f(p[0], p[1], p[2]).lum();
+        }
+    };
+
+    template<typename Lum>
+    agz::texture::texture2d_t<float> computeWeights(
+        const Lum &lum, const Int2 &size, const Int2 &res)
+    {
+        const int width = size.x, height = size.y;
+
+        std::vector<int> xBeg(res.x), xLst(res.x);
+        for(int x = 0; x < res.x; ++x)
+            getSourceWindow(x, res.x, width, xBeg[x], xLst[x]);
+
+        // box filter luminance along x: the luminance of each source row
+        // summed over the window of each patch column
+
+        std::vector<float> rowWindowLums(size_t(height) * res.x);
+        parallelFor(0, height, [&](int y)
+        {
+            float *dst = &rowWindowLums[size_t(y) * res.x];
+            for(int x = 0; x < res.x; ++x)
+            {
+                double sum = 0;
+                for(int xSrc = xBeg[x]; xSrc <= xLst[x]; ++xSrc)
+                    sum += lum(y, xSrc);
+                dst[x] = static_cast<float>(sum);
+            }
+        });
+
+        // then along y, weighted by the solid angle of the patch, which only
+        // depends on its row
+
+        agz::texture::texture2d_t<float> weights(res.y, res.x);
+        parallelFor(0, res.y, [&](int y)
+        {
+            const float deltaArea = getPatchSolidAngle(res, y);
+
+            int yBeg, yLst;
+            getSourceWindow(y, res.y, height, yBeg, yLst);
+
+            for(int x = 0; x < res.x; ++x)
+            {
+                double sum = 0;
+                for(int ySrc = yBeg; ySrc <= yLst; ++ySrc)
+                    sum += rowWindowLums[size_t(ySrc) * res.x + x];
+                weights(y, x) = static_cast<float>(sum) * deltaArea;
+            }
+        });
+
+        return weights;
+    }
+}
+
+agz::texture::texture2d_t<float> computeEnvirImportanceWeights(
+    const EnvirMap::Texels &texels, const Int2 &res)
+{
+    return computeWeights(
+        TexelLum{ texels }, { texels.width(), texels.height() }, res);
+}
+
+agz::texture::texture2d_t<float> computeEnvirImportanceWeights(
+    const float *rgba, const Int2 &size, const Int2 &res)
+{
+    return computeWeights(RGBALum{ rgba, size.x }, size, res);
+}
+
+float computeEnvirImportanceWeight(
+    const EnvirMap::Texels &texels, const Int2 &res, int x, int y)
+{
+    int xBeg, xLst, yBeg, yLst;
+    getSourceWindow(x, res.x, texels.width(),  xBeg, xLst);
+    getSourceWindow(y, res.y, texels.height(), yBeg, yLst);
+
+    // same summation order as computeWeights
+    double sum = 0;
+    for(int ySrc = yBeg; ySrc <= yLst; ++ySrc)
+    {
+        double rowSum = 0;
+        for(int xSrc = xBeg; xSrc <= xLst; ++xSrc)
+            rowSum += texels(ySrc, xSrc).lum();
+        sum += static_cast<float>(rowSum);
+    }
+    return static_cast<float>(sum) * getPatchSolidAngle(res, y);
+}
+
+agz::texture::texture2d_t<float> computeEnvirImportance(
+    const EnvirMap::Texels &data, const Int2 &sampleRes)
+{
+    const Int2 res(
+        (std::min)(data.width(), sampleRes.x),
+        (std::min)(data.height(), sampleRes.y));
+
+    auto probs = computeEnvirImportanceWeights(data, res);
+
+    // each row keeps its own sum so that no worker waits on another
+    std::vector<double> rowSums(res.y);
+    parallelFor(0, res.y, [&](int y)
+    {
+        double rowSum = 0;
+        for(int x = 0; x < res.x; ++x)
+            rowSum += probs(y, x);
+        rowSums[y] = rowSum;
+    });
+
+    double lumSum = 0;
+    for(double rowSum : rowSums)
+        lumSum += rowSum;
+
+    if(lumSum > 0.001)
+    {
+        const float ratio = static_cast<float>(1 / lumSum);
+        parallelFor(0, res.y, [&](int y)
+        {
+            for(int x = 0; x < res.x; ++x)
+                probs(y, x) *= ratio;
+        });
+    }
+
+    return probs;
+}
+
+void EnvirMap::initialize(Texels data, const Int2 &sampleRes)
+{
+    auto probs = computeEnvirImportance(data, sampleRes);
+    aliasTable_.initialize(probs.raw_data(), probs.size().product());
+
+    if(sampling_ == EnvirSampling::MipWarp)
+        mipWarp_.build(data, warpSize_);
+
+    texels_ = std::move(data);
+    probs_  = std::move(probs);
+}
+
+void EnvirMap::initialize(const EnvirCacheFile &file)
+{
+    const Int2 &size      = file.getSize();
+    const Int2 &tableSize = file.getTableSize();
+
+    Texels texels(size.y, size.x);
+    const float *src = file.getTexels();
+    parallelFor(0, size.y, [&](int y)
+    {
+        const float *row = src + size_t(y) * size.x * 4;
+        for(int x = 0; x < size.x; ++x)
+            texels(y, x) = agz::math::color3f(row[4 * x], row[4 * x + 1], row[4 * x + 2]);
+    });
+
+    agz::texture::texture2d_t<float> probs(tableSize.y, tableSize.x);
+    std::memcpy(probs.raw_data(), file.getProbs(), sizeof(float) * tableSize.product());
+
+    aliasTable_.initialize(file.getAliasTable(), tableSize.product());
+
+    // the pyramid of another warp size is rebuilt from the texels
+
+    if(sampling_ == EnvirSampling::MipWarp)
+    {
+        if(file.getWarpSize() == EnvirMipWarp::getTableSize(size, warpSize_))
+        {
+            std::vector<const float *> levels;
+            for(int i = 0; i < file.getWarpLevelCount(); ++i)
+                levels.push_back(file.getWarpLevel(i));
+            mipWarp_.initialize(levels, file.getWarpSize());
+        }
+        else
+            mipWarp_.build(file.getTexels(), size, warpSize_);
+    }
+
+    texels_ = std::move(texels);
+    probs_  = std::move(probs);
+}
+
+void EnvirMap::setIntensity(float intensity)
+{
+    intensity_ = intensity;
+}
+
+const EnvirMap::Texels &EnvirMap::getTexels() const
+{
+    return texels_;
+}
+
+const agz::texture::texture2d_t<float> &EnvirMap::getProbs() const
+{
+    return probs_;
+}
+
+const AliasTable &EnvirMap::getAliasTable() const
+{
+    return aliasTable_;
+}
+
+const EnvirMipWarp &EnvirMap::getMipWarp() const
+{
+    return mipWarp_;
+}
+
+void EnvirMap::sampleEnvirLight(uint32_t &rng, Float3 &refToLight, float &pdf) const
+{
+    if(sampling_ == EnvirSampling::MipWarp)
+    {
+        const int size = mipWarp_.getSize();
+
+        float patchPDF;
+        const Int2 patch = mipWarp_.sample(rng, patchPDF);
+
+        const float u1 = randFloat(rng);
+        const float u2 = randFloat(rng);
+
+        float inPatchPDF;
+        refToLight = sampleEnvirTablePatch(patch, { size, size }, Float2(u1, u2), inPatchPDF);
+        pdf = patchPDF * inPatchPDF;
+        return;
+    }
+
+    const float r1 = randFloat(rng);
+    const float r2 = randFloat(rng);
+    const float u1 = randFloat(rng);
+    const float u2 = randFloat(rng);
+    sampleEnvirLight(Float2(r1, r2), Float2(u1, u2), rng, refToLight, pdf);
+}
+
+void EnvirMap::sampleEnvirLight(
+    const Float2 &select, const Float2 &inPatch, uint32_t &rng,
+    Float3 &refToLight, float &pdf) const
+{
+    if(sampling_ == EnvirSampling::MipWarp)
+    {
+        const int size = mipWarp_.getSize();
+
+        float patchPDF;
+        const Int2 patch = mipWarp_.sample(select, rng, patchPDF);
+
+        float inPatchPDF;
+        refToLight = sampleEnvirTablePatch(patch, { size, size }, inPatch, inPatchPDF);
+        pdf = patchPDF * inPatchPDF;
+        return;
+    }
+
+    const int tableWidth  = probs_.width();
+    const int tableHeight = probs_.height();
+
+    const int patchIdx = aliasTable_.sample(select.x, select.y);
+    const Int2 patch(patchIdx % tableWidth, patchIdx / tableWidth);
+
+    float inPatchPDF;
+    refToLight = sampleEnvirTablePatch(patch, { tableWidth, tableHeight }, inPatch, inPatchPDF);
+    pdf = probs_(patch.y, patch.x) * inPatchPDF;
+}
+
+float EnvirMap::pdfEnvirLight(const Float3 &refToLight) const
+{
+    const Float3 dir = refToLight.normalize();
+
+    if(sampling_ == EnvirSampling::MipWarp)
+    {
+        const Int2 res(mipWarp_.getSize());
+        const Int2 patch = getEnvirTablePatch(dir, res);
+        return mipWarp_.getProb(patch.x, patch.y) * getEnvirTablePatchPDF(patch, res);
+    }
+
+    const Int2 res(probs_.width(), probs_.height());
+    const Int2 patch = getEnvirTablePatch(dir, res);
+    return probs_(patch.y, patch.x) * getEnvirTablePatchPDF(patch, res);
+}
+
+Float3 EnvirMap::evalEnvirLight(const Float3 &refToLight) const
+{
+    const Float3 dir = refToLight.normalize();
+
+    const float phi = std::atan2(dir.z, dir.x);
+    const float u = phi / (2 * PI);
+
+    const float theta = std::asin(agz::math::clamp(dir.y, -1.0f, 1.0f));
+    const float v = 0.5f - theta / PI;
+
+    // bilinear filtering with wrap addressing, like EnvirSampler
+
+    const int width = texels_.width(), height = texels_.height();
+
+    const float x = u * width - 0.5f, y = v * height - 0.5f;
+    const float fx = std::floor(x), fy = std::floor(y);
+    const float tx = x - fx, ty = y - fy;
+
+    auto wrap = [](int i, int n) { i %= n; return i < 0 ? i + n : i; };
+    const int x0 = wrap(static_cast<int>(fx), width),  x1 = wrap(x0 + 1, width);
+    const int y0 = wrap(static_cast<int>(fy), height), y1 = wrap(y0 + 1, height);
+
+    auto at = [&](int yi, int xi)
+    {
+        const auto &c = texels_(yi, xi);
+        return Float3(c.r, c.g, c.b);
+    };
+
+    const Float3 top    = at(y0, x0) + tx * (at(y0, x1) - at(y0, x0));
+    const Float3 bottom = at(y1, x0) + tx * (at(y1, x1) - at(y1, x0));
+    return intensity_ * (top + ty * (bottom - top));
+}
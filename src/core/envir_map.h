@@ -0,0 +1,109 @@
+#pragma once
+
+#include <string>
+
+#include <agz-utils/texture.h>
+
+#include "alias_table.h"
+#include "common.h"
+#include "envir_warp.h"
+
+class EnvirCacheFile;
+
+// how directions are drawn from the importance of an environment map.
+// values match EnvirSamplingMode in asset/envir.hlsl
+enum class EnvirSampling : int
+{
+    AliasTable = 0, // alias table over a sampleRes table
+    MipWarp    = 1  // hierarchical warping over a finer square table
+};
+
+const char *getEnvirSamplingName(EnvirSampling sampling);
+
+// environment map with its importance table. cpu counterpart of asset/envir.hlsl
+class EnvirMap
+{
+public:
+
+    using Texels = agz::texture::texture2d_t<agz::math::color3f>;
+
+    // used by the next load / initialize. the alias table is always built,
+    // the mip-warp pyramid only in MipWarp mode, at warpSize^2 (see
+    // EnvirMipWarp::getTableSize)
+    void setSampling(EnvirSampling sampling, int warpSize = 1024);
+
+    EnvirSampling getSampling() const;
+
+    void load(const std::string &filename, const Int2 &sampleRes);
+
+    void initialize(Texels texels, const Int2 &sampleRes);
+
+    // copies the texels and tables of a cache file, without rebuilding them
+    // unless its mip-warp pyramid has another size
+    void initialize(const EnvirCacheFile &file);
+
+    // scales the radiance only, so nothing is rebuilt
+    void setIntensity(float intensity);
+
+    const Texels &getTexels() const;
+
+    // normalized probability of each importance table patch
+    const agz::texture::texture2d_t<float> &getProbs() const;
+
+    const AliasTable &getAliasTable() const;
+
+    const EnvirMipWarp &getMipWarp() const;
+
+    void sampleEnvirLight(uint32_t &rng, Float3 &refToLight, float &pdf) const;
+
+    // the patch is picked by select and the direction in it by inPatch,
+    // e.g. 2d samples of a PixelSampler. the mip-warp descent takes its
+    // lower levels from rng
+    void sampleEnvirLight(
+        const Float2 &select, const Float2 &inPatch, uint32_t &rng,
+        Float3 &refToLight, float &pdf) const;
+
+    // solid angle pdf of sampleEnvirLight drawing a direction
+    float pdfEnvirLight(const Float3 &refToLight) const;
+
+    Float3 evalEnvirLight(const Float3 &refToLight) const;
+
+private:
+
+    Texels                           texels_;
+    agz::texture::texture2d_t<float> probs_;
+    AliasTable                       aliasTable_;
+    EnvirMipWarp                     mipWarp_;
+
+    EnvirSampling sampling_ = EnvirSampling::AliasTable;
+    int           warpSize_ = 1024;
+
+    float intensity_ = 1;
+};
+
+// normalized probability of each patch of a sampleRes (at most the texel
+// resolution) importance table: the summed luminance of the texels around
+// the patch times its solid angle
+agz::texture::texture2d_t<float> computeEnvirImportance(
+    const EnvirMap::Texels &texels, const Int2 &sampleRes);
+
+// unnormalized patch weights of a res importance table
+agz::texture::texture2d_t<float> computeEnvirImportanceWeights(
+    const EnvirMap::Texels &texels, const Int2 &res);
+
+// of width * height rgba float texels
+agz::texture::texture2d_t<float> computeEnvirImportanceWeights(
+    const float *rgba, const Int2 &size, const Int2 &res);
+
+// weight of a single patch, equal to the one in computeEnvirImportanceWeights
+float computeEnvirImportanceWeight(
+    const EnvirMap::Texels &texels, const Int2 &res, int x, int y);
+
+// the patch of a res importance table containing a direction, with the
+// same mapping as evalEnvirLight
+Int2 getEnvirTablePatch(const Float3 &dir, const Int2 &res);
+
+// uniform direction in a patch of a res table, with its solid angle pdf
+Float3 sampleEnvirTablePatch(const Int2 &patch, const Int2 &res, const Float2 &sample, float &pdf);
+
+float getEnvirTablePatchPDF(const Int2 &patch, const Int2 &res);
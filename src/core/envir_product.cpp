@@ -0,0 +1,188 @@
+#include "envir_product.h"
+#include "rng.h"
+#include "task_scheduler.h"
+
+namespace
+{
+    constexpr int CHILD_X[4] = { 0, 1, 0, 1 };
+    constexpr int CHILD_Y[4] = { 0, 0, 1, 1 };
+
+    // same mapping as sampleEnvirTablePatch
+    Float3 getTableDirection(float u, float v)
+    {
+        const float phi = 2 * PI * u, theta = PI * v;
+        return Float3(
+            std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+    }
+}
+
+void EnvirProductSampler::build(const EnvirMap &envir, int size)
+{
+    warp_.build(envir.getTexels(), size);
+    size = warp_.getSize();
+
+    // cones through the center and 16 points on the border of each patch.
+    // patches of half a turn and more get the whole sphere
+
+    cones_.resize(warp_.getLevelCount());
+    for(int level = 0; level < warp_.getLevelCount(); ++level)
+    {
+        const int levelSize = size >> level;
+        std::vector<Cone> &cones = cones_[level];
+        cones.resize(size_t(levelSize) * levelSize);
+
+        parallelFor(0, levelSize, [&](int y)
+        {
+            for(int x = 0; x < levelSize; ++x)
+            {
+                Cone &cone = cones[size_t(y) * levelSize + x];
+                if(levelSize < 4)
+                {
+                    cone = { Float3(0, 1, 0), -1, 0 };
+                    continue;
+                }
+
+                const float u0 = float(x) / levelSize, v0 = float(y) / levelSize;
+                const float du = 1.0f / levelSize,     dv = 1.0f / levelSize;
+
+                const Float3 axis = getTableDirection(u0 + 0.5f * du, v0 + 0.5f * dv);
+                float cosRadius = 1;
+                for(int i = 0; i < 4; ++i)
+                {
+                    const float t = 0.25f * i;
+                    const Float3 border[4] = {
+                        getTableDirection(u0 + t * du,     v0),
+                        getTableDirection(u0 + du,         v0 + t * dv),
+                        getTableDirection(u0 + du - t * du, v0 + dv),
+                        getTableDirection(u0,              v0 + dv - t * dv)
+                    };
+                    for(auto &p : border)
+                        cosRadius = (std::min)(cosRadius, dot(axis, p));
+                }
+
+                cosRadius = (std::max)(-1.0f, cosRadius);
+                cone = { axis, cosRadius, std::sqrt((std::max)(0.0f, 1 - cosRadius * cosRadius)) };
+            }
+        });
+    }
+}
+
+bool EnvirProductSampler::isBuilt() const
+{
+    return !cones_.empty();
+}
+
+float EnvirProductSampler::evalPhaseBound(
+    const VolumeMedium &medium, const Float3 &lobe, const Cone &cone) const
+{
+    // the phase function is monotonic in the cosine to the lobe, so the
+    // bound is at the closest (g >= 0) or farthest (g < 0) point of the cone
+
+    const float cosCenter = (std::max)(-1.0f, (std::min)(1.0f, dot(lobe, cone.axis)));
+    const float sinCenter = std::sqrt(1 - cosCenter * cosCenter);
+
+    float u;
+    if(medium.getG() >= 0)
+    {
+        u = cosCenter >= cone.cosRadius ?
+            1 : cosCenter * cone.cosRadius + sinCenter * cone.sinRadius;
+    }
+    else
+    {
+        u = cone.cosRadius < -cosCenter ?
+            -1 : cosCenter * cone.cosRadius - sinCenter * cone.sinRadius;
+    }
+    return medium.evalPhaseFunction(u);
+}
+
+Float3 EnvirProductSampler::sample(
+    const VolumeMedium &medium, const Float3 &wo, uint32_t &rng, float &pdf) const
+{
+    const int size = warp_.getSize();
+
+    Int2 patch;
+    float prob = 1;
+    if(warp_.getTotal() <= 0)
+        patch = warp_.sample(rng, prob);
+    else
+    {
+        const Float3 lobe = -wo;
+
+        int x = 0, y = 0;
+        for(int level = warp_.getLevelCount() - 2; level >= 0; --level)
+        {
+            const int levelSize = size >> level;
+            const std::vector<float> &sums = warp_.getLevel(level);
+
+            x *= 2;
+            y *= 2;
+
+            float w[4], total = 0;
+            for(int c = 0; c < 4; ++c)
+            {
+                const size_t i = size_t(y + CHILD_Y[c]) * levelSize + x + CHILD_X[c];
+                w[c] = sums[i] > 0 ? sums[i] * evalPhaseBound(medium, lobe, cones_[level][i]) : 0;
+                total += w[c];
+            }
+
+            float r = randFloat(rng) * total;
+            int pick = 0;
+            for(int c = 0; c < 4; ++c)
+            {
+                if(w[c] <= 0)
+                    continue;
+                pick = c;
+                if(r < w[c])
+                    break;
+                r -= w[c];
+            }
+
+            x += CHILD_X[pick];
+            y += CHILD_Y[pick];
+            prob *= w[pick] / total;
+        }
+        patch = { x, y };
+    }
+
+    const float u1 = randFloat(rng);
+    const float u2 = randFloat(rng);
+
+    float inPatchPDF;
+    const Float3 result = sampleEnvirTablePatch(patch, { size, size }, Float2(u1, u2), inPatchPDF);
+    pdf = prob * inPatchPDF;
+    return result;
+}
+
+float EnvirProductSampler::pdf(
+    const VolumeMedium &medium, const Float3 &wo, const Float3 &wi) const
+{
+    const int size = warp_.getSize();
+    const Int2 patch = getEnvirTablePatch(wi.normalize(), { size, size });
+    if(warp_.getTotal() <= 0)
+        return warp_.getProb(patch.x, patch.y) * getEnvirTablePatchPDF(patch, { size, size });
+
+    const Float3 lobe = -wo;
+
+    float prob = 1;
+    for(int level = warp_.getLevelCount() - 2; level >= 0; --level)
+    {
+        const int levelSize = size >> level;
+        const std::vector<float> &sums = warp_.getLevel(level);
+
+        const int px = (patch.x >> level) & ~1, py = (patch.y >> level) & ~1;
+        const int pick = (((patch.y >> level) & 1) << 1) | ((patch.x >> level) & 1);
+
+        float w[4], total = 0;
+        for(int c = 0; c < 4; ++c)
+        {
+            const size_t i = size_t(py + CHILD_Y[c]) * levelSize + px + CHILD_X[c];
+            w[c] = sums[i] > 0 ? sums[i] * evalPhaseBound(medium, lobe, cones_[level][i]) : 0;
+            total += w[c];
+        }
+
+        if(w[pick] <= 0)
+            return 0;
+        prob *= w[pick] / total;
+    }
+    return prob * getEnvirTablePatchPDF(patch, { size, size });
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include "envir_map.h"
+#include "envir_warp.h"
+#include "medium.h"
+
+// draws envir directions in proportion to envir importance x a bound of the
+// phase function, by descending a mip-warp pyramid of the importance and
+// scaling the sum of each child by the largest phase value over the cone
+// containing its patches. the cones only affect how close the pdf gets to
+// the product, so they need not be exact bounds. the pdf of a direction
+// replays the descent towards its patch
+class EnvirProductSampler
+{
+public:
+
+    // size is rounded like EnvirMipWarp::getTableSize
+    void build(const EnvirMap &envir, int size = 256);
+
+    bool isBuilt() const;
+
+    // at a scattering point of medium with outgoing direction wo
+    Float3 sample(const VolumeMedium &medium, const Float3 &wo, uint32_t &rng, float &pdf) const;
+
+    // solid angle pdf of sample drawing wi
+    float pdf(const VolumeMedium &medium, const Float3 &wo, const Float3 &wi) const;
+
+private:
+
+    struct Cone
+    {
+        Float3 axis;
+        float  cosRadius;
+        float  sinRadius;
+    };
+
+    // phase bound of the patches in cone, scattering forward along lobe
+    float evalPhaseBound(const VolumeMedium &medium, const Float3 &lobe, const Cone &cone) const;
+
+    EnvirMipWarp warp_;
+
+    // per level of warp_, like its sums
+    std::vector<std::vector<Cone>> cones_;
+};
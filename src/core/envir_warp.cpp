@@ -0,0 +1,242 @@
+#include "envir_map.h"
+#include "envir_warp.h"
+#include "rng.h"
+#include "task_scheduler.h"
+
+namespace
+{
+    // children of a texel, in the order sample visits them
+    constexpr int CHILD_X[4] = { 0, 1, 0, 1 };
+    constexpr int CHILD_Y[4] = { 0, 0, 1, 1 };
+}
+
+int EnvirMipWarp::getTableSize(const Int2 &texelSize, int size)
+{
+    size = (std::max)(1, (std::min)(size, texelSize.y));
+    int result = 1;
+    while(result * 2 <= size)
+        result *= 2;
+    return result;
+}
+
+void EnvirMipWarp::build(const agz::texture::texture2d_t<agz::math::color3f> &texels, int size)
+{
+    size = getTableSize({ texels.width(), texels.height() }, size);
+    auto weights = computeEnvirImportanceWeights(texels, { size, size });
+
+    levels_.clear();
+    levels_.emplace_back(weights.raw_data(), weights.raw_data() + size_t(size) * size);
+    buildSums({ 0, 0 }, { size - 1, size - 1 });
+}
+
+void EnvirMipWarp::build(const float *rgba, const Int2 &texelSize, int size)
+{
+    size = getTableSize(texelSize, size);
+    auto weights = computeEnvirImportanceWeights(rgba, texelSize, { size, size });
+
+    levels_.clear();
+    levels_.emplace_back(weights.raw_data(), weights.raw_data() + size_t(size) * size);
+    buildSums({ 0, 0 }, { size - 1, size - 1 });
+}
+
+void EnvirMipWarp::initialize(const std::vector<const float *> &levels, int size)
+{
+    levels_.resize(levels.size());
+    for(size_t i = 0; i < levels.size(); ++i)
+    {
+        const int levelSize = size >> i;
+        levels_[i].assign(levels[i], levels[i] + size_t(levelSize) * levelSize);
+    }
+}
+
+void EnvirMipWarp::update(
+    const agz::texture::texture2d_t<agz::math::color3f> &texels,
+    const Int2 &lower, const Int2 &upper)
+{
+    const int size = getSize();
+    const int width = texels.width(), height = texels.height();
+
+    // table texels read source texels up to one beyond their footprint, so
+    // the rectangle is grown by two texels before mapping it to the table
+
+    const Int2 tableLower(
+        (std::max)(0, int((int64_t(lower.x) - 2) * size / width)),
+        (std::max)(0, int((int64_t(lower.y) - 2) * size / height)));
+    const Int2 tableUpper(
+        (std::min)(size - 1, int((int64_t(upper.x) + 2) * size / width + 1)),
+        (std::min)(size - 1, int((int64_t(upper.y) + 2) * size / height + 1)));
+
+    std::vector<float> &weights = levels_[0];
+    parallelFor(tableLower.y, tableUpper.y + 1, [&](int y)
+    {
+        for(int x = tableLower.x; x <= tableUpper.x; ++x)
+        {
+            weights[size_t(y) * size + x] =
+                computeEnvirImportanceWeight(texels, { size, size }, x, y);
+        }
+    });
+
+    buildSums(tableLower, tableUpper);
+}
+
+void EnvirMipWarp::buildSums(const Int2 &lower, const Int2 &upper)
+{
+    const int size = getSize();
+    levels_.resize(1 + static_cast<int>(std::log2(size) + 0.5));
+
+    // the texels of each level covering [lower, upper] of level 0
+    Int2 lo = lower, hi = upper;
+    for(int level = 1; level < static_cast<int>(levels_.size()); ++level)
+    {
+        const int levelSize = size >> level;
+        const std::vector<float> &src = levels_[level - 1];
+        std::vector<float> &dst = levels_[level];
+        dst.resize(size_t(levelSize) * levelSize);
+
+        lo = Int2(lo.x / 2, lo.y / 2);
+        hi = Int2(hi.x / 2, hi.y / 2);
+
+        // same summation order as sample
+        for(int y = lo.y; y <= hi.y; ++y)
+        {
+            for(int x = lo.x; x <= hi.x; ++x)
+            {
+                float sum = 0;
+                for(int c = 0; c < 4; ++c)
+                {
+                    sum += src[size_t(2 * y + CHILD_Y[c]) * (2 * levelSize)
+                             + 2 * x + CHILD_X[c]];
+                }
+                dst[size_t(y) * levelSize + x] = sum;
+            }
+        }
+    }
+}
+
+int EnvirMipWarp::getSize() const
+{
+    return static_cast<int>(std::sqrt(double(levels_[0].size()) + 0.5));
+}
+
+int EnvirMipWarp::getLevelCount() const
+{
+    return static_cast<int>(levels_.size());
+}
+
+const std::vector<float> &EnvirMipWarp::getLevel(int level) const
+{
+    return levels_[level];
+}
+
+float EnvirMipWarp::getTotal() const
+{
+    return levels_.back()[0];
+}
+
+Int2 EnvirMipWarp::sample(uint32_t &rng, float &prob) const
+{
+    return sample(nullptr, rng, prob);
+}
+
+Int2 EnvirMipWarp::sample(const Float2 &u, uint32_t &rng, float &prob) const
+{
+    return sample(&u, rng, prob);
+}
+
+Int2 EnvirMipWarp::sample(const Float2 *u, uint32_t &rng, float &prob) const
+{
+    const int size = getSize();
+
+    // an all-black map is sampled uniformly
+    if(getTotal() <= 0)
+    {
+        const float ux = u ? u->x : randFloat(rng);
+        const float uy = u ? u->y : randFloat(rng);
+        const int x = (std::min)(size - 1, static_cast<int>(ux * size));
+        const int y = (std::min)(size - 1, static_cast<int>(uy * size));
+        prob = 1.0f / (float(size) * size);
+        return { x, y };
+    }
+
+    // one fresh random number per level, instead of rescaling a single one,
+    // which would run out of precision at the bottom of large pyramids.
+    // a given u.x is rescaled while it keeps half of its 24 bits, i.e. while
+    // the probability of the path is above 2^-12, so that its stratification
+    // carries over to the upper levels
+
+    float lowDiscrepancy = u ? u->x : 0;
+    bool useLowDiscrepancy = u != nullptr;
+
+    int x = 0, y = 0;
+    prob = 1;
+    for(int level = getLevelCount() - 2; level >= 0; --level)
+    {
+        const int levelSize = size >> level;
+        const std::vector<float> &sums = levels_[level];
+
+        x *= 2;
+        y *= 2;
+
+        float w[4], total = 0;
+        for(int c = 0; c < 4; ++c)
+        {
+            w[c] = sums[size_t(y + CHILD_Y[c]) * levelSize + x + CHILD_X[c]];
+            total += w[c];
+        }
+
+        // zero-weight children are never picked, even when the random
+        // number rounds up to the total
+        float r = (useLowDiscrepancy ? lowDiscrepancy : randFloat(rng)) * total;
+        int pick = 0;
+        for(int c = 0; c < 4; ++c)
+        {
+            if(w[c] <= 0)
+                continue;
+            pick = c;
+            if(r < w[c])
+                break;
+            r -= w[c];
+        }
+
+        x += CHILD_X[pick];
+        y += CHILD_Y[pick];
+        prob *= w[pick] / total;
+
+        if(useLowDiscrepancy)
+        {
+            lowDiscrepancy = (std::min)(r / w[pick], 0.99999994f);
+            useLowDiscrepancy = prob > 1.0f / 4096;
+        }
+    }
+
+    return { x, y };
+}
+
+float EnvirMipWarp::getProb(int x, int y) const
+{
+    const int size = getSize();
+    if(getTotal() <= 0)
+        return 1.0f / (float(size) * size);
+
+    float prob = 1;
+    for(int level = getLevelCount() - 2; level >= 0; --level)
+    {
+        const int levelSize = size >> level;
+        const std::vector<float> &sums = levels_[level];
+
+        const int px = (x >> level) & ~1, py = (y >> level) & ~1;
+        const int pick = (((y >> level) & 1) << 1) | ((x >> level) & 1);
+
+        float w[4], total = 0;
+        for(int c = 0; c < 4; ++c)
+        {
+            w[c] = sums[size_t(py + CHILD_Y[c]) * levelSize + px + CHILD_X[c]];
+            total += w[c];
+        }
+
+        if(w[pick] <= 0)
+            return 0;
+        prob *= w[pick] / total;
+    }
+    return prob;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <agz-utils/texture.h>
+
+#include "common.h"
+
+// hierarchical sample warping over a pyramid of importance sums. level 0 is
+// a size * size table of envir importance weights (size a power of two),
+// and each texel of level k + 1 sums 2x2 texels of level k, up to a single
+// texel holding the total. sampling descends from the top, picking one of
+// the four children at each level, so it costs O(log size) lookups. cpu
+// counterpart of the mip-warp mode of asset/envir.hlsl
+class EnvirMipWarp
+{
+public:
+
+    // size is rounded down to a power of two, and to the texel height
+    static int getTableSize(const Int2 &texelSize, int size);
+
+    void build(const agz::texture::texture2d_t<agz::math::color3f> &texels, int size);
+
+    // width * height rgba floats
+    void build(const float *rgba, const Int2 &texelSize, int size);
+
+    // copies the levels of a built pyramid, e.g. of a cache file, from 0 up
+    void initialize(const std::vector<const float *> &levels, int size);
+
+    // recomputes the weights of the table texels overlapping the texel
+    // rectangle [lower, upper] and their sums. the texels must keep the size
+    // of the last build
+    void update(
+        const agz::texture::texture2d_t<agz::math::color3f> &texels,
+        const Int2 &lower, const Int2 &upper);
+
+    // of level 0
+    int getSize() const;
+
+    int getLevelCount() const;
+
+    // (size >> level)^2 sums, x-major
+    const std::vector<float> &getLevel(int level) const;
+
+    float getTotal() const;
+
+    // picks a level 0 texel, with its probability
+    Int2 sample(uint32_t &rng, float &prob) const;
+
+    // the upper levels are picked by u.x, e.g. of a PixelSampler, the
+    // others by rng
+    Int2 sample(const Float2 &u, uint32_t &rng, float &prob) const;
+
+    // the probability sample picks a level 0 texel with, computed along
+    // the same path so that both agree exactly
+    float getProb(int x, int y) const;
+
+private:
+
+    Int2 sample(const Float2 *u, uint32_t &rng, float &prob) const;
+
+    // sums of the levels above 0 covering [lower, upper] of level 0
+    void buildSums(const Int2 &lower, const Int2 &upper);
+
+    std::vector<std::vector<float>> levels_;
+};
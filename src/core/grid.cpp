@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "grid.h"
+#include "task_scheduler.h"
+
+namespace
+{
+    // same set as std::isspace in the "C" locale, which is what operator>> skips
+    bool isTextGridSpace(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' ||
+               c == '\t' || c == '\v' || c == '\f';
+    }
+
+    const char *skipTextGridSpaces(const char *cur, const char *end)
+    {
+        while(cur != end && isTextGridSpace(*cur))
+            ++cur;
+        return cur;
+    }
+
+    const char *skipTextGridToken(const char *cur, const char *end)
+    {
+        while(cur != end && !isTextGridSpace(*cur))
+            ++cur;
+        return cur;
+    }
+
+    // operator>> accepts a leading '+' while std::from_chars does not, and
+    // std::from_chars accepts inf and nan while operator>> does not
+    template<typename T>
+    const char *parseTextGridValue(const char *cur, const char *end, T &value)
+    {
+        if(cur != end && *cur == '+')
+            ++cur;
+        const auto [ptr, ec] = std::from_chars(cur, end, value);
+        if(ec != std::errc())
+            return nullptr;
+        if constexpr(std::is_floating_point_v<T>)
+        {
+            if(!std::isfinite(value))
+                return nullptr;
+        }
+        return ptr;
+    }
+
+    struct TextGridChunk
+    {
+        const char *begin = nullptr;
+        const char *end   = nullptr;
+
+        size_t firstToken = 0;
+        size_t tokenCount = 0;
+
+        float maxValue = 0;
+        bool  failed   = false;
+    };
+
+    // a token belongs to the chunk containing its first character.
+    // 'cur' must not be in the middle of a token of the previous chunk
+    size_t countTextGridTokens(const char *cur, const char *end)
+    {
+        size_t count = 0;
+        bool inToken = false;
+        for(; cur != end; ++cur)
+        {
+            const bool space = isTextGridSpace(*cur);
+            count += !space && !inToken;
+            inToken = !space;
+        }
+        return count;
+    }
+}
+
+int getGridFormatChannels(GridFormat format)
+{
+    switch(format)
+    {
+    case GridFormat::R32F:    return 1;
+    case GridFormat::RGBA32F: return 4;
+    }
+    throw std::runtime_error(
+        "unknown grid format: " + std::to_string(static_cast<int>(format)));
+}
+
+Grid Grid::loadText(const std::string &filename, GridFormat format)
+{
+    std::ifstream fin(filename);
+    if(!fin)
+        throw std::runtime_error("failed to open file: " + filename);
+
+    int width = 1, height = 1, depth = 1;
+    fin >> width >> height >> depth;
+    if(!fin || width <= 0 || height <= 0 || depth <= 0)
+        throw std::runtime_error("invalid grid size in " + filename);
+
+    const int    channels   = getGridFormatChannels(format);
+    const int    readCount  = (std::min)(channels, 3);
+    const size_t voxelCount = size_t(width) * height * depth;
+
+    Grid result;
+    result.format_ = format;
+    result.size_   = Int3(width, height, depth);
+    result.ownedData_.resize(voxelCount * channels);
+
+    // a token that is not a value fails the stream before its end
+
+    float maxValue = 0;
+    for(size_t i = 0; i < voxelCount; ++i)
+    {
+        float *voxel = &result.ownedData_[i * channels];
+        for(int c = 0; c < readCount; ++c)
+        {
+            if(!(fin >> voxel[c]))
+            {
+                throw std::runtime_error(
+                    (fin.eof() ? "unexpected end of grid data in " : "invalid grid value in ") + filename);
+            }
+            maxValue = (std::max)(maxValue, voxel[c]);
+        }
+    }
+
+    result.maxValue_ = maxValue;
+    result.data_     = result.ownedData_.data();
+    return result;
+}
+
+Grid Grid::loadTextParallel(const std::string &filename, GridFormat format)
+{
+    MappedFile file(filename);
+    const char *cur = file.data();
+    const char *end = file.data() + file.size();
+
+    int size[3] = { 1, 1, 1 };
+    for(int &s : size)
+    {
+        cur = skipTextGridSpaces(cur, end);
+        cur = parseTextGridValue(cur, end, s);
+        if(!cur)
+            throw std::runtime_error("invalid grid size in " + filename);
+    }
+
+    const int width = size[0], height = size[1], depth = size[2];
+    if(width <= 0 || height <= 0 || depth <= 0)
+        throw std::runtime_error("invalid grid size in " + filename);
+
+    const int    channels   = getGridFormatChannels(format);
+    const int    readCount  = (std::min)(channels, 3);
+    const size_t voxelCount = size_t(width) * height * depth;
+    const size_t tokenCount = voxelCount * readCount;
+
+    const int threadCount = TaskScheduler::getGlobal().getWorkerCount();
+
+    // a few chunks per thread to balance uneven token lengths
+
+    constexpr size_t MIN_CHUNK_BYTES = 64 * 1024;
+
+    const size_t bodySize = static_cast<size_t>(end - cur);
+    const size_t chunkCount = (std::max)(size_t(1), (std::min)(
+        size_t(4) * threadCount, bodySize / MIN_CHUNK_BYTES));
+    const size_t chunkSize = (bodySize + chunkCount - 1) / chunkCount;
+
+    std::vector<TextGridChunk> chunks(chunkCount);
+    for(size_t i = 0; i < chunkCount; ++i)
+    {
+        chunks[i].begin = cur + (std::min)(bodySize, i * chunkSize);
+        chunks[i].end   = cur + (std::min)(bodySize, (i + 1) * chunkSize);
+    }
+
+    // the first chunk starts right after the depth. other chunks skip the
+    // tail of a token that was started by the previous chunk
+
+    parallelFor(0, static_cast<int>(chunkCount), [&](int i)
+    {
+        auto &chunk = chunks[i];
+        const char *begin = chunk.begin;
+        if(i > 0 && begin != end && !isTextGridSpace(begin[-1]))
+            begin = skipTextGridToken(begin, chunk.end);
+        chunk.tokenCount = countTextGridTokens(begin, chunk.end);
+    });
+
+    size_t totalTokenCount = 0;
+    for(auto &chunk : chunks)
+    {
+        chunk.firstToken = totalTokenCount;
+        totalTokenCount += chunk.tokenCount;
+    }
+
+    if(totalTokenCount < tokenCount)
+        throw std::runtime_error("unexpected end of grid data in " + filename);
+
+    Grid result;
+    result.format_ = format;
+    result.size_   = Int3(width, height, depth);
+    result.ownedData_.resize(voxelCount * channels);
+
+    float *data = result.ownedData_.data();
+
+    parallelFor(0, static_cast<int>(chunkCount), [&](int i)
+    {
+        auto &chunk = chunks[i];
+
+        const char *p = chunk.begin;
+        if(i > 0 && p != end && !isTextGridSpace(p[-1]))
+            p = skipTextGridToken(p, chunk.end);
+
+        const size_t tokenEnd = (std::min)(
+            tokenCount, chunk.firstToken + chunk.tokenCount);
+
+        float maxValue = 0;
+        for(size_t t = chunk.firstToken; t < tokenEnd; ++t)
+        {
+            p = skipTextGridSpaces(p, end);
+
+            // the last token may extend past the chunk end
+
+            float value;
+            p = parseTextGridValue(p, end, value);
+            if(!p)
+            {
+                chunk.failed = true;
+                return;
+            }
+
+            const size_t voxel = t / readCount;
+            const size_t c     = t % readCount;
+            data[voxel * channels + c] = value;
+            maxValue = (std::max)(maxValue, value);
+        }
+
+        chunk.maxValue = maxValue;
+    });
+
+    float maxValue = 0;
+    for(auto &chunk : chunks)
+    {
+        if(chunk.failed)
+            throw std::runtime_error("invalid grid value in " + filename);
+        maxValue = (std::max)(maxValue, chunk.maxValue);
+    }
+
+    result.maxValue_ = maxValue;
+    result.data_     = data;
+    return result;
+}
+
+Grid Grid::loadBinary(const std::string &filename)
+{
+    MappedFile file(filename);
+
+    GridFileHeader header;
+    if(file.size() < sizeof(header))
+        throw std::runtime_error("invalid grid file: " + filename);
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if(std::memcmp(header.magic, GRID_FILE_MAGIC, sizeof(GRID_FILE_MAGIC)))
+        throw std::runtime_error("invalid grid file: " + filename);
+
+    // the byte order goes first, as the other fields read swapped too.
+    // version 1 files have no byteOrder, which is in the zeroed padding,
+    // and are little-endian as well
+
+    const bool isVersion1 = header.version == 1 && header.byteOrder == 0;
+    if(header.byteOrder != GRID_FILE_BYTE_ORDER && !isVersion1)
+        throw std::runtime_error("grid file of the other byte order: " + filename);
+
+    if(header.version != GRID_FILE_VERSION && !isVersion1)
+    {
+        throw std::runtime_error(
+            "unsupported grid file version " +
+            std::to_string(header.version) + ": " + filename);
+    }
+
+    const auto format = static_cast<GridFormat>(header.format);
+    const int channels = getGridFormatChannels(format);
+
+    if(header.width <= 0 || header.height <= 0 || header.depth <= 0)
+        throw std::runtime_error("invalid grid size in " + filename);
+
+    const uint64_t expectedSize = uint64_t(header.width) * header.height *
+                                  header.depth * channels * sizeof(float);
+    if(header.payloadSize != expectedSize ||
+       header.payloadOffset % GRID_FILE_ALIGNMENT ||
+       header.payloadOffset + header.payloadSize > file.size())
+        throw std::runtime_error("corrupted grid file: " + filename);
+
+    Grid result;
+    result.format_   = format;
+    result.size_     = Int3(header.width, header.height, header.depth);
+    result.maxValue_ = header.maxValue;
+    result.data_     = reinterpret_cast<const float *>(
+        file.data() + header.payloadOffset);
+    result.mappedFile_ = std::move(file);
+
+    return result;
+}
+
+Grid Grid::load(const std::string &filename, GridFormat textFormat)
+{
+    if(isBinaryFile(filename))
+        return loadBinary(filename);
+    return loadTextParallel(filename, textFormat);
+}
+
+bool Grid::isBinaryFile(const std::string &filename)
+{
+    std::ifstream fin(filename, std::ios::binary);
+    if(!fin)
+        throw std::runtime_error("failed to open file: " + filename);
+
+    char magic[sizeof(GRID_FILE_MAGIC)] = {};
+    fin.read(magic, sizeof(magic));
+    return fin && !std::memcmp(magic, GRID_FILE_MAGIC, sizeof(magic));
+}
+
+Grid Grid::fromData(GridFormat format, const Int3 &size, std::vector<float> data)
+{
+    const size_t expectedCount = size_t(size.x) * size.y * size.z * getGridFormatChannels(format);
+    if(data.size() != expectedCount)
+        throw std::runtime_error("grid data does not match the grid size");
+
+    Grid result;
+    result.format_    = format;
+    result.size_      = size;
+    result.maxValue_  = (std::max)(0.0f, data.empty() ? 0.0f : *std::max_element(data.begin(), data.end()));
+    result.ownedData_ = std::move(data);
+    result.data_      = result.ownedData_.data();
+    return result;
+}
+
+void Grid::saveBinary(const std::string &filename) const
+{
+    std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+    if(!fout)
+        throw std::runtime_error("failed to create file: " + filename);
+
+    GridFileHeader header = {};
+    std::memcpy(header.magic, GRID_FILE_MAGIC, sizeof(GRID_FILE_MAGIC));
+    header.version       = GRID_FILE_VERSION;
+    header.format        = static_cast<uint32_t>(format_);
+    header.width         = size_.x;
+    header.height        = size_.y;
+    header.depth         = size_.z;
+    header.maxValue      = maxValue_;
+    header.payloadOffset = GRID_FILE_ALIGNMENT;
+    header.payloadSize   = getByteSize();
+    header.byteOrder     = GRID_FILE_BYTE_ORDER;
+
+    static_assert(sizeof(GridFileHeader) <= GRID_FILE_ALIGNMENT);
+    std::vector<char> headerPage(GRID_FILE_ALIGNMENT, 0);
+    std::memcpy(headerPage.data(), &header, sizeof(header));
+
+    fout.write(headerPage.data(), static_cast<std::streamsize>(headerPage.size()));
+    fout.write(
+        reinterpret_cast<const char *>(data_),
+        static_cast<std::streamsize>(header.payloadSize));
+
+    if(!fout)
+        throw std::runtime_error("failed to write file: " + filename);
+}
+
+GridFormat Grid::getFormat() const
+{
+    return format_;
+}
+
+int Grid::getChannels() const
+{
+    return getGridFormatChannels(format_);
+}
+
+const Int3 &Grid::getSize() const
+{
+    return size_;
+}
+
+size_t Grid::getVoxelCount() const
+{
+    return size_t(size_.x) * size_.y * size_.z;
+}
+
+float Grid::getMaxValue() const
+{
+    return maxValue_;
+}
+
+const float *Grid::getData() const
+{
+    return data_;
+}
+
+size_t Grid::getByteSize() const
+{
+    return getVoxelCount() * getChannels() * sizeof(float);
+}
+
+bool Grid::isMapped() const
+{
+    return mappedFile_.isOpen();
+}
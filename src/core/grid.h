@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "mapped_file.h"
+
+enum class GridFormat : uint32_t
+{
+    R32F    = 0, // one float per voxel
+    RGBA32F = 1  // four floats per voxel, alpha is unused
+};
+
+/*
+binary grid file (.vgrid) layout:
+
+    GridFileHeader
+    zero padding up to payloadOffset (a multiple of GRID_FILE_ALIGNMENT)
+    payload: x-major, then y, then z; little-endian floats
+
+the payload has exactly the layout of D3D11_SUBRESOURCE_DATA with tightly
+packed rows and slices, so a mapped file can be uploaded without any copy.
+the header is little-endian too. byteOrder is GRID_FILE_BYTE_ORDER written
+by a little-endian host, so a host of the other byte order reads it swapped
+and rejects the file instead of reading its values as garbage
+*/
+struct GridFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t format;
+    int32_t  width;
+    int32_t  height;
+    int32_t  depth;
+    float    maxValue;
+    uint64_t payloadOffset;
+    uint64_t payloadSize;
+    uint32_t byteOrder; // since version 2
+    uint32_t pad0;
+};
+
+constexpr char     GRID_FILE_MAGIC[8]   = { 'A', 'G', 'Z', 'V', 'G', 'R', 'I', 'D' };
+constexpr uint32_t GRID_FILE_VERSION    = 2;
+constexpr uint32_t GRID_FILE_BYTE_ORDER = 0x01020304;
+constexpr uint64_t GRID_FILE_ALIGNMENT  = 4096;
+
+int getGridFormatChannels(GridFormat format);
+
+class Grid
+{
+public:
+
+    // whitespace-separated 'width height depth' followed by voxel values.
+    // a RGBA32F grid reads three values per voxel and sets alpha to 0
+    static Grid loadText(const std::string &filename, GridFormat format);
+
+    // same as loadText, but tokenizes and parses the mapped file in parallel.
+    // produces bit-identical voxel values
+    static Grid loadTextParallel(const std::string &filename, GridFormat format);
+
+    // maps the file into memory. voxel data is not copied
+    static Grid loadBinary(const std::string &filename);
+
+    // binary if the file starts with GRID_FILE_MAGIC, parallel text otherwise
+    static Grid load(const std::string &filename, GridFormat textFormat);
+
+    static bool isBinaryFile(const std::string &filename);
+
+    // takes ownership of voxel values laid out like the .vgrid payload
+    static Grid fromData(GridFormat format, const Int3 &size, std::vector<float> data);
+
+    Grid() = default;
+
+    Grid(Grid &&) noexcept = default;
+
+    Grid &operator=(Grid &&) noexcept = default;
+
+    Grid(const Grid &) = delete;
+
+    Grid &operator=(const Grid &) = delete;
+
+    void saveBinary(const std::string &filename) const;
+
+    GridFormat getFormat() const;
+
+    int getChannels() const;
+
+    const Int3 &getSize() const;
+
+    size_t getVoxelCount() const;
+
+    // max value over all voxels and channels
+    float getMaxValue() const;
+
+    const float *getData() const;
+
+    size_t getByteSize() const;
+
+    bool isMapped() const;
+
+private:
+
+    GridFormat format_   = GridFormat::R32F;
+    Int3       size_     = Int3(0);
+    float      maxValue_ = 0;
+
+    std::vector<float> ownedData_;
+    MappedFile         mappedFile_;
+
+    const float *data_ = nullptr;
+};
+
+// trilinear filtering of the first C channels of voxels with the given
+// channel stride, with clamp addressing like VolumeSampler
+template<int C>
+void sampleTrilinear(
+    const float *data, const Int3 &size, int channels, const Float3 &uvw, float *result)
+{
+    const int   sizes[3] = { size.x, size.y, size.z };
+    const float coords[3] = { uvw.x, uvw.y, uvw.z };
+
+    int   i0[3], i1[3];
+    float f[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        const float x  = coords[i] * sizes[i] - 0.5f;
+        const float fx = std::floor(x);
+        const int   ix = static_cast<int>(fx);
+
+        f[i]  = x - fx;
+        i0[i] = (std::max)(0, (std::min)(sizes[i] - 1, ix));
+        i1[i] = (std::max)(0, (std::min)(sizes[i] - 1, ix + 1));
+    }
+
+    auto at = [&](int x, int y, int z)
+    {
+        return data + ((size_t(z) * size.y + y) * size.x + x) * channels;
+    };
+
+    const float *v000 = at(i0[0], i0[1], i0[2]), *v100 = at(i1[0], i0[1], i0[2]);
+    const float *v010 = at(i0[0], i1[1], i0[2]), *v110 = at(i1[0], i1[1], i0[2]);
+    const float *v001 = at(i0[0], i0[1], i1[2]), *v101 = at(i1[0], i0[1], i1[2]);
+    const float *v011 = at(i0[0], i1[1], i1[2]), *v111 = at(i1[0], i1[1], i1[2]);
+
+    for(int c = 0; c < C; ++c)
+    {
+        const float x00 = v000[c] + f[0] * (v100[c] - v000[c]);
+        const float x10 = v010[c] + f[0] * (v110[c] - v010[c]);
+        const float x01 = v001[c] + f[0] * (v101[c] - v001[c]);
+        const float x11 = v011[c] + f[0] * (v111[c] - v011[c]);
+        const float y0  = x00 + f[1] * (x10 - x00);
+        const float y1  = x01 + f[1] * (x11 - x01);
+        result[c] = y0 + f[2] * (y1 - y0);
+    }
+}
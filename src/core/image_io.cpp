@@ -0,0 +1,78 @@
+#include <fstream>
+#include <stdexcept>
+
+#include "image_io.h"
+
+namespace
+{
+    Float3 resolve(const Float4 &pixel)
+    {
+        return pixel.w > 0 ? pixel.xyz() / pixel.w : Float3(0);
+    }
+
+    float tonemap(float x, float exposure)
+    {
+        constexpr float A = 2.51f, B = 0.03f, C = 2.43f, D = 0.59f, E = 0.14f;
+        const float v = exposure * x;
+        return (v * (A * v + B)) / (v * (C * v + D) + E);
+    }
+}
+
+void saveAccumulatedToPFM(
+    const std::string &filename, const Int2 &size, const std::vector<Float4> &pixels)
+{
+    std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+    if(!fout)
+        throw std::runtime_error("failed to create file: " + filename);
+
+    // negative scale means little-endian. rows are stored bottom to top
+    fout << "PF\n" << size.x << " " << size.y << "\n-1.0\n";
+
+    std::vector<float> row(3 * size.x);
+    for(int y = size.y - 1; y >= 0; --y)
+    {
+        for(int x = 0; x < size.x; ++x)
+        {
+            const Float3 c = resolve(pixels[y * size.x + x]);
+            row[3 * x] = c.x; row[3 * x + 1] = c.y; row[3 * x + 2] = c.z;
+        }
+        fout.write(
+            reinterpret_cast<const char *>(row.data()),
+            static_cast<std::streamsize>(row.size() * sizeof(float)));
+    }
+
+    if(!fout)
+        throw std::runtime_error("failed to write file: " + filename);
+}
+
+void saveAccumulatedToPPM(
+    const std::string &filename, const Int2 &size, const std::vector<Float4> &pixels,
+    float exposure)
+{
+    std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+    if(!fout)
+        throw std::runtime_error("failed to create file: " + filename);
+
+    fout << "P6\n" << size.x << " " << size.y << "\n255\n";
+
+    std::vector<unsigned char> row(3 * size.x);
+    for(int y = 0; y < size.y; ++y)
+    {
+        for(int x = 0; x < size.x; ++x)
+        {
+            const Float3 c = resolve(pixels[y * size.x + x]);
+            for(int i = 0; i < 3; ++i)
+            {
+                const float ldr = std::pow(tonemap(c[i], exposure), 1 / 2.2f);
+                row[3 * x + i] = static_cast<unsigned char>(
+                    agz::math::clamp(ldr, 0.0f, 1.0f) * 255 + 0.5f);
+            }
+        }
+        fout.write(
+            reinterpret_cast<const char *>(row.data()),
+            static_cast<std::streamsize>(row.size()));
+    }
+
+    if(!fout)
+        throw std::runtime_error("failed to write file: " + filename);
+}
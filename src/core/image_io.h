@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+// pixels are (accumulated radiance, sample count) as in the renderer outputs.
+// the saved radiance is rgb / count
+
+void saveAccumulatedToPFM(
+    const std::string &filename, const Int2 &size, const std::vector<Float4> &pixels);
+
+// tonemapped and gamma corrected like asset/display.hlsl
+void saveAccumulatedToPPM(
+    const std::string &filename, const Int2 &size, const std::vector<Float4> &pixels,
+    float exposure);
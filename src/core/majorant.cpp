@@ -0,0 +1,161 @@
+#include <cmath>
+
+#include "brick_file.h"
+#include "majorant.h"
+#include "task_scheduler.h"
+
+namespace
+{
+    // voxel range [beg, end) read by trilinear filtering at texture
+    // coordinates in [c / res, (c + 1) / res], with clamp addressing
+    void computeVoxelRanges(
+        const Int3 &size, const Int3 &res, std::vector<int> (&ranges)[3])
+    {
+        const int sizes[3] = { size.x, size.y, size.z };
+        const int ress[3]  = { res.x, res.y, res.z };
+
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            ranges[axis].resize(2 * ress[axis]);
+            for(int c = 0; c < ress[axis]; ++c)
+            {
+                const float lo = float(c)     / ress[axis] * sizes[axis] - 0.5f;
+                const float hi = float(c + 1) / ress[axis] * sizes[axis] - 0.5f;
+
+                const int beg = static_cast<int>(std::floor(lo));
+                const int end = static_cast<int>(std::floor(hi)) + 2;
+
+                ranges[axis][2 * c]     = (std::max)(0, beg);
+                ranges[axis][2 * c + 1] = (std::min)(sizes[axis], end);
+            }
+        }
+    }
+}
+
+void MajorantGrid::build(const Grid &density, int cellSize)
+{
+    if(density.getFormat() != GridFormat::R32F)
+        throw std::runtime_error("majorant grid requires a R32F density grid");
+
+    const Int3 &size = density.getSize();
+
+    res_ = Int3(
+        (size.x + cellSize - 1) / cellSize,
+        (size.y + cellSize - 1) / cellSize,
+        (size.z + cellSize - 1) / cellSize);
+
+    std::vector<int> ranges[3];
+    computeVoxelRanges(size, res_, ranges);
+
+    majorants_.assign(res_.product(), 0.0f);
+    minorants_.assign(res_.product(), 0.0f);
+
+    const float *data = density.getData();
+    parallelFor(0, res_.z, [&](int cz)
+    {
+        for(int cy = 0; cy < res_.y; ++cy)
+        {
+            for(int cx = 0; cx < res_.x; ++cx)
+            {
+                float majorant = 0;
+                float minorant = std::numeric_limits<float>::infinity();
+                for(int z = ranges[2][2 * cz]; z < ranges[2][2 * cz + 1]; ++z)
+                {
+                    for(int y = ranges[1][2 * cy]; y < ranges[1][2 * cy + 1]; ++y)
+                    {
+                        const float *row = data + (size_t(z) * size.y + y) * size.x;
+                        for(int x = ranges[0][2 * cx]; x < ranges[0][2 * cx + 1]; ++x)
+                        {
+                            majorant = (std::max)(majorant, row[x]);
+                            minorant = (std::min)(minorant, row[x]);
+                        }
+                    }
+                }
+
+                const size_t index = (size_t(cz) * res_.y + cy) * res_.x + cx;
+                majorants_[index] = majorant;
+                minorants_[index] = (std::min)(minorant, majorant);
+            }
+        }
+    });
+}
+
+void MajorantGrid::build(const BrickFile &file, int cellSize)
+{
+    const Int3 &size = file.getSize();
+
+    res_ = Int3(
+        (size.x + cellSize - 1) / cellSize,
+        (size.y + cellSize - 1) / cellSize,
+        (size.z + cellSize - 1) / cellSize);
+
+    std::vector<int> ranges[3];
+    computeVoxelRanges(size, res_, ranges);
+
+    // bricks storing the voxels of each range. the bounds of a brick cover
+    // its apron, which only loosens them
+
+    for(auto &range : ranges)
+    {
+        for(size_t i = 0; i < range.size(); i += 2)
+        {
+            range[i + 1] = (range[i + 1] - 1) / BRICK_SIZE + 1;
+            range[i]     = range[i] / BRICK_SIZE;
+        }
+    }
+
+    majorants_.assign(res_.product(), 0.0f);
+    minorants_.assign(res_.product(), 0.0f);
+
+    parallelFor(0, res_.z, [&](int cz)
+    {
+        for(int cy = 0; cy < res_.y; ++cy)
+        {
+            for(int cx = 0; cx < res_.x; ++cx)
+            {
+                float majorant = 0;
+                float minorant = std::numeric_limits<float>::infinity();
+                for(int z = ranges[2][2 * cz]; z < ranges[2][2 * cz + 1]; ++z)
+                {
+                    for(int y = ranges[1][2 * cy]; y < ranges[1][2 * cy + 1]; ++y)
+                    {
+                        for(int x = ranges[0][2 * cx]; x < ranges[0][2 * cx + 1]; ++x)
+                        {
+                            majorant = (std::max)(majorant, file.getBrickMajorant(x, y, z));
+                            minorant = (std::min)(minorant, file.getBrickMinorant(x, y, z));
+                        }
+                    }
+                }
+
+                const size_t index = (size_t(cz) * res_.y + cy) * res_.x + cx;
+                majorants_[index] = majorant;
+                minorants_[index] = (std::min)(minorant, majorant);
+            }
+        }
+    });
+}
+
+const Int3 &MajorantGrid::getResolution() const
+{
+    return res_;
+}
+
+float MajorantGrid::getMajorant(int x, int y, int z) const
+{
+    return majorants_[(size_t(z) * res_.y + y) * res_.x + x];
+}
+
+float MajorantGrid::getMinorant(int x, int y, int z) const
+{
+    return minorants_[(size_t(z) * res_.y + y) * res_.x + x];
+}
+
+const std::vector<float> &MajorantGrid::getData() const
+{
+    return majorants_;
+}
+
+const std::vector<float> &MajorantGrid::getMinorantData() const
+{
+    return minorants_;
+}
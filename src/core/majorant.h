@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "grid.h"
+
+constexpr int MAJORANT_CELL_SIZE = 8;
+
+class BrickFile;
+
+// coarse grid of per-cell upper and lower bounds of a density grid.
+// cells are aligned to the [0, 1]^3 texture coordinate space
+class MajorantGrid
+{
+public:
+
+    // each majorant (minorant) bounds every value trilinear interpolation
+    // can return inside the cell from above (below), including the voxels it
+    // fetches from neighbor cells
+    void build(const Grid &density, int cellSize = MAJORANT_CELL_SIZE);
+
+    // conservative bounds from the per-brick bounds of a brick file, without
+    // reading any voxel
+    void build(const BrickFile &file, int cellSize = MAJORANT_CELL_SIZE);
+
+    const Int3 &getResolution() const;
+
+    // raw (unscaled) majorant of a cell
+    float getMajorant(int x, int y, int z) const;
+
+    // raw (unscaled) minorant of a cell
+    float getMinorant(int x, int y, int z) const;
+
+    const std::vector<float> &getData() const;
+
+    const std::vector<float> &getMinorantData() const;
+
+    // visits cells along the segment from uvwA to uvwB, parameterized by
+    // t in [0, tMax]. func(t0, t1, majorant, minorant) is called for each
+    // overlapped cell in order and returns false to stop the traversal
+    template<typename Func>
+    void traverse(
+        const Float3 &uvwA, const Float3 &uvwB, float tMax, Func &&func) const;
+
+private:
+
+    Int3               res_ = Int3(0);
+    std::vector<float> majorants_;
+    std::vector<float> minorants_;
+};
+
+template<typename Func>
+void MajorantGrid::traverse(
+    const Float3 &uvwA, const Float3 &uvwB, float tMax, Func &&func) const
+{
+    if(tMax <= 0 || majorants_.empty())
+        return;
+
+    constexpr float INF = std::numeric_limits<float>::infinity();
+
+    const int   res[3] = { res_.x, res_.y, res_.z };
+    const float p[3]   = { uvwA.x * res_.x, uvwA.y * res_.y, uvwA.z * res_.z };
+    const float q[3]   = { uvwB.x * res_.x, uvwB.y * res_.y, uvwB.z * res_.z };
+
+    int   cell[3], step[3];
+    float tNext[3], tDelta[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        cell[i] = (std::max)(0, (std::min)(res[i] - 1, static_cast<int>(std::floor(p[i]))));
+
+        const float dir = (q[i] - p[i]) / tMax;
+        if(dir > 0)
+        {
+            step[i]   = 1;
+            tNext[i]  = (cell[i] + 1 - p[i]) / dir;
+            tDelta[i] = 1 / dir;
+        }
+        else if(dir < 0)
+        {
+            step[i]   = -1;
+            tNext[i]  = (cell[i] - p[i]) / dir;
+            tDelta[i] = -1 / dir;
+        }
+        else
+        {
+            step[i]   = 0;
+            tNext[i]  = INF;
+            tDelta[i] = INF;
+        }
+    }
+
+    float t = 0;
+    while(t < tMax)
+    {
+        int axis = tNext[0] < tNext[1] ? 0 : 1;
+        axis = tNext[2] < tNext[axis] ? 2 : axis;
+
+        const float tExit = (std::max)(t, (std::min)(tNext[axis], tMax));
+        const size_t index = (size_t(cell[2]) * res_.y + cell[1]) * res_.x + cell[0];
+        if(!func(t, tExit, majorants_[index], minorants_[index]))
+            return;
+        t = tExit;
+
+        cell[axis] += step[axis];
+        if(cell[axis] < 0 || cell[axis] >= res[axis])
+            return;
+        tNext[axis] += tDelta[axis];
+    }
+}
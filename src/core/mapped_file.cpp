@@ -0,0 +1,177 @@
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+MappedFile::MappedFile(const std::string &filename)
+{
+    open(filename);
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+    swap(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    MappedFile(std::move(other)).swap(*this);
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+void MappedFile::open(const std::string &filename)
+{
+    close();
+
+    HANDLE file = CreateFileA(
+        filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("failed to open file: " + filename);
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        throw std::runtime_error("failed to get size of file: " + filename);
+    }
+
+    file_ = file;
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+    if(!size_)
+        return;
+
+    HANDLE mapping = CreateFileMappingA(
+        file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!mapping)
+    {
+        close();
+        throw std::runtime_error("failed to map file: " + filename);
+    }
+    mapping_ = mapping;
+
+    data_ = static_cast<const char *>(
+        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(!data_)
+    {
+        close();
+        throw std::runtime_error("failed to map file: " + filename);
+    }
+}
+
+void MappedFile::close()
+{
+    if(data_)
+        UnmapViewOfFile(data_);
+    if(mapping_)
+        CloseHandle(mapping_);
+    if(file_)
+        CloseHandle(file_);
+
+    data_    = nullptr;
+    size_    = 0;
+    mapping_ = nullptr;
+    file_    = nullptr;
+}
+
+bool MappedFile::isOpen() const
+{
+    return file_ != nullptr;
+}
+
+void MappedFile::swap(MappedFile &other) noexcept
+{
+    std::swap(data_,    other.data_);
+    std::swap(size_,    other.size_);
+    std::swap(file_,    other.file_);
+    std::swap(mapping_, other.mapping_);
+}
+
+#else
+
+void MappedFile::open(const std::string &filename)
+{
+    close();
+
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("failed to open file: " + filename);
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("failed to get size of file: " + filename);
+    }
+
+    fd_   = fd;
+    size_ = static_cast<size_t>(st.st_size);
+    if(!size_)
+        return;
+
+    void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(addr == MAP_FAILED)
+    {
+        close();
+        throw std::runtime_error("failed to map file: " + filename);
+    }
+    data_ = static_cast<const char *>(addr);
+
+    madvise(addr, size_, MADV_SEQUENTIAL);
+}
+
+void MappedFile::close()
+{
+    if(data_)
+        munmap(const_cast<char *>(data_), size_);
+    if(fd_ >= 0)
+        ::close(fd_);
+
+    data_ = nullptr;
+    size_ = 0;
+    fd_   = -1;
+}
+
+bool MappedFile::isOpen() const
+{
+    return fd_ >= 0;
+}
+
+void MappedFile::swap(MappedFile &other) noexcept
+{
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(fd_,   other.fd_);
+}
+
+#endif
+
+const char *MappedFile::data() const
+{
+    return data_;
+}
+
+size_t MappedFile::size() const
+{
+    return size_;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string &filename);
+
+    MappedFile(MappedFile &&other) noexcept;
+
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile();
+
+    void open(const std::string &filename);
+
+    void close();
+
+    bool isOpen() const;
+
+    const char *data() const;
+
+    size_t size() const;
+
+private:
+
+    void swap(MappedFile &other) noexcept;
+
+    const char *data_ = nullptr;
+    size_t      size_ = 0;
+
+#ifdef _WIN32
+    void *file_    = nullptr;
+    void *mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
@@ -0,0 +1,674 @@
+#include "medium.h"
+#include "rng.h"
+
+namespace
+{
+    // an estimate cut off by the step cap is zero, not its partial
+    // product, which would be biased up
+    constexpr int MAX_TRACKING_STEPS = 10000;
+
+    constexpr float ROULETTE_THRESHOLD = 0.1f;
+
+    template<int C>
+    void sampleGrid(const Grid &grid, const Float3 &uvw, float *result)
+    {
+        sampleTrilinear<C>(grid.getData(), grid.getSize(), grid.getChannels(), uvw, result);
+    }
+
+    Float3 lerp(const Float3 &a, const Float3 &b, float t)
+    {
+        return a + t * (b - a);
+    }
+
+    float sampleExponential(float invSigma, uint32_t &rng)
+    {
+        return -std::log(1 - randFloat(rng)) * invSigma;
+    }
+
+    // estimates below the threshold survive with probability
+    // estimate / threshold and continue as the threshold. returns false
+    // if the estimate is terminated
+    bool roulette(float &estimate, uint32_t &rng)
+    {
+        if(estimate >= ROULETTE_THRESHOLD)
+            return true;
+
+        if(randFloat(rng) * ROULETTE_THRESHOLD >= estimate)
+        {
+            estimate = 0;
+            return false;
+        }
+
+        estimate = ROULETTE_THRESHOLD;
+        return true;
+    }
+}
+
+const char *getTransmittanceEstimatorName(TransmittanceEstimator estimator)
+{
+    switch(estimator)
+    {
+    case TransmittanceEstimator::RatioCutoff:   return "cutoff";
+    case TransmittanceEstimator::RatioRoulette: return "roulette";
+    case TransmittanceEstimator::ResidualRatio: return "residual";
+    }
+    return "unknown";
+}
+
+const char *getFreeFlightSamplerName(FreeFlightSampler sampler)
+{
+    switch(sampler)
+    {
+    case FreeFlightSampler::Delta:         return "delta";
+    case FreeFlightSampler::Decomposition: return "decomposition";
+    }
+    return "unknown";
+}
+
+void VolumeMedium::setDensity(const Grid *density)
+{
+    density_ = density;
+    setDensityScale(densityScale_);
+}
+
+void VolumeMedium::setAlbedo(const Grid *albedo)
+{
+    albedo_ = albedo;
+}
+
+void VolumeMedium::setBrickGrid(const BrickGrid *bricks)
+{
+    bricks_ = bricks;
+}
+
+void VolumeMedium::setBrickCache(const BrickCache *cache)
+{
+    cache_ = cache;
+    setDensityScale(densityScale_);
+}
+
+void VolumeMedium::setMipChain(const DensityMipChain *mips)
+{
+    mips_ = mips;
+}
+
+VolumeMedium VolumeMedium::atLod(float lod) const
+{
+    VolumeMedium result = *this;
+    result.lod_ = mips_ ? lod : 0.0f;
+    return result;
+}
+
+float VolumeMedium::getLod() const
+{
+    return lod_;
+}
+
+void VolumeMedium::setMajorantGrid(const MajorantGrid *majorants)
+{
+    majorants_ = majorants;
+}
+
+void VolumeMedium::setBoundingBox(const Float3 &lower, const Float3 &upper)
+{
+    lower_     = lower;
+    upper_     = upper;
+    invExtent_ = Float3(1) / (upper - lower);
+}
+
+void VolumeMedium::setDensityScale(float scale)
+{
+    densityScale_ = scale;
+    maxDensity_   = scale * (
+        cache_   ? cache_->getFile().getMaxValue() :
+        density_ ? density_->getMaxValue() : 0.0f);
+    invDensity_   = 1 / (std::max)(0.001f, maxDensity_);
+}
+
+void VolumeMedium::setG(float g)
+{
+    g_  = g;
+    g2_ = g * g;
+}
+
+float VolumeMedium::getMaxDensity() const
+{
+    return maxDensity_;
+}
+
+const Grid *VolumeMedium::getDensity() const
+{
+    return density_;
+}
+
+const void *VolumeMedium::getDensitySource() const
+{
+    if(lod_ > 0)
+        return mips_;
+    if(cache_)
+        return cache_;
+    if(bricks_)
+        return bricks_;
+    return density_;
+}
+
+const Grid *VolumeMedium::getAlbedo() const
+{
+    return albedo_;
+}
+
+const Float3 &VolumeMedium::getLower() const
+{
+    return lower_;
+}
+
+const Float3 &VolumeMedium::getUpper() const
+{
+    return upper_;
+}
+
+float VolumeMedium::getDensityScale() const
+{
+    return densityScale_;
+}
+
+float VolumeMedium::getG() const
+{
+    return g_;
+}
+
+Float2 VolumeMedium::intersectRayBox(const Float3 &o, const Float3 &d) const
+{
+    const Float3 invD = Float3(1) / d;
+    const Float3 n = invD * (lower_ - o);
+    const Float3 f = invD * (upper_ - o);
+
+    const float t0 = (std::max)({
+        (std::min)(n.x, f.x), (std::min)(n.y, f.y), (std::min)(n.z, f.z) });
+    const float t1 = (std::min)({
+        (std::max)(n.x, f.x), (std::max)(n.y, f.y), (std::max)(n.z, f.z) });
+
+    return Float2((std::max)(0.0f, t0), t1);
+}
+
+bool VolumeMedium::findEntry(const Float3 &o, const Float3 &d, Float3 &entry) const
+{
+    if(lower_.x <= o.x && o.x <= upper_.x &&
+       lower_.y <= o.y && o.y <= upper_.y &&
+       lower_.z <= o.z && o.z <= upper_.z)
+    {
+        entry = o;
+        return true;
+    }
+
+    const Float2 incts = intersectRayBox(o, d);
+    if(incts.x + 0.001f < incts.y)
+    {
+        entry = o + (incts.x + 0.001f) * d;
+        return true;
+    }
+
+    return false;
+}
+
+Float3 VolumeMedium::toTexCoord(const Float3 &worldPos) const
+{
+    return (worldPos - lower_) * invExtent_;
+}
+
+Float3 VolumeMedium::sampleAlbedo(const Float3 &uvw) const
+{
+    float raw[3];
+    sampleGrid<3>(*albedo_, uvw, raw);
+    return Float3(
+        std::pow(raw[0], 2.2f), std::pow(raw[1], 2.2f), std::pow(raw[2], 2.2f));
+}
+
+float VolumeMedium::sampleDensity(const Float3 &uvw) const
+{
+    if(lod_ > 0)
+        return densityScale_ * mips_->sampleLod(uvw, lod_);
+    if(cache_)
+        return densityScale_ * cache_->sample(uvw);
+    if(bricks_)
+        return densityScale_ * bricks_->sample(uvw);
+
+    float raw;
+    sampleGrid<1>(*density_, uvw, &raw);
+    return densityScale_ * raw;
+}
+
+float VolumeMedium::evalPhaseFunction(float u) const
+{
+    const float dem = 1 + g2_ - 2 * g_ * u;
+    return (1 - g2_) / (4 * PI * dem * std::sqrt(dem));
+}
+
+Float3 VolumeMedium::samplePhaseFunction(const Float3 &wo, uint32_t &rng) const
+{
+    const float u1 = randFloat(rng);
+    const float u2 = randFloat(rng);
+    return samplePhaseFunction(wo, Float2(u1, u2));
+}
+
+Float3 VolumeMedium::samplePhaseFunction(const Float3 &wo, const Float2 &sample) const
+{
+    const float s = 2 * sample.x - 1;
+
+    float u;
+    if(std::abs(g_) < 0.001f)
+        u = s;
+    else
+    {
+        const float m = (1 - g2_) / (1 + g_ * s);
+        u = (1 + g2_ - m * m) / (2 * g_);
+    }
+
+    const float cosTheta = -u;
+    const float sinTheta = std::sqrt((std::max)(0.0f, 1 - cosTheta * cosTheta));
+    const float phi = 2 * PI * sample.y;
+
+    const Float3 localWi(
+        sinTheta * std::sin(phi),
+        sinTheta * std::cos(phi),
+        cosTheta);
+
+    const Float3 X(1, 0, 0), Y(0, 1, 0);
+
+    const Float3 localZ = wo;
+    const Float3 localX = cross(
+        localZ, std::abs(dot(localZ, Y)) > 0.9f ? X : Y).normalize();
+    const Float3 localY = cross(localZ, localX);
+
+    return localWi.z * localZ + localWi.x * localX + localWi.y * localY;
+}
+
+float VolumeMedium::estimateTransmittance(
+    const Float3 &a, const Float3 &b, uint32_t &rng, TrackingStats *stats) const
+{
+    const float tMax = (b - a).length();
+
+    float result = 1, t = 0;
+    uint64_t lookups = 0;
+
+    int i = 0;
+    for(; i < MAX_TRACKING_STEPS; ++i)
+    {
+        t += sampleExponential(invDensity_, rng);
+        if(t >= tMax)
+            break;
+
+        const float density = sampleDensity(toTexCoord(lerp(a, b, t / tMax)));
+        ++lookups;
+
+        result *= 1 - density * invDensity_;
+        if(result < 0.001f)
+        {
+            result = 0;
+            break;
+        }
+    }
+    if(i == MAX_TRACKING_STEPS)
+        result = 0;
+
+    if(stats)
+        stats->densityLookups += lookups;
+    return result;
+}
+
+float VolumeMedium::estimateTransmittanceRoulette(
+    const Float3 &a, const Float3 &b, uint32_t &rng, TrackingStats *stats) const
+{
+    const float tMax = (b - a).length();
+
+    float result = 1, t = 0;
+    uint64_t lookups = 0;
+
+    int i = 0;
+    for(; i < MAX_TRACKING_STEPS; ++i)
+    {
+        t += sampleExponential(invDensity_, rng);
+        if(t >= tMax)
+            break;
+
+        const float density = sampleDensity(toTexCoord(lerp(a, b, t / tMax)));
+        ++lookups;
+
+        result *= 1 - density * invDensity_;
+        if(!roulette(result, rng))
+            break;
+    }
+    if(i == MAX_TRACKING_STEPS)
+        result = 0;
+
+    if(stats)
+        stats->densityLookups += lookups;
+    return result;
+}
+
+float VolumeMedium::estimateTransmittanceResidual(
+    const Float3 &a, const Float3 &b, uint32_t &rng, TrackingStats *stats) const
+{
+    if(!majorants_ || lod_ > 0)
+        return estimateTransmittanceRoulette(a, b, rng, stats);
+
+    const float tMax = (b - a).length();
+    const Float3 uvwA = toTexCoord(a), uvwB = toTexCoord(b);
+
+    float result = 1;
+    int steps = 0;
+    uint64_t lookups = 0;
+
+    majorants_->traverse(uvwA, uvwB, tMax,
+        [&](float t0, float t1, float rawMajorant, float rawMinorant)
+    {
+        // the control density is integrated analytically, and ratio tracking
+        // only estimates the residual density. using the minorant as control
+        // keeps the ratios within [0, 1]; a centered control halves the
+        // residual majorant but its ratios in [0, 2] blow up the variance
+        const float control  = densityScale_ * rawMinorant;
+        const float residual = densityScale_ * (rawMajorant - rawMinorant);
+
+        result *= std::exp(-control * (t1 - t0));
+        if(!roulette(result, rng))
+            return false;
+
+        if(residual <= 0)
+            return true;
+        const float invResidual = 1 / residual;
+
+        float t = t0;
+        while(steps++ < MAX_TRACKING_STEPS)
+        {
+            t += sampleExponential(invResidual, rng);
+            if(t >= t1)
+                return true;
+
+            const float density = sampleDensity(lerp(uvwA, uvwB, t / tMax));
+            ++lookups;
+
+            result *= 1 - (density - control) * invResidual;
+            if(!roulette(result, rng))
+                return false;
+        }
+        result = 0;
+        return false;
+    });
+
+    if(stats)
+        stats->densityLookups += lookups;
+    return result;
+}
+
+float VolumeMedium::estimateTransmittance(
+    TransmittanceEstimator estimator,
+    const Float3 &a, const Float3 &b, uint32_t &rng, TrackingStats *stats) const
+{
+    switch(estimator)
+    {
+    case TransmittanceEstimator::RatioRoulette:
+        return estimateTransmittanceRoulette(a, b, rng, stats);
+    case TransmittanceEstimator::ResidualRatio:
+        return estimateTransmittanceResidual(a, b, rng, stats);
+    default:
+        return estimateTransmittance(a, b, rng, stats);
+    }
+}
+
+bool VolumeMedium::deltaTrack(
+    const Float3 &a, const Float3 &b, uint32_t &rng, Float3 &scatterPos,
+    TrackingStats *stats) const
+{
+    return deltaTrack(a, b, nullptr, rng, scatterPos, stats);
+}
+
+bool VolumeMedium::deltaTrack(
+    const Float3 &a, const Float3 &b, const Float2 &firstStep, uint32_t &rng,
+    Float3 &scatterPos, TrackingStats *stats) const
+{
+    return deltaTrack(a, b, &firstStep, rng, scatterPos, stats);
+}
+
+bool VolumeMedium::deltaTrack(
+    const Float3 &a, const Float3 &b, const Float2 *firstStep, uint32_t &rng,
+    Float3 &scatterPos, TrackingStats *stats) const
+{
+    const float tMax = (b - a).length();
+
+    float t = 0;
+    uint64_t lookups = 0;
+    bool scattered = false;
+
+    // firstStep->y decides null collisions after the first too, rescaled
+    // to [0, 1) after each, while it keeps half of its 24 bits. whether and
+    // at which of the tentative collisions the path scatters is then
+    // stratified like the sample
+
+    float decision = firstStep ? firstStep->y : 0;
+    float nullProb = 1;
+
+    for(int i = 0; i < MAX_TRACKING_STEPS; ++i)
+    {
+        t += firstStep && i == 0 ? -std::log(1 - firstStep->x) * invDensity_ :
+                                   sampleExponential(invDensity_, rng);
+        if(t >= tMax)
+            break;
+
+        const Float3 pos = lerp(a, b, t / tMax);
+        const float density = sampleDensity(toTexCoord(pos));
+        ++lookups;
+
+        const float scatterProb = density * invDensity_;
+        const bool useDecision = firstStep && nullProb > 1.0f / 4096;
+
+        if((useDecision ? decision : randFloat(rng)) < scatterProb)
+        {
+            scatterPos = pos;
+            scattered = true;
+            break;
+        }
+
+        if(useDecision)
+        {
+            decision = (std::min)((decision - scatterProb) / (1 - scatterProb), 0.99999994f);
+            nullProb *= 1 - scatterProb;
+        }
+    }
+
+    if(stats)
+        stats->densityLookups += lookups;
+    return scattered;
+}
+
+float VolumeMedium::estimateTransmittanceDDA(
+    const Float3 &a, const Float3 &b, uint32_t &rng, TrackingStats *stats) const
+{
+    if(!majorants_ || lod_ > 0)
+        return estimateTransmittance(a, b, rng, stats);
+
+    const float tMax = (b - a).length();
+    const Float3 uvwA = toTexCoord(a), uvwB = toTexCoord(b);
+
+    float result = 1;
+    int steps = 0;
+    uint64_t lookups = 0;
+
+    majorants_->traverse(uvwA, uvwB, tMax, [&](float t0, float t1, float rawMajorant, float)
+    {
+        const float majorant = densityScale_ * rawMajorant;
+        if(majorant <= 0)
+            return true;
+        const float invMajorant = 1 / majorant;
+
+        float t = t0;
+        while(steps++ < MAX_TRACKING_STEPS)
+        {
+            t += sampleExponential(invMajorant, rng);
+            if(t >= t1)
+                return true;
+
+            const float density = sampleDensity(lerp(uvwA, uvwB, t / tMax));
+            ++lookups;
+
+            result *= 1 - density * invMajorant;
+            if(result < 0.001f)
+            {
+                result = 0;
+                return false;
+            }
+        }
+        result = 0;
+        return false;
+    });
+
+    if(stats)
+        stats->densityLookups += lookups;
+    return result;
+}
+
+bool VolumeMedium::deltaTrackDDA(
+    const Float3 &a, const Float3 &b, uint32_t &rng, Float3 &scatterPos,
+    TrackingStats *stats) const
+{
+    if(!majorants_ || lod_ > 0)
+        return deltaTrack(a, b, rng, scatterPos, stats);
+
+    const float tMax = (b - a).length();
+    const Float3 uvwA = toTexCoord(a), uvwB = toTexCoord(b);
+
+    bool scattered = false;
+    int steps = 0;
+    uint64_t lookups = 0;
+
+    majorants_->traverse(uvwA, uvwB, tMax, [&](float t0, float t1, float rawMajorant, float)
+    {
+        const float majorant = densityScale_ * rawMajorant;
+        if(majorant <= 0)
+            return true;
+        const float invMajorant = 1 / majorant;
+
+        // exponential distances are memoryless, so tracking restarts at
+        // each cell boundary with the new majorant
+        float t = t0;
+        while(steps++ < MAX_TRACKING_STEPS)
+        {
+            t += sampleExponential(invMajorant, rng);
+            if(t >= t1)
+                return true;
+
+            const float density = sampleDensity(lerp(uvwA, uvwB, t / tMax));
+            ++lookups;
+
+            if(randFloat(rng) < density * invMajorant)
+            {
+                scatterPos = lerp(a, b, t / tMax);
+                scattered = true;
+                return false;
+            }
+        }
+        return false;
+    });
+
+    if(stats)
+        stats->densityLookups += lookups;
+    return scattered;
+}
+
+bool VolumeMedium::deltaTrackDecomposition(
+    const Float3 &a, const Float3 &b, uint32_t &rng, Float3 &scatterPos,
+    TrackingStats *stats) const
+{
+    return deltaTrackDecomposition(a, b, nullptr, rng, scatterPos, stats);
+}
+
+bool VolumeMedium::deltaTrackDecomposition(
+    const Float3 &a, const Float3 &b, const Float2 &firstStep, uint32_t &rng,
+    Float3 &scatterPos, TrackingStats *stats) const
+{
+    return deltaTrackDecomposition(a, b, &firstStep, rng, scatterPos, stats);
+}
+
+bool VolumeMedium::deltaTrackDecomposition(
+    const Float3 &a, const Float3 &b, const Float2 *firstStep, uint32_t &rng,
+    Float3 &scatterPos, TrackingStats *stats) const
+{
+    if(!majorants_ || lod_ > 0)
+        return deltaTrack(a, b, firstStep, rng, scatterPos, stats);
+
+    const float tMax = (b - a).length();
+    const Float3 uvwA = toTexCoord(a), uvwB = toTexCoord(b);
+
+    // the control collision is found by inverting the optical depth of the
+    // piecewise constant control density. the residual decisions use rng,
+    // as the residual collisions are rare where the control is dense
+    float controlDepth = firstStep ? -std::log(1 - firstStep->x) : sampleExponential(1, rng);
+
+    bool scattered = false;
+    int steps = 0;
+    uint64_t lookups = 0;
+
+    majorants_->traverse(uvwA, uvwB, tMax,
+        [&](float t0, float t1, float rawMajorant, float rawMinorant)
+    {
+        const float control  = densityScale_ * rawMinorant;
+        const float residual = densityScale_ * (rawMajorant - rawMinorant);
+
+        // residual tracking ends at the control collision if it is in this cell
+        float tEnd = t1;
+        bool controlHit = false;
+        if(control * (t1 - t0) > controlDepth)
+        {
+            tEnd = t0 + controlDepth / control;
+            controlHit = true;
+        }
+        else
+            controlDepth -= control * (t1 - t0);
+
+        if(residual > 0)
+        {
+            const float invResidual = 1 / residual;
+
+            float t = t0;
+            for(;;)
+            {
+                if(steps++ >= MAX_TRACKING_STEPS)
+                    return false;
+
+                t += sampleExponential(invResidual, rng);
+                if(t >= tEnd)
+                    break;
+
+                const float density = sampleDensity(lerp(uvwA, uvwB, t / tMax));
+                ++lookups;
+
+                if(randFloat(rng) * residual < density - control)
+                {
+                    scatterPos = lerp(a, b, t / tMax);
+                    scattered = true;
+                    return false;
+                }
+            }
+        }
+
+        if(!controlHit)
+            return true;
+
+        scatterPos = lerp(a, b, tEnd / tMax);
+        scattered = true;
+        return false;
+    });
+
+    if(stats)
+        stats->densityLookups += lookups;
+    return scattered;
+}
+
+bool VolumeMedium::sampleFreeFlight(
+    FreeFlightSampler sampler,
+    const Float3 &a, const Float3 &b, uint32_t &rng, Float3 &scatterPos,
+    TrackingStats *stats) const
+{
+    if(sampler == FreeFlightSampler::Decomposition)
+        return deltaTrackDecomposition(a, b, rng, scatterPos, stats);
+    return deltaTrack(a, b, rng, scatterPos, stats);
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstdint>
+
+#include "brick_cache.h"
+#include "density_mips.h"
+#include "majorant.h"
+
+// shadow ray transmittance estimators. values match the shader's
+// VolumeTransmittanceEstimator
+enum class TransmittanceEstimator
+{
+    RatioCutoff   = 0, // ratio tracking, terminated below 0.001. biased
+    RatioRoulette = 1, // ratio tracking with russian roulette
+    ResidualRatio = 2  // residual ratio tracking against per-cell control densities
+};
+
+// "cutoff", "roulette" or "residual"
+const char *getTransmittanceEstimatorName(TransmittanceEstimator estimator);
+
+// free-flight samplers of camera and scattered rays
+enum class FreeFlightSampler
+{
+    Delta         = 0, // delta tracking against the global majorant
+    Decomposition = 1  // decomposition tracking with per-cell control densities
+};
+
+// "delta" or "decomposition"
+const char *getFreeFlightSamplerName(FreeFlightSampler sampler);
+
+struct TrackingStats
+{
+    uint64_t densityLookups = 0;
+};
+
+// cpu counterpart of asset/volume.hlsl
+class VolumeMedium
+{
+public:
+
+    void setDensity(const Grid *density);
+
+    void setAlbedo(const Grid *albedo);
+
+    // density lookups go through the bricks when set, skipping empty ones.
+    // the dense grid is still required by packet tracing
+    void setBrickGrid(const BrickGrid *bricks);
+
+    // density lookups page bricks in through the cache when set, which
+    // replaces both the dense grid and the brick grid. packet tracing
+    // needs the dense grid and is skipped without it
+    void setBrickCache(const BrickCache *cache);
+
+    // coarser density levels for atLod
+    void setMipChain(const DensityMipChain *mips);
+
+    // a copy sampling the density at a (fractional) mip level of the chain.
+    // mean mips never exceed the max density, so global majorant tracking
+    // stays valid. level 0, or no chain, is the full resolution
+    VolumeMedium atLod(float lod) const;
+
+    float getLod() const;
+
+    // enables the *DDA trackers and residual ratio tracking
+    void setMajorantGrid(const MajorantGrid *majorants);
+
+    void setBoundingBox(const Float3 &lower, const Float3 &upper);
+
+    void setDensityScale(float scale);
+
+    void setG(float g);
+
+    float getMaxDensity() const;
+
+    const Grid *getDensity() const;
+
+    // the mip chain, brick cache, brick grid or dense grid sampleDensity
+    // reads, to tell whether two media sample the same density
+    const void *getDensitySource() const;
+
+    const Grid *getAlbedo() const;
+
+    const Float3 &getLower() const;
+
+    const Float3 &getUpper() const;
+
+    float getDensityScale() const;
+
+    float getG() const;
+
+    Float2 intersectRayBox(const Float3 &o, const Float3 &d) const;
+
+    bool findEntry(const Float3 &o, const Float3 &d, Float3 &entry) const;
+
+    Float3 toTexCoord(const Float3 &worldPos) const;
+
+    Float3 sampleAlbedo(const Float3 &uvw) const;
+
+    float sampleDensity(const Float3 &uvw) const;
+
+    float evalPhaseFunction(float u) const;
+
+    Float3 samplePhaseFunction(const Float3 &wo, uint32_t &rng) const;
+
+    // from a 2d sample, e.g. of a PixelSampler
+    Float3 samplePhaseFunction(const Float3 &wo, const Float2 &sample) const;
+
+    // tracking against the global majorant, same as the shader
+
+    float estimateTransmittance(
+        const Float3 &a, const Float3 &b, uint32_t &rng,
+        TrackingStats *stats = nullptr) const;
+
+    bool deltaTrack(
+        const Float3 &a, const Float3 &b, uint32_t &rng, Float3 &scatterPos,
+        TrackingStats *stats = nullptr) const;
+
+    // the free flight of the first step comes from firstStep.x, e.g. of a
+    // PixelSampler, and the real / null decisions from firstStep.y. the
+    // other random numbers come from rng
+    bool deltaTrack(
+        const Float3 &a, const Float3 &b, const Float2 &firstStep, uint32_t &rng,
+        Float3 &scatterPos, TrackingStats *stats = nullptr) const;
+
+    // unbiased variants of estimateTransmittance.
+    // residual ratio tracking uses the minorant of each majorant grid cell
+    // as its control density, so homogeneous cells need no lookup.
+    // it falls back to ratio tracking without a majorant grid and at
+    // coarser lods, whose densities the grid does not bound
+
+    float estimateTransmittanceRoulette(
+        const Float3 &a, const Float3 &b, uint32_t &rng,
+        TrackingStats *stats = nullptr) const;
+
+    float estimateTransmittanceResidual(
+        const Float3 &a, const Float3 &b, uint32_t &rng,
+        TrackingStats *stats = nullptr) const;
+
+    float estimateTransmittance(
+        TransmittanceEstimator estimator,
+        const Float3 &a, const Float3 &b, uint32_t &rng,
+        TrackingStats *stats = nullptr) const;
+
+    // tracking against local majorants, traversing the majorant grid with DDA.
+    // without a majorant grid and at coarser lods they fall back to the
+    // global majorant trackers
+
+    float estimateTransmittanceDDA(
+        const Float3 &a, const Float3 &b, uint32_t &rng,
+        TrackingStats *stats = nullptr) const;
+
+    bool deltaTrackDDA(
+        const Float3 &a, const Float3 &b, uint32_t &rng, Float3 &scatterPos,
+        TrackingStats *stats = nullptr) const;
+
+    // decomposition tracking: the minorant of each majorant grid cell is a
+    // homogeneous control medium whose collisions are sampled analytically,
+    // and only the residual density up to the cell majorant is delta tracked
+    // with lookups. the first collision of either component scatters. falls
+    // back to deltaTrack without a majorant grid and at coarser lods, whose
+    // densities the grid does not bound
+
+    bool deltaTrackDecomposition(
+        const Float3 &a, const Float3 &b, uint32_t &rng, Float3 &scatterPos,
+        TrackingStats *stats = nullptr) const;
+
+    // the optical depth of the control collision comes from firstStep.x
+    bool deltaTrackDecomposition(
+        const Float3 &a, const Float3 &b, const Float2 &firstStep, uint32_t &rng,
+        Float3 &scatterPos, TrackingStats *stats = nullptr) const;
+
+    bool sampleFreeFlight(
+        FreeFlightSampler sampler,
+        const Float3 &a, const Float3 &b, uint32_t &rng, Float3 &scatterPos,
+        TrackingStats *stats = nullptr) const;
+
+private:
+
+    bool deltaTrack(
+        const Float3 &a, const Float3 &b, const Float2 *firstStep, uint32_t &rng,
+        Float3 &scatterPos, TrackingStats *stats) const;
+
+    bool deltaTrackDecomposition(
+        const Float3 &a, const Float3 &b, const Float2 *firstStep, uint32_t &rng,
+        Float3 &scatterPos, TrackingStats *stats) const;
+
+    const Grid         *density_   = nullptr;
+    const Grid         *albedo_    = nullptr;
+    const MajorantGrid *majorants_ = nullptr;
+    const BrickGrid    *bricks_    = nullptr;
+    const BrickCache   *cache_     = nullptr;
+
+    const DensityMipChain *mips_ = nullptr;
+    float                  lod_  = 0;
+
+    Float3 lower_     = Float3(-1);
+    Float3 upper_     = Float3(1);
+    Float3 invExtent_ = Float3(0.5f);
+
+    float densityScale_ = 1;
+    float maxDensity_   = 0;
+    float invDensity_   = 1;
+
+    float g_  = 0;
+    float g2_ = 0;
+};
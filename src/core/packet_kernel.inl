@@ -0,0 +1,524 @@
+// packet version of CPUVolumeRenderer::trace, instantiated by the
+// packet_tracer_*.cpp units after including simd.h
+
+namespace
+{
+
+template<int W>
+struct Vec3
+{
+    SimdFloat<W> x, y, z;
+};
+
+template<int W>
+Vec3<W> operator+(const Vec3<W> &a, const Vec3<W> &b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+template<int W>
+Vec3<W> operator-(const Vec3<W> &a, const Vec3<W> &b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+template<int W>
+Vec3<W> operator*(const Vec3<W> &a, const Vec3<W> &b) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+template<int W>
+Vec3<W> operator*(const SimdFloat<W> &s, const Vec3<W> &a) { return { s * a.x, s * a.y, s * a.z }; }
+template<int W>
+Vec3<W> operator-(const Vec3<W> &a) { return { -a.x, -a.y, -a.z }; }
+
+template<int W>
+SimdFloat<W> dot(const Vec3<W> &a, const Vec3<W> &b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+template<int W>
+Vec3<W> cross(const Vec3<W> &a, const Vec3<W> &b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+template<int W>
+Vec3<W> normalize(const Vec3<W> &a)
+{
+    const SimdFloat<W> inv = SimdFloat<W>(1) / sqrt(dot(a, a));
+    return inv * a;
+}
+
+template<int W>
+Vec3<W> select(SimdMask<W> m, const Vec3<W> &a, const Vec3<W> &b)
+{
+    return { select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z) };
+}
+
+// natural logarithm, cephes polynomial. relative error < 2e-7 on normals
+template<int W>
+SimdFloat<W> log(SimdFloat<W> x)
+{
+    using F = SimdFloat<W>;
+    using I = SimdInt<W>;
+
+    const SimdMask<W> nonPositive = x <= F(0);
+    x = max(x, asFloat(I(0x00800000)));
+
+    const I bits = asInt(x);
+    F e = toFloat(shiftRight(bits, 23) - I(126));
+    F m = asFloat((bits & I(0x007fffff)) | I(0x3f000000));
+
+    const SimdMask<W> small = m < F(0.707106781186547524f);
+    e = select(small, e - F(1), e);
+    m = select(small, m + m, m) - F(1);
+
+    const F z = m * m;
+    F y = F(7.0376836292e-2f);
+    y = y * m + F(-1.1514610310e-1f);
+    y = y * m + F(1.1676998740e-1f);
+    y = y * m + F(-1.2420140846e-1f);
+    y = y * m + F(1.4249322787e-1f);
+    y = y * m + F(-1.6668057665e-1f);
+    y = y * m + F(2.0000714765e-1f);
+    y = y * m + F(-2.4999993993e-1f);
+    y = y * m + F(3.3333331174e-1f);
+    y = y * m * z;
+
+    y = y + e * F(-2.12194440e-4f);
+    y = y - F(0.5f) * z;
+    F result = m + y + e * F(0.693359375f);
+
+    return select(nonPositive, F(-std::numeric_limits<float>::infinity()), result);
+}
+
+// sin(2 * pi * u) and cos(2 * pi * u), reduced to a quadrant around 0
+template<int W>
+void sinCos2Pi(SimdFloat<W> u, SimdFloat<W> &s, SimdFloat<W> &c)
+{
+    using F = SimdFloat<W>;
+    using I = SimdInt<W>;
+
+    const F q = round(u * F(4));
+    const F r = (u - q * F(0.25f)) * F(2 * 3.14159265358979f);
+    const F r2 = r * r;
+
+    F sp = F(-1.9515295891e-4f);
+    sp = sp * r2 + F(8.3321608736e-3f);
+    sp = sp * r2 + F(-1.6666654611e-1f);
+    sp = sp * r2 * r + r;
+
+    F cp = F(2.443315711809948e-5f);
+    cp = cp * r2 + F(-1.388731625493765e-3f);
+    cp = cp * r2 + F(4.166664568298827e-2f);
+    cp = cp * r2 * r2 - F(0.5f) * r2 + F(1);
+
+    const I quadrant = toInt(q) & I(3);
+    const SimdMask<W> swap = (toFloat(quadrant & I(1)) > F(0));
+    const SimdMask<W> negS = (toFloat(quadrant & I(2)) > F(0));
+    const SimdMask<W> negC = (toFloat((quadrant + I(1)) & I(2)) > F(0));
+
+    s = select(swap, cp, sp);
+    c = select(swap, sp, cp);
+    s = select(negS, -s, s);
+    c = select(negC, -c, c);
+}
+
+template<int W>
+SimdInt<W> randUint(SimdInt<W> &state)
+{
+    using I = SimdInt<W>;
+
+    const I s = state * I(static_cast<int32_t>(747796405u)) + I(static_cast<int32_t>(2891336453u));
+    const I word = (shiftRight(s, shiftRight(s, 28) + I(4)) ^ s) * I(277803737);
+    const I result = shiftRight(word, 22) ^ word;
+    return result;
+}
+
+// same value as static_cast<float>(uint32) / 4294967295.0f
+template<int W>
+SimdFloat<W> randFloat(SimdInt<W> &state, SimdMask<W> active)
+{
+    using F = SimdFloat<W>;
+    using I = SimdInt<W>;
+
+    const I next = randUint(state);
+    state = select(active, next, state);
+
+    const F hi = toFloat(shiftRight(next, 16)) * F(65536.0f);
+    const F lo = toFloat(next & I(0xffff));
+    return (hi + lo) / F(4294967295.0f);
+}
+
+template<int W>
+class PacketTracer
+{
+public:
+
+    using F = SimdFloat<W>;
+    using I = SimdInt<W>;
+    using M = SimdMask<W>;
+    using V = Vec3<W>;
+
+    explicit PacketTracer(const PacketTraceContext &ctx)
+        : ctx_(ctx)
+    {
+        
+    }
+
+    void trace(PacketRays &rays) const
+    {
+        V o = { F::load(rays.ox), F::load(rays.oy), F::load(rays.oz) };
+        V d = { F::load(rays.dx), F::load(rays.dy), F::load(rays.dz) };
+
+        I rng = I::load(rays.rng);
+
+        V coef   = { F(1), F(1), F(1) };
+        V result = { F(0), F(0), F(0) };
+
+        V firstAlbedo        = { F(0), F(0), F(0) };
+        F firstDistance      = F(0);
+        F firstTransmittance = F(1);
+
+        M active = M::fromBits(rays.activeMask);
+
+        for(int i = 0; i < ctx_.maxDepth && active.any(); ++i)
+        {
+            F tNear, tFar;
+            intersectRayBox(o, d, tNear, tFar);
+
+            const M escaped = active & (tNear + F(0.001f) >= tFar);
+            if(i == 0)
+                result = select(escaped, evalEnvirLight(d, escaped), result);
+            active = andNot(active, escaped);
+
+            const V b = o + (tFar - F(0.001f)) * d;
+
+            V scatterPos;
+            const M scattered = deltaTrack(o, b, active, rng, scatterPos);
+
+            const M absorbed = andNot(active, scattered);
+            if(i == 0)
+            {
+                result = select(absorbed, evalEnvirLight(d, absorbed), result);
+
+                const V segment = select(scattered, scatterPos, b) - o;
+                firstDistance      = select(escaped, F(0), sqrt(dot(segment, segment)));
+                firstTransmittance = select(scattered, F(0), F(1));
+            }
+            active = scattered;
+
+            if(!active.any())
+                break;
+
+            const V albedo = sampleAlbedo(toTexCoord(scatterPos));
+            coef = select(active, coef * albedo, coef);
+            if(i == 0)
+                firstAlbedo = select(active, albedo, firstAlbedo);
+
+            const V direct = estimateDirectIllum(scatterPos, -d, active, rng);
+            result = select(active, result + coef * direct, result);
+
+            o = scatterPos;
+            d = select(active, samplePhaseFunction(-d, active, rng), d);
+        }
+
+        rng.store(rays.rng);
+        result.x.store(rays.r);
+        result.y.store(rays.g);
+        result.z.store(rays.b);
+
+        firstAlbedo.x.store(rays.albedoR);
+        firstAlbedo.y.store(rays.albedoG);
+        firstAlbedo.z.store(rays.albedoB);
+        firstDistance.store(rays.firstDistance);
+        firstTransmittance.store(rays.transmittance);
+    }
+
+private:
+
+    void intersectRayBox(const V &o, const V &d, F &tNear, F &tFar) const
+    {
+        const float *lower = ctx_.lower, *upper = ctx_.upper;
+
+        const F invDx = F(1) / d.x, invDy = F(1) / d.y, invDz = F(1) / d.z;
+        const F nx = invDx * (F(lower[0]) - o.x), fx = invDx * (F(upper[0]) - o.x);
+        const F ny = invDy * (F(lower[1]) - o.y), fy = invDy * (F(upper[1]) - o.y);
+        const F nz = invDz * (F(lower[2]) - o.z), fz = invDz * (F(upper[2]) - o.z);
+
+        const F t0 = max(min(nx, fx), max(min(ny, fy), min(nz, fz)));
+        const F t1 = min(max(nx, fx), min(max(ny, fy), max(nz, fz)));
+
+        tNear = max(F(0), t0);
+        tFar  = t1;
+    }
+
+    V toTexCoord(const V &p) const
+    {
+        return {
+            (p.x - F(ctx_.lower[0])) * F(ctx_.invExtent[0]),
+            (p.y - F(ctx_.lower[1])) * F(ctx_.invExtent[1]),
+            (p.z - F(ctx_.lower[2])) * F(ctx_.invExtent[2])
+        };
+    }
+
+    // texel indices and weights of trilinear filtering with clamp addressing
+    struct Trilinear
+    {
+        I i0[3], i1[3];
+        F f[3];
+    };
+
+    static Trilinear computeTrilinear(const V &uvw, const int size[3])
+    {
+        Trilinear result;
+        const F coords[3] = { uvw.x, uvw.y, uvw.z };
+        for(int i = 0; i < 3; ++i)
+        {
+            const F x  = coords[i] * F(static_cast<float>(size[i])) - F(0.5f);
+            const F fx = floor(x);
+            const I ix = toInt(fx);
+
+            result.f[i]  = x - fx;
+            result.i0[i] = max(I(0), min(I(size[i] - 1), ix));
+            result.i1[i] = max(I(0), min(I(size[i] - 1), ix + I(1)));
+        }
+        return result;
+    }
+
+    static F sampleTrilinear(
+        const float *data, const Trilinear &t, const I &strideY, const I &strideZ,
+        int channels, int channel)
+    {
+        auto at = [&](const I &x, const I &y, const I &z)
+        {
+            const I index = (x + y * strideY + z * strideZ) * I(channels) + I(channel);
+            return gather(data, index);
+        };
+
+        const F v000 = at(t.i0[0], t.i0[1], t.i0[2]), v100 = at(t.i1[0], t.i0[1], t.i0[2]);
+        const F v010 = at(t.i0[0], t.i1[1], t.i0[2]), v110 = at(t.i1[0], t.i1[1], t.i0[2]);
+        const F v001 = at(t.i0[0], t.i0[1], t.i1[2]), v101 = at(t.i1[0], t.i0[1], t.i1[2]);
+        const F v011 = at(t.i0[0], t.i1[1], t.i1[2]), v111 = at(t.i1[0], t.i1[1], t.i1[2]);
+
+        const F x00 = v000 + t.f[0] * (v100 - v000);
+        const F x10 = v010 + t.f[0] * (v110 - v010);
+        const F x01 = v001 + t.f[0] * (v101 - v001);
+        const F x11 = v011 + t.f[0] * (v111 - v011);
+        const F y0  = x00 + t.f[1] * (x10 - x00);
+        const F y1  = x01 + t.f[1] * (x11 - x01);
+        return y0 + t.f[2] * (y1 - y0);
+    }
+
+    F sampleDensity(const V &uvw) const
+    {
+        const int *size = ctx_.densitySize;
+        const Trilinear t = computeTrilinear(uvw, size);
+        return F(ctx_.densityScale) * sampleTrilinear(
+            ctx_.density, t, I(size[0]), I(size[0] * size[1]), 1, 0);
+    }
+
+    V sampleAlbedo(const V &uvw) const
+    {
+        const int *size = ctx_.albedoSize;
+        const Trilinear t = computeTrilinear(uvw, size);
+        const I strideY = I(size[0]), strideZ = I(size[0] * size[1]);
+
+        alignas(64) float raw[3][W];
+        for(int c = 0; c < 3; ++c)
+            sampleTrilinear(ctx_.albedo, t, strideY, strideZ, 4, c).store(raw[c]);
+
+        // pow(x, 2.2) per lane, the albedo is fetched once per scattering
+        for(int c = 0; c < 3; ++c)
+        {
+            for(int l = 0; l < W; ++l)
+                raw[c][l] = std::pow(raw[c][l], 2.2f);
+        }
+        return { F::load(raw[0]), F::load(raw[1]), F::load(raw[2]) };
+    }
+
+    V evalEnvirLight(const V &d, M mask) const
+    {
+        alignas(64) float dir[3][W], rad[3][W] = {};
+        d.x.store(dir[0]); d.y.store(dir[1]); d.z.store(dir[2]);
+
+        const int bits = mask.bits();
+        for(int l = 0; l < W; ++l)
+        {
+            if(!(bits & (1 << l)))
+                continue;
+            const float ld[3] = { dir[0][l], dir[1][l], dir[2][l] };
+            float lr[3];
+            ctx_.evalEnvirLight(ctx_.envir, ld, lr);
+            rad[0][l] = lr[0]; rad[1][l] = lr[1]; rad[2][l] = lr[2];
+        }
+
+        return { F::load(rad[0]), F::load(rad[1]), F::load(rad[2]) };
+    }
+
+    M deltaTrack(const V &a, const V &b, M active, I &rng, V &scatterPos) const
+    {
+        const V ab = b - a;
+        const F tMax = sqrt(dot(ab, ab));
+        const F invTMax = F(1) / tMax;
+        const F invMaxDensity = F(ctx_.invMaxDensity);
+
+        F t = F(0);
+        M scattered = M::fromBits(0);
+        M tracking = active;
+
+        scatterPos = a;
+
+        for(int i = 0; i < 10000 && tracking.any(); ++i)
+        {
+            t = select(tracking, t - log(F(1) - randFloat(rng, tracking)) * invMaxDensity, t);
+            tracking = tracking & (t < tMax);
+            if(!tracking.any())
+                break;
+
+            const V pos = a + (t * invTMax) * ab;
+            const F density = sampleDensity(toTexCoord(pos));
+
+            const M accept = tracking & (randFloat(rng, tracking) < density * invMaxDensity);
+            scatterPos = select(accept, pos, scatterPos);
+            scattered = scattered | accept;
+            tracking = andNot(tracking, accept);
+        }
+
+        return scattered;
+    }
+
+    F estimateTransmittance(const V &a, const V &b, M active, I &rng) const
+    {
+        const V ab = b - a;
+        const F tMax = sqrt(dot(ab, ab));
+        const F invTMax = F(1) / tMax;
+        const F invMaxDensity = F(ctx_.invMaxDensity);
+
+        F result = F(1), t = F(0);
+        M tracking = active;
+
+        for(int i = 0; i < 10000 && tracking.any(); ++i)
+        {
+            t = select(tracking, t - log(F(1) - randFloat(rng, tracking)) * invMaxDensity, t);
+            tracking = tracking & (t < tMax);
+            if(!tracking.any())
+                break;
+
+            const V pos = a + (t * invTMax) * ab;
+            const F density = sampleDensity(toTexCoord(pos));
+
+            result = select(tracking, result * (F(1) - density * invMaxDensity), result);
+
+            if(ctx_.transmittanceRoulette)
+            {
+                // same as roulette in medium.cpp
+                const F threshold = F(0.1f);
+                const M low = tracking & (result < threshold);
+                if(low.any())
+                {
+                    const M killed = low & (randFloat(rng, low) * threshold >= result);
+                    result = select(killed, F(0), select(low, threshold, result));
+                    tracking = andNot(tracking, killed);
+                }
+            }
+            else
+            {
+                const M cutoff = tracking & (result < F(0.001f));
+                result = select(cutoff, F(0), result);
+                tracking = andNot(tracking, cutoff);
+            }
+        }
+
+        // lanes still tracking were cut off by the step cap
+        return select(tracking, F(0), result);
+    }
+
+    F evalPhaseFunction(const F &u) const
+    {
+        const F g = F(ctx_.g), g2 = F(ctx_.g2);
+        const F dem = F(1) + g2 - F(2) * g * u;
+        return (F(1) - g2) / (F(4 * 3.14159265f) * dem * sqrt(dem));
+    }
+
+    V samplePhaseFunction(const V &wo, M active, I &rng) const
+    {
+        const F g = F(ctx_.g), g2 = F(ctx_.g2);
+
+        const F s = F(2) * randFloat(rng, active) - F(1);
+
+        F u = s;
+        if(ctx_.g < -0.001f || ctx_.g > 0.001f)
+        {
+            const F m = (F(1) - g2) / (F(1) + g * s);
+            u = (F(1) + g2 - m * m) / (F(2) * g);
+        }
+
+        const F cosTheta = -u;
+        const F sinTheta = sqrt(max(F(0), F(1) - cosTheta * cosTheta));
+
+        F sinPhi, cosPhi;
+        sinCos2Pi(randFloat(rng, active), sinPhi, cosPhi);
+
+        const V X = { F(1), F(0), F(0) }, Y = { F(0), F(1), F(0) };
+
+        const V localZ = wo;
+        const V localX = normalize(cross(
+            localZ, select(abs(localZ.y) > F(0.9f), X, Y)));
+        const V localY = cross(localZ, localX);
+
+        return (cosTheta * localZ)
+             + (sinTheta * sinPhi) * localX
+             + (sinTheta * cosPhi) * localY;
+    }
+
+    V estimateDirectIllum(const V &o, const V &wo, M active, I &rng) const
+    {
+        // environment sampling is done per lane, in the same order
+        // of random numbers as the scalar tracer
+
+        alignas(64) uint32_t laneRng[W];
+        alignas(64) float wi[3][W] = {}, pdf[W], rad[3][W] = {};
+        rng.store(laneRng);
+
+        const int bits = active.bits();
+        for(int l = 0; l < W; ++l)
+        {
+            pdf[l] = 1;
+            if(!(bits & (1 << l)))
+            {
+                wi[1][l] = 1;
+                continue;
+            }
+
+            float dir[3], lr[3];
+            ctx_.sampleEnvirLight(ctx_.envir, laneRng[l], dir, pdf[l]);
+            ctx_.evalEnvirLight(ctx_.envir, dir, lr);
+
+            for(int c = 0; c < 3; ++c)
+            {
+                wi[c][l]  = dir[c];
+                rad[c][l] = lr[c];
+            }
+        }
+
+        rng = I::load(laneRng);
+
+        const V w = { F::load(wi[0]), F::load(wi[1]), F::load(wi[2]) };
+
+        F tNear, tFar;
+        intersectRayBox(o, w, tNear, tFar);
+
+        const M inside = active & (tNear < tFar);
+        const F trans = select(
+            inside,
+            estimateTransmittance(o + tNear * w, o + tFar * w, inside, rng),
+            F(1));
+
+        const F phase = evalPhaseFunction(-dot(wo, w));
+        const F scale = trans * phase / F::load(pdf);
+
+        return scale * V{ F::load(rad[0]), F::load(rad[1]), F::load(rad[2]) };
+    }
+
+    const PacketTraceContext &ctx_;
+};
+
+template<int W>
+void tracePacket(const PacketTraceContext &ctx, PacketRays &rays)
+{
+    PacketTracer<W>(ctx).trace(rays);
+}
+
+} // namespace anonymous
@@ -0,0 +1,114 @@
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <initializer_list>
+
+#include "packet_tracer.h"
+
+PacketTraceFunc getPacketTraceFuncSSE41();
+PacketTraceFunc getPacketTraceFuncAVX2();
+PacketTraceFunc getPacketTraceFuncAVX512();
+
+namespace
+{
+    struct CPUFeatures
+    {
+        bool sse41  = false;
+        bool avx2   = false;
+        bool avx512 = false;
+    };
+
+    CPUFeatures queryCPUFeatures()
+    {
+        CPUFeatures result;
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64))
+
+        int info[4];
+        __cpuid(info, 0);
+        const int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        result.sse41 = (info[2] & (1 << 19)) != 0;
+
+        // avx state must also be enabled by the os
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+        const bool ymm = (xcr0 & 0x06) == 0x06;
+        const bool zmm = (xcr0 & 0xe6) == 0xe6;
+
+        if(maxLeaf >= 7)
+        {
+            __cpuidex(info, 7, 0);
+            result.avx2   = ymm && (info[1] & (1 << 5)) != 0;
+            result.avx512 = zmm && (info[1] & (1 << 16)) != 0;
+        }
+
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+
+        __builtin_cpu_init();
+        result.sse41  = __builtin_cpu_supports("sse4.1");
+        result.avx2   = __builtin_cpu_supports("avx2");
+        result.avx512 = __builtin_cpu_supports("avx512f");
+
+#endif
+
+        return result;
+    }
+
+    const CPUFeatures &getCPUFeatures()
+    {
+        static const CPUFeatures features = queryCPUFeatures();
+        return features;
+    }
+}
+
+SimdLevel detectSimdLevel()
+{
+    for(auto level : { SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE41 })
+    {
+        if(isSimdLevelSupported(level))
+            return level;
+    }
+    return SimdLevel::Scalar;
+}
+
+bool isSimdLevelSupported(SimdLevel level)
+{
+    const auto &features = getCPUFeatures();
+    switch(level)
+    {
+    case SimdLevel::Scalar: return true;
+    case SimdLevel::SSE41:  return features.sse41  && getPacketTraceFuncSSE41();
+    case SimdLevel::AVX2:   return features.avx2   && getPacketTraceFuncAVX2();
+    case SimdLevel::AVX512: return features.avx512 && getPacketTraceFuncAVX512();
+    }
+    return false;
+}
+
+const char *getSimdLevelName(SimdLevel level)
+{
+    switch(level)
+    {
+    case SimdLevel::Scalar: return "scalar";
+    case SimdLevel::SSE41:  return "sse4.1";
+    case SimdLevel::AVX2:   return "avx2";
+    case SimdLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+PacketTraceFunc getPacketTraceFunc(SimdLevel level)
+{
+    if(level == SimdLevel::Scalar || !isSimdLevelSupported(level))
+        return nullptr;
+
+    switch(level)
+    {
+    case SimdLevel::SSE41:  return getPacketTraceFuncSSE41();
+    case SimdLevel::AVX2:   return getPacketTraceFuncAVX2();
+    case SimdLevel::AVX512: return getPacketTraceFuncAVX512();
+    default:                return nullptr;
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+
+enum class SimdLevel
+{
+    Scalar = 1,
+    SSE41  = 4,
+    AVX2   = 8,
+    AVX512 = 16
+};
+
+// widest level supported by both the build and the running cpu
+SimdLevel detectSimdLevel();
+
+bool isSimdLevelSupported(SimdLevel level);
+
+const char *getSimdLevelName(SimdLevel level);
+
+constexpr int MAX_PACKET_WIDTH = 16;
+
+// plain description of the scene for packet tracing, so that the simd
+// translation units need no other headers
+struct PacketTraceContext
+{
+    const float *density;
+    int          densitySize[3];
+    float        densityScale;
+    float        invMaxDensity;
+
+    const float *albedo; // rgba
+    int          albedoSize[3];
+
+    float lower[3];
+    float upper[3];
+    float invExtent[3];
+
+    float g;
+    float g2;
+
+    int maxDepth;
+
+    // ratio tracking with russian roulette instead of the 0.001 cutoff
+    int transmittanceRoulette;
+
+    // environment light is sampled and evaluated per lane with these
+    const void *envir;
+    void (*sampleEnvirLight)(const void *envir, uint32_t &rng, float dir[3], float &pdf);
+    void (*evalEnvirLight)(const void *envir, const float dir[3], float rad[3]);
+};
+
+// structure of arrays of up to MAX_PACKET_WIDTH paths
+struct PacketRays
+{
+    alignas(64) float ox[MAX_PACKET_WIDTH], oy[MAX_PACKET_WIDTH], oz[MAX_PACKET_WIDTH];
+    alignas(64) float dx[MAX_PACKET_WIDTH], dy[MAX_PACKET_WIDTH], dz[MAX_PACKET_WIDTH];
+
+    alignas(64) uint32_t rng[MAX_PACKET_WIDTH];
+
+    alignas(64) float r[MAX_PACKET_WIDTH], g[MAX_PACKET_WIDTH], b[MAX_PACKET_WIDTH];
+
+    // denoiser features of the first scattering: its albedo (0 if none),
+    // its distance from the origin (of the box exit if none, 0 if the ray
+    // misses the box), and 1 if there is none, else 0
+    alignas(64) float albedoR[MAX_PACKET_WIDTH], albedoG[MAX_PACKET_WIDTH], albedoB[MAX_PACKET_WIDTH];
+    alignas(64) float firstDistance[MAX_PACKET_WIDTH];
+    alignas(64) float transmittance[MAX_PACKET_WIDTH];
+
+    // bit i is set if lane i carries a path
+    int activeMask;
+};
+
+// same as CPUVolumeRenderer::trace for every active lane, consuming each
+// lane's random numbers in the same order
+using PacketTraceFunc = void (*)(const PacketTraceContext &ctx, PacketRays &rays);
+
+// nullptr for SimdLevel::Scalar
+PacketTraceFunc getPacketTraceFunc(SimdLevel level);
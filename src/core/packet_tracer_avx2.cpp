@@ -0,0 +1,25 @@
+// compiled with AVX2 code generation enabled, see CMakeLists.txt
+
+#include "packet_tracer.h"
+
+#if defined(__AVX2__)
+
+#include <cmath>
+#include <limits>
+
+#include "simd.h"
+#include "packet_kernel.inl"
+
+PacketTraceFunc getPacketTraceFuncAVX2()
+{
+    return &tracePacket<8>;
+}
+
+#else
+
+PacketTraceFunc getPacketTraceFuncAVX2()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,25 @@
+// compiled with AVX512 code generation enabled, see CMakeLists.txt
+
+#include "packet_tracer.h"
+
+#if defined(__AVX512F__)
+
+#include <cmath>
+#include <limits>
+
+#include "simd.h"
+#include "packet_kernel.inl"
+
+PacketTraceFunc getPacketTraceFuncAVX512()
+{
+    return &tracePacket<16>;
+}
+
+#else
+
+PacketTraceFunc getPacketTraceFuncAVX512()
+{
+    return nullptr;
+}
+
+#endif
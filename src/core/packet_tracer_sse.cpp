@@ -0,0 +1,25 @@
+// compiled with SSE41 code generation enabled, see CMakeLists.txt
+
+#include "packet_tracer.h"
+
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64)))
+
+#include <cmath>
+#include <limits>
+
+#include "simd.h"
+#include "packet_kernel.inl"
+
+PacketTraceFunc getPacketTraceFuncSSE41()
+{
+    return &tracePacket<4>;
+}
+
+#else
+
+PacketTraceFunc getPacketTraceFuncSSE41()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,306 @@
+#include <atomic>
+#include <cmath>
+
+#include "path_guiding.h"
+
+namespace
+{
+    Float2 toSquare(const Float3 &dir)
+    {
+        float phi = std::atan2(dir.y, dir.x) / (2 * PI);
+        if(phi < 0)
+            phi += 1;
+        return {
+            (std::min)(0.99999994f, (std::max)(0.0f, 0.5f * (dir.z + 1))),
+            (std::min)(0.99999994f, phi)
+        };
+    }
+
+    Float3 fromSquare(const Float2 &p)
+    {
+        const float cosTheta = 2 * p.x - 1;
+        const float sinTheta = std::sqrt((std::max)(0.0f, 1 - cosTheta * cosTheta));
+        const float phi = 2 * PI * p.y;
+        return Float3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+    }
+
+    // child c covers [cx, cx + 0.5] x [cy, cy + 0.5] of its parent
+    int getChild(Float2 &p)
+    {
+        const int cx = p.x >= 0.5f, cy = p.y >= 0.5f;
+        p = Float2(2 * p.x - cx, 2 * p.y - cy);
+        return cx | (cy << 1);
+    }
+}
+
+DirectionalTree::DirectionalTree()
+    : nodes_(1)
+{
+
+}
+
+void DirectionalTree::record(const Float3 &dir, float value)
+{
+    Float2 p = toSquare(dir);
+    uint32_t node = 0;
+    for(;;)
+    {
+        const int c = getChild(p);
+        std::atomic_ref<float>(nodes_[node].sums[c]).fetch_add(value, std::memory_order_relaxed);
+        if(!nodes_[node].children[c])
+            break;
+        node = nodes_[node].children[c];
+    }
+}
+
+float DirectionalTree::getTotal() const
+{
+    const Node &root = nodes_[0];
+    return root.sums[0] + root.sums[1] + root.sums[2] + root.sums[3];
+}
+
+int DirectionalTree::getNodeCount() const
+{
+    return static_cast<int>(nodes_.size());
+}
+
+Float3 DirectionalTree::sample(const Float2 &u, float &pdf) const
+{
+    if(getTotal() <= 0)
+    {
+        pdf = 1 / (4 * PI);
+        return fromSquare(u);
+    }
+
+    // the x half is picked by u.x, then the y half by u.y, each rescaled
+    // for the next level. a half of zero weight is never picked, even when
+    // rounding puts the sample past the end of the other one
+
+    Float2 r = u, origin(0), size(1);
+    float squarePDF = 1;
+    uint32_t node = 0;
+    for(;;)
+    {
+        const float *w = nodes_[node].sums;
+        const float total = w[0] + w[1] + w[2] + w[3];
+
+        const float left = w[0] + w[2], right = w[1] + w[3];
+        int cx = 0;
+        if(right <= 0 || (r.x * total < left && left > 0))
+            r.x = (std::min)(r.x * total / left, 0.99999994f);
+        else
+        {
+            cx = 1;
+            r.x = (std::min)((r.x * total - left) / right, 0.99999994f);
+        }
+
+        const float column = w[cx] + w[cx + 2];
+        int cy = 0;
+        if(w[cx + 2] <= 0 || (r.y * column < w[cx] && w[cx] > 0))
+            r.y = (std::min)(r.y * column / w[cx], 0.99999994f);
+        else
+        {
+            cy = 1;
+            r.y = (std::min)((r.y * column - w[cx]) / w[cx + 2], 0.99999994f);
+        }
+
+        const int c = cx | (cy << 1);
+        squarePDF *= 4 * w[c] / total;
+
+        size = 0.5f * size;
+        origin = Float2(origin.x + cx * size.x, origin.y + cy * size.y);
+
+        if(!nodes_[node].children[c])
+            break;
+        node = nodes_[node].children[c];
+    }
+
+    pdf = squarePDF / (4 * PI);
+    return fromSquare(Float2(origin.x + r.x * size.x, origin.y + r.y * size.y));
+}
+
+float DirectionalTree::pdf(const Float3 &dir) const
+{
+    const float rootTotal = getTotal();
+    if(rootTotal <= 0)
+        return 1 / (4 * PI);
+
+    Float2 p = toSquare(dir);
+    float squarePDF = 1;
+    uint32_t node = 0;
+    for(;;)
+    {
+        const float *w = nodes_[node].sums;
+        const float total = w[0] + w[1] + w[2] + w[3];
+
+        const int c = getChild(p);
+        if(w[c] <= 0)
+            return 0;
+        squarePDF *= 4 * w[c] / total;
+
+        if(!nodes_[node].children[c])
+            break;
+        node = nodes_[node].children[c];
+    }
+    return squarePDF / (4 * PI);
+}
+
+void DirectionalTree::build(const DirectionalTree &stats, float threshold, int maxDepth)
+{
+    nodes_.assign(1, Node{});
+
+    const float total = stats.getTotal();
+    if(total <= 0)
+        return;
+
+    // cells of stats without children spread their energy evenly over the
+    // cells they are split into
+
+    struct Item
+    {
+        uint32_t node;
+        int      statsNode; // -1 below the leaves of stats
+        float    energy;
+        int      depth;
+    };
+
+    std::vector<Item> stack = { { 0, 0, total, 1 } };
+    while(!stack.empty())
+    {
+        const Item item = stack.back();
+        stack.pop_back();
+
+        for(int c = 0; c < 4; ++c)
+        {
+            const float energy = item.statsNode >= 0 ?
+                stats.nodes_[item.statsNode].sums[c] : item.energy / 4;
+            if(item.depth >= maxDepth || energy <= threshold * total)
+                continue;
+
+            const uint32_t child = static_cast<uint32_t>(nodes_.size());
+            nodes_.push_back(Node{});
+            nodes_[item.node].children[c] = child;
+
+            const int statsChild = item.statsNode >= 0 && stats.nodes_[item.statsNode].children[c] ?
+                static_cast<int>(stats.nodes_[item.statsNode].children[c]) : -1;
+            stack.push_back({ child, statsChild, energy, item.depth + 1 });
+        }
+    }
+}
+
+void DirectionalTree::scale(float s)
+{
+    for(auto &node : nodes_)
+    {
+        for(auto &sum : node.sums)
+            sum *= s;
+    }
+}
+
+void PathGuide::initialize(const Float3 &lower, const Float3 &upper, const PathGuidingParams &params)
+{
+    params_ = params;
+    lower_  = lower;
+    extent_ = upper - lower;
+
+    nodes_.assign(1, SpatialNode{});
+    leaves_.assign(1, Leaf{});
+    recordedSamples_ = 0;
+}
+
+const PathGuidingParams &PathGuide::getParams() const
+{
+    return params_;
+}
+
+const DirectionalTree *PathGuide::getSamplingTree(const Float3 &pos) const
+{
+    const DirectionalTree &tree = leaves_[findLeaf(pos)].sampling;
+    return tree.getTotal() > 0 ? &tree : nullptr;
+}
+
+void PathGuide::record(const Float3 &pos, const Float3 &dir, float value)
+{
+    Leaf &leaf = leaves_[findLeaf(pos)];
+    std::atomic_ref<uint32_t>(leaf.sampleCount).fetch_add(1, std::memory_order_relaxed);
+    if(value > 0 && std::isfinite(value))
+        leaf.building.record(dir, value);
+}
+
+void PathGuide::finishIteration(int frames)
+{
+    recordedSamples_ = 0;
+    for(auto &leaf : leaves_)
+        recordedSamples_ += leaf.sampleCount;
+
+    // children of new nodes are visited too, as the loop runs to the end
+    // of the growing node list
+
+    const float threshold = params_.spatialThreshold * std::sqrt(float(frames));
+    for(size_t i = 0; i < nodes_.size(); ++i)
+    {
+        if(nodes_[i].children[0])
+            continue;
+
+        const int leafIndex = nodes_[i].leaf;
+        if(leaves_[leafIndex].sampleCount <= threshold)
+            continue;
+
+        Leaf half = leaves_[leafIndex];
+        half.building.scale(0.5f);
+        half.sampleCount /= 2;
+
+        leaves_[leafIndex] = half;
+        leaves_.push_back(std::move(half));
+
+        const int axis = nodes_[i].axis;
+        for(int c = 0; c < 2; ++c)
+        {
+            SpatialNode child;
+            child.axis = (axis + 1) % 3;
+            child.leaf = c ? static_cast<int>(leaves_.size()) - 1 : leafIndex;
+            nodes_[i].children[c] = static_cast<uint32_t>(nodes_.size());
+            nodes_.push_back(child);
+        }
+    }
+
+    for(auto &leaf : leaves_)
+    {
+        leaf.sampling = leaf.building;
+        leaf.building.build(leaf.sampling, params_.directionalThreshold, params_.maxDirectionalDepth);
+        leaf.sampleCount = 0;
+    }
+}
+
+int PathGuide::getLeafCount() const
+{
+    return static_cast<int>(leaves_.size());
+}
+
+int PathGuide::getDirectionalNodeCount() const
+{
+    int result = 0;
+    for(auto &leaf : leaves_)
+        result += leaf.sampling.getNodeCount();
+    return result;
+}
+
+uint64_t PathGuide::getRecordedSampleCount() const
+{
+    return recordedSamples_;
+}
+
+int PathGuide::findLeaf(const Float3 &pos) const
+{
+    Float3 p = (pos - lower_) / extent_;
+    uint32_t node = 0;
+    while(nodes_[node].children[0])
+    {
+        const int axis = nodes_[node].axis;
+        const float x = (std::min)(1.0f, (std::max)(0.0f, p[axis]));
+        const int c = x >= 0.5f;
+        p[axis] = 2 * x - c;
+        node = nodes_[node].children[c];
+    }
+    return nodes_[node].leaf;
+}
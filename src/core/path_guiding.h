@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "common.h"
+
+// online guiding of the scattering directions of camera paths (Mueller et
+// al., "Practical path guiding"): a kd-tree over the volume bounds whose
+// leaves hold quadtrees of the radiance arriving from each direction. the
+// trees are trained in iterations of doubling length. each iteration samples
+// the distributions learned by the last one, while the paths it traces
+// splat their incident radiance into a second set of quadtrees with atomic
+// adds. bounces pick the guide or the phase function at random, with the
+// pdf of the mixture (one-sample mis, balance heuristic)
+struct PathGuidingParams
+{
+    bool enabled = false;
+
+    // probability of drawing a bounce from the guide where it has data
+    float guideFraction = 0.5f;
+
+    // length of the first training iteration. each next one is twice as long
+    int firstIterationFrames = 1;
+
+    // after which the distributions are kept as they are
+    int trainingIterations = 6;
+
+    // leaves are split when they recorded more than spatialThreshold x
+    // sqrt(frames of the iteration) samples
+    int spatialThreshold = 4000;
+
+    // quadtree cells holding more than this fraction of the energy of their
+    // tree are subdivided
+    float directionalThreshold = 0.01f;
+
+    int maxDirectionalDepth = 16;
+};
+
+// radiance over the sphere, in cylindrical coordinates (cos theta, phi) so
+// that quadtree cells of equal area have equal solid angles
+class DirectionalTree
+{
+public:
+
+    DirectionalTree();
+
+    // splats value into the cells containing dir. thread-safe, lock-free
+    void record(const Float3 &dir, float value);
+
+    float getTotal() const;
+
+    int getNodeCount() const;
+
+    // solid angle pdf proportional to the energy of the cells
+    Float3 sample(const Float2 &u, float &pdf) const;
+
+    float pdf(const Float3 &dir) const;
+
+    // the structure of stats refined by its energy, with zero energy
+    void build(const DirectionalTree &stats, float threshold, int maxDepth);
+
+    // halves the energy, for the two children of a split spatial leaf
+    void scale(float s);
+
+private:
+
+    struct Node
+    {
+        float    sums[4]     = { 0, 0, 0, 0 };
+        uint32_t children[4] = { 0, 0, 0, 0 }; // 0 for leaves
+    };
+
+    std::vector<Node> nodes_;
+};
+
+class PathGuide
+{
+public:
+
+    void initialize(const Float3 &lower, const Float3 &upper, const PathGuidingParams &params);
+
+    const PathGuidingParams &getParams() const;
+
+    // learned distribution at pos, nullptr where nothing has been learned
+    const DirectionalTree *getSamplingTree(const Float3 &pos) const;
+
+    // radiance arriving at pos from dir, over the pdf dir was drawn with.
+    // thread-safe, lock-free
+    void record(const Float3 &pos, const Float3 &dir, float value);
+
+    // between frames: splits the spatial leaves by their sample counts, and
+    // makes the recorded radiance the next sampling distributions. frames
+    // is the length of the iteration
+    void finishIteration(int frames);
+
+    int getLeafCount() const;
+
+    // over all sampling trees
+    int getDirectionalNodeCount() const;
+
+    // of the last finished iteration
+    uint64_t getRecordedSampleCount() const;
+
+private:
+
+    struct SpatialNode
+    {
+        int      axis        = 0;
+        uint32_t children[2] = { 0, 0 }; // 0 for leaves
+        int      leaf        = 0;
+    };
+
+    struct Leaf
+    {
+        DirectionalTree sampling;
+        DirectionalTree building;
+        uint32_t        sampleCount = 0;
+    };
+
+    int findLeaf(const Float3 &pos) const;
+
+    PathGuidingParams params_;
+
+    Float3 lower_;
+    Float3 extent_;
+
+    std::vector<SpatialNode> nodes_;
+    std::vector<Leaf>        leaves_;
+
+    uint64_t recordedSamples_ = 0;
+};
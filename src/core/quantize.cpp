@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "quantize.h"
+
+namespace
+{
+    // round to nearest even, overflow to infinity
+    uint16_t floatToHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        bits &= 0x7fffffff;
+
+        if(bits >= 0x7f800000)
+            return sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0);
+        if(bits >= 0x477ff000) // rounds above 65504
+            return sign | 0x7c00;
+        if(bits < 0x38800000) // below the smallest normal half
+        {
+            float abs;
+            std::memcpy(&abs, &bits, sizeof(abs));
+            return sign | static_cast<uint16_t>(std::nearbyint(abs * 16777216.0f));
+        }
+
+        // rebias the exponent and round the dropped 13 mantissa bits
+        bits += 0xc8000fff + ((bits >> 13) & 1);
+        return sign | static_cast<uint16_t>(bits >> 13);
+    }
+
+    float halfToFloat(uint16_t half)
+    {
+        const uint32_t sign = uint32_t(half & 0x8000) << 16;
+        const uint32_t exp  = (half >> 10) & 0x1f;
+        const uint32_t mant = half & 0x3ff;
+
+        if(exp == 0)
+        {
+            const float abs = mant * (1.0f / 16777216.0f);
+            return sign ? -abs : abs;
+        }
+
+        const uint32_t bits = exp == 31 ?
+            sign | 0x7f800000 | (mant << 13) :
+            sign | ((exp + 112) << 23) | (mant << 13);
+
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    template<typename T>
+    void encodeUnorm(
+        const DensityQuantization &quant, const float *src, size_t count, T *dst)
+    {
+        constexpr float MAX_CODE = float((std::numeric_limits<T>::max)());
+        const float invScale = 1 / quant.scale;
+        for(size_t i = 0; i < count; ++i)
+        {
+            const float x = (std::max)(0.0f, (std::min)(1.0f, (src[i] - quant.offset) * invScale));
+            dst[i] = static_cast<T>(x * MAX_CODE + 0.5f);
+        }
+    }
+
+    uint8_t encodeUnorm8(float value)
+    {
+        return static_cast<uint8_t>((std::max)(0.0f, (std::min)(1.0f, value)) * 255 + 0.5f);
+    }
+}
+
+const char *getDensityEncodingName(DensityEncoding encoding)
+{
+    switch(encoding)
+    {
+    case DensityEncoding::Float32: return "float";
+    case DensityEncoding::Half:    return "half";
+    case DensityEncoding::Unorm16: return "unorm16";
+    case DensityEncoding::Unorm8:  return "unorm8";
+    }
+    return "unknown";
+}
+
+size_t getDensityTexelSize(DensityEncoding encoding)
+{
+    switch(encoding)
+    {
+    case DensityEncoding::Float32: return 4;
+    case DensityEncoding::Half:    return 2;
+    case DensityEncoding::Unorm16: return 2;
+    case DensityEncoding::Unorm8:  return 1;
+    }
+    return 4;
+}
+
+DensityQuantization fitDensityQuantization(
+    DensityEncoding encoding, float minValue, float maxValue)
+{
+    DensityQuantization result;
+    result.encoding = encoding;
+
+    if(encoding == DensityEncoding::Unorm16 || encoding == DensityEncoding::Unorm8)
+    {
+        result.offset = minValue;
+        result.scale  = maxValue > minValue ? maxValue - minValue : 1.0f;
+    }
+
+    return result;
+}
+
+void encodeDensity(
+    const DensityQuantization &quant, const float *src, size_t count, void *dst)
+{
+    switch(quant.encoding)
+    {
+    case DensityEncoding::Float32:
+        std::memcpy(dst, src, count * sizeof(float));
+        break;
+    case DensityEncoding::Half:
+        for(size_t i = 0; i < count; ++i)
+            static_cast<uint16_t *>(dst)[i] = floatToHalf(src[i]);
+        break;
+    case DensityEncoding::Unorm16:
+        encodeUnorm(quant, src, count, static_cast<uint16_t *>(dst));
+        break;
+    case DensityEncoding::Unorm8:
+        encodeUnorm(quant, src, count, static_cast<uint8_t *>(dst));
+        break;
+    }
+}
+
+float decodeDensity(const DensityQuantization &quant, const void *src, size_t index)
+{
+    switch(quant.encoding)
+    {
+    case DensityEncoding::Float32:
+        return static_cast<const float *>(src)[index];
+    case DensityEncoding::Half:
+        return halfToFloat(static_cast<const uint16_t *>(src)[index]);
+    case DensityEncoding::Unorm16:
+        return quant.offset + quant.scale * (static_cast<const uint16_t *>(src)[index] / 65535.0f);
+    case DensityEncoding::Unorm8:
+        return quant.offset + quant.scale * (static_cast<const uint8_t *>(src)[index] / 255.0f);
+    }
+    return 0;
+}
+
+float getDensityQuantizationError(const DensityQuantization &quant, float value)
+{
+    // half the code step, plus a few ulps for the decoding arithmetic
+    switch(quant.encoding)
+    {
+    case DensityEncoding::Float32: return 0;
+    case DensityEncoding::Half:    return std::abs(value) * (1.0f / 2048) + 1.0f / 16777216;
+    case DensityEncoding::Unorm16: return quant.scale * (0.5f / 65535) + std::abs(value) * 1e-6f;
+    case DensityEncoding::Unorm8:  return quant.scale * (0.5f / 255)   + std::abs(value) * 1e-6f;
+    }
+    return 0;
+}
+
+Grid roundTripDensity(const Grid &density, DensityEncoding encoding)
+{
+    if(density.getFormat() != GridFormat::R32F)
+        throw std::runtime_error("density encoding requires a R32F density grid");
+
+    const float *values = density.getData();
+    const size_t count  = density.getVoxelCount();
+
+    const auto [minValue, maxValue] = std::minmax_element(values, values + count);
+    const DensityQuantization quant = fitDensityQuantization(
+        encoding, count ? *minValue : 0.0f, count ? *maxValue : 0.0f);
+
+    std::vector<uint8_t> encoded(count * getDensityTexelSize(encoding));
+    encodeDensity(quant, values, count, encoded.data());
+
+    std::vector<float> decoded(count);
+    for(size_t i = 0; i < count; ++i)
+        decoded[i] = decodeDensity(quant, encoded.data(), i);
+
+    return Grid::fromData(GridFormat::R32F, density.getSize(), std::move(decoded));
+}
+
+const char *getAlbedoEncodingName(AlbedoEncoding encoding)
+{
+    switch(encoding)
+    {
+    case AlbedoEncoding::Float32: return "float";
+    case AlbedoEncoding::SRGB8:   return "srgb8";
+    }
+    return "unknown";
+}
+
+std::vector<uint32_t> encodeAlbedoSRGB8(const Grid &albedo)
+{
+    if(albedo.getFormat() != GridFormat::RGBA32F)
+        throw std::runtime_error("albedo encoding requires a RGBA32F albedo grid");
+
+    std::vector<uint32_t> result(albedo.getVoxelCount());
+    const float *voxel = albedo.getData();
+    for(auto &texel : result)
+    {
+        texel = uint32_t(encodeUnorm8(voxel[0]))       |
+                uint32_t(encodeUnorm8(voxel[1])) << 8  |
+                uint32_t(encodeUnorm8(voxel[2])) << 16 |
+                uint32_t(255) << 24;
+        voxel += 4;
+    }
+    return result;
+}
+
+Float3 decodeAlbedoSRGB8(uint32_t texel)
+{
+    return Float3(
+        (texel & 0xff) / 255.0f, ((texel >> 8) & 0xff) / 255.0f,
+        ((texel >> 16) & 0xff) / 255.0f);
+}
+
+Grid roundTripAlbedo(const Grid &albedo, AlbedoEncoding encoding)
+{
+    std::vector<float> decoded(albedo.getData(), albedo.getData() + 4 * albedo.getVoxelCount());
+    if(encoding == AlbedoEncoding::SRGB8)
+    {
+        const std::vector<uint32_t> texels = encodeAlbedoSRGB8(albedo);
+        for(size_t i = 0; i < texels.size(); ++i)
+        {
+            const Float3 rgb = decodeAlbedoSRGB8(texels[i]);
+            decoded[4 * i]     = rgb.x;
+            decoded[4 * i + 1] = rgb.y;
+            decoded[4 * i + 2] = rgb.z;
+        }
+    }
+    return Grid::fromData(GridFormat::RGBA32F, albedo.getSize(), std::move(decoded));
+}
+
+bool findConstantAlbedo(const Grid &albedo, Float3 &value)
+{
+    if(albedo.getFormat() != GridFormat::RGBA32F || !albedo.getVoxelCount())
+        return false;
+
+    const float *data = albedo.getData();
+    for(size_t i = 1; i < albedo.getVoxelCount(); ++i)
+    {
+        const float *voxel = data + 4 * i;
+        if(voxel[0] != data[0] || voxel[1] != data[1] || voxel[2] != data[2])
+            return false;
+    }
+
+    value = Float3(data[0], data[1], data[2]);
+    return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "grid.h"
+
+// density texel encodings. values match the order of the demo's setting
+enum class DensityEncoding
+{
+    Float32 = 0, // R32_FLOAT
+    Half    = 1, // R16_FLOAT
+    Unorm16 = 2, // R16_UNORM with a per-grid scale and offset
+    Unorm8  = 3  // R8_UNORM with a per-grid scale and offset
+};
+
+// "float", "half", "unorm16" or "unorm8"
+const char *getDensityEncodingName(DensityEncoding encoding);
+
+size_t getDensityTexelSize(DensityEncoding encoding);
+
+// decoded value = offset + scale * stored value. the offset is the grid's
+// min, so zero voxels stay exactly zero in the common zero-min case, and
+// linear decoding commutes with trilinear filtering
+struct DensityQuantization
+{
+    DensityEncoding encoding = DensityEncoding::Float32;
+    float           scale    = 1;
+    float           offset   = 0;
+};
+
+DensityQuantization fitDensityQuantization(
+    DensityEncoding encoding, float minValue, float maxValue);
+
+// dst receives count * getDensityTexelSize(encoding) bytes
+void encodeDensity(
+    const DensityQuantization &quant, const float *src, size_t count, void *dst);
+
+float decodeDensity(const DensityQuantization &quant, const void *src, size_t index);
+
+// bound of |decode(encode(value)) - value|, by which majorants computed from
+// the unencoded values are widened
+float getDensityQuantizationError(const DensityQuantization &quant, float value);
+
+// encodes a R32F grid and decodes it back, which is what the gpu samples
+Grid roundTripDensity(const Grid &density, DensityEncoding encoding);
+
+// albedo texel encodings
+enum class AlbedoEncoding
+{
+    Float32 = 0, // RGBA32_FLOAT
+    SRGB8   = 1  // RGBA8_UNORM of the gamma-encoded values
+};
+
+const char *getAlbedoEncodingName(AlbedoEncoding encoding);
+
+// albedo grids store gamma-encoded values that the shader linearizes with
+// pow(x, 2.2). packing them into 8 bits before linearization is the usual
+// sRGB8 trade-off: quantization steps are even in perceived brightness.
+// the texture is not a _SRGB format, as hardware sRGB decoding uses a
+// different curve and converts before filtering
+std::vector<uint32_t> encodeAlbedoSRGB8(const Grid &albedo);
+
+Float3 decodeAlbedoSRGB8(uint32_t texel);
+
+Grid roundTripAlbedo(const Grid &albedo, AlbedoEncoding encoding);
+
+// true if every voxel has the same rgb, which is then stored in value
+bool findConstantAlbedo(const Grid &albedo, Float3 &value);
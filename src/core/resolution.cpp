@@ -0,0 +1,80 @@
+#include "resolution.h"
+
+int getInterleaveRank(int x, int y, int stride)
+{
+    // x ^ y and y interleaved, lowest bits first
+    int rank = 0;
+    for(int bit = 1; bit < stride; bit <<= 1)
+        rank = (rank << 2) | (((x ^ y) & bit) ? 2 : 0) | ((y & bit) ? 1 : 0);
+    return rank;
+}
+
+void ResolutionController::setParams(const DynamicResolutionParams &params)
+{
+    params_ = params;
+}
+
+const DynamicResolutionParams &ResolutionController::getParams() const
+{
+    return params_;
+}
+
+void ResolutionController::beginFrame(bool moving)
+{
+    if(!params_.enabled)
+    {
+        stride_     = 1;
+        phase_      = 0;
+        fillPhases_ = 0;
+        return;
+    }
+
+    if(moving)
+    {
+        // the densest stride predicted to fit. without a measurement yet,
+        // the first moving frame is a full one
+
+        int stride = 1;
+        while(stride < params_.maxStride &&
+              fullFrameMs_ / (stride * stride) > params_.frameBudgetMs)
+            stride *= 2;
+
+        phase_      = stride == stride_ ? (phase_ + 1) % (stride * stride) : 0;
+        stride_     = stride;
+        fillPhases_ = stride * stride - 1;
+        return;
+    }
+
+    if(fillPhases_ > 0)
+    {
+        phase_ = (phase_ + 1) % (stride_ * stride_);
+        --fillPhases_;
+        return;
+    }
+
+    stride_ = 1;
+    phase_  = 0;
+}
+
+int ResolutionController::getStride() const
+{
+    return stride_;
+}
+
+int ResolutionController::getPhase() const
+{
+    return phase_;
+}
+
+void ResolutionController::endFrame(double ms)
+{
+    // the cost of a frame is mostly its traced pixels
+
+    const double fullMs = ms * stride_ * stride_;
+    fullFrameMs_ = fullFrameMs_ > 0 ? fullFrameMs_ + 0.25 * (fullMs - fullFrameMs_) : fullMs;
+}
+
+double ResolutionController::getFullFrameMs() const
+{
+    return fullFrameMs_;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "common.h"
+
+// interleaved rendering under a frame time budget. while the camera moves,
+// each frame traces one pixel of each stride x stride block, the largest
+// fraction of the pixels whose predicted time fits the budget, and the
+// other pixels are upsampled from them for display. once the camera
+// stops, the remaining pixels of the blocks are traced at the same stride,
+// then whole frames are
+struct DynamicResolutionParams
+{
+    bool enabled = false;
+
+    float frameBudgetMs = 33;
+
+    // 1, 2 or 4. the sparsest frames trace 1 / maxStride^2 of the pixels
+    int maxStride = 4;
+};
+
+// rank of a pixel of a stride x stride block (stride a power of 2) in the
+// order the blocks are traced in: a bayer matrix, so that the pixels
+// traced in consecutive frames are spread over the block
+int getInterleaveRank(int x, int y, int stride);
+
+// picks the stride and phase of each frame from the measured frame times
+class ResolutionController
+{
+public:
+
+    void setParams(const DynamicResolutionParams &params);
+
+    const DynamicResolutionParams &getParams() const;
+
+    // before a frame. moving if the camera moved since the last frame
+    void beginFrame(bool moving);
+
+    // traced pixels (x, y) of the frame have
+    // getInterleaveRank(x % stride, y % stride, stride) == phase
+    int getStride() const;
+
+    int getPhase() const;
+
+    // after the frame, with what it took
+    void endFrame(double ms);
+
+    // of a frame tracing all pixels, estimated from the last frames
+    double getFullFrameMs() const;
+
+private:
+
+    DynamicResolutionParams params_;
+
+    int stride_ = 1;
+    int phase_  = 0;
+
+    // phases of the current stride not traced since the camera stopped
+    int fillPhases_ = 0;
+
+    double fullFrameMs_ = 0;
+};
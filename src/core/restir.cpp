@@ -0,0 +1,30 @@
+#include "restir.h"
+
+void EnvirReservoir::update(
+    const Float3 &candidate, float weight, float candidateTargetPdf, float u)
+{
+    weightSum += weight;
+    M += 1;
+    if(weight > 0 && u * weightSum <= weight)
+    {
+        dir       = candidate;
+        targetPdf = candidateTargetPdf;
+    }
+}
+
+void EnvirReservoir::merge(const EnvirReservoir &other, float otherTargetPdf, float u)
+{
+    const float weight = otherTargetPdf * other.W * other.M;
+    weightSum += weight;
+    M += other.M;
+    if(weight > 0 && u * weightSum <= weight)
+    {
+        dir       = other.dir;
+        targetPdf = otherTargetPdf;
+    }
+}
+
+void EnvirReservoir::finalize()
+{
+    W = targetPdf > 0 && M > 0 ? weightSum / (M * targetPdf) : 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+
+// reservoir resampling (Bitterli et al., "Spatiotemporal reservoir
+// resampling") of the envir light at the first scattering of camera
+// paths. each path draws candidates from the envir importance sampler,
+// weighted by envir luminance x phase function, merges its reservoir with
+// the one of its pixel in the last frame and with those of neighboring
+// pixels, and traces the shadow ray of the surviving direction only.
+// directions are shared as they are: the envir is at infinity and the
+// phase function positive everywhere, so every reservoir covers the same
+// directions and the 1/M weights stay unbiased
+struct ReSTIRParams
+{
+    bool enabled = false;
+
+    // per path
+    int candidates = 8;
+
+    bool temporalReuse = true;
+
+    // reservoirs of other pixels merged per path, up to spatialRadius away
+    int spatialNeighbors = 3;
+    int spatialRadius    = 8;
+
+    // the sample count of the history is capped at historyLimit times the
+    // candidates of a path, so that old samples fade out
+    int historyLimit = 20;
+};
+
+// one envir direction out of a stream of weighted candidates
+struct EnvirReservoir
+{
+    Float3 dir       = Float3(0);
+    float  targetPdf = 0; // of dir, at the owner of the reservoir
+    float  weightSum = 0;
+    float  M         = 0;
+    float  W         = 0; // unbiased contribution weight of dir
+
+    // a candidate drawn with weight = targetPdf / sourcePdf. u in [0, 1]
+    void update(const Float3 &candidate, float weight, float candidateTargetPdf, float u);
+
+    // another reservoir, with the target pdf of its direction here
+    void merge(const EnvirReservoir &other, float otherTargetPdf, float u);
+
+    // computes W after the candidates and merges
+    void finalize();
+};
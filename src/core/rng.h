@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// same generator as asset/rng.hlsl
+
+inline uint32_t randUint(uint32_t &input)
+{
+    const uint32_t state = input * 747796405u + 2891336453u;
+    const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    const uint32_t result = (word >> 22u) ^ word;
+
+    input = result;
+    return result;
+}
+
+inline float randFloat(uint32_t &input)
+{
+    return static_cast<float>(randUint(input)) / 4294967295.0f;
+}
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "rng.h"
+#include "sampler.h"
+
+namespace
+{
+    // second generator of the extensible rank-1 lattice
+    // lattice-32001-1024-1048576.3600 of Cools, Kuo and Nuyens
+    constexpr uint32_t LATTICE_GENERATOR = 182667u;
+
+    uint32_t reverseBits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    uint32_t hashCombine(uint32_t seed, uint32_t value)
+    {
+        return hash(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+    }
+
+    // owen scrambling of bit-reversed values: each bit is flipped by a hash
+    // of the bits below it (Laine-Karras, with the constants of Vegdahl)
+    uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed)
+    {
+        x ^= x * 0x3d20adeau;
+        x += seed;
+        x *= (seed >> 16) | 1;
+        x ^= x * 0x05526c56u;
+        x ^= x * 0x53a22864u;
+        return x;
+    }
+
+    uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+    {
+        return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+    }
+
+    // first two dimensions of the sobol sequence
+    uint32_t sobol0(uint32_t index)
+    {
+        return reverseBits(index);
+    }
+
+    uint32_t sobol1(uint32_t index)
+    {
+        uint32_t result = 0;
+        for(uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+        {
+            if(index & 1)
+                result ^= v;
+        }
+        return result;
+    }
+
+    float toFloat(uint32_t x)
+    {
+        return static_cast<float>(x >> 8) * (1.0f / 16777216);
+    }
+
+    Float2 toFloat2(uint32_t x, uint32_t y)
+    {
+        return Float2(toFloat(x), toFloat(y));
+    }
+
+    // void-and-cluster without the initial pattern: each pixel in turn is
+    // put into the largest void, the minimum of the energy of toroidal
+    // gaussians around the pixels placed so far
+    std::vector<uint16_t> buildBlueNoiseMask()
+    {
+        constexpr int N = BLUE_NOISE_SIZE;
+        constexpr float SIGMA = 1.9f;
+
+        float gaussian[N][N];
+        for(int y = 0; y < N; ++y)
+        {
+            for(int x = 0; x < N; ++x)
+            {
+                const int dx = (std::min)(x, N - x), dy = (std::min)(y, N - y);
+                gaussian[y][x] = std::exp(-float(dx * dx + dy * dy) / (2 * SIGMA * SIGMA));
+            }
+        }
+
+        // a little noise breaks the ties of the first placements
+        std::vector<float> energy(N * N);
+        uint32_t rng = 1;
+        for(float &e : energy)
+            e = 1e-4f * randFloat(rng);
+
+        std::vector<uint16_t> result(N * N);
+        std::vector<bool> placed(N * N);
+
+        for(int rank = 0; rank < N * N; ++rank)
+        {
+            int best = -1;
+            for(int i = 0; i < N * N; ++i)
+            {
+                if(!placed[i] && (best < 0 || energy[i] < energy[best]))
+                    best = i;
+            }
+
+            placed[best] = true;
+            result[best] = static_cast<uint16_t>(rank);
+
+            const int bx = best % N, by = best / N;
+            for(int y = 0; y < N; ++y)
+            {
+                const float *row = gaussian[(y - by + N) % N];
+                for(int x = 0; x < N; ++x)
+                    energy[y * N + x] += row[(x - bx + N) % N];
+            }
+        }
+
+        return result;
+    }
+}
+
+const char *getSamplerTypeName(SamplerType type)
+{
+    switch(type)
+    {
+    case SamplerType::Random:    return "random";
+    case SamplerType::Sobol:     return "sobol";
+    case SamplerType::Lattice:   return "lattice";
+    case SamplerType::BlueNoise: return "bluenoise";
+    }
+    return "unknown";
+}
+
+void PixelSampler::setType(SamplerType type)
+{
+    type_ = type;
+}
+
+SamplerType PixelSampler::getType() const
+{
+    return type_;
+}
+
+Float2 PixelSampler::get2D(const Int2 &pixel, uint32_t sampleIndex, int dim) const
+{
+    const uint32_t pair = static_cast<uint32_t>(dim / 2);
+    const uint32_t pixelSeed = hashCombine(hash(static_cast<uint32_t>(pixel.x)), pixel.y);
+
+    switch(type_)
+    {
+    case SamplerType::Random:
+        break;
+
+    case SamplerType::Sobol:
+    {
+        // the shuffled index keeps prefixes of 2^k samples stratified
+        const uint32_t seed  = hashCombine(pixelSeed, pair);
+        const uint32_t index = nestedUniformScramble(sampleIndex, seed);
+        return toFloat2(
+            nestedUniformScramble(sobol0(index), hashCombine(seed, 1)),
+            nestedUniformScramble(sobol1(index), hashCombine(seed, 2)));
+    }
+
+    case SamplerType::Lattice:
+    {
+        // radical inverse order visits the 2^k point lattices one after
+        // another, and scrambling the index only permutes within them.
+        // wrapping 32-bit arithmetic is arithmetic mod 1
+        const uint32_t seed  = hashCombine(pixelSeed, pair);
+        const uint32_t point = reverseBits(nestedUniformScramble(sampleIndex, seed));
+        return toFloat2(
+            point + hashCombine(seed, 1),
+            point * LATTICE_GENERATOR + hashCombine(seed, 2));
+    }
+
+    case SamplerType::BlueNoise:
+    {
+        // all pixels share the sequence of a pair, toroidally shifted by a
+        // blue noise mask at a per-dimension offset. neighbors then have
+        // dissimilar shifts, which pushes the error to high frequencies
+        const uint32_t seed  = hashCombine(0x2545f491u, pair);
+        const uint32_t index = nestedUniformScramble(sampleIndex, seed);
+
+        const uint16_t *mask = getBlueNoiseMask();
+        auto getShift = [&](uint32_t offsetSeed)
+        {
+            const uint32_t offset = hash(offsetSeed);
+            const int x = (pixel.x + static_cast<int>(offset & 0xffff)) % BLUE_NOISE_SIZE;
+            const int y = (pixel.y + static_cast<int>(offset >> 16))    % BLUE_NOISE_SIZE;
+            return static_cast<uint32_t>(mask[y * BLUE_NOISE_SIZE + x]) << 20;
+        };
+
+        return toFloat2(
+            nestedUniformScramble(sobol0(index), hashCombine(seed, 1)) + getShift(seed + 1),
+            nestedUniformScramble(sobol1(index), hashCombine(seed, 2)) + getShift(seed + 2));
+    }
+    }
+
+    const uint32_t x = hashCombine(hashCombine(pixelSeed, sampleIndex), static_cast<uint32_t>(dim));
+    return toFloat2(x, hash(x));
+}
+
+const uint16_t *getBlueNoiseMask()
+{
+    static const std::vector<uint16_t> mask = buildBlueNoiseMask();
+    return mask.data();
+}
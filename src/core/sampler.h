@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common.h"
+
+// where the random numbers of the camera paths of the cpu renderer come from
+enum class SamplerType
+{
+    Random    = 0, // per-pixel pcg, like asset/raw.hlsl
+    Sobol     = 1, // owen-scrambled sobol, shuffled per dimension pair
+    Lattice   = 2, // rank-1 lattice in radical inverse order, shifted per pixel
+    BlueNoise = 3  // sobol shared by all pixels, shifted by a blue noise mask
+};
+
+// "random", "sobol", "lattice" or "bluenoise"
+const char *getSamplerTypeName(SamplerType type);
+
+// dimensions of one bounce of a camera path. each bounce takes the next
+// SAMPLE_DIMS_PER_BOUNCE dimensions, drawn in pairs. random numbers beyond
+// them (the tracking steps after the first, shadow rays, and bounces past
+// SAMPLE_MAX_BOUNCES) come from the pcg of the pixel
+enum SampleDimension
+{
+    SAMPLE_DIM_FREE_FLIGHT  = 0, // first tentative collision of delta tracking
+    SAMPLE_DIM_SCATTER      = 1, // real / null decisions of delta tracking
+    SAMPLE_DIM_PHASE        = 2, // 2d
+    SAMPLE_DIM_LIGHT_SELECT = 4, // 2d, envir patch
+    SAMPLE_DIM_LIGHT        = 6, // 2d, direction in the patch
+
+    SAMPLE_DIMS_PER_BOUNCE = 8
+};
+
+constexpr int SAMPLE_MAX_BOUNCES = 16;
+
+// low-discrepancy samples, indexed by pixel, sample index and dimension.
+// the sample index of a pixel is the number of samples it has accumulated,
+// so prefixes of 2^k samples are well stratified in each dimension pair.
+// pairs are decorrelated by scrambling the sample index per pair, as in
+// Burley, "Practical Hash-based Owen Scrambling"
+class PixelSampler
+{
+public:
+
+    void setType(SamplerType type);
+
+    SamplerType getType() const;
+
+    // dimensions dim and dim + 1 (dim even) of a sample, in [0, 1)
+    Float2 get2D(const Int2 &pixel, uint32_t sampleIndex, int dim) const;
+
+private:
+
+    SamplerType type_ = SamplerType::Random;
+};
+
+// 64x64 blue noise ranks in [0, 4096), x-major, built on first use
+const uint16_t *getBlueNoiseMask();
+
+constexpr int BLUE_NOISE_SIZE = 64;
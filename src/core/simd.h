@@ -0,0 +1,302 @@
+#pragma once
+
+// thin wrappers of SSE4.1 / AVX2 / AVX-512F registers used by the packet
+// tracer. each width is only available in translation units compiled for
+// its instruction set, and everything has internal linkage so that code
+// generated for a wider instruction set never leaks into other units
+
+#include <cstdint>
+
+#include <immintrin.h>
+
+namespace
+{
+
+template<int W> struct SimdFloat;
+template<int W> struct SimdInt;
+template<int W> struct SimdMask;
+
+#if defined(__SSE4_1__) || defined(_MSC_VER)
+
+template<> struct SimdMask<4>
+{
+    __m128 m;
+
+    bool any()  const { return _mm_movemask_ps(m) != 0; }
+    int  bits() const { return _mm_movemask_ps(m); }
+
+    static SimdMask fromBits(int bits)
+    {
+        const __m128i b = _mm_and_si128(
+            _mm_set1_epi32(bits), _mm_setr_epi32(1, 2, 4, 8));
+        return { _mm_castsi128_ps(_mm_cmpgt_epi32(b, _mm_setzero_si128())) };
+    }
+};
+
+template<> struct SimdInt<4>
+{
+    __m128i v;
+
+    SimdInt() = default;
+    SimdInt(__m128i v) : v(v) { }
+    SimdInt(int32_t s) : v(_mm_set1_epi32(s)) { }
+
+    static SimdInt load(const uint32_t *p) { return { _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)) }; }
+    void store(uint32_t *p) const { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+};
+
+template<> struct SimdFloat<4>
+{
+    __m128 v;
+
+    SimdFloat() = default;
+    SimdFloat(__m128 v) : v(v) { }
+    SimdFloat(float s) : v(_mm_set1_ps(s)) { }
+
+    static SimdFloat load(const float *p) { return { _mm_loadu_ps(p) }; }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+};
+
+inline SimdMask<4> operator&(SimdMask<4> a, SimdMask<4> b) { return { _mm_and_ps(a.m, b.m) }; }
+inline SimdMask<4> operator|(SimdMask<4> a, SimdMask<4> b) { return { _mm_or_ps(a.m, b.m) }; }
+inline SimdMask<4> andNot(SimdMask<4> a, SimdMask<4> b) { return { _mm_andnot_ps(b.m, a.m) }; }
+
+inline SimdFloat<4> operator+(SimdFloat<4> a, SimdFloat<4> b) { return _mm_add_ps(a.v, b.v); }
+inline SimdFloat<4> operator-(SimdFloat<4> a, SimdFloat<4> b) { return _mm_sub_ps(a.v, b.v); }
+inline SimdFloat<4> operator*(SimdFloat<4> a, SimdFloat<4> b) { return _mm_mul_ps(a.v, b.v); }
+inline SimdFloat<4> operator/(SimdFloat<4> a, SimdFloat<4> b) { return _mm_div_ps(a.v, b.v); }
+inline SimdFloat<4> operator-(SimdFloat<4> a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+
+inline SimdFloat<4> min(SimdFloat<4> a, SimdFloat<4> b) { return _mm_min_ps(a.v, b.v); }
+inline SimdFloat<4> max(SimdFloat<4> a, SimdFloat<4> b) { return _mm_max_ps(a.v, b.v); }
+inline SimdFloat<4> sqrt(SimdFloat<4> a) { return _mm_sqrt_ps(a.v); }
+inline SimdFloat<4> floor(SimdFloat<4> a) { return _mm_floor_ps(a.v); }
+inline SimdFloat<4> round(SimdFloat<4> a) { return _mm_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+inline SimdFloat<4> abs(SimdFloat<4> a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+inline SimdMask<4> operator<(SimdFloat<4> a, SimdFloat<4> b)  { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline SimdMask<4> operator<=(SimdFloat<4> a, SimdFloat<4> b) { return { _mm_cmple_ps(a.v, b.v) }; }
+inline SimdMask<4> operator>(SimdFloat<4> a, SimdFloat<4> b)  { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline SimdMask<4> operator>=(SimdFloat<4> a, SimdFloat<4> b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+
+inline SimdFloat<4> select(SimdMask<4> m, SimdFloat<4> a, SimdFloat<4> b) { return _mm_blendv_ps(b.v, a.v, m.m); }
+inline SimdInt<4> select(SimdMask<4> m, SimdInt<4> a, SimdInt<4> b)
+{
+    return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b.v), _mm_castsi128_ps(a.v), m.m));
+}
+
+inline SimdInt<4> operator+(SimdInt<4> a, SimdInt<4> b) { return _mm_add_epi32(a.v, b.v); }
+inline SimdInt<4> operator-(SimdInt<4> a, SimdInt<4> b) { return _mm_sub_epi32(a.v, b.v); }
+inline SimdInt<4> operator*(SimdInt<4> a, SimdInt<4> b) { return _mm_mullo_epi32(a.v, b.v); }
+inline SimdInt<4> operator^(SimdInt<4> a, SimdInt<4> b) { return _mm_xor_si128(a.v, b.v); }
+inline SimdInt<4> operator&(SimdInt<4> a, SimdInt<4> b) { return _mm_and_si128(a.v, b.v); }
+inline SimdInt<4> operator|(SimdInt<4> a, SimdInt<4> b) { return _mm_or_si128(a.v, b.v); }
+inline SimdInt<4> shiftRight(SimdInt<4> a, int s) { return _mm_srli_epi32(a.v, s); }
+inline SimdInt<4> shiftLeft(SimdInt<4> a, int s) { return _mm_slli_epi32(a.v, s); }
+inline SimdInt<4> min(SimdInt<4> a, SimdInt<4> b) { return _mm_min_epi32(a.v, b.v); }
+inline SimdInt<4> max(SimdInt<4> a, SimdInt<4> b) { return _mm_max_epi32(a.v, b.v); }
+
+// SSE has no per-lane variable shift
+inline SimdInt<4> shiftRight(SimdInt<4> a, SimdInt<4> s)
+{
+    alignas(16) uint32_t x[4], n[4];
+    a.store(x); s.store(n);
+    for(int i = 0; i < 4; ++i)
+        x[i] >>= n[i];
+    return SimdInt<4>::load(x);
+}
+
+inline SimdInt<4> toInt(SimdFloat<4> a) { return _mm_cvttps_epi32(a.v); }
+inline SimdFloat<4> toFloat(SimdInt<4> a) { return _mm_cvtepi32_ps(a.v); }
+inline SimdInt<4> asInt(SimdFloat<4> a) { return _mm_castps_si128(a.v); }
+inline SimdFloat<4> asFloat(SimdInt<4> a) { return _mm_castsi128_ps(a.v); }
+
+inline SimdFloat<4> gather(const float *base, SimdInt<4> idx)
+{
+    alignas(16) uint32_t i[4];
+    idx.store(i);
+    return _mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]);
+}
+
+#endif
+
+#if defined(__AVX2__)
+
+template<> struct SimdMask<8>
+{
+    __m256 m;
+
+    bool any()  const { return _mm256_movemask_ps(m) != 0; }
+    int  bits() const { return _mm256_movemask_ps(m); }
+
+    static SimdMask fromBits(int bits)
+    {
+        const __m256i b = _mm256_and_si256(
+            _mm256_set1_epi32(bits), _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128));
+        return { _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, _mm256_setzero_si256())) };
+    }
+};
+
+template<> struct SimdInt<8>
+{
+    __m256i v;
+
+    SimdInt() = default;
+    SimdInt(__m256i v) : v(v) { }
+    SimdInt(int32_t s) : v(_mm256_set1_epi32(s)) { }
+
+    static SimdInt load(const uint32_t *p) { return { _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)) }; }
+    void store(uint32_t *p) const { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v); }
+};
+
+template<> struct SimdFloat<8>
+{
+    __m256 v;
+
+    SimdFloat() = default;
+    SimdFloat(__m256 v) : v(v) { }
+    SimdFloat(float s) : v(_mm256_set1_ps(s)) { }
+
+    static SimdFloat load(const float *p) { return { _mm256_loadu_ps(p) }; }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline SimdMask<8> operator&(SimdMask<8> a, SimdMask<8> b) { return { _mm256_and_ps(a.m, b.m) }; }
+inline SimdMask<8> operator|(SimdMask<8> a, SimdMask<8> b) { return { _mm256_or_ps(a.m, b.m) }; }
+inline SimdMask<8> andNot(SimdMask<8> a, SimdMask<8> b) { return { _mm256_andnot_ps(b.m, a.m) }; }
+
+inline SimdFloat<8> operator+(SimdFloat<8> a, SimdFloat<8> b) { return _mm256_add_ps(a.v, b.v); }
+inline SimdFloat<8> operator-(SimdFloat<8> a, SimdFloat<8> b) { return _mm256_sub_ps(a.v, b.v); }
+inline SimdFloat<8> operator*(SimdFloat<8> a, SimdFloat<8> b) { return _mm256_mul_ps(a.v, b.v); }
+inline SimdFloat<8> operator/(SimdFloat<8> a, SimdFloat<8> b) { return _mm256_div_ps(a.v, b.v); }
+inline SimdFloat<8> operator-(SimdFloat<8> a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+
+inline SimdFloat<8> min(SimdFloat<8> a, SimdFloat<8> b) { return _mm256_min_ps(a.v, b.v); }
+inline SimdFloat<8> max(SimdFloat<8> a, SimdFloat<8> b) { return _mm256_max_ps(a.v, b.v); }
+inline SimdFloat<8> sqrt(SimdFloat<8> a) { return _mm256_sqrt_ps(a.v); }
+inline SimdFloat<8> floor(SimdFloat<8> a) { return _mm256_floor_ps(a.v); }
+inline SimdFloat<8> round(SimdFloat<8> a) { return _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+inline SimdFloat<8> abs(SimdFloat<8> a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+
+inline SimdMask<8> operator<(SimdFloat<8> a, SimdFloat<8> b)  { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline SimdMask<8> operator<=(SimdFloat<8> a, SimdFloat<8> b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+inline SimdMask<8> operator>(SimdFloat<8> a, SimdFloat<8> b)  { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline SimdMask<8> operator>=(SimdFloat<8> a, SimdFloat<8> b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+
+inline SimdFloat<8> select(SimdMask<8> m, SimdFloat<8> a, SimdFloat<8> b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+inline SimdInt<8> select(SimdMask<8> m, SimdInt<8> a, SimdInt<8> b)
+{
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), m.m));
+}
+
+inline SimdInt<8> operator+(SimdInt<8> a, SimdInt<8> b) { return _mm256_add_epi32(a.v, b.v); }
+inline SimdInt<8> operator-(SimdInt<8> a, SimdInt<8> b) { return _mm256_sub_epi32(a.v, b.v); }
+inline SimdInt<8> operator*(SimdInt<8> a, SimdInt<8> b) { return _mm256_mullo_epi32(a.v, b.v); }
+inline SimdInt<8> operator^(SimdInt<8> a, SimdInt<8> b) { return _mm256_xor_si256(a.v, b.v); }
+inline SimdInt<8> operator&(SimdInt<8> a, SimdInt<8> b) { return _mm256_and_si256(a.v, b.v); }
+inline SimdInt<8> operator|(SimdInt<8> a, SimdInt<8> b) { return _mm256_or_si256(a.v, b.v); }
+inline SimdInt<8> shiftRight(SimdInt<8> a, int s) { return _mm256_srli_epi32(a.v, s); }
+inline SimdInt<8> shiftLeft(SimdInt<8> a, int s) { return _mm256_slli_epi32(a.v, s); }
+inline SimdInt<8> shiftRight(SimdInt<8> a, SimdInt<8> s) { return _mm256_srlv_epi32(a.v, s.v); }
+inline SimdInt<8> min(SimdInt<8> a, SimdInt<8> b) { return _mm256_min_epi32(a.v, b.v); }
+inline SimdInt<8> max(SimdInt<8> a, SimdInt<8> b) { return _mm256_max_epi32(a.v, b.v); }
+
+inline SimdInt<8> toInt(SimdFloat<8> a) { return _mm256_cvttps_epi32(a.v); }
+inline SimdFloat<8> toFloat(SimdInt<8> a) { return _mm256_cvtepi32_ps(a.v); }
+inline SimdInt<8> asInt(SimdFloat<8> a) { return _mm256_castps_si256(a.v); }
+inline SimdFloat<8> asFloat(SimdInt<8> a) { return _mm256_castsi256_ps(a.v); }
+
+inline SimdFloat<8> gather(const float *base, SimdInt<8> idx) { return _mm256_i32gather_ps(base, idx.v, 4); }
+
+#endif
+
+#if defined(__AVX512F__)
+
+template<> struct SimdMask<16>
+{
+    __mmask16 m;
+
+    bool any()  const { return m != 0; }
+    int  bits() const { return m; }
+
+    static SimdMask fromBits(int bits) { return { static_cast<__mmask16>(bits) }; }
+};
+
+template<> struct SimdInt<16>
+{
+    __m512i v;
+
+    SimdInt() = default;
+    SimdInt(__m512i v) : v(v) { }
+    SimdInt(int32_t s) : v(_mm512_set1_epi32(s)) { }
+
+    static SimdInt load(const uint32_t *p) { return { _mm512_loadu_si512(p) }; }
+    void store(uint32_t *p) const { _mm512_storeu_si512(p, v); }
+};
+
+template<> struct SimdFloat<16>
+{
+    __m512 v;
+
+    SimdFloat() = default;
+    SimdFloat(__m512 v) : v(v) { }
+    SimdFloat(float s) : v(_mm512_set1_ps(s)) { }
+
+    static SimdFloat load(const float *p) { return { _mm512_loadu_ps(p) }; }
+    void store(float *p) const { _mm512_storeu_ps(p, v); }
+};
+
+inline SimdMask<16> operator&(SimdMask<16> a, SimdMask<16> b) { return { static_cast<__mmask16>(a.m & b.m) }; }
+inline SimdMask<16> operator|(SimdMask<16> a, SimdMask<16> b) { return { static_cast<__mmask16>(a.m | b.m) }; }
+inline SimdMask<16> andNot(SimdMask<16> a, SimdMask<16> b) { return { static_cast<__mmask16>(a.m & ~b.m) }; }
+
+inline SimdInt<16> asInt(SimdFloat<16> a) { return _mm512_castps_si512(a.v); }
+inline SimdFloat<16> asFloat(SimdInt<16> a) { return _mm512_castsi512_ps(a.v); }
+
+inline SimdFloat<16> operator+(SimdFloat<16> a, SimdFloat<16> b) { return _mm512_add_ps(a.v, b.v); }
+inline SimdFloat<16> operator-(SimdFloat<16> a, SimdFloat<16> b) { return _mm512_sub_ps(a.v, b.v); }
+inline SimdFloat<16> operator*(SimdFloat<16> a, SimdFloat<16> b) { return _mm512_mul_ps(a.v, b.v); }
+inline SimdFloat<16> operator/(SimdFloat<16> a, SimdFloat<16> b) { return _mm512_div_ps(a.v, b.v); }
+inline SimdFloat<16> operator-(SimdFloat<16> a)
+{
+    return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(INT32_MIN)));
+}
+
+inline SimdFloat<16> min(SimdFloat<16> a, SimdFloat<16> b) { return _mm512_min_ps(a.v, b.v); }
+inline SimdFloat<16> max(SimdFloat<16> a, SimdFloat<16> b) { return _mm512_max_ps(a.v, b.v); }
+inline SimdFloat<16> sqrt(SimdFloat<16> a) { return _mm512_sqrt_ps(a.v); }
+inline SimdFloat<16> floor(SimdFloat<16> a) { return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+inline SimdFloat<16> round(SimdFloat<16> a) { return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+inline SimdFloat<16> abs(SimdFloat<16> a)
+{
+    return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(INT32_MAX)));
+}
+
+inline SimdMask<16> operator<(SimdFloat<16> a, SimdFloat<16> b)  { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+inline SimdMask<16> operator<=(SimdFloat<16> a, SimdFloat<16> b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; }
+inline SimdMask<16> operator>(SimdFloat<16> a, SimdFloat<16> b)  { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+inline SimdMask<16> operator>=(SimdFloat<16> a, SimdFloat<16> b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; }
+
+inline SimdFloat<16> select(SimdMask<16> m, SimdFloat<16> a, SimdFloat<16> b) { return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+inline SimdInt<16> select(SimdMask<16> m, SimdInt<16> a, SimdInt<16> b) { return _mm512_mask_blend_epi32(m.m, b.v, a.v); }
+
+inline SimdInt<16> operator+(SimdInt<16> a, SimdInt<16> b) { return _mm512_add_epi32(a.v, b.v); }
+inline SimdInt<16> operator-(SimdInt<16> a, SimdInt<16> b) { return _mm512_sub_epi32(a.v, b.v); }
+inline SimdInt<16> operator*(SimdInt<16> a, SimdInt<16> b) { return _mm512_mullo_epi32(a.v, b.v); }
+inline SimdInt<16> operator^(SimdInt<16> a, SimdInt<16> b) { return _mm512_xor_si512(a.v, b.v); }
+inline SimdInt<16> operator&(SimdInt<16> a, SimdInt<16> b) { return _mm512_and_si512(a.v, b.v); }
+inline SimdInt<16> operator|(SimdInt<16> a, SimdInt<16> b) { return _mm512_or_si512(a.v, b.v); }
+inline SimdInt<16> shiftRight(SimdInt<16> a, int s) { return _mm512_srli_epi32(a.v, static_cast<unsigned>(s)); }
+inline SimdInt<16> shiftLeft(SimdInt<16> a, int s) { return _mm512_slli_epi32(a.v, static_cast<unsigned>(s)); }
+inline SimdInt<16> shiftRight(SimdInt<16> a, SimdInt<16> s) { return _mm512_srlv_epi32(a.v, s.v); }
+inline SimdInt<16> min(SimdInt<16> a, SimdInt<16> b) { return _mm512_min_epi32(a.v, b.v); }
+inline SimdInt<16> max(SimdInt<16> a, SimdInt<16> b) { return _mm512_max_epi32(a.v, b.v); }
+
+inline SimdInt<16> toInt(SimdFloat<16> a) { return _mm512_cvttps_epi32(a.v); }
+inline SimdFloat<16> toFloat(SimdInt<16> a) { return _mm512_cvtepi32_ps(a.v); }
+
+inline SimdFloat<16> gather(const float *base, SimdInt<16> idx) { return _mm512_i32gather_ps(idx.v, base, 4); }
+
+#endif
+
+} // namespace anonymous
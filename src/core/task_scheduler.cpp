@@ -0,0 +1,307 @@
+#include <stdexcept>
+#include <utility>
+
+#include "task_scheduler.h"
+
+namespace
+{
+    // worker identity and priority of the running task, per thread
+    thread_local const TaskScheduler *currentScheduler = nullptr;
+    thread_local int                  currentWorker    = -1;
+    thread_local TaskPriority         currentPriority  = TaskPriority::Normal;
+
+    std::mutex                     globalMutex;
+    std::unique_ptr<TaskScheduler> globalScheduler;
+}
+
+const char *getTaskPriorityName(TaskPriority priority)
+{
+    switch(priority)
+    {
+    case TaskPriority::Interactive: return "interactive";
+    case TaskPriority::Normal:      return "normal";
+    case TaskPriority::Background:  return "background";
+    }
+    return "unknown";
+}
+
+TaskScheduler::TaskScheduler(int workerCount)
+{
+    if(workerCount <= 0)
+        workerCount = static_cast<int>((std::max)(1u, std::thread::hardware_concurrency()));
+
+    workerCount_ = workerCount;
+    queues_      = std::make_unique<Queue[]>(workerCount + 1);
+
+    for(int i = 0; i < workerCount; ++i)
+        workers_.emplace_back([this, i] { workerLoop(i); });
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard lock(sleepMutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+
+    for(auto &t : workers_)
+        t.join();
+}
+
+TaskScheduler &TaskScheduler::getGlobal()
+{
+    std::lock_guard lock(globalMutex);
+    if(!globalScheduler)
+        globalScheduler = std::make_unique<TaskScheduler>();
+    return *globalScheduler;
+}
+
+void TaskScheduler::setGlobalWorkerCount(int count)
+{
+    std::lock_guard lock(globalMutex);
+    globalScheduler.reset();
+    globalScheduler = std::make_unique<TaskScheduler>(count);
+}
+
+TaskPriority TaskScheduler::getCurrentPriority()
+{
+    return currentPriority;
+}
+
+int TaskScheduler::getWorkerCount() const
+{
+    return workerCount_;
+}
+
+int TaskScheduler::getWorkerIndex() const
+{
+    return currentScheduler == this ? currentWorker : -1;
+}
+
+void TaskScheduler::submit(Task task, TaskPriority priority)
+{
+    const int worker = getWorkerIndex();
+    Queue &queue = queues_[worker >= 0 ? worker : workerCount_];
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.tasks[static_cast<int>(priority)].push_back(std::move(task));
+        ++pending_;
+    }
+
+    // taking the lock orders the push before a worker going to sleep
+    // checks pending_
+    {
+        std::lock_guard lock(sleepMutex_);
+    }
+    wake_.notify_one();
+}
+
+bool TaskScheduler::runOne(TaskPriority priority)
+{
+    const int worker = getWorkerIndex();
+    if(worker < 0)
+        return false;
+
+    Task task;
+    TaskPriority taskPriority;
+    if(!pop(worker, priority, task, taskPriority))
+        return false;
+
+    run(task, taskPriority);
+    return true;
+}
+
+bool TaskScheduler::pop(int worker, TaskPriority priority, Task &task, TaskPriority &taskPriority)
+{
+    auto tryPop = [&](int queueIndex, int p, bool back)
+    {
+        Queue &queue = queues_[queueIndex];
+        std::lock_guard lock(queue.mutex);
+
+        auto &tasks = queue.tasks[p];
+        if(tasks.empty())
+            return false;
+
+        if(back)
+        {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        --pending_;
+        taskPriority = static_cast<TaskPriority>(p);
+        return true;
+    };
+
+    // own queue, then injected tasks, then the other workers starting with
+    // the next one, so that thieves spread over victims
+
+    for(int p = 0; p <= static_cast<int>(priority); ++p)
+    {
+        if(tryPop(worker, p, true) || tryPop(workerCount_, p, false))
+            return true;
+
+        for(int i = 1; i < workerCount_; ++i)
+        {
+            if(tryPop((worker + i) % workerCount_, p, false))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+void TaskScheduler::run(Task &task, TaskPriority priority)
+{
+    const TaskPriority outerPriority = currentPriority;
+    currentPriority = priority;
+    task();
+    currentPriority = outerPriority;
+}
+
+void TaskScheduler::workerLoop(int index)
+{
+    currentScheduler = this;
+    currentWorker    = index;
+
+    for(;;)
+    {
+        Task task;
+        TaskPriority priority;
+        if(pop(index, TaskPriority::Background, task, priority))
+        {
+            run(task, priority);
+            continue;
+        }
+
+        std::unique_lock lock(sleepMutex_);
+        wake_.wait(lock, [&] { return stop_ || pending_ > 0; });
+        if(stop_ && !pending_)
+            return;
+    }
+}
+
+TaskGroup::TaskGroup(TaskPriority priority, TaskScheduler &scheduler)
+    : scheduler_(scheduler), priority_(priority), state_(std::make_shared<State>())
+{
+
+}
+
+TaskGroup::~TaskGroup()
+{
+    try
+    {
+        wait();
+    }
+    catch(...)
+    {
+    }
+}
+
+TaskScheduler &TaskGroup::getScheduler() const
+{
+    return scheduler_;
+}
+
+TaskPriority TaskGroup::getPriority() const
+{
+    return priority_;
+}
+
+void TaskGroup::run(TaskScheduler::Task task)
+{
+    ++state_->remaining;
+
+    // the state outlives the group if wait returns before the last task
+    // has notified
+    scheduler_.submit([state = state_, task = std::move(task)]
+    {
+        if(!state->failed)
+        {
+            try
+            {
+                task();
+            }
+            catch(...)
+            {
+                std::lock_guard lock(state->mutex);
+                if(!state->exception)
+                    state->exception = std::current_exception();
+                state->failed = true;
+            }
+        }
+
+        if(--state->remaining == 0)
+            state->remaining.notify_all();
+    }, priority_);
+}
+
+void TaskGroup::wait()
+{
+    for(int remaining; (remaining = state_->remaining) != 0;)
+    {
+        if(!scheduler_.runOne(priority_))
+            state_->remaining.wait(remaining);
+    }
+
+    std::lock_guard lock(state_->mutex);
+    if(state_->exception)
+    {
+        state_->failed = false;
+        std::rethrow_exception(std::exchange(state_->exception, nullptr));
+    }
+}
+
+TaskGraph::NodeID TaskGraph::add(TaskScheduler::Task task)
+{
+    nodes_.push_back({ std::move(task), {}, 0 });
+    return static_cast<NodeID>(nodes_.size() - 1);
+}
+
+void TaskGraph::addDependency(NodeID before, NodeID after)
+{
+    nodes_[before].successors.push_back(after);
+    ++nodes_[after].dependencyCount;
+}
+
+void TaskGraph::run(TaskPriority priority)
+{
+    const int nodeCount = static_cast<int>(nodes_.size());
+
+    auto remaining = std::make_unique<std::atomic<int>[]>(nodeCount);
+    for(int i = 0; i < nodeCount; ++i)
+        remaining[i] = nodes_[i].dependencyCount;
+
+    std::atomic<int> doneCount = 0;
+    TaskGroup group(priority);
+
+    std::function<void(NodeID)> start = [&](NodeID id)
+    {
+        group.run([&, id]
+        {
+            nodes_[id].task();
+            ++doneCount;
+
+            for(NodeID next : nodes_[id].successors)
+            {
+                if(--remaining[next] == 0)
+                    start(next);
+            }
+        });
+    };
+
+    for(int i = 0; i < nodeCount; ++i)
+    {
+        if(!nodes_[i].dependencyCount)
+            start(i);
+    }
+    group.wait();
+
+    if(doneCount != nodeCount)
+        throw std::runtime_error("cyclic dependencies in task graph");
+}
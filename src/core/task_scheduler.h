@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class TaskPriority
+{
+    Interactive = 0, // work a frame waits for
+    Normal      = 1,
+    Background  = 2  // asset loads
+};
+
+constexpr int TASK_PRIORITY_COUNT = 3;
+
+const char *getTaskPriorityName(TaskPriority priority);
+
+// persistent pool of worker threads with work stealing. each worker owns a
+// deque per priority, pushing and popping its own tasks at the back (the most
+// recently split work, still in cache) while idle workers steal from the
+// front. tasks submitted by other threads go to a shared injection queue.
+//
+// workers take the most urgent queued task over all queues, so background
+// work delays interactive work by at most the tasks workers are busy with.
+//
+// a worker waiting for a TaskGroup runs queued tasks in the meantime, which
+// makes nested parallel loops safe. other threads block instead, so that at
+// most getWorkerCount() tasks run at a time
+class TaskScheduler
+{
+public:
+
+    using Task = std::function<void()>;
+
+    // 0 means one worker per hardware thread
+    explicit TaskScheduler(int workerCount = 0);
+
+    TaskScheduler(const TaskScheduler &) = delete;
+
+    TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+    // runs the queued tasks first
+    ~TaskScheduler();
+
+    // shared by the loaders, preprocessing and cpu rendering. created with
+    // one worker per hardware thread on first use
+    static TaskScheduler &getGlobal();
+
+    // replaces the global scheduler. must not be called while it has tasks
+    static void setGlobalWorkerCount(int count);
+
+    // of the task running on the calling thread, Normal outside of tasks
+    static TaskPriority getCurrentPriority();
+
+    int getWorkerCount() const;
+
+    // of the calling thread in this scheduler, -1 if it is not a worker
+    int getWorkerIndex() const;
+
+    void submit(Task task, TaskPriority priority);
+
+    // runs a queued task at least as urgent as priority on the calling
+    // worker. returns false if there is none
+    bool runOne(TaskPriority priority);
+
+private:
+
+    struct Queue
+    {
+        std::mutex       mutex;
+        std::deque<Task> tasks[TASK_PRIORITY_COUNT];
+    };
+
+    bool pop(int worker, TaskPriority priority, Task &task, TaskPriority &taskPriority);
+
+    void run(Task &task, TaskPriority priority);
+
+    void workerLoop(int index);
+
+    int workerCount_;
+
+    // one per worker, followed by the injection queue
+    std::unique_ptr<Queue[]> queues_;
+
+    // queued tasks over all queues. changed under the lock of their queue
+    std::atomic<int> pending_ = 0;
+
+    std::mutex              sleepMutex_;
+    std::condition_variable wake_;
+    bool                    stop_ = false;
+
+    std::vector<std::thread> workers_;
+};
+
+// tasks waited for together. the first exception thrown by a task is
+// rethrown by wait, and tasks of the group not started yet are skipped
+class TaskGroup
+{
+public:
+
+    // the priority is inherited from the calling task by default
+    explicit TaskGroup(
+        TaskPriority priority = TaskScheduler::getCurrentPriority(),
+        TaskScheduler &scheduler = TaskScheduler::getGlobal());
+
+    TaskGroup(const TaskGroup &) = delete;
+
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    // waits, dropping exceptions
+    ~TaskGroup();
+
+    TaskScheduler &getScheduler() const;
+
+    TaskPriority getPriority() const;
+
+    // may be called from the tasks of the group
+    void run(TaskScheduler::Task task);
+
+    void wait();
+
+private:
+
+    struct State
+    {
+        std::atomic<int>   remaining = 0;
+        std::atomic<bool>  failed    = false;
+        std::mutex         mutex;
+        std::exception_ptr exception;
+    };
+
+    TaskScheduler         &scheduler_;
+    TaskPriority           priority_;
+    std::shared_ptr<State> state_;
+};
+
+// tasks with dependencies, e.g. the stages of a scene load. run starts the
+// tasks without unfinished dependencies and blocks until all are done
+class TaskGraph
+{
+public:
+
+    using NodeID = int;
+
+    NodeID add(TaskScheduler::Task task);
+
+    // after starts once before is done
+    void addDependency(NodeID before, NodeID after);
+
+    // successors of a failed task are skipped, and the first exception is
+    // rethrown. throws if the dependencies have a cycle
+    void run(TaskPriority priority = TaskScheduler::getCurrentPriority());
+
+private:
+
+    struct Node
+    {
+        TaskScheduler::Task task;
+        std::vector<NodeID> successors;
+        int                 dependencyCount = 0;
+    };
+
+    std::vector<Node> nodes_;
+};
+
+// calls func(i) for each i in [beg, end) on the global scheduler, in chunks
+// of grain indices (0 picks a few chunks per worker), and returns when all
+// calls are done. may be nested
+template<typename Func>
+void parallelFor(int beg, int end, const Func &func, int grain = 0)
+{
+    if(beg >= end)
+        return;
+
+    TaskGroup group;
+
+    const int count = end - beg;
+    if(grain <= 0)
+        grain = (std::max)(1, count / (4 * group.getScheduler().getWorkerCount()));
+
+    for(int chunkBeg = beg; chunkBeg < end;)
+    {
+        const int chunkEnd = chunkBeg + (std::min)(grain, end - chunkBeg);
+        group.run([&func, chunkBeg, chunkEnd]
+        {
+            for(int i = chunkBeg; i < chunkEnd; ++i)
+                func(i);
+        });
+        chunkBeg = chunkEnd;
+    }
+
+    group.wait();
+}
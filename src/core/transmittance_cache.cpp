@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+#include "task_scheduler.h"
+#include "transmittance_cache.h"
+
+void TransmittanceCache::initialize(const EnvirMap &envir, const TransmittanceCacheParams &params)
+{
+    params_ = params;
+    built_  = false;
+    depths_.clear();
+
+    const auto &probs = envir.getProbs();
+    tableRes_ = Int2(probs.width(), probs.height());
+
+    const int patchCount = tableRes_.product();
+    const float *patchProbs = probs.raw_data();
+
+    std::vector<Float3> centers(patchCount);
+    for(int i = 0; i < patchCount; ++i)
+    {
+        float pdf;
+        centers[i] = sampleEnvirTablePatch(
+            Int2(i % tableRes_.x, i / tableRes_.x), tableRes_, Float2(0.5f), pdf);
+    }
+
+    std::vector<int> order(patchCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b)
+    {
+        return patchProbs[a] > patchProbs[b];
+    });
+
+    patchLobes_.assign(patchCount, -1);
+    lobes_.clear();
+    coverage_ = 0;
+
+    const float cosLobeAngle = std::cos(params.lobeAngle);
+    for(int index : order)
+    {
+        if(static_cast<int>(lobes_.size()) >= params.lobeCount || patchProbs[index] <= 0)
+            break;
+        if(patchLobes_[index] >= 0)
+            continue;
+
+        const int lobe = static_cast<int>(lobes_.size());
+        const Float3 &center = centers[index];
+        lobes_.push_back(center);
+
+        for(int i = 0; i < patchCount; ++i)
+        {
+            if(patchLobes_[i] < 0 && dot(centers[i], center) >= cosLobeAngle)
+            {
+                patchLobes_[i] = lobe;
+                coverage_ += patchProbs[i];
+            }
+        }
+        // the seed itself, even if its center is not within a tiny angle
+        if(patchLobes_[index] < 0)
+        {
+            patchLobes_[index] = lobe;
+            coverage_ += patchProbs[index];
+        }
+    }
+}
+
+void TransmittanceCache::build(const VolumeMedium &medium, const std::atomic<bool> *cancel)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    built_ = false;
+
+    lower_ = medium.getLower();
+    const Float3 extent = medium.getUpper() - lower_;
+    invExtent_ = Float3(1) / extent;
+
+    const float maxExtent = (std::max)({ extent.x, extent.y, extent.z });
+    const int resolution = (std::max)(2, params_.resolution);
+    res_ = Int3(
+        (std::max)(2, static_cast<int>(std::ceil(resolution * extent.x / maxExtent))),
+        (std::max)(2, static_cast<int>(std::ceil(resolution * extent.y / maxExtent))),
+        (std::max)(2, static_cast<int>(std::ceil(resolution * extent.z / maxExtent))));
+
+    // one step per voxel of the density, or per half node without a dense
+    // grid, e.g. when it is streamed
+    const Int3 densitySize = medium.getDensity() ? medium.getDensity()->getSize() : 2 * res_;
+    const float step = (std::min)({
+        extent.x / densitySize.x, extent.y / densitySize.y, extent.z / densitySize.z });
+
+    const int lobeCount = static_cast<int>(lobes_.size());
+    depths_.assign(lobeCount, std::vector<float>(size_t(res_.product())));
+
+    // slices of all lobes are spread over the workers together
+
+    parallelFor(0, lobeCount * res_.z, [&](int item)
+    {
+        if(cancel && *cancel)
+            return;
+
+        const int lobe = item / res_.z, z = item % res_.z;
+        const Float3 &dir = lobes_[lobe];
+        float *depths = depths_[lobe].data() + size_t(z) * res_.x * res_.y;
+
+        for(int y = 0; y < res_.y; ++y)
+        {
+            for(int x = 0; x < res_.x; ++x)
+            {
+                const Float3 node = lower_ + extent * Float3(
+                    (x + 0.5f) / res_.x, (y + 0.5f) / res_.y, (z + 0.5f) / res_.z);
+
+                const float tMax = medium.intersectRayBox(node, dir).y;
+                const int steps = (std::max)(1, static_cast<int>(std::ceil(tMax / step)));
+                const float dt = (std::max)(0.0f, tMax) / steps;
+
+                float depth = 0;
+                for(int i = 0; i < steps; ++i)
+                    depth += medium.sampleDensity(medium.toTexCoord(node + ((i + 0.5f) * dt) * dir));
+                depths[y * res_.x + x] = depth * dt;
+            }
+        }
+    });
+
+    built_ = !(cancel && *cancel);
+    buildMs_ = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+bool TransmittanceCache::isBuilt() const
+{
+    return built_;
+}
+
+bool TransmittanceCache::lookup(const Float3 &pos, const Float3 &refToLight, float &trans) const
+{
+    if(!built_)
+        return false;
+
+    const Int2 patch = getEnvirTablePatch(refToLight.normalize(), tableRes_);
+    const int lobe = patchLobes_[patch.y * tableRes_.x + patch.x];
+    if(lobe < 0)
+        return false;
+
+    // the optical depth is interpolated rather than the transmittance, as
+    // it grows about linearly into dense regions
+    float depth;
+    sampleTrilinear<1>(depths_[lobe].data(), res_, 1, (pos - lower_) * invExtent_, &depth);
+    trans = std::exp(-depth);
+    return true;
+}
+
+int TransmittanceCache::getLobeCount() const
+{
+    return static_cast<int>(lobes_.size());
+}
+
+float TransmittanceCache::getCoverage() const
+{
+    return coverage_;
+}
+
+const Int3 &TransmittanceCache::getResolution() const
+{
+    return res_;
+}
+
+size_t TransmittanceCache::getByteSize() const
+{
+    return sizeof(float) * size_t(res_.product()) * depths_.size();
+}
+
+double TransmittanceCache::getBuildMs() const
+{
+    return buildMs_;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "envir_map.h"
+#include "medium.h"
+
+// transmittance toward the dominant directions of the envir light, cached
+// while only the camera moves. lobes are grown from the patches of the
+// importance table in order of probability: each claims the patches whose
+// centers are within lobeAngle of its first one, and gets a shadow volume,
+// the optical depth from the nodes of a grid over the volume bounds to the
+// box exit toward that center. light samples drawn in a claimed patch
+// interpolate it trilinearly instead of tracking a shadow ray. this is
+// biased by the angle to the lobe center, the grid resolution and the
+// quadrature of the optical depth; other light samples keep the unbiased
+// estimator
+struct TransmittanceCacheParams
+{
+    bool enabled = false;
+
+    int lobeCount = 16;
+
+    // radians
+    float lobeAngle = 0.05f;
+
+    // nodes of each shadow volume along the longest axis of the bounds
+    int resolution = 48;
+};
+
+class TransmittanceCache
+{
+public:
+
+    // picks the lobes from the importance table of envir. cheap, and the
+    // envir is not referenced afterwards
+    void initialize(const EnvirMap &envir, const TransmittanceCacheParams &params);
+
+    // marches the optical depth from each node toward each lobe with steps
+    // of a density voxel, in parallel loops that inherit the priority of the
+    // caller. returns early, unbuilt, once cancel is set
+    void build(const VolumeMedium &medium, const std::atomic<bool> *cancel = nullptr);
+
+    bool isBuilt() const;
+
+    // false if refToLight is in no cached patch
+    bool lookup(const Float3 &pos, const Float3 &refToLight, float &trans) const;
+
+    int getLobeCount() const;
+
+    // probability of the importance table drawing a cached patch
+    float getCoverage() const;
+
+    const Int3 &getResolution() const;
+
+    size_t getByteSize() const;
+
+    double getBuildMs() const;
+
+private:
+
+    TransmittanceCacheParams params_;
+
+    Int2                tableRes_;
+    std::vector<int>    patchLobes_; // lobe of each table patch, -1 if not cached
+    std::vector<Float3> lobes_;
+    float               coverage_ = 0;
+
+    // cell-centered nodes over the bounds, like the voxels of a density grid
+    Int3                            res_ = Int3(0);
+    Float3                          lower_;
+    Float3                          invExtent_;
+    std::vector<std::vector<float>> depths_;
+
+    bool   built_   = false;
+    double buildMs_ = 0;
+};
@@ -0,0 +1,155 @@
+#include <tuple>
+
+#include "denoise.h"
+
+namespace
+{
+    std::pair<ComPtr<ID3D11ShaderResourceView>,
+              ComPtr<ID3D11UnorderedAccessView>>
+        createTexture(const Int2 &size, DXGI_FORMAT format)
+    {
+        D3D11_TEXTURE2D_DESC texDesc;
+        texDesc.Width          = static_cast<UINT>(size.x);
+        texDesc.Height         = static_cast<UINT>(size.y);
+        texDesc.MipLevels      = 1;
+        texDesc.ArraySize      = 1;
+        texDesc.Format         = format;
+        texDesc.SampleDesc     = { 1, 0 };
+        texDesc.Usage          = D3D11_USAGE_DEFAULT;
+        texDesc.BindFlags      = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+        texDesc.CPUAccessFlags = 0;
+        texDesc.MiscFlags      = 0;
+
+        auto tex = device.createTex2D(texDesc, nullptr);
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+        srvDesc.Format                    = format;
+        srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels       = 1;
+        srvDesc.Texture2D.MostDetailedMip = 0;
+
+        auto srv = device.createSRV(tex, srvDesc);
+
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+        uavDesc.Format             = format;
+        uavDesc.ViewDimension      = D3D11_UAV_DIMENSION_TEXTURE2D;
+        uavDesc.Texture2D.MipSlice = 0;
+
+        auto uav = device.createUAV(tex, uavDesc);
+
+        return { srv, uav };
+    }
+}
+
+void GPUDenoiser::initialize(const Int2 &size)
+{
+    resolveShader_.initializeStageFromFile<CS>("./asset/denoise.hlsl", nullptr, "CSResolve");
+    resolveRscs_ = resolveShader_.createResourceManager();
+
+    outputSlot_   = resolveRscs_.getShaderResourceViewSlot<CS>("Output");
+    featuresSlot_ = resolveRscs_.getShaderResourceViewSlot<CS>("Features");
+    momentsSlot_  = resolveRscs_.getShaderResourceViewSlot<CS>("Moments");
+
+    resolvedColorSlot_         = resolveRscs_.getUnorderedAccessViewSlot<CS>("ResolvedColor");
+    resolvedGuideSlot_         = resolveRscs_.getUnorderedAccessViewSlot<CS>("ResolvedGuide");
+    resolvedTransmittanceSlot_ = resolveRscs_.getUnorderedAccessViewSlot<CS>("ResolvedTransmittance");
+
+    filterShader_.initializeStageFromFile<CS>("./asset/denoise.hlsl", nullptr, "CSFilter");
+    filterRscs_ = filterShader_.createResourceManager();
+
+    colorSlot_         = filterRscs_.getShaderResourceViewSlot<CS>("Color");
+    guideSlot_         = filterRscs_.getShaderResourceViewSlot<CS>("Guide");
+    transmittanceSlot_ = filterRscs_.getShaderResourceViewSlot<CS>("Transmittance");
+    filteredColorSlot_ = filterRscs_.getUnorderedAccessViewSlot<CS>("FilteredColor");
+
+    resize(size);
+    setParams({});
+
+    csParams_.initialize();
+    resolveRscs_.getConstantBufferSlot<CS>("CSParams")
+        ->setBuffer(csParams_);
+    filterRscs_.getConstantBufferSlot<CS>("CSParams")
+        ->setBuffer(csParams_);
+}
+
+void GPUDenoiser::resize(const Int2 &size)
+{
+    std::tie(colorSRV1_, colorUAV1_) = createTexture(size, DXGI_FORMAT_R32G32B32A32_FLOAT);
+    std::tie(colorSRV2_, colorUAV2_) = createTexture(size, DXGI_FORMAT_R32G32B32A32_FLOAT);
+
+    std::tie(guideSRV_, guideUAV_) = createTexture(size, DXGI_FORMAT_R32G32B32A32_FLOAT);
+    std::tie(transmittanceSRV_, transmittanceUAV_) = createTexture(size, DXGI_FORMAT_R32_FLOAT);
+
+    csParamsData_.outputWidth  = size.x;
+    csParamsData_.outputHeight = size.y;
+}
+
+void GPUDenoiser::setParams(const DenoiserParams &params)
+{
+    iterations_ = params.iterations;
+
+    csParamsData_.sigmaLuminance     = params.sigmaLuminance;
+    csParamsData_.sigmaDepth         = params.sigmaDepth;
+    csParamsData_.sigmaAlbedo        = params.sigmaAlbedo;
+    csParamsData_.sigmaTransmittance = params.sigmaTransmittance;
+}
+
+ComPtr<ID3D11ShaderResourceView> GPUDenoiser::denoise(
+    ComPtr<ID3D11ShaderResourceView> output,
+    ComPtr<ID3D11ShaderResourceView> features,
+    ComPtr<ID3D11ShaderResourceView> moments)
+{
+    if(iterations_ <= 0)
+        return output;
+
+    outputSlot_->setShaderResourceView(std::move(output));
+    featuresSlot_->setShaderResourceView(std::move(features));
+    momentsSlot_->setShaderResourceView(std::move(moments));
+
+    resolvedColorSlot_->setUnorderedAccessView(colorUAV1_);
+    resolvedGuideSlot_->setUnorderedAccessView(guideUAV_);
+    resolvedTransmittanceSlot_->setUnorderedAccessView(transmittanceUAV_);
+
+    csParams_.update(csParamsData_);
+
+    resolveShader_.bind();
+    resolveRscs_.bind();
+    dispatch();
+    resolveRscs_.unbind();
+    resolveShader_.unbind();
+
+    guideSlot_->setShaderResourceView(guideSRV_);
+    transmittanceSlot_->setShaderResourceView(transmittanceSRV_);
+
+    for(int i = 0; i < iterations_; ++i)
+    {
+        colorSlot_->setShaderResourceView(colorSRV1_);
+        filteredColorSlot_->setUnorderedAccessView(colorUAV2_);
+
+        std::swap(colorSRV1_, colorSRV2_);
+        std::swap(colorUAV1_, colorUAV2_);
+
+        csParamsData_.stepSize   = 1 << i;
+        csParamsData_.isLastPass = i == iterations_ - 1;
+        csParams_.update(csParamsData_);
+
+        filterShader_.bind();
+        filterRscs_.bind();
+        dispatch();
+        filterRscs_.unbind();
+        filterShader_.unbind();
+    }
+
+    return colorSRV1_;
+}
+
+void GPUDenoiser::dispatch()
+{
+    const int GROUP_SIZE_X = 16, GROUP_SIZE_Y = 16;
+    const int groupCountX =
+        (csParamsData_.outputWidth + GROUP_SIZE_X - 1) / GROUP_SIZE_X;
+    const int groupCountY =
+        (csParamsData_.outputHeight + GROUP_SIZE_Y - 1) / GROUP_SIZE_Y;
+
+    deviceContext.dispatch(groupCountX, groupCountY, 1);
+}
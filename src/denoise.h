@@ -0,0 +1,74 @@
+#pragma once
+
+#include "core/denoiser.h"
+#include "common.h"
+
+// asset/denoise.hlsl on the output of RawVolumeRenderer, guided by its
+// features and moments. see Denoiser for the cpu counterpart
+class GPUDenoiser
+{
+public:
+
+    void initialize(const Int2 &size);
+
+    void resize(const Int2 &size);
+
+    void setParams(const DenoiserParams &params);
+
+    // denoised radiance with a sample count of 1, displayable like the
+    // output. the output itself if there are no iterations
+    ComPtr<ID3D11ShaderResourceView> denoise(
+        ComPtr<ID3D11ShaderResourceView> output,
+        ComPtr<ID3D11ShaderResourceView> features,
+        ComPtr<ID3D11ShaderResourceView> moments);
+
+private:
+
+    struct CSParams
+    {
+        int   outputWidth;
+        int   outputHeight;
+        int   stepSize;
+        int   isLastPass;
+        float sigmaLuminance;
+        float sigmaDepth;
+        float sigmaAlbedo;
+        float sigmaTransmittance;
+    };
+
+    void dispatch();
+
+    int iterations_ = 5;
+
+    Shader<CS>         resolveShader_;
+    Shader<CS>::RscMgr resolveRscs_;
+
+    ShaderResourceViewSlot<CS> *outputSlot_   = nullptr;
+    ShaderResourceViewSlot<CS> *featuresSlot_ = nullptr;
+    ShaderResourceViewSlot<CS> *momentsSlot_  = nullptr;
+
+    UnorderedAccessViewSlot<CS> *resolvedColorSlot_         = nullptr;
+    UnorderedAccessViewSlot<CS> *resolvedGuideSlot_         = nullptr;
+    UnorderedAccessViewSlot<CS> *resolvedTransmittanceSlot_ = nullptr;
+
+    Shader<CS>         filterShader_;
+    Shader<CS>::RscMgr filterRscs_;
+
+    ShaderResourceViewSlot<CS>  *colorSlot_         = nullptr;
+    ShaderResourceViewSlot<CS>  *guideSlot_         = nullptr;
+    ShaderResourceViewSlot<CS>  *transmittanceSlot_ = nullptr;
+    UnorderedAccessViewSlot<CS> *filteredColorSlot_ = nullptr;
+
+    // (radiance, variance) ping-pong
+    ComPtr<ID3D11ShaderResourceView>  colorSRV1_, colorSRV2_;
+    ComPtr<ID3D11UnorderedAccessView> colorUAV1_, colorUAV2_;
+
+    ComPtr<ID3D11ShaderResourceView>  guideSRV_;
+    ComPtr<ID3D11UnorderedAccessView> guideUAV_;
+
+    ComPtr<ID3D11ShaderResourceView>  transmittanceSRV_;
+    ComPtr<ID3D11UnorderedAccessView> transmittanceUAV_;
+
+    CSParams                 csParamsData_ = {};
+    ConstantBuffer<CSParams> csParams_;
+};
@@ -26,6 +26,11 @@ void Displayer::setExposure(float exposure)
     psParamsData_.exposure = exposure;
 }
 
+void Displayer::setFillRadius(int radius)
+{
+    psParamsData_.fillRadius = radius;
+}
+
 void Displayer::render(ComPtr<ID3D11ShaderResourceView> tex)
 {
     texSlot_->setShaderResourceView(std::move(tex));
@@ -10,6 +10,10 @@ public:
 
     void setExposure(float exposure);
 
+    // pixels without samples take the mean of those with samples up to
+    // radius pixels away, for the holes of interleaved frames
+    void setFillRadius(int radius);
+
     void render(ComPtr<ID3D11ShaderResourceView> tex);
 
 private:
@@ -17,7 +21,7 @@ private:
     struct PSParams
     {
         float exposure;
-        float pad0;
+        int   fillRadius;
         float pad1;
         float pad2;
     };
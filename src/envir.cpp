@@ -1,99 +1,130 @@
-#include <agz-utils/image.h>
-#include <agz-utils/thread.h>
-
+#include "core/envir_cache.h"
+#include "core/task_scheduler.h"
 #include "envir.h"
 
-void EnvirLight::initialize(const std::string &filename, const Int2 &sampleRes)
+namespace
 {
-    const auto data =
-        agz::texture::texture2d_t(agz::img::load_rgb_from_hdr_file(filename));
+    // only uses the device, so that environment lights can be created on
+    // loader threads
+    ComPtr<ID3D11ShaderResourceView> createMipTex2DSRV(
+        const std::vector<Int2> &sizes, DXGI_FORMAT format,
+        const std::vector<const void *> &levels, size_t texelSize)
+    {
+        const UINT levelCount = static_cast<UINT>(levels.size());
+
+        D3D11_TEXTURE2D_DESC texDesc;
+        texDesc.Width              = sizes[0].x;
+        texDesc.Height             = sizes[0].y;
+        texDesc.MipLevels          = levelCount;
+        texDesc.ArraySize          = 1;
+        texDesc.Format             = format;
+        texDesc.SampleDesc.Count   = 1;
+        texDesc.SampleDesc.Quality = 0;
+        texDesc.Usage              = D3D11_USAGE_IMMUTABLE;
+        texDesc.BindFlags          = D3D11_BIND_SHADER_RESOURCE;
+        texDesc.CPUAccessFlags     = 0;
+        texDesc.MiscFlags          = 0;
+
+        std::vector<D3D11_SUBRESOURCE_DATA> texData(levelCount);
+        for(UINT i = 0; i < levelCount; ++i)
+        {
+            texData[i].pSysMem          = levels[i];
+            texData[i].SysMemPitch      = static_cast<UINT>(sizes[i].x * texelSize);
+            texData[i].SysMemSlicePitch = 0;
+        }
 
-    const int width = data.width(), height = data.height();
-    const int newWidth  = (std::min)(width, sampleRes.x);
-    const int newHeight = (std::min)(height, sampleRes.y);
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+        srvDesc.Format                    = texDesc.Format;
+        srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels       = levelCount;
+        srvDesc.Texture2D.MostDetailedMip = 0;
 
-    std::atomic<float> lum_sum = 0;
-    agz::texture::texture2d_t<float> probs(newHeight, newWidth);
-    
-    agz::thread::parallel_forrange(0, newHeight, [&](int, int y)
+        auto tex = device.createTex2D(texDesc, texData.data());
+        return device.createSRV(tex, srvDesc);
+    }
+
+    ComPtr<ID3D11ShaderResourceView> createTex2DSRV(
+        const Int2 &size, DXGI_FORMAT format, const void *data, size_t texelSize)
     {
-        const float y0 = float(y)     / float(newHeight);
-        const float y1 = float(y + 1) / float(newHeight);
+        return createMipTex2DSRV({ size }, format, { data }, texelSize);
+    }
+}
 
-        const float y0_src = y0 * height;
-        const float y1_src = y1 * height;
+void EnvirLight::setSampling(EnvirSampling sampling, int warpSize)
+{
+    sampling_ = sampling;
+    warpSize_ = warpSize;
+}
 
-        const int y_src_beg = (std::max)(0, int(std::floor(y0_src) - 1));
-        const int y_src_lst = (std::min)(height - 1, int(std::floor(y1_src) + 1));
+void EnvirLight::setCacheDirectory(const std::string &directory)
+{
+    cacheDirectory_ = directory;
+}
 
-        for(int x = 0; x < newWidth; ++x)
-        {
-            const float x0 = float(x)     / newWidth;
-            const float x1 = float(x + 1) / newWidth;
-
-            const float x0_src = x0 * width;
-            const float x1_src = x1 * width;
-
-            const int x_src_beg = (std::max)(0, int(std::floor(x0_src) - 1));
-            const int x_src_lst = (std::min)(width - 1, int(std::floor(x1_src) + 1));
-
-            float pixel_lum = 0;
-            for(int y_src = y_src_beg; y_src <= y_src_lst; ++y_src)
-            {
-                for(int x_src = x_src_beg; x_src <= x_src_lst; ++x_src)
-                {
-                    const float src_u = (float(x_src) + 0.5f) / float(width);
-                    const float src_v = (float(y_src) + 0.5f) / float(height);
-
-                    const auto texel = agz::texture::linear_sample2d(
-                        Float2(src_u, src_v),
-                        [&](int xi, int yi) { return data(yi, xi); },
-                        width, height);
-
-                    pixel_lum += texel.lum();
-                }
-            }
-
-            const float delta_area = std::abs(
-                2 * PI * (x1 - x0) * (std::cos(PI * y1)
-              - std::cos(PI * y0)));
-              
-            const float area_lum = pixel_lum * delta_area;
-            probs(y, x) = area_lum;
-            agz::math::atomic_add(lum_sum, area_lum);
-        }
-    });
+void EnvirLight::initialize(const std::string &filename, const Int2 &sampleRes)
+{
+    // a cache hit uploads the mapped texels and tables as they are
+
+    if(!cacheDirectory_.empty())
+    {
+        const EnvirCacheFile file = EnvirCache(cacheDirectory_).load(filename, sampleRes, warpSize_);
+        initializeTables(
+            createTex2DSRV(
+                file.getSize(), DXGI_FORMAT_R32G32B32A32_FLOAT,
+                file.getTexels(), 4 * sizeof(float)),
+            file.getTableSize(), file.getProbs(), file.getAliasTable());
+
+        std::vector<const float *> levels;
+        for(int i = 0; i < file.getWarpLevelCount(); ++i)
+            levels.push_back(file.getWarpLevel(i));
+        uploadMipWarp(file.getWarpSize(), levels);
+        return;
+    }
+
+    EnvirMap map;
+    map.load(filename, sampleRes);
 
-    if(lum_sum > 0.001f)
+    const auto &data = map.getTexels();
+    const int width = data.width(), height = data.height();
+
+    std::vector<Float4> texels(size_t(width) * height);
+    parallelFor(0, height, [&](int y)
     {
-        const float ratio = 1 / lum_sum;
-        for(int y = 0; y < newHeight; ++y)
+        for(int x = 0; x < width; ++x)
         {
-            for(int x = 0; x < newWidth; ++x)
-                probs(y, x) *= ratio;
+            const auto &c = data(y, x);
+            texels[size_t(y) * width + x] = Float4(c.r, c.g, c.b, 1);
         }
-    }
+    });
 
-    using AliasTable = agz::math::distribution::alias_sampler_t<float>;
+    auto envirSRV = createTex2DSRV(
+        { width, height }, DXGI_FORMAT_R32G32B32A32_FLOAT, texels.data(), sizeof(Float4));
 
-    AliasTable aliasTable;
-    aliasTable.initialize(probs.raw_data(), probs.size().product());
-    auto &aliasTableData = aliasTable.get_table();
+    const auto &probs = map.getProbs();
+    initializeTables(
+        std::move(envirSRV), { probs.width(), probs.height() },
+        probs.raw_data(), map.getAliasTable().getTable().data());
+    initializeMipWarp(&texels[0].x, { width, height });
+}
 
-    auto envirSRV = Texture2DLoader::loadFromMemory(
-        DXGI_FORMAT_R32G32B32A32_FLOAT, width, height, 1, 3, &data.raw_data()->r);
+void EnvirLight::initializeTables(
+    ComPtr<ID3D11ShaderResourceView> envirSRV, const Int2 &tableSize,
+    const float *probs, const AliasTableUnit *aliasTableData)
+{
+    const int newWidth = tableSize.x, newHeight = tableSize.y;
+    const UINT aliasTableSize = static_cast<UINT>(tableSize.product());
 
     D3D11_BUFFER_DESC aliasTableBufDesc;
     aliasTableBufDesc.ByteWidth = static_cast<UINT>(
-        sizeof(AliasTable::table_unit) * aliasTableData.size());
+        sizeof(AliasTableUnit) * aliasTableSize);
     aliasTableBufDesc.Usage               = D3D11_USAGE_IMMUTABLE;
     aliasTableBufDesc.BindFlags           = D3D11_BIND_SHADER_RESOURCE;
     aliasTableBufDesc.CPUAccessFlags      = 0;
     aliasTableBufDesc.MiscFlags           = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
-    aliasTableBufDesc.StructureByteStride = sizeof(AliasTable::table_unit);
+    aliasTableBufDesc.StructureByteStride = sizeof(AliasTableUnit);
 
     D3D11_SUBRESOURCE_DATA aliasTableBufSubrscData;
-    aliasTableBufSubrscData.pSysMem          = aliasTableData.data();
+    aliasTableBufSubrscData.pSysMem          = aliasTableData;
     aliasTableBufSubrscData.SysMemPitch      = 0;
     aliasTableBufSubrscData.SysMemSlicePitch = 0;
 
@@ -104,12 +135,12 @@ void EnvirLight::initialize(const std::string &filename, const Int2 &sampleRes)
     aliasTableSRVDesc.Format              = DXGI_FORMAT_UNKNOWN;
     aliasTableSRVDesc.ViewDimension       = D3D11_SRV_DIMENSION_BUFFER;
     aliasTableSRVDesc.Buffer.FirstElement = 0;
-    aliasTableSRVDesc.Buffer.NumElements  = static_cast<UINT>(aliasTableData.size());
+    aliasTableSRVDesc.Buffer.NumElements  = aliasTableSize;
 
     auto aliasTableSRV = device.createSRV(aliasTableBuf, aliasTableSRVDesc);
 
-    auto probSRV = Texture2DLoader::loadFromMemory(
-        DXGI_FORMAT_R32_FLOAT, newWidth, newHeight, 1, 1, probs.raw_data());
+    auto probSRV = createTex2DSRV(
+        tableSize, DXGI_FORMAT_R32_FLOAT, probs, sizeof(float));
 
     auto sampler = device.createSampler(
         D3D11_FILTER_MIN_MAG_MIP_LINEAR,
@@ -126,7 +157,49 @@ void EnvirLight::initialize(const std::string &filename, const Int2 &sampleRes)
 
     envirLightData_.tableWidth  = newWidth;
     envirLightData_.tableHeight = newHeight;
-    envirLightData_.tableSize   = static_cast<int>(aliasTableData.size());
+    envirLightData_.tableSize   = static_cast<int>(aliasTableSize);
+}
+
+void EnvirLight::initializeMipWarp(const float *rgba, const Int2 &size)
+{
+    if(sampling_ != EnvirSampling::MipWarp)
+    {
+        uploadMipWarp(0, {});
+        return;
+    }
+
+    EnvirMipWarp warp;
+    warp.build(rgba, size, warpSize_);
+
+    std::vector<const float *> levels;
+    for(int i = 0; i < warp.getLevelCount(); ++i)
+        levels.push_back(warp.getLevel(i).data());
+    uploadMipWarp(warp.getSize(), levels);
+}
+
+void EnvirLight::uploadMipWarp(int size, const std::vector<const float *> &levels)
+{
+    envirLightData_.samplingMode = static_cast<int>(sampling_);
+    if(sampling_ != EnvirSampling::MipWarp || levels.empty())
+    {
+        warp_.Reset();
+        return;
+    }
+
+    std::vector<Int2>         levelSizes;
+    std::vector<const void *> levelData;
+    for(size_t i = 0; i < levels.size(); ++i)
+    {
+        levelSizes.push_back(Int2(size >> i));
+        levelData.push_back(levels[i]);
+    }
+
+    warp_ = createMipTex2DSRV(levelSizes, DXGI_FORMAT_R32_FLOAT, levelData, sizeof(float));
+
+    // the top level is the single total
+    envirLightData_.warpSize   = size;
+    envirLightData_.warpLevels = static_cast<int>(levels.size());
+    envirLightData_.warpTotal  = levels.back()[0];
 }
 
 void EnvirLight::updateConstantBuffer(float intensity)
@@ -143,6 +216,8 @@ void EnvirLight::bind(Shader<CS>::RscMgr &shaderRscs)
         ->setShaderResourceView(aliasTable_);
     shaderRscs.getShaderResourceViewSlot<CS>("EnvirAliasProbs")
         ->setShaderResourceView(aliasProbs_);
+    shaderRscs.getShaderResourceViewSlot<CS>("EnvirWarp")
+        ->setShaderResourceView(warp_);
     shaderRscs.getSamplerSlot<CS>("EnvirSampler")
         ->setSampler(sampler_);
 
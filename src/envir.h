@@ -1,11 +1,18 @@
 #pragma once
 
+#include "core/envir_map.h"
 #include "common.h"
 
 class EnvirLight
 {
 public:
 
+    // .venv cache directory used by initialize. none by default
+    void setCacheDirectory(const std::string &directory);
+
+    // used by the next initialize, see EnvirMap::setSampling
+    void setSampling(EnvirSampling sampling, int warpSize = 1024);
+
     void initialize(const std::string &filename, const Int2 &sampleRes);
     
     void updateConstantBuffer(float intensity);
@@ -14,19 +21,39 @@ public:
 
 private:
 
+    void initializeTables(
+        ComPtr<ID3D11ShaderResourceView> envirSRV, const Int2 &tableSize,
+        const float *probs, const AliasTableUnit *aliasTableData);
+
+    // sum pyramid of the mip-warp mode, built from width * height rgba texels
+    void initializeMipWarp(const float *rgba, const Int2 &size);
+
+    // levels of a built sum pyramid from 0 up, e.g. of a cache file
+    void uploadMipWarp(int size, const std::vector<const float *> &levels);
+
     struct EnvirLightParams
     {
         float intensity;
         int   tableWidth;
         int   tableHeight;
         int   tableSize;
+        int   samplingMode;
+        int   warpSize;
+        int   warpLevels;
+        float warpTotal;
     };
 
     ComPtr<ID3D11ShaderResourceView> envir_;
     ComPtr<ID3D11ShaderResourceView> aliasTable_;
     ComPtr<ID3D11ShaderResourceView> aliasProbs_;
+    ComPtr<ID3D11ShaderResourceView> warp_;
     ComPtr<ID3D11SamplerState>       sampler_;
 
     EnvirLightParams                 envirLightData_ = {};
     ConstantBuffer<EnvirLightParams> envirLight_;
+
+    std::string cacheDirectory_;
+
+    EnvirSampling sampling_ = EnvirSampling::AliasTable;
+    int           warpSize_ = 1024;
 };
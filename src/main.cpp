@@ -1,5 +1,9 @@
+#include <chrono>
+
 #include <agz-utils/string.h>
 
+#include "async_asset.h"
+#include "denoise.h"
 #include "display.h"
 #include "envir.h"
 #include "raw.h"
@@ -17,9 +21,17 @@ private:
 
     Displayer         disp_;
     RawVolumeRenderer raw_;
+    GPUDenoiser       denoiser_;
+
+    // the instances being rendered, replaced by the async loaders at the
+    // start of a frame once a new one is complete
+    std::unique_ptr<EnvirLight> envir_;
+    std::unique_ptr<Volume>     volume_;
 
-    EnvirLight envir_;
-    Volume     volume_;
+    AsyncAsset<EnvirLight> envirLoader_;
+    AsyncAsset<Volume>     volumeLoader_;
+
+    std::string loadError_;
 
     bool discardHistory_ = false;
 
@@ -34,22 +46,45 @@ private:
 
     int maxDepth_ = 5;
 
+    int transmittanceEstimator_ = 0;
+    int densityEncoding_ = 0;
+    int densityLod_      = 0;
+    int envirSampling_   = 0;
+    int directLight_     = 0;
+
+    bool brickedDensity_ = false;
+
+    bool reprojection_ = false;
+
+    // frame-to-frame time of rendered frames drives the interleave stride
+    bool                 dynamicResolution_ = false;
+    float                frameBudgetMs_     = 33;
+    ResolutionController resolution_;
+    bool                 frameRendered_ = false;
+    std::chrono::steady_clock::time_point lastFrameStart_;
+
+    bool           denoise_ = false;
+    DenoiserParams denoiserParams_;
+
+    std::string envirFilename_;
+
     ImGui::FileBrowser fileBrowser_;
 
     void initialize() override
     {
         disp_.initialize();
         raw_.initilalize(window_->getClientSize());
+        denoiser_.initialize(window_->getClientSize());
 
-        envir_.initialize("./asset/sky.hdr", { 200, 200 });
-
-        volume_.initialize();
-        volume_.loadAlbedo("./asset/albedo.txt");
-        volume_.loadDensity("./asset/density.txt");
+        // the environment light, albedo and density load in parallel while
+        // the first frames are displayed
+        loadEnvir("./asset/sky.hdr");
+        loadVolume();
 
         window_->attach([&](const WindowPostResizeEvent &e)
         {
             raw_.resize({ e.width, e.height });
+            denoiser_.resize({ e.width, e.height });
         });
 
         const Float3 extent = Float3(1.98f, 1.98f, 0.78f);
@@ -69,8 +104,76 @@ private:
         window_->doEvents();
     }
 
+    void loadEnvir(const std::string &filename)
+    {
+        envirFilename_ = filename;
+
+        const auto sampling = static_cast<EnvirSampling>(envirSampling_);
+        envirLoader_.load([filename, sampling](EnvirLight &envir)
+        {
+            envir.setCacheDirectory("./cache/envir");
+            envir.setSampling(sampling);
+            envir.initialize(filename, { 200, 200 });
+        });
+    }
+
+    void loadVolume()
+    {
+        const auto encoding = static_cast<DensityEncoding>(densityEncoding_);
+        const bool bricked  = brickedDensity_;
+        volumeLoader_.load([encoding, bricked](Volume &volume)
+        {
+            Grid albedo;
+            TaskGroup group;
+            group.run([&]
+            {
+                albedo = Grid::load("./asset/albedo.txt", GridFormat::RGBA32F);
+            });
+
+            volume.initialize();
+            volume.setDensityEncoding(encoding);
+            volume.loadDensity("./asset/density.txt", bricked);
+
+            group.wait();
+            volume.loadAlbedo(albedo);
+        });
+    }
+
+    // frame boundary of the double-buffered assets
+    void publishAssets()
+    {
+        try
+        {
+            discardHistory_ |= envirLoader_.publish(envir_);
+        }
+        catch(const std::exception &e)
+        {
+            loadError_ = e.what();
+        }
+
+        try
+        {
+            discardHistory_ |= volumeLoader_.publish(volume_);
+        }
+        catch(const std::exception &e)
+        {
+            loadError_ = e.what();
+        }
+    }
+
     void frame() override
     {
+        const auto frameStart = std::chrono::steady_clock::now();
+        if(frameRendered_)
+        {
+            resolution_.endFrame(std::chrono::duration<double, std::milli>(
+                frameStart - lastFrameStart_).count());
+        }
+        lastFrameStart_ = frameStart;
+        frameRendered_  = false;
+
+        publishAssets();
+
         if(keyboard_->isDown(KEY_ESCAPE))
             window_->setCloseFlag(true);
 
@@ -86,9 +189,57 @@ private:
             discardHistory_ |= ImGui::InputFloat("Density Scale", &densityScale_);
             discardHistory_ |= ImGui::SliderFloat("g", &g_, -0.99f, 0.99f);
             discardHistory_ |= ImGui::InputInt("Max Depth", &maxDepth_);
+            discardHistory_ |= ImGui::Combo(
+                "Transmittance", &transmittanceEstimator_,
+                "Ratio (Cutoff)\0Ratio (Roulette)\0Residual Ratio\0");
+
+            if(ImGui::Combo(
+                "Density Encoding", &densityEncoding_,
+                "Float32\0Float16\0Unorm16\0Unorm8\0"))
+            {
+                loadVolume();
+            }
+            if(ImGui::Checkbox("Bricked Density", &brickedDensity_))
+                loadVolume();
+            discardHistory_ |= ImGui::Combo("Density LOD", &densityLod_, "Off\0Depth\0Footprint\0");
+            discardHistory_ |= ImGui::Combo(
+                "Direct Light", &directLight_, "Light Sampling\0MIS (Balance)\0MIS (Power)\0");
+            if(volume_)
+            {
+                ImGui::Text(
+                    "Volume Textures: %.2f MB (Mips %.2f MB)",
+                    volume_->getTextureByteSize() / (1024.0 * 1024.0),
+                    volume_->getMipByteSize() / (1024.0 * 1024.0));
+            }
+
+            if(envirLoader_.isLoading() || volumeLoader_.isLoading())
+                ImGui::Text("Loading...");
+            if(!loadError_.empty())
+                ImGui::TextWrapped("Load failed: %s", loadError_.c_str());
 
             ImGui::InputFloat("Exposure", &exposure_);
 
+            ImGui::Checkbox("Reprojection", &reprojection_);
+
+            ImGui::Checkbox("Dynamic Resolution", &dynamicResolution_);
+            if(dynamicResolution_)
+            {
+                ImGui::InputFloat("Frame Budget (ms)", &frameBudgetMs_);
+                ImGui::Text("Stride: %d, Whole Frame: %.1f ms",
+                            resolution_.getStride(), resolution_.getFullFrameMs());
+            }
+
+            ImGui::Checkbox("Denoise", &denoise_);
+            if(denoise_)
+            {
+                ImGui::SliderInt("Denoise Iterations", &denoiserParams_.iterations, 0, 8);
+                ImGui::InputFloat("Sigma Luminance", &denoiserParams_.sigmaLuminance);
+                ImGui::InputFloat("Sigma Depth", &denoiserParams_.sigmaDepth);
+            }
+
+            if(ImGui::Combo("Envir Sampling", &envirSampling_, "Alias Table\0Mip Warp\0"))
+                loadEnvir(envirFilename_);
+
             if(ImGui::Button("Envir Light"))
                 fileBrowser_.Open();
         }
@@ -99,19 +250,24 @@ private:
         {
             const auto filename = fileBrowser_.GetSelected().string();
             fileBrowser_.ClearSelected();
-            envir_.initialize(filename, { 200, 200 });
+            loadEnvir(filename);
         }
 
-        if(keyboard_->isPressed('W') ||
-           keyboard_->isPressed('A') ||
-           keyboard_->isPressed('D') ||
-           keyboard_->isPressed('S') ||
-           keyboard_->isPressed(KEY_SPACE) ||
-           keyboard_->isPressed(KEY_LSHIFT))
+        // vsync would hide the frame time from the resolution controller
+        if(!dynamicResolution_ &&
+           (keyboard_->isPressed('W') ||
+            keyboard_->isPressed('A') ||
+            keyboard_->isPressed('D') ||
+            keyboard_->isPressed('S') ||
+            keyboard_->isPressed(KEY_SPACE) ||
+            keyboard_->isPressed(KEY_LSHIFT)))
             window_->setVSync(true);
         else
             window_->setVSync(false);
         
+        const Float3 lastPosition  = camera_.getPosition();
+        const Float2 lastDirection = camera_.getDirection();
+
         camera_.setWOverH(window_->getClientWOverH());
         if(!mouse_->isVisible())
         {
@@ -128,32 +284,71 @@ private:
         }
         camera_.recalculateMatrics();
 
-        envir_.updateConstantBuffer(envirIntensity_);
-
-        volume_.setBoundingBox(lower_, upper_);
-        volume_.setDensityScale(densityScale_);
-        volume_.setG(g_);
-        volume_.updateConstantBuffer();
-
-        if(discardHistory_)
+        // the last output stays on screen until both assets are loaded
+        if(envir_ && volume_)
         {
-            raw_.discardHistory();
-            discardHistory_ = false;
+            envir_->updateConstantBuffer(envirIntensity_);
+
+            DensityLodParams lod;
+            lod.mode = static_cast<DensityLodMode>(densityLod_);
+
+            volume_->setBoundingBox(lower_, upper_);
+            volume_->setDensityScale(densityScale_);
+            volume_->setG(g_);
+            volume_->setTransmittanceEstimator(
+                static_cast<TransmittanceEstimator>(transmittanceEstimator_));
+            volume_->setDensityLod(lod);
+            volume_->updateConstantBuffer();
+
+            if(discardHistory_)
+            {
+                raw_.discardHistory();
+                discardHistory_ = false;
+            }
+            TemporalReprojectionParams reprojection;
+            reprojection.enabled = reprojection_;
+            raw_.setTemporalReprojection(reprojection);
+
+            raw_.setCamera(camera_);
+            raw_.setEnvir(*envir_);
+            raw_.setVolume(*volume_);
+            raw_.setTracer(maxDepth_);
+
+            DirectLightParams direct;
+            direct.sampling  = directLight_ ? DirectLightSampling::MIS : DirectLightSampling::Light;
+            direct.heuristic = directLight_ == 1 ? MISHeuristic::Balance : MISHeuristic::Power;
+            raw_.setDirectLight(direct);
+
+            DynamicResolutionParams resolution;
+            resolution.enabled       = dynamicResolution_;
+            resolution.frameBudgetMs = frameBudgetMs_;
+            resolution_.setParams(resolution);
+            resolution_.beginFrame(
+                camera_.getPosition() != lastPosition || camera_.getDirection() != lastDirection);
+            raw_.setInterleave(resolution_.getStride(), resolution_.getPhase());
+
+            raw_.render();
+            frameRendered_ = true;
         }
-        raw_.setCamera(camera_);
-        raw_.setEnvir(envir_);
-        raw_.setVolume(volume_);
-        raw_.setTracer(maxDepth_);
-        
-        raw_.render();
 
         window_->useDefaultRTVAndDSV();
         window_->useDefaultViewport();
         window_->clearDefaultDepth(1);
         window_->clearDefaultRenderTarget({ 0, 1, 1, 0 });
 
+        // the denoised image is not accumulated, only displayed. the holes
+        // of interleaved frames are filled by the displayer instead
+        const int stride = resolution_.getStride();
+        auto output = raw_.getOutput();
+        if(denoise_ && stride == 1)
+        {
+            denoiser_.setParams(denoiserParams_);
+            output = denoiser_.denoise(output, raw_.getFeatures(), raw_.getMoments());
+        }
+
         disp_.setExposure(exposure_);
-        disp_.render(raw_.getOutput());
+        disp_.setFillRadius(stride > 1 ? stride : 0);
+        disp_.render(std::move(output));
     }
 
     std::vector<std::string> getSortedImages(const std::string &path) const
@@ -1,3 +1,5 @@
+#include <tuple>
+
 #include "raw.h"
 
 namespace
@@ -61,6 +63,12 @@ void RawVolumeRenderer::initilalize(const Int2 &size)
     historySlot_ = shaderRscs_.getShaderResourceViewSlot<CS>("History");
     outputSlot_  = shaderRscs_.getUnorderedAccessViewSlot<CS>("Output");
 
+    featureHistorySlot_ = shaderRscs_.getShaderResourceViewSlot<CS>("FeatureHistory");
+    featureOutputSlot_  = shaderRscs_.getUnorderedAccessViewSlot<CS>("FeatureOutput");
+
+    momentHistorySlot_ = shaderRscs_.getShaderResourceViewSlot<CS>("MomentHistory");
+    momentOutputSlot_  = shaderRscs_.getUnorderedAccessViewSlot<CS>("MomentOutput");
+
     resize(size);
 
     csParams_.initialize();
@@ -73,6 +81,12 @@ void RawVolumeRenderer::resize(const Int2 &size)
     auto output1 = createOutput(size);
     auto output2 = createOutput(size);
 
+    std::tie(featureSRV1_, featureUAV1_) = createOutput(size);
+    std::tie(featureSRV2_, featureUAV2_) = createOutput(size);
+
+    std::tie(momentSRV1_, momentUAV1_) = createOutput(size);
+    std::tie(momentSRV2_, momentUAV2_) = createOutput(size);
+
     generateRandomSeeds(size);
 
     outputSRV1_ = std::move(output1.first);
@@ -100,17 +114,42 @@ void RawVolumeRenderer::setTracer(int maxDepth)
     csParamsData_.maxTraceDepth = maxDepth;
 }
 
+void RawVolumeRenderer::setDirectLight(const DirectLightParams &params)
+{
+    csParamsData_.directLightMIS    = params.sampling != DirectLightSampling::Light;
+    csParamsData_.misPowerHeuristic = params.heuristic == MISHeuristic::Power;
+}
+
+void RawVolumeRenderer::setTemporalReprojection(const TemporalReprojectionParams &params)
+{
+    reprojection_ = params.enabled;
+    csParamsData_.maxHistorySamples = params.maxHistorySamples;
+    csParamsData_.depthTolerance    = params.depthTolerance;
+}
+
 void RawVolumeRenderer::setCamera(const Camera &camera)
 {
     const auto fD = camera.getFrustumDirections();
 
-    csParamsData_.discardHistory |=
+    const bool moved =
         csParamsData_.eye != camera.getPosition() ||
         csParamsData_.frustumA != fD.frustumA ||
         csParamsData_.frustumB != fD.frustumB ||
         csParamsData_.frustumC != fD.frustumC ||
         csParamsData_.frustumD != fD.frustumD;
 
+    // the history is seen from the camera before the first move since
+    // the last frame
+    if(moved && reprojection_ && !csParamsData_.reprojectHistory)
+    {
+        csParamsData_.prevEye      = csParamsData_.eye;
+        csParamsData_.prevFrustumA = csParamsData_.frustumA;
+        csParamsData_.prevFrustumB = csParamsData_.frustumB;
+        csParamsData_.prevFrustumC = csParamsData_.frustumC;
+        csParamsData_.reprojectHistory = true;
+    }
+    csParamsData_.discardHistory |= moved && !reprojection_;
+
     csParamsData_.eye = camera.getPosition();
     csParamsData_.frustumA = fD.frustumA;
     csParamsData_.frustumB = fD.frustumB;
@@ -118,6 +157,12 @@ void RawVolumeRenderer::setCamera(const Camera &camera)
     csParamsData_.frustumD = fD.frustumD;
 }
 
+void RawVolumeRenderer::setInterleave(int stride, int phase)
+{
+    csParamsData_.interleaveStride = stride;
+    csParamsData_.interleavePhase  = phase;
+}
+
 void RawVolumeRenderer::discardHistory()
 {
     csParamsData_.discardHistory = true;
@@ -128,6 +173,16 @@ ComPtr<ID3D11ShaderResourceView> RawVolumeRenderer::getOutput() const
     return outputSRV1_;
 }
 
+ComPtr<ID3D11ShaderResourceView> RawVolumeRenderer::getFeatures() const
+{
+    return featureSRV1_;
+}
+
+ComPtr<ID3D11ShaderResourceView> RawVolumeRenderer::getMoments() const
+{
+    return momentSRV1_;
+}
+
 void RawVolumeRenderer::render()
 {
     oldRandomSeedsSlot_->setShaderResourceView(randomSeedsSRV1_);
@@ -142,8 +197,21 @@ void RawVolumeRenderer::render()
     std::swap(outputSRV1_, outputSRV2_);
     std::swap(outputUAV1_, outputUAV2_);
 
+    featureHistorySlot_->setShaderResourceView(featureSRV1_);
+    featureOutputSlot_->setUnorderedAccessView(featureUAV2_);
+
+    std::swap(featureSRV1_, featureSRV2_);
+    std::swap(featureUAV1_, featureUAV2_);
+
+    momentHistorySlot_->setShaderResourceView(momentSRV1_);
+    momentOutputSlot_->setUnorderedAccessView(momentUAV2_);
+
+    std::swap(momentSRV1_, momentSRV2_);
+    std::swap(momentUAV1_, momentUAV2_);
+
     csParams_.update(csParamsData_);
-    csParamsData_.discardHistory = false;
+    csParamsData_.discardHistory   = false;
+    csParamsData_.reprojectHistory = false;
 
     shader_.bind();
     shaderRscs_.bind();
@@ -1,6 +1,7 @@
 #pragma once
 
-#include "camera.h"
+#include "core/camera.h"
+#include "core/cpu_renderer.h"
 #include "envir.h"
 #include "volume.h"
 
@@ -14,8 +15,19 @@ public:
 
     void setTracer(int maxDepth);
 
+    // product sampling is cpu only, and falls back to mis here
+    void setDirectLight(const DirectLightParams &params);
+
+    // camera moves discard the history when disabled. see
+    // TemporalReprojectionParams
+    void setTemporalReprojection(const TemporalReprojectionParams &params);
+
     void setCamera(const Camera &camera);
 
+    // frames trace the pixels of rank phase in each stride x stride block
+    // only, see ResolutionController
+    void setInterleave(int stride, int phase);
+
     void setEnvir(EnvirLight &envir);
 
     void setVolume(Volume &volume);
@@ -24,6 +36,12 @@ public:
 
     ComPtr<ID3D11ShaderResourceView> getOutput() const;
 
+    // guides of GPUDenoiser, accumulated along the output:
+    // (albedo, depth) and (luminance, squared luminance, transmittance, 0)
+    ComPtr<ID3D11ShaderResourceView> getFeatures() const;
+
+    ComPtr<ID3D11ShaderResourceView> getMoments() const;
+
     void render();
 
 private:
@@ -34,7 +52,17 @@ private:
         Float3 frustumA; int   outputWidth;
         Float3 frustumB; int   outputHeight;
         Float3 frustumC; int   discardHistory;
-        Float3 frustumD; float pad0;
+        Float3 frustumD; int   reprojectHistory;
+
+        Float3 prevEye;      int   maxHistorySamples;
+        Float3 prevFrustumA; float depthTolerance;
+        Float3 prevFrustumB; int   interleaveStride;
+        Float3 prevFrustumC; int   interleavePhase;
+
+        int   directLightMIS;
+        int   misPowerHeuristic;
+        float pad0;
+        float pad1;
     };
 
     void generateRandomSeeds(const Int2 &size);
@@ -45,6 +73,12 @@ private:
     ComPtr<ID3D11ShaderResourceView>  outputSRV2_;
     ComPtr<ID3D11UnorderedAccessView> outputUAV2_;
 
+    ComPtr<ID3D11ShaderResourceView>  featureSRV1_, featureSRV2_;
+    ComPtr<ID3D11UnorderedAccessView> featureUAV1_, featureUAV2_;
+
+    ComPtr<ID3D11ShaderResourceView>  momentSRV1_, momentSRV2_;
+    ComPtr<ID3D11UnorderedAccessView> momentUAV1_, momentUAV2_;
+
     Shader<CS>         shader_;
     Shader<CS>::RscMgr shaderRscs_;
     
@@ -57,12 +91,20 @@ private:
     ShaderResourceViewSlot<CS>  *historySlot_ = nullptr;
     UnorderedAccessViewSlot<CS> *outputSlot_  = nullptr;
 
+    ShaderResourceViewSlot<CS>  *featureHistorySlot_ = nullptr;
+    UnorderedAccessViewSlot<CS> *featureOutputSlot_  = nullptr;
+
+    ShaderResourceViewSlot<CS>  *momentHistorySlot_ = nullptr;
+    UnorderedAccessViewSlot<CS> *momentOutputSlot_  = nullptr;
+
     ComPtr<ID3D11ShaderResourceView> randomSeedsSRV1_;
     ComPtr<ID3D11ShaderResourceView> randomSeedsSRV2_;
 
     ComPtr<ID3D11UnorderedAccessView> randomSeedsUAV1_;
     ComPtr<ID3D11UnorderedAccessView> randomSeedsUAV2_;
 
+    bool reprojection_ = false;
+
     CSParams                 csParamsData_ = {};
     ConstantBuffer<CSParams> csParams_;
 };
@@ -1,7 +1,63 @@
-#include <fstream>
-
+#include "core/brick_file.h"
+#include "core/grid.h"
 #include "volume.h"
 
+namespace
+{
+    // levels[i] holds texels of sizes[i], tightly packed
+    ComPtr<ID3D11ShaderResourceView> createMipTex3DSRV(
+        const std::vector<Int3> &sizes, DXGI_FORMAT format,
+        const std::vector<const void *> &levels, size_t texelSize)
+    {
+        const UINT levelCount = static_cast<UINT>(levels.size());
+
+        D3D11_TEXTURE3D_DESC texDesc;
+        texDesc.Width          = sizes[0].x;
+        texDesc.Height         = sizes[0].y;
+        texDesc.Depth          = sizes[0].z;
+        texDesc.MipLevels      = levelCount;
+        texDesc.Format         = format;
+        texDesc.Usage          = D3D11_USAGE_IMMUTABLE;
+        texDesc.BindFlags      = D3D11_BIND_SHADER_RESOURCE;
+        texDesc.CPUAccessFlags = 0;
+        texDesc.MiscFlags      = 0;
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+        srvDesc.Format                    = format;
+        srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE3D;
+        srvDesc.Texture3D.MipLevels       = levelCount;
+        srvDesc.Texture3D.MostDetailedMip = 0;
+
+        std::vector<D3D11_SUBRESOURCE_DATA> texData(levelCount);
+        for(UINT i = 0; i < levelCount; ++i)
+        {
+            texData[i].pSysMem          = levels[i];
+            texData[i].SysMemPitch      = static_cast<UINT>(sizes[i].x * texelSize);
+            texData[i].SysMemSlicePitch = sizes[i].y * texData[i].SysMemPitch;
+        }
+
+        auto tex = device.createTex3D(texDesc, texData.data());
+        return device.createSRV(tex, srvDesc);
+    }
+
+    ComPtr<ID3D11ShaderResourceView> createTex3DSRV(
+        const Int3 &size, DXGI_FORMAT format, const void *data, size_t texelSize)
+    {
+        return createMipTex3DSRV({ size }, format, { data }, texelSize);
+    }
+
+    DXGI_FORMAT getDensityFormat(DensityEncoding encoding)
+    {
+        switch(encoding)
+        {
+        case DensityEncoding::Half:    return DXGI_FORMAT_R16_FLOAT;
+        case DensityEncoding::Unorm16: return DXGI_FORMAT_R16_UNORM;
+        case DensityEncoding::Unorm8:  return DXGI_FORMAT_R8_UNORM;
+        default:                       return DXGI_FORMAT_R32_FLOAT;
+        }
+    }
+}
+
 void Volume::initialize()
 {
     volParams_.initialize();
@@ -13,90 +69,309 @@ void Volume::initialize()
         D3D11_TEXTURE_ADDRESS_CLAMP);
 }
 
-void Volume::loadDensity(const std::string &filename)
+void Volume::loadDensity(const std::string &filename, bool bricked)
 {
-    std::ifstream fin(filename);
-    if(!fin)
-        throw std::runtime_error("failed to open file: " + filename);
-    
-    int width = 1, height = 1, depth = 1;
-    fin >> width >> height >> depth;
-    
-    const int voxelCount = width * height * depth;
-    std::vector<float> data(voxelCount);
+    if(BrickFile::isBrickFile(filename))
+    {
+        BrickFile file;
+        file.open(filename);
+
+        // the stored voxels of all brick cells, empty ones included, span
+        // the value range of the grid
+        const Int3 &res = file.getBrickResolution();
+        float minValue = file.getMaxValue();
+        for(int z = 0; z < res.z; ++z)
+        {
+            for(int y = 0; y < res.y; ++y)
+            {
+                for(int x = 0; x < res.x; ++x)
+                    minValue = (std::min)(minValue, file.getBrickMinorant(x, y, z));
+            }
+        }
+
+        densityQuant_ = fitDensityQuantization(
+            densityEncoding_, minValue, file.getMaxValue());
+        rawMaxDensity_ = file.getMaxValue();
+        majorants_.build(file);
+
+        uploadBrickedDensity(file);
+        densitySRV_.Reset();
+        densityMipsSRV_.Reset();
+        mipBytes_ = 0;
+        volParamsData_.mipCount = 0;
+
+        bricked = true;
+        volParamsData_.densityRes = file.getSize();
+    }
+    else
+    {
+        const Grid grid = Grid::load(filename, GridFormat::R32F);
+        if(grid.getFormat() != GridFormat::R32F)
+            throw std::runtime_error("density grid must be R32F: " + filename);
+
+        const float *values = grid.getData();
+        const float minValue = *std::min_element(values, values + grid.getVoxelCount());
+
+        densityQuant_ = fitDensityQuantization(
+            densityEncoding_, minValue, grid.getMaxValue());
+        rawMaxDensity_ = grid.getMaxValue();
+        majorants_.build(grid);
+
+        if(bricked)
+        {
+            uploadBrickedDensity(grid);
+            densitySRV_.Reset();
+        }
+        else
+        {
+            uploadDenseDensity(grid);
+            brickPoolSRV_.Reset();
+            brickIndicesSRV_.Reset();
+        }
+
+        // levels from 1 on, as one mipped texture. the mip sizes of the
+        // chain are the ones d3d expects
 
-    rawMaxDensity_ = 0;
-    for(int i = 0; i < voxelCount; ++i)
+        DensityMipChain mips;
+        mips.build(grid);
+
+        std::vector<Int3>         mipSizes;
+        std::vector<const void *> mipData;
+        mipBytes_ = 0;
+        for(int level = 1; level < mips.getLevelCount(); ++level)
+        {
+            mipSizes.push_back(mips.getSize(level));
+            mipData.push_back(mips.getMeanData(level));
+            mipBytes_ += size_t(mips.getSize(level).product()) * sizeof(float);
+        }
+
+        volParamsData_.mipCount = static_cast<int>(mipData.size());
+        if(mipData.empty())
+        {
+            densityMipsSRV_.Reset();
+        }
+        else
+        {
+            densityMipsSRV_ = createMipTex3DSRV(
+                mipSizes, DXGI_FORMAT_R32_FLOAT, mipData, sizeof(float));
+        }
+
+        volParamsData_.densityRes = grid.getSize();
+    }
+
+    volParamsData_.brickedDensity      = bricked;
+    volParamsData_.densityDecodeScale  = densityQuant_.scale;
+    volParamsData_.densityDecodeOffset = densityQuant_.offset;
+
+    // (majorant, minorant) pairs for residual ratio tracking, widened by the
+    // quantization error so that they bound the decoded values
+
+    const std::vector<float> &maxs = majorants_.getData();
+    const std::vector<float> &mins = majorants_.getMinorantData();
+
+    std::vector<Float2> bounds(maxs.size());
+    for(size_t i = 0; i < bounds.size(); ++i)
     {
-        fin >> data[i];
-        rawMaxDensity_ = (std::max)(rawMaxDensity_, data[i]);
+        bounds[i] = Float2(
+            maxs[i] + getDensityQuantizationError(densityQuant_, maxs[i]),
+            (std::max)(0.0f, mins[i] - getDensityQuantizationError(densityQuant_, mins[i])));
     }
+    rawMaxDensity_ += getDensityQuantizationError(densityQuant_, rawMaxDensity_);
 
-    D3D11_TEXTURE3D_DESC texDesc;
-    texDesc.Width          = width;
-    texDesc.Height         = height;
-    texDesc.Depth          = depth;
-    texDesc.MipLevels      = 1;
-    texDesc.Format         = DXGI_FORMAT_R32_FLOAT;
-    texDesc.Usage          = D3D11_USAGE_IMMUTABLE;
-    texDesc.BindFlags      = D3D11_BIND_SHADER_RESOURCE;
-    texDesc.CPUAccessFlags = 0;
-    texDesc.MiscFlags      = 0;
-    
-    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
-    srvDesc.Format                    = DXGI_FORMAT_R32_FLOAT;
-    srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE3D;
-    srvDesc.Texture3D.MipLevels       = 1;
-    srvDesc.Texture3D.MostDetailedMip = 0;
-    
-    D3D11_SUBRESOURCE_DATA texData;
-    texData.pSysMem          = data.data();
-    texData.SysMemPitch      = width * sizeof(float);
-    texData.SysMemSlicePitch = height * texData.SysMemPitch;
-    
-    auto tex = device.createTex3D(texDesc, &texData);
-    densitySRV_ = device.createSRV(tex, srvDesc);
+    volParamsData_.majorantRes = majorants_.getResolution();
+    majorantBoundsSRV_ = createTex3DSRV(
+        majorants_.getResolution(), DXGI_FORMAT_R32G32_FLOAT,
+        bounds.data(), sizeof(Float2));
 }
 
 void Volume::loadAlbedo(const std::string &filename)
 {
-    std::ifstream fin(filename);
-    if(!fin)
-        throw std::runtime_error("failed to open file: " + filename);
-    
-    int width = 1, height = 1, depth = 1;
-    fin >> width >> height >> depth;
-    
-    const int voxelCount = width * height * depth;
-    std::vector<Float4> data(voxelCount);
-    
-    for(int i = 0; i < voxelCount; ++i)
-        fin >> data[i].x >> data[i].y >> data[i].z;
-    
-    D3D11_TEXTURE3D_DESC texDesc;
-    texDesc.Width          = width;
-    texDesc.Height         = height;
-    texDesc.Depth          = depth;
-    texDesc.MipLevels      = 1;
-    texDesc.Format         = DXGI_FORMAT_R32G32B32A32_FLOAT;
-    texDesc.Usage          = D3D11_USAGE_IMMUTABLE;
-    texDesc.BindFlags      = D3D11_BIND_SHADER_RESOURCE;
-    texDesc.CPUAccessFlags = 0;
-    texDesc.MiscFlags      = 0;
-    
-    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
-    srvDesc.Format                    = DXGI_FORMAT_R32G32B32A32_FLOAT;
-    srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE3D;
-    srvDesc.Texture3D.MipLevels       = 1;
-    srvDesc.Texture3D.MostDetailedMip = 0;
-    
-    D3D11_SUBRESOURCE_DATA texData;
-    texData.pSysMem          = data.data();
-    texData.SysMemPitch      = width * sizeof(Float4);
-    texData.SysMemSlicePitch = height * texData.SysMemPitch;
-    
-    auto tex = device.createTex3D(texDesc, &texData);
-    albedoSRV_ = device.createSRV(tex, srvDesc);
+    const Grid grid = Grid::load(filename, GridFormat::RGBA32F);
+    if(grid.getFormat() != GridFormat::RGBA32F)
+        throw std::runtime_error("albedo grid must be RGBA32F: " + filename);
+    loadAlbedo(grid);
+}
+
+void Volume::loadAlbedo(const Grid &grid)
+{
+    // the shader linearizes the constant like the texels it replaces
+
+    Float3 constant;
+    if(findConstantAlbedo(grid, constant))
+    {
+        volParamsData_.albedoIsConstant = 1;
+        volParamsData_.constantAlbedo   = Float3(
+            std::pow(constant.x, 2.2f), std::pow(constant.y, 2.2f),
+            std::pow(constant.z, 2.2f));
+
+        albedoSRV_.Reset();
+        albedoBytes_ = 0;
+        return;
+    }
+
+    volParamsData_.albedoIsConstant = 0;
+
+    if(albedoEncoding_ == AlbedoEncoding::SRGB8)
+    {
+        const std::vector<uint32_t> texels = encodeAlbedoSRGB8(grid);
+        albedoSRV_ = createTex3DSRV(
+            grid.getSize(), DXGI_FORMAT_R8G8B8A8_UNORM, texels.data(), sizeof(uint32_t));
+        albedoBytes_ = texels.size() * sizeof(uint32_t);
+    }
+    else
+    {
+        albedoSRV_ = createTex3DSRV(
+            grid.getSize(), DXGI_FORMAT_R32G32B32A32_FLOAT, grid.getData(), sizeof(Float4));
+        albedoBytes_ = grid.getByteSize();
+    }
+}
+
+void Volume::setDensityEncoding(DensityEncoding encoding)
+{
+    densityEncoding_ = encoding;
+}
+
+void Volume::setAlbedoEncoding(AlbedoEncoding encoding)
+{
+    albedoEncoding_ = encoding;
+}
+
+size_t Volume::getTextureByteSize() const
+{
+    return densityBytes_ + mipBytes_ + albedoBytes_;
+}
+
+size_t Volume::getMipByteSize() const
+{
+    return mipBytes_;
+}
+
+ComPtr<ID3D11ShaderResourceView> Volume::createDensitySRV(const Int3 &size, const float *data)
+{
+    const size_t count     = size_t(size.x) * size.y * size.z;
+    const size_t texelSize = getDensityTexelSize(densityQuant_.encoding);
+    const DXGI_FORMAT format = getDensityFormat(densityQuant_.encoding);
+
+    densityBytes_ += count * texelSize;
+
+    // float grids, possibly mapped, are uploaded without a copy
+    if(densityQuant_.encoding == DensityEncoding::Float32)
+        return createTex3DSRV(size, format, data, texelSize);
+
+    std::vector<uint8_t> encoded(count * texelSize);
+    encodeDensity(densityQuant_, data, count, encoded.data());
+    return createTex3DSRV(size, format, encoded.data(), texelSize);
+}
+
+void Volume::uploadDenseDensity(const Grid &grid)
+{
+    densityBytes_ = 0;
+    densitySRV_ = createDensitySRV(grid.getSize(), grid.getData());
+}
+
+void Volume::uploadBrickedDensity(const Grid &grid)
+{
+    BrickGrid bricks;
+    bricks.build(grid);
+
+    const Int3 &res = bricks.getBrickResolution();
+    std::vector<int32_t> indices(res.product());
+    for(int z = 0, i = 0; z < res.z; ++z)
+    {
+        for(int y = 0; y < res.y; ++y)
+        {
+            for(int x = 0; x < res.x; ++x)
+                indices[i++] = bricks.getBrickIndex(x, y, z);
+        }
+    }
+
+    uploadBrickPool(res, indices, bricks.getBrickCount(), [&](int i, float *dst)
+    {
+        const float *src = bricks.getBrickData(i);
+        std::copy(src, src + BRICK_VOXEL_COUNT, dst);
+    });
+}
+
+void Volume::uploadBrickedDensity(const BrickFile &file)
+{
+    const Int3 &res = file.getBrickResolution();
+    std::vector<int32_t> indices(res.product());
+    for(int z = 0, i = 0; z < res.z; ++z)
+    {
+        for(int y = 0; y < res.y; ++y)
+        {
+            for(int x = 0; x < res.x; ++x)
+                indices[i++] = file.getBrickIndex(x, y, z);
+        }
+    }
+
+    uploadBrickPool(res, indices, file.getBrickCount(), [&](int i, float *dst)
+    {
+        file.readBrick(i, dst);
+    });
+}
+
+void Volume::uploadBrickPool(
+    const Int3 &res, const std::vector<int32_t> &indices, int brickCount,
+    const std::function<void(int, float *)> &readBrick)
+{
+    // occupied bricks are packed into a pool texture with the apron voxels
+    // kept, so hardware trilinear filtering inside a brick is exact
+
+    constexpr int MAX_POOL_BRICKS = D3D11_REQ_TEXTURE3D_U_V_OR_W_DIMENSION / BRICK_STORAGE_SIZE;
+
+    const int poolBricks = (std::max)(1, brickCount);
+    const int poolEdge   = static_cast<int>(std::ceil(std::cbrt(float(poolBricks))));
+
+    Int3 poolRes;
+    poolRes.x = (std::min)(MAX_POOL_BRICKS, poolEdge);
+    poolRes.y = (std::min)(MAX_POOL_BRICKS, poolEdge);
+    poolRes.z = (poolBricks + poolRes.x * poolRes.y - 1) / (poolRes.x * poolRes.y);
+    if(poolRes.z > MAX_POOL_BRICKS)
+        throw std::runtime_error("too many bricks for a brick pool texture");
+
+    const Int3 poolSize = BRICK_STORAGE_SIZE * poolRes;
+    std::vector<float> pool(poolSize.product(), 0.0f);
+
+    std::vector<float> voxels(BRICK_VOXEL_COUNT);
+    for(int i = 0; i < brickCount; ++i)
+    {
+        const int px = i % poolRes.x;
+        const int py = i / poolRes.x % poolRes.y;
+        const int pz = i / (poolRes.x * poolRes.y);
+
+        readBrick(i, voxels.data());
+
+        const float *src = voxels.data();
+        for(int z = 0; z < BRICK_STORAGE_SIZE; ++z)
+        {
+            for(int y = 0; y < BRICK_STORAGE_SIZE; ++y)
+            {
+                const size_t dstZ = size_t(pz) * BRICK_STORAGE_SIZE + z;
+                const size_t dstY = size_t(py) * BRICK_STORAGE_SIZE + y;
+                float *dst = &pool[
+                    (dstZ * poolSize.y + dstY) * poolSize.x + px * BRICK_STORAGE_SIZE];
+                std::copy(src, src + BRICK_STORAGE_SIZE, dst);
+                src += BRICK_STORAGE_SIZE;
+            }
+        }
+    }
+
+    densityBytes_ = indices.size() * sizeof(int32_t);
+    brickPoolSRV_ = createDensitySRV(poolSize, pool.data());
+    brickIndicesSRV_ = createTex3DSRV(
+        res, DXGI_FORMAT_R32_SINT, indices.data(), sizeof(int32_t));
+
+    volParamsData_.brickPoolRes = poolRes;
+}
+
+void Volume::setDensityLod(const DensityLodParams &params)
+{
+    volParamsData_.lodMode          = static_cast<int>(params.mode);
+    volParamsData_.lodStartDepth    = params.startDepth;
+    volParamsData_.lodPerBounce     = params.perBounce;
+    volParamsData_.lodScatterSpread = params.scatterSpread;
+    volParamsData_.lodMax           = params.maxLod;
 }
 
 void Volume::setBoundingBox(const Float3 &lower, const Float3 &upper)
@@ -117,11 +392,21 @@ void Volume::setG(float g)
     volParamsData_.phaseG2 = g * g;
 }
 
+void Volume::setTransmittanceEstimator(TransmittanceEstimator estimator)
+{
+    volParamsData_.transmittanceEstimator = static_cast<int>(estimator);
+}
+
 void Volume::updateConstantBuffer()
 {
     volParamsData_.maxDensity = rawMaxDensity_ * volParamsData_.densityScale;
     volParamsData_.invDensity = 1 / (std::max)(0.001f, volParamsData_.maxDensity);
 
+    const Int3  &res    = volParamsData_.densityRes;
+    const Float3 extent = volParamsData_.upper - volParamsData_.lower;
+    volParamsData_.invVoxelSize = (std::max)({
+        res.x / extent.x, res.y / extent.y, res.z / extent.z });
+
     volParams_.update(volParamsData_);
 }
 
@@ -131,8 +416,21 @@ void Volume::bind(Shader<CS>::RscMgr &shaderRscs)
         ->setShaderResourceView(albedoSRV_);
     shaderRscs.getShaderResourceViewSlot<CS>("Density")
         ->setShaderResourceView(densitySRV_);
+    shaderRscs.getShaderResourceViewSlot<CS>("DensityMips")
+        ->setShaderResourceView(densityMipsSRV_);
+    shaderRscs.getShaderResourceViewSlot<CS>("BrickPool")
+        ->setShaderResourceView(brickPoolSRV_);
+    shaderRscs.getShaderResourceViewSlot<CS>("BrickIndices")
+        ->setShaderResourceView(brickIndicesSRV_);
+    shaderRscs.getShaderResourceViewSlot<CS>("MajorantBounds")
+        ->setShaderResourceView(majorantBoundsSRV_);
     shaderRscs.getConstantBufferSlot<CS>("VolumeParams")
         ->setBuffer(volParams_);
     shaderRscs.getSamplerSlot<CS>("VolumeSampler")
         ->setSampler(sampler_);
 }
+
+const MajorantGrid &Volume::getMajorantGrid() const
+{
+    return majorants_;
+}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <functional>
+
 #include "common.h"
+#include "core/medium.h"
+#include "core/quantize.h"
 
 class Volume
 {
@@ -8,20 +12,50 @@ public:
 
     void initialize();
 
-    void loadDensity(const std::string &filename);
+    // bricked densities are uploaded as a pool of occupied bricks plus an
+    // indirection texture instead of a dense texture, and the shaders track
+    // them cell by cell of the majorant grid, crossing empty cells without
+    // lookups. .vbrick files are always bricked and are read brick by brick,
+    // without a dense copy
+    void loadDensity(const std::string &filename, bool bricked = false);
 
+    // constant albedo grids are stored in the constant buffer instead of a texture
     void loadAlbedo(const std::string &filename);
 
+    // RGBA32F grid
+    void loadAlbedo(const Grid &grid);
+
+    // texel encodings used by the next loadDensity / loadAlbedo
+    void setDensityEncoding(DensityEncoding encoding);
+
+    void setAlbedoEncoding(AlbedoEncoding encoding);
+
+    // bytes of the density, density mip, albedo and brick textures
+    size_t getTextureByteSize() const;
+
+    // bytes of the density mips alone, included in getTextureByteSize
+    size_t getMipByteSize() const;
+
     void setBoundingBox(const Float3 &lower, const Float3 &upper);
 
     void setDensityScale(float scale);
 
     void setG(float g);
 
+    void setTransmittanceEstimator(TransmittanceEstimator estimator);
+
+    // coarser density mips by path depth or ray footprint. the mips are
+    // built by loadDensity, except for .vbrick files, which render at full
+    // resolution
+    void setDensityLod(const DensityLodParams &params);
+
     void updateConstantBuffer();
 
     void bind(Shader<CS>::RscMgr &shaderRscs);
 
+    // per-cell majorants of the raw density, rebuilt by loadDensity
+    const MajorantGrid &getMajorantGrid() const;
+
 private:
 
     struct VolumeParams
@@ -30,13 +64,55 @@ private:
         Float3 upper;        float invDensity;
         Float3 invExtent;    float phaseG;
         float  densityScale; float phaseG2;
-        float  pad0, pad1;
+        int    transmittanceEstimator;
+        float  pad0;
+        Int3   majorantRes;  int   brickedDensity;
+        Int3   densityRes;   float pad1;
+        Int3   brickPoolRes; float densityDecodeScale;
+        Float3 constantAlbedo; int  albedoIsConstant;
+        float  densityDecodeOffset;
+        int    lodMode;
+        int    lodStartDepth;
+        float  lodPerBounce;
+        float  lodScatterSpread;
+        float  lodMax;
+        float  invVoxelSize;
+        int    mipCount;
     };
 
+    // encodes with densityQuant_ and creates the texture
+    ComPtr<ID3D11ShaderResourceView> createDensitySRV(const Int3 &size, const float *data);
+
+    void uploadDenseDensity(const Grid &grid);
+
+    void uploadBrickedDensity(const Grid &grid);
+
+    void uploadBrickedDensity(const BrickFile &file);
+
+    // packs brickCount bricks into the pool texture. readBrick(i, dst) fills
+    // the BRICK_VOXEL_COUNT voxels of brick i
+    void uploadBrickPool(
+        const Int3 &res, const std::vector<int32_t> &indices, int brickCount,
+        const std::function<void(int, float *)> &readBrick);
+
     float rawMaxDensity_ = 0;
 
+    DensityEncoding     densityEncoding_ = DensityEncoding::Float32;
+    AlbedoEncoding      albedoEncoding_  = AlbedoEncoding::Float32;
+    DensityQuantization densityQuant_;
+
+    size_t densityBytes_ = 0;
+    size_t mipBytes_     = 0;
+    size_t albedoBytes_  = 0;
+
+    MajorantGrid majorants_;
+
     ComPtr<ID3D11ShaderResourceView> densitySRV_;
+    ComPtr<ID3D11ShaderResourceView> densityMipsSRV_;
+    ComPtr<ID3D11ShaderResourceView> brickPoolSRV_;
+    ComPtr<ID3D11ShaderResourceView> brickIndicesSRV_;
     ComPtr<ID3D11ShaderResourceView> albedoSRV_;
+    ComPtr<ID3D11ShaderResourceView> majorantBoundsSRV_;
 
     ComPtr<ID3D11SamplerState> sampler_;
 
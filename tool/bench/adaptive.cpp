@@ -0,0 +1,179 @@
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "bench.h"
+
+namespace
+{
+    std::vector<float> parseFloatList(const std::string &str)
+    {
+        std::vector<float> result;
+        std::stringstream stream(str);
+        std::string item;
+        while(std::getline(stream, item, ','))
+            result.push_back(std::stof(item));
+        return result;
+    }
+
+    std::vector<Float3> resolve(const std::vector<Float4> &output)
+    {
+        std::vector<Float3> result(output.size());
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            result[i] = o.w > 0 ? Float3(o.x, o.y, o.z) / o.w : Float3(0);
+        }
+        return result;
+    }
+
+    double computeRMSE(const std::vector<Float4> &output, const std::vector<Float3> &reference)
+    {
+        double sum = 0;
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            const Float3 d = Float3(o.x, o.y, o.z) / o.w - reference[i];
+            sum += (d.x * d.x + d.y * d.y + d.z * d.z) / 3;
+        }
+        return std::sqrt(sum / output.size());
+    }
+
+    void setupRenderer(CPUVolumeRenderer &renderer, const ToolScene &scene)
+    {
+        renderer.initialize(scene.size);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+    }
+
+    struct TargetResult
+    {
+        int      frames = 0; // 0 if not reached
+        double   ms     = 0;
+        uint64_t paths  = 0;
+    };
+
+    // render time and paths until the rmse first drops below each target
+    std::vector<TargetResult> runToTargets(
+        const ToolScene &scene, const AdaptiveSamplingParams &adaptive,
+        const std::vector<Float3> &reference, const std::vector<double> &targets,
+        int maxFrames, double &firstRMSE, int &convergedCount)
+    {
+        CPUVolumeRenderer renderer;
+        setupRenderer(renderer, scene);
+        renderer.setAdaptiveSampling(adaptive);
+
+        std::vector<TargetResult> results(targets.size());
+        size_t reached = 0;
+        double ms = 0;
+
+        for(int frame = 1; frame <= maxFrames; ++frame)
+        {
+            ToolTimer timer;
+            renderer.render();
+            ms += timer.ms();
+
+            const double rmse = computeRMSE(renderer.getOutput(), reference);
+            if(frame == 1)
+                firstRMSE = rmse;
+
+            while(reached < targets.size() && rmse <= targets[reached])
+                results[reached++] = { frame, ms, renderer.getPathCount() };
+            if(reached == targets.size())
+                break;
+        }
+
+        convergedCount = renderer.getConvergedPixelCount();
+        return results;
+    }
+}
+
+void benchAdaptive(const ToolOptions &options)
+{
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    // a smaller default image than the other tools, for the reference
+    scene.size = Int2(options.getInt("width", 160), options.getInt("height", 120));
+    scene.camera.setWOverH(float(scene.size.x) / scene.size.y);
+    scene.camera.recalculateMatrics();
+
+    const int referenceFrames = options.getInt("reference-frames", 512);
+    const int maxFrames = options.getInt("max-frames", 64);
+    const std::vector<float> targetRatios = parseFloatList(options.get("targets", "0.5,0.3,0.2"));
+    const std::vector<float> thresholds = parseFloatList(options.get("thresholds", "0.05,0.02,0.01"));
+
+    // reference from independent random sequences
+
+    ToolTimer timer;
+    CPUVolumeRenderer referenceRenderer;
+    setupRenderer(referenceRenderer, scene);
+    referenceRenderer.setSeed(1);
+    for(int i = 0; i < referenceFrames; ++i)
+        referenceRenderer.render();
+    const std::vector<Float3> reference = resolve(referenceRenderer.getOutput());
+
+    std::cout << scene.size.x << "x" << scene.size.y << " reference of "
+              << referenceFrames << " frames in " << timer.ms() << " ms" << std::endl;
+
+    // targets are fractions of the rmse of one uniform frame
+
+    double uniformFirstRMSE = 0;
+    int convergedCount = 0;
+    runToTargets(scene, {}, reference, {}, 1, uniformFirstRMSE, convergedCount);
+
+    std::vector<double> targets;
+    for(float ratio : targetRatios)
+        targets.push_back(ratio * uniformFirstRMSE);
+
+    auto print = [&](const std::string &name, const std::vector<TargetResult> &results)
+    {
+        std::cout << name << ":";
+        for(size_t i = 0; i < targets.size(); ++i)
+        {
+            std::cout << (i ? "," : "") << " rmse " << targets[i] << ": ";
+            if(!results[i].frames)
+                std::cout << "not reached in " << maxFrames << " frames";
+            else
+            {
+                std::cout << results[i].ms << " ms (" << results[i].frames << " frames, "
+                          << results[i].paths << " paths)";
+            }
+        }
+        std::cout << std::endl;
+    };
+
+    double firstRMSE = 0;
+    const auto uniform = runToTargets(
+        scene, {}, reference, targets, maxFrames, firstRMSE, convergedCount);
+    std::cout << "rmse of one uniform frame " << uniformFirstRMSE << std::endl;
+    print("uniform", uniform);
+
+    for(float threshold : thresholds)
+    {
+        AdaptiveSamplingParams adaptive = scene.adaptive;
+        adaptive.enabled   = true;
+        adaptive.threshold = threshold;
+
+        const auto results = runToTargets(
+            scene, adaptive, reference, targets, maxFrames, firstRMSE, convergedCount);
+
+        std::ostringstream name;
+        name << "adaptive " << threshold << " (" << convergedCount
+             << " pixels converged at the end)";
+        print(name.str(), results);
+
+        for(size_t i = 0; i < targets.size(); ++i)
+        {
+            if(uniform[i].frames && results[i].frames)
+            {
+                std::cout << "    " << uniform[i].ms / results[i].ms
+                          << "x faster to rmse " << targets[i] << std::endl;
+            }
+        }
+    }
+}
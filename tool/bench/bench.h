@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../options.h"
+#include "../scene.h"
+
+void benchTracking(const ToolOptions &options);
+
+void benchDecomposition(const ToolOptions &options);
+
+void benchSimd(const ToolOptions &options);
+
+void benchTransmittance(const ToolOptions &options);
+
+void benchBricks(const ToolOptions &options);
+
+void benchStreaming(const ToolOptions &options);
+
+void benchQuantize(const ToolOptions &options);
+
+void benchLod(const ToolOptions &options);
+
+void benchEnvir(const ToolOptions &options);
+
+void benchEnvirCache(const ToolOptions &options);
+
+void benchEnvirSampling(const ToolOptions &options);
+
+void benchScheduler(const ToolOptions &options);
+
+void benchAdaptive(const ToolOptions &options);
+
+void benchSamplers(const ToolOptions &options);
+
+void benchDenoise(const ToolOptions &options);
+
+void benchReprojection(const ToolOptions &options);
+
+void benchResolution(const ToolOptions &options);
+
+void benchReSTIR(const ToolOptions &options);
+
+void benchMIS(const ToolOptions &options);
+
+void benchGuiding(const ToolOptions &options);
+
+void benchTransCache(const ToolOptions &options);
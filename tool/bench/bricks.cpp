@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "../../src/core/rng.h"
+#include "bench.h"
+
+namespace
+{
+    struct Ray
+    {
+        Float3 uvwA, uvwB;
+        float  tMax;
+    };
+
+    Float3 sampleSphere(uint32_t &rng)
+    {
+        const float z = 2 * randFloat(rng) - 1;
+        const float r = std::sqrt((std::max)(0.0f, 1 - z * z));
+        const float phi = 2 * PI * randFloat(rng);
+        return Float3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    std::vector<Ray> generateRays(const VolumeMedium &medium, int count)
+    {
+        std::vector<Ray> rays;
+        uint32_t rng = 1;
+
+        while(static_cast<int>(rays.size()) < count)
+        {
+            const Float3 eye = 4.0f * sampleSphere(rng);
+            const Float3 d = (0.5f * sampleSphere(rng) - eye).normalize();
+
+            const Float2 incts = medium.intersectRayBox(eye, d);
+            if(incts.x >= incts.y)
+                continue;
+
+            rays.push_back({
+                medium.toTexCoord(eye + incts.x * d),
+                medium.toTexCoord(eye + incts.y * d),
+                incts.y - incts.x });
+        }
+
+        return rays;
+    }
+
+    // marches every step, like a dense ray marcher
+    float marchDense(const VolumeMedium &dense, const Ray &ray, float dt, uint64_t &lookups)
+    {
+        double opticalDepth = 0;
+        for(int k = 0;; ++k)
+        {
+            const float t = (k + 0.5f) * dt;
+            if(t >= ray.tMax)
+                break;
+            opticalDepth += dense.sampleDensity(
+                ray.uvwA + (t / ray.tMax) * (ray.uvwB - ray.uvwA));
+            ++lookups;
+        }
+        return static_cast<float>(opticalDepth * dt);
+    }
+}
+
+void benchBricks(const ToolOptions &options)
+{
+    const int lookupCount = options.getInt("lookups", 4000000);
+    const int rayCount    = options.getInt("rays", 20000);
+    const float stepSize  = options.getFloat("step", 0.5f);
+
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    // raw densities on both sides
+    VolumeMedium dense;
+    dense.setDensity(&scene.density);
+    dense.setBoundingBox(scene.medium.getLower(), scene.medium.getUpper());
+
+    ToolTimer buildTimer;
+    BrickGrid bricks;
+    bricks.build(scene.density);
+    const double buildMs = buildTimer.ms();
+
+    const Int3 &size = bricks.getSize();
+    const Int3 &res  = bricks.getBrickResolution();
+    std::cout << "grid " << size.x << "x" << size.y << "x" << size.z
+              << ", bricks " << res.x << "x" << res.y << "x" << res.z
+              << ", occupied " << bricks.getBrickCount() << " ("
+              << 100.0 * bricks.getBrickCount() / res.product() << "%)"
+              << ", built in " << buildMs << " ms" << std::endl;
+
+    const float *voxels = scene.density.getData();
+    const size_t zeroVoxels = std::count(
+        voxels, voxels + scene.density.getVoxelCount(), 0.0f);
+    std::cout << "zero voxels " << 100.0 * zeroVoxels / scene.density.getVoxelCount()
+              << "%, apron overhead per brick "
+              << double(BRICK_VOXEL_COUNT) / (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE)
+              << "x" << std::endl;
+
+    // the dense texture is uploaded with its mean mips, the bricks without
+
+    size_t mipBytes = 0;
+    for(int level = 1; level < scene.mips.getLevelCount(); ++level)
+        mipBytes += size_t(scene.mips.getSize(level).product()) * sizeof(float);
+
+    const double denseMB  = (scene.density.getByteSize() + mipBytes) / (1024.0 * 1024.0);
+    const double mipMB    = mipBytes / (1024.0 * 1024.0);
+    const double bricksMB = bricks.getByteSize() / (1024.0 * 1024.0);
+    std::cout << "memory: dense " << denseMB << " MB (" << mipMB << " MB of it mips), bricked "
+              << bricksMB << " MB (" << denseMB / bricksMB << "x smaller)" << std::endl;
+
+    // random lookups
+
+    std::vector<Float3> points(lookupCount);
+    uint32_t rng = 1;
+    for(auto &p : points)
+        p = Float3(randFloat(rng), randFloat(rng), randFloat(rng));
+
+    float maxDiff = 0;
+    double denseSum = 0, bricksSum = 0;
+
+    ToolTimer timer;
+    for(auto &p : points)
+        denseSum += dense.sampleDensity(p);
+    const double denseMs = timer.ms();
+
+    timer.restart();
+    for(auto &p : points)
+        bricksSum += bricks.sample(p);
+    const double bricksMs = timer.ms();
+
+    for(int i = 0; i < lookupCount; i += 7)
+    {
+        maxDiff = (std::max)(maxDiff, std::abs(
+            dense.sampleDensity(points[i]) - bricks.sample(points[i])));
+    }
+
+    std::cout << "random lookups: dense " << lookupCount / denseMs / 1000
+              << " M/s, bricked " << lookupCount / bricksMs / 1000
+              << " M/s, max abs diff " << maxDiff
+              << " (sums " << denseSum << " / " << bricksSum << ")" << std::endl;
+
+    // ray marching, steps of stepSize voxels
+
+    const std::vector<Ray> rays = generateRays(scene.medium, rayCount);
+    const Float3 voxelSize = (scene.medium.getUpper() - scene.medium.getLower()) /
+        Float3(float(size.x), float(size.y), float(size.z));
+    const float dt = stepSize * (std::min)({ voxelSize.x, voxelSize.y, voxelSize.z });
+
+    std::vector<float> denseDepths(rays.size());
+    uint64_t denseLookups = 0, bricksLookups = 0;
+
+    timer.restart();
+    for(size_t i = 0; i < rays.size(); ++i)
+        denseDepths[i] = marchDense(dense, rays[i], dt, denseLookups);
+    const double denseMarchMs = timer.ms();
+
+    float maxRelDiff = 0;
+    double bricksMarchMs = 0;
+    for(size_t i = 0; i < rays.size(); ++i)
+    {
+        timer.restart();
+        const float depth = bricks.march(
+            rays[i].uvwA, rays[i].uvwB, rays[i].tMax, dt, &bricksLookups);
+        bricksMarchMs += timer.ms();
+
+        maxRelDiff = (std::max)(maxRelDiff, std::abs(depth - denseDepths[i]) /
+                                            (std::max)(1e-3f, denseDepths[i]));
+    }
+
+    std::cout << "ray marching: dense " << denseMarchMs * 1000 / rays.size()
+              << " us/ray with " << double(denseLookups) / rays.size()
+              << " lookups, bricked " << bricksMarchMs * 1000 / rays.size()
+              << " us/ray with " << double(bricksLookups) / rays.size()
+              << " lookups (" << denseMarchMs / bricksMarchMs
+              << "x), max rel diff " << maxRelDiff << std::endl;
+}
@@ -0,0 +1,201 @@
+#include <cmath>
+#include <iostream>
+
+#include "../../src/core/rng.h"
+#include "bench.h"
+
+namespace
+{
+    enum class Tracker
+    {
+        Global,
+        Local,
+        Decomposition
+    };
+
+    struct PathStats
+    {
+        TrackingStats tracking;
+        uint64_t      scatterCount = 0;
+        uint64_t      entries = 0;      // camera rays entering the volume
+        double        firstFlight = 0;  // sum of camera ray free flights, clamped at the exit
+        double        firstFlight2 = 0; // and of their squares
+        double        ms = 0;
+    };
+
+    Float3 sampleSphere(uint32_t &rng)
+    {
+        const float z = 2 * randFloat(rng) - 1;
+        const float r = std::sqrt((std::max)(0.0f, 1 - z * z));
+        const float phi = 2 * PI * randFloat(rng);
+        return Float3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    // random walks of free flights only, as shadow rays are estimated by
+    // ratio tracking and are covered by the transmittance bench
+    PathStats runPaths(const VolumeMedium &medium, Tracker tracker, int pathCount, int maxDepth)
+    {
+        PathStats result;
+        ToolTimer timer;
+
+        for(int p = 0; p < pathCount; ++p)
+        {
+            uint32_t rng = static_cast<uint32_t>(p + 1);
+
+            const Float3 eye = 4.0f * sampleSphere(rng);
+            Float3 d = (0.5f * sampleSphere(rng) - eye).normalize();
+
+            Float3 o;
+            if(!medium.findEntry(eye, d, o))
+                continue;
+            ++result.entries;
+
+            for(int depth = 0; depth < maxDepth; ++depth)
+            {
+                const Float2 incts = medium.intersectRayBox(o, d);
+                if(incts.x + 0.001f >= incts.y)
+                    break;
+
+                const Float3 b = o + (incts.y - 0.001f) * d;
+
+                Float3 scatterPos;
+                bool scattered;
+                switch(tracker)
+                {
+                case Tracker::Global:
+                    scattered = medium.deltaTrack(o, b, rng, scatterPos, &result.tracking);
+                    break;
+                case Tracker::Local:
+                    scattered = medium.deltaTrackDDA(o, b, rng, scatterPos, &result.tracking);
+                    break;
+                default:
+                    scattered = medium.deltaTrackDecomposition(o, b, rng, scatterPos, &result.tracking);
+                    break;
+                }
+                if(depth == 0)
+                {
+                    const double flight = ((scattered ? scatterPos : b) - o).length();
+                    result.firstFlight  += flight;
+                    result.firstFlight2 += flight * flight;
+                }
+                if(!scattered)
+                    break;
+                ++result.scatterCount;
+
+                o = scatterPos;
+                d = medium.samplePhaseFunction(-d, rng);
+            }
+        }
+
+        result.ms = timer.ms();
+        return result;
+    }
+
+    void print(const char *name, const PathStats &stats, const PathStats &base, int pathCount)
+    {
+        // the distribution of free flights must not depend on the tracker.
+        // z is the difference of the mean camera ray flight to the one of
+        // global delta tracking over their standard errors
+        auto getMean = [](const PathStats &s, double &variance)
+        {
+            const double n = (std::max)(uint64_t(2), s.entries);
+            const double mean = s.firstFlight / n;
+            variance = (std::max)(0.0, s.firstFlight2 / n - mean * mean) / (n - 1);
+            return mean;
+        };
+        double variance, baseVariance;
+        const double mean = getMean(stats, variance), baseMean = getMean(base, baseVariance);
+        const double z = (mean - baseMean) / std::sqrt(variance + baseVariance + 1e-30);
+
+        std::cout << "    " << name
+                  << ": lookups/path " << double(stats.tracking.densityLookups) / pathCount
+                  << ", scatters/path " << double(stats.scatterCount) / pathCount
+                  << ", " << stats.ms * 1000 / pathCount << " us/path"
+                  << ", camera ray flight " << mean << " (z = " << z << ")" << std::endl;
+    }
+
+    void runVolume(const char *name, const VolumeMedium &medium, int pathCount, int maxDepth)
+    {
+        std::cout << name << ":" << std::endl;
+
+        const PathStats global = runPaths(medium, Tracker::Global,        pathCount, maxDepth);
+        const PathStats local  = runPaths(medium, Tracker::Local,         pathCount, maxDepth);
+        const PathStats decomp = runPaths(medium, Tracker::Decomposition, pathCount, maxDepth);
+
+        print("global majorant", global, global, pathCount);
+        print("local majorants", local,  global, pathCount);
+        print("decomposition  ", decomp, global, pathCount);
+
+        std::cout << "    lookup reduction vs local majorants "
+                  << double(local.tracking.densityLookups) /
+                     (std::max)(uint64_t(1), decomp.tracking.densityLookups)
+                  << "x, time " << decomp.ms / local.ms << " of local majorants" << std::endl;
+    }
+}
+
+void benchDecomposition(const ToolOptions &options)
+{
+    const int   pathCount = options.getInt("paths", 200000);
+    const int   maxDepth  = options.getInt("depth", 5);
+    const float fill      = options.getFloat("fill", 0.5f);
+
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    const Grid &density = scene.density;
+    if(!density.getVoxelCount())
+    {
+        std::cout << "decomposition tracking needs the dense grid, not --stream" << std::endl;
+        return;
+    }
+
+    // the dense test volume is the loaded one with fill x its max density
+    // added everywhere, so that its cells have large minorants
+    std::vector<float> filled(density.getData(), density.getData() + density.getVoxelCount());
+    const float offset = fill * density.getMaxValue();
+    for(auto &v : filled)
+        v += offset;
+    const Grid dense = Grid::fromData(GridFormat::R32F, density.getSize(), std::move(filled));
+
+    MajorantGrid denseMajorants;
+    denseMajorants.build(dense);
+
+    VolumeMedium denseMedium = scene.medium;
+    denseMedium.setBrickGrid(nullptr);
+    denseMedium.setDensity(&dense);
+    denseMedium.setMajorantGrid(&denseMajorants);
+
+    // the control density is the minorant of the cells. report how much of
+    // the majorant it covers, averaged over cells with any density
+    auto printCoverage = [](const char *name, const MajorantGrid &majorants)
+    {
+        const Int3 &res = majorants.getResolution();
+        double coverage = 0;
+        int cells = 0;
+        for(int z = 0; z < res.z; ++z)
+        {
+            for(int y = 0; y < res.y; ++y)
+            {
+                for(int x = 0; x < res.x; ++x)
+                {
+                    const float majorant = majorants.getMajorant(x, y, z);
+                    if(majorant <= 0)
+                        continue;
+                    coverage += majorants.getMinorant(x, y, z) / majorant;
+                    ++cells;
+                }
+            }
+        }
+        std::cout << name << " volume: " << res.x << "x" << res.y << "x" << res.z
+                  << " majorant cells, minorant / majorant " << coverage / (std::max)(1, cells)
+                  << " in " << cells << " non-empty cells" << std::endl;
+    };
+    printCoverage("sparse", scene.majorants);
+    printCoverage("dense", denseMajorants);
+
+    std::cout << pathCount << " paths of up to " << maxDepth << " free flights, density scale "
+              << options.getFloat("scale", 10) << std::endl;
+
+    runVolume("sparse (loaded)", scene.medium, pathCount, maxDepth);
+    runVolume("dense (filled)",  denseMedium,  pathCount, maxDepth);
+}
@@ -0,0 +1,267 @@
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "../../src/core/denoiser.h"
+#include "bench.h"
+
+namespace
+{
+    std::vector<double> parseList(const std::string &str)
+    {
+        std::vector<double> result;
+        std::stringstream stream(str);
+        std::string item;
+        while(std::getline(stream, item, ','))
+            result.push_back(std::stod(item));
+        return result;
+    }
+
+    std::vector<Float3> resolve(const std::vector<Float4> &output)
+    {
+        std::vector<Float3> result(output.size());
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            result[i] = o.w > 0 ? Float3(o.x, o.y, o.z) / o.w : Float3(0);
+        }
+        return result;
+    }
+
+    double computeRMSE(const std::vector<Float3> &image, const std::vector<Float3> &reference)
+    {
+        double sum = 0;
+        for(size_t i = 0; i < image.size(); ++i)
+        {
+            const Float3 d = image[i] - reference[i];
+            sum += (d.x * d.x + d.y * d.y + d.z * d.z) / 3;
+        }
+        return std::sqrt(sum / image.size());
+    }
+
+    // luma of what the display shows: tonemapped like asset/display.hlsl at
+    // exposure 1, then gamma corrected
+    std::vector<float> computeDisplayLuma(const std::vector<Float3> &image)
+    {
+        auto tonemap = [](float x)
+        {
+            const float v = (std::max)(0.0f, x);
+            return std::pow((v * (2.51f * v + 0.03f)) / (v * (2.43f * v + 0.59f) + 0.14f), 1 / 2.2f);
+        };
+
+        std::vector<float> result(image.size());
+        for(size_t i = 0; i < image.size(); ++i)
+        {
+            const Float3 &c = image[i];
+            result[i] = 0.2126f * tonemap(c.x) + 0.7152f * tonemap(c.y) + 0.0722f * tonemap(c.z);
+        }
+        return result;
+    }
+
+    // separable 11x11 gaussian with sigma 1.5, clamped at the borders
+    std::vector<float> blur(const std::vector<float> &image, const Int2 &size)
+    {
+        constexpr int RADIUS = 5;
+
+        float kernel[2 * RADIUS + 1], kernelSum = 0;
+        for(int i = -RADIUS; i <= RADIUS; ++i)
+        {
+            kernel[i + RADIUS] = std::exp(-float(i * i) / (2 * 1.5f * 1.5f));
+            kernelSum += kernel[i + RADIUS];
+        }
+
+        std::vector<float> temp(image.size()), result(image.size());
+        for(int y = 0; y < size.y; ++y)
+        {
+            for(int x = 0; x < size.x; ++x)
+            {
+                float sum = 0;
+                for(int i = -RADIUS; i <= RADIUS; ++i)
+                {
+                    const int qx = (std::min)((std::max)(x + i, 0), size.x - 1);
+                    sum += kernel[i + RADIUS] * image[y * size.x + qx];
+                }
+                temp[y * size.x + x] = sum / kernelSum;
+            }
+        }
+        for(int y = 0; y < size.y; ++y)
+        {
+            for(int x = 0; x < size.x; ++x)
+            {
+                float sum = 0;
+                for(int i = -RADIUS; i <= RADIUS; ++i)
+                {
+                    const int qy = (std::min)((std::max)(y + i, 0), size.y - 1);
+                    sum += kernel[i + RADIUS] * temp[qy * size.x + x];
+                }
+                result[y * size.x + x] = sum / kernelSum;
+            }
+        }
+        return result;
+    }
+
+    // mean ssim (Wang et al.) of the display lumas
+    double computeSSIM(const std::vector<Float3> &image, const std::vector<Float3> &reference, const Int2 &size)
+    {
+        constexpr float C1 = 0.01f * 0.01f, C2 = 0.03f * 0.03f;
+
+        const std::vector<float> a = computeDisplayLuma(image);
+        const std::vector<float> b = computeDisplayLuma(reference);
+
+        std::vector<float> aa(a.size()), bb(a.size()), ab(a.size());
+        for(size_t i = 0; i < a.size(); ++i)
+        {
+            aa[i] = a[i] * a[i];
+            bb[i] = b[i] * b[i];
+            ab[i] = a[i] * b[i];
+        }
+
+        const auto muA = blur(a, size), muB = blur(b, size);
+        const auto sAA = blur(aa, size), sBB = blur(bb, size), sAB = blur(ab, size);
+
+        double sum = 0;
+        for(size_t i = 0; i < a.size(); ++i)
+        {
+            const float varA  = sAA[i] - muA[i] * muA[i];
+            const float varB  = sBB[i] - muB[i] * muB[i];
+            const float covAB = sAB[i] - muA[i] * muB[i];
+            sum += (2 * muA[i] * muB[i] + C1) * (2 * covAB + C2) /
+                   ((muA[i] * muA[i] + muB[i] * muB[i] + C1) * (varA + varB + C2));
+        }
+        return sum / a.size();
+    }
+
+    void setupRenderer(CPUVolumeRenderer &renderer, const ToolScene &scene)
+    {
+        renderer.initialize(scene.size);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+    }
+
+    // records the spp at which value first reaches each target
+    void updateReached(
+        std::vector<int> &reached, const std::vector<double> &targets,
+        double value, bool lowerIsBetter, int spp)
+    {
+        for(size_t i = 0; i < targets.size(); ++i)
+        {
+            const bool hit = lowerIsBetter ? value <= targets[i] : value >= targets[i];
+            if(!reached[i] && hit)
+                reached[i] = spp;
+        }
+    }
+
+    void printReached(
+        const std::string &metric, const std::vector<double> &targets,
+        const std::vector<int> &raw, const std::vector<int> &denoised, int maxSpp)
+    {
+        for(size_t i = 0; i < targets.size(); ++i)
+        {
+            std::cout << "    " << metric << " " << targets[i] << ": raw ";
+            if(raw[i])
+                std::cout << raw[i] << " spp";
+            else
+                std::cout << "> " << maxSpp << " spp";
+
+            std::cout << ", denoised ";
+            if(denoised[i])
+                std::cout << denoised[i] << " spp";
+            else
+                std::cout << "> " << maxSpp << " spp";
+
+            if(raw[i] && denoised[i])
+                std::cout << " (" << double(raw[i]) / denoised[i] << "x fewer)";
+            std::cout << std::endl;
+        }
+    }
+}
+
+void benchDenoise(const ToolOptions &options)
+{
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    // a smaller default image than the other tools, for the reference
+    scene.size = Int2(options.getInt("width", 160), options.getInt("height", 120));
+    scene.camera.setWOverH(float(scene.size.x) / scene.size.y);
+    scene.camera.recalculateMatrics();
+
+    const int referenceFrames = options.getInt("reference-frames", 512);
+    const int maxFrames = options.getInt("max-frames", 128);
+    const std::vector<double> rmseRatios  = parseList(options.get("rmse-targets", "0.5,0.25,0.1"));
+    const std::vector<double> ssimTargets = parseList(options.get("ssim-targets", "0.9,0.95,0.98"));
+
+    ToolTimer timer;
+    CPUVolumeRenderer referenceRenderer;
+    setupRenderer(referenceRenderer, scene);
+    referenceRenderer.setSeed(1);
+    for(int i = 0; i < referenceFrames; ++i)
+        referenceRenderer.render();
+    const std::vector<Float3> reference = resolve(referenceRenderer.getOutput());
+
+    std::cout << scene.size.x << "x" << scene.size.y << " reference of "
+              << 2 * referenceFrames << " spp in " << timer.ms() << " ms" << std::endl;
+
+    CPUVolumeRenderer renderer;
+    setupRenderer(renderer, scene);
+
+    Denoiser denoiser;
+    denoiser.setParams(scene.denoiser);
+
+    // rmse targets are fractions of the rmse of the raw first frame. 0 in
+    // the reached spps is not reached yet
+
+    std::vector<double> rmseTargets;
+    std::vector<int> rawRMSESpp(rmseRatios.size()), denoisedRMSESpp(rmseRatios.size());
+    std::vector<int> rawSSIMSpp(ssimTargets.size()), denoisedSSIMSpp(ssimTargets.size());
+
+    std::vector<Float4> filtered;
+    double denoiseMs = 0;
+
+    for(int frame = 1; frame <= maxFrames; ++frame)
+    {
+        renderer.render();
+        const int spp = 2 * frame;
+
+        timer.restart();
+        denoiser.denoise(
+            scene.size, renderer.getOutput(), renderer.getMoments(),
+            renderer.getFeatures(), filtered);
+        denoiseMs += timer.ms();
+
+        const std::vector<Float3> rawImage = resolve(renderer.getOutput());
+        const std::vector<Float3> denoisedImage = resolve(filtered);
+
+        const double rawRMSE = computeRMSE(rawImage, reference);
+        const double rawSSIM = computeSSIM(rawImage, reference, scene.size);
+        const double denoisedRMSE = computeRMSE(denoisedImage, reference);
+        const double denoisedSSIM = computeSSIM(denoisedImage, reference, scene.size);
+
+        if(frame == 1)
+        {
+            for(double ratio : rmseRatios)
+                rmseTargets.push_back(ratio * rawRMSE);
+        }
+
+        updateReached(rawRMSESpp,      rmseTargets, rawRMSE,      true,  spp);
+        updateReached(rawSSIMSpp,      ssimTargets, rawSSIM,      false, spp);
+        updateReached(denoisedRMSESpp, rmseTargets, denoisedRMSE, true,  spp);
+        updateReached(denoisedSSIMSpp, ssimTargets, denoisedSSIM, false, spp);
+
+        if((frame & (frame - 1)) == 0)
+        {
+            std::cout << spp << " spp: raw rmse " << rawRMSE << " ssim " << rawSSIM
+                      << ", denoised rmse " << denoisedRMSE << " ssim " << denoisedSSIM << std::endl;
+        }
+    }
+
+    std::cout << "denoising " << denoiseMs / maxFrames << " ms/frame ("
+              << scene.denoiser.iterations << " iterations)" << std::endl
+              << "spp to reach:" << std::endl;
+    printReached("rmse", rmseTargets, rawRMSESpp, denoisedRMSESpp, 2 * maxFrames);
+    printReached("ssim", ssimTargets, rawSSIMSpp, denoisedSSIMSpp, 2 * maxFrames);
+}
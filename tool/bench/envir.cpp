@@ -0,0 +1,146 @@
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <agz-utils/thread.h>
+
+#include "bench.h"
+
+namespace
+{
+    using ImportanceTable = agz::texture::texture2d_t<float>;
+
+    // the previous builder: bilinear lookups over each patch window and a
+    // single atomic luminance sum shared by all workers
+    ImportanceTable computeImportanceReference(
+        const EnvirMap::Texels &data, const Int2 &sampleRes)
+    {
+        const int width = data.width(), height = data.height();
+        const int newWidth  = (std::min)(width, sampleRes.x);
+        const int newHeight = (std::min)(height, sampleRes.y);
+
+        std::atomic<float> lumSum = 0;
+        ImportanceTable probs(newHeight, newWidth);
+
+        agz::thread::parallel_forrange(0, newHeight, [&](int, int y)
+        {
+            const float y0 = float(y)     / float(newHeight);
+            const float y1 = float(y + 1) / float(newHeight);
+
+            const int ySrcBeg = (std::max)(0, int(std::floor(y0 * height) - 1));
+            const int ySrcLst = (std::min)(height - 1, int(std::floor(y1 * height) + 1));
+
+            for(int x = 0; x < newWidth; ++x)
+            {
+                const float x0 = float(x)     / newWidth;
+                const float x1 = float(x + 1) / newWidth;
+
+                const int xSrcBeg = (std::max)(0, int(std::floor(x0 * width) - 1));
+                const int xSrcLst = (std::min)(width - 1, int(std::floor(x1 * width) + 1));
+
+                float pixelLum = 0;
+                for(int ySrc = ySrcBeg; ySrc <= ySrcLst; ++ySrc)
+                {
+                    for(int xSrc = xSrcBeg; xSrc <= xSrcLst; ++xSrc)
+                    {
+                        const float u = (float(xSrc) + 0.5f) / float(width);
+                        const float v = (float(ySrc) + 0.5f) / float(height);
+
+                        const auto texel = agz::texture::linear_sample2d(
+                            Float2(u, v),
+                            [&](int xi, int yi) { return data(yi, xi); },
+                            width, height);
+
+                        pixelLum += texel.lum();
+                    }
+                }
+
+                const float deltaArea = std::abs(
+                    2 * PI * (x1 - x0) * (std::cos(PI * y1) - std::cos(PI * y0)));
+
+                const float areaLum = pixelLum * deltaArea;
+                probs(y, x) = areaLum;
+                agz::math::atomic_add(lumSum, areaLum);
+            }
+        });
+
+        if(lumSum > 0.001f)
+        {
+            const float ratio = 1 / lumSum;
+            for(int y = 0; y < newHeight; ++y)
+            {
+                for(int x = 0; x < newWidth; ++x)
+                    probs(y, x) *= ratio;
+            }
+        }
+
+        return probs;
+    }
+
+    std::vector<int> parseSizes(const std::string &str)
+    {
+        std::vector<int> sizes;
+        std::stringstream stream(str);
+        std::string item;
+        while(std::getline(stream, item, ','))
+            sizes.push_back(std::stoi(item));
+        return sizes;
+    }
+}
+
+void benchEnvir(const ToolOptions &options)
+{
+    const std::vector<int> widths = parseSizes(options.get("sizes", "2048,8192,16384"));
+    const int tableSize = options.getInt("table", 200);
+    const int repeats   = (std::max)(1, options.getInt("repeats", 3));
+
+    for(int width : widths)
+    {
+        const Int2 size(width, width / 2);
+        const EnvirMap::Texels texels = createProceduralSky(size);
+
+        std::cout << size.x << "x" << size.y << " -> "
+                  << tableSize << "x" << tableSize << ":" << std::endl;
+
+        // best of a few runs, as the first one also faults the pages in
+
+        double referenceMs = 1e30, builderMs = 1e30;
+        ImportanceTable reference, probs;
+        for(int i = 0; i < repeats; ++i)
+        {
+            ToolTimer timer;
+            reference = computeImportanceReference(texels, { tableSize, tableSize });
+            referenceMs = (std::min)(referenceMs, timer.ms());
+
+            timer.restart();
+            probs = computeEnvirImportance(texels, { tableSize, tableSize });
+            builderMs = (std::min)(builderMs, timer.ms());
+        }
+
+        ToolTimer aliasTimer;
+        AliasTable aliasTable;
+        aliasTable.initialize(probs.raw_data(), probs.size().product());
+        const double aliasMs = aliasTimer.ms();
+
+        float maxRelDiff = 0;
+        double sum = 0;
+        for(int y = 0; y < probs.height(); ++y)
+        {
+            for(int x = 0; x < probs.width(); ++x)
+            {
+                const float a = probs(y, x), b = reference(y, x);
+                sum += a;
+                if(b > 0)
+                    maxRelDiff = (std::max)(maxRelDiff, std::abs(a - b) / b);
+            }
+        }
+
+        std::cout << "    reference " << referenceMs << " ms, box filter "
+                  << builderMs << " ms (" << referenceMs / builderMs
+                  << "x), alias table " << aliasMs << " ms" << std::endl;
+        std::cout << "    max rel diff " << maxRelDiff
+                  << ", prob sum " << sum << std::endl;
+    }
+}
@@ -0,0 +1,149 @@
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "bench.h"
+
+namespace
+{
+    // flat (not run-length encoded) radiance rgbe file
+    void saveHDR(const std::string &filename, const EnvirMap::Texels &texels)
+    {
+        std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+        if(!fout)
+            throw std::runtime_error("failed to create file: " + filename);
+
+        fout << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n"
+             << "-Y " << texels.height() << " +X " << texels.width() << "\n";
+
+        std::vector<unsigned char> row(size_t(texels.width()) * 4);
+        for(int y = 0; y < texels.height(); ++y)
+        {
+            for(int x = 0; x < texels.width(); ++x)
+            {
+                const auto &c = texels(y, x);
+                const float m = (std::max)({ c.r, c.g, c.b });
+
+                unsigned char *rgbe = &row[4 * x];
+                if(m < 1e-32f)
+                {
+                    rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+                    continue;
+                }
+
+                int e;
+                const float scale = std::frexp(m, &e) * 256 / m;
+                rgbe[0] = static_cast<unsigned char>(c.r * scale);
+                rgbe[1] = static_cast<unsigned char>(c.g * scale);
+                rgbe[2] = static_cast<unsigned char>(c.b * scale);
+                rgbe[3] = static_cast<unsigned char>(e + 128);
+            }
+            fout.write(
+                reinterpret_cast<const char *>(row.data()),
+                static_cast<std::streamsize>(row.size()));
+        }
+
+        if(!fout)
+            throw std::runtime_error("failed to write file: " + filename);
+    }
+}
+
+void benchEnvirCache(const ToolOptions &options)
+{
+    const std::string cacheDir = options.get("cache-dir", "./envir_cache_bench");
+    const int width   = options.getInt("width", 8192);
+    const int repeats = (std::max)(1, options.getInt("repeats", 3));
+    const int warpSize = options.getInt("envir-warp-size", 1024);
+    const Int2 sampleRes(200, 200);
+
+    // without --envir a procedural sky is written to an .hdr first
+
+    std::string filename = options.get("envir", "");
+    const bool ownsFile = filename.empty();
+    if(ownsFile)
+    {
+        filename = "./envir_cache_bench.hdr";
+        saveHDR(filename, createProceduralSky({ width, width / 2 }));
+    }
+
+    std::filesystem::remove_all(cacheDir);
+
+    std::cout << filename << ": " << std::filesystem::file_size(filename) / (1024.0 * 1024.0)
+              << " MB" << std::endl;
+
+    // best of a few runs of each path. the cold path clears the cache first
+
+    double uncachedMs = 1e30, coldMs = 1e30, hashMs = 1e30, hitMs = 1e30, hitCopyMs = 1e30;
+    double uncachedWarpMs = 1e30, hitWarpCopyMs = 1e30;
+    bool coldHit = true, warmHit = false, sameWarp = true;
+    for(int i = 0; i < repeats; ++i)
+    {
+        ToolTimer timer;
+        {
+            EnvirMap map;
+            map.load(filename, sampleRes);
+        }
+        uncachedMs = (std::min)(uncachedMs, timer.ms());
+
+        EnvirMap uncachedWarp;
+        uncachedWarp.setSampling(EnvirSampling::MipWarp, warpSize);
+        timer.restart();
+        uncachedWarp.load(filename, sampleRes);
+        uncachedWarpMs = (std::min)(uncachedWarpMs, timer.ms());
+
+        std::filesystem::remove_all(cacheDir);
+        EnvirCache cache(cacheDir);
+
+        timer.restart();
+        cache.load(filename, sampleRes, warpSize, &coldHit);
+        coldMs = (std::min)(coldMs, timer.ms());
+
+        timer.restart();
+        hashFileContent(filename);
+        hashMs = (std::min)(hashMs, timer.ms());
+
+        // what the demo does on a hit: the mapped blob is uploaded as it is
+        timer.restart();
+        const EnvirCacheFile file = cache.load(filename, sampleRes, warpSize, &warmHit);
+        hitMs = (std::min)(hitMs, timer.ms());
+
+        // the cpu renderer copies it into an EnvirMap
+        timer.restart();
+        EnvirMap map;
+        map.initialize(file);
+        hitCopyMs = (std::min)(hitCopyMs, timer.ms());
+
+        // in mip-warp mode the cached pyramid is copied too
+        EnvirMap warpMap;
+        warpMap.setSampling(EnvirSampling::MipWarp, warpSize);
+        timer.restart();
+        warpMap.initialize(file);
+        hitWarpCopyMs = (std::min)(hitWarpCopyMs, timer.ms());
+
+        const EnvirMipWarp &a = warpMap.getMipWarp(), &b = uncachedWarp.getMipWarp();
+        sameWarp &= a.getLevelCount() == b.getLevelCount();
+        for(int level = 0; sameWarp && level < a.getLevelCount(); ++level)
+            sameWarp &= a.getLevel(level) == b.getLevel(level);
+    }
+
+    size_t cacheBytes = 0;
+    for(auto &entry : std::filesystem::directory_iterator(cacheDir))
+        cacheBytes += entry.file_size();
+
+    std::cout << "uncached load " << uncachedMs << " ms" << std::endl;
+    std::cout << "cold cached load " << coldMs << " ms (" << (coldHit ? "hit" : "miss")
+              << "), entry " << cacheBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    std::cout << "cache hit " << hitMs << " ms (" << (warmHit ? "hit" : "miss")
+              << ", of which content hash " << hashMs << " ms), "
+              << uncachedMs / hitMs << "x faster than uncached" << std::endl;
+    std::cout << "cache hit copied to EnvirMap " << hitMs + hitCopyMs << " ms" << std::endl;
+    std::cout << "mip-warp: uncached load " << uncachedWarpMs << " ms, cache hit copied "
+              << hitMs + hitWarpCopyMs << " ms, pyramid identical to a rebuilt one "
+              << sameWarp << std::endl;
+
+    std::filesystem::remove_all(cacheDir);
+    if(ownsFile)
+        std::filesystem::remove(filename);
+}
@@ -0,0 +1,214 @@
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "../../src/core/rng.h"
+#include "bench.h"
+
+namespace
+{
+    struct SamplingStats
+    {
+        double ns          = 0; // per sample
+        double mean        = 0; // of lum / pdf, relative to the reference
+        double relVariance = 0; // per sample, relative to the squared reference
+        double pdfMismatch = 0; // fraction of samples whose pdfEnvirLight is off by > 1e-3
+        int    zeroPdfs    = 0; // sampled directions with a zero pdf
+    };
+
+    std::vector<int> parseList(const std::string &str)
+    {
+        std::vector<int> result;
+        std::stringstream stream(str);
+        std::string item;
+        while(std::getline(stream, item, ','))
+            result.push_back(std::stoi(item));
+        return result;
+    }
+
+    Float3 sampleSphere(uint32_t &rng)
+    {
+        const float z = 2 * randFloat(rng) - 1;
+        const float r = std::sqrt((std::max)(0.0f, 1 - z * z));
+        const float phi = 2 * PI * randFloat(rng);
+        return Float3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    float luminance(const Float3 &c)
+    {
+        return agz::math::color3f(c.x, c.y, c.z).lum();
+    }
+
+    // integral of the luminance over the sphere: bilinear lookups at texel
+    // centers return the texels
+    double computeReference(const EnvirMap::Texels &texels)
+    {
+        const int width = texels.width(), height = texels.height();
+
+        double result = 0;
+        for(int y = 0; y < height; ++y)
+        {
+            const double solidAngle = 2 * PI / width * std::abs(
+                std::cos(PI * (y + 1.0) / height) - std::cos(PI * double(y) / height));
+
+            double rowSum = 0;
+            for(int x = 0; x < width; ++x)
+                rowSum += texels(y, x).lum();
+            result += rowSum * solidAngle;
+        }
+        return result;
+    }
+
+    SamplingStats runSampling(const EnvirMap &envir, int samples, double reference)
+    {
+        SamplingStats stats;
+        uint32_t rng = 1;
+
+        std::vector<Float3> dirs(samples);
+        std::vector<float>  pdfs(samples);
+
+        ToolTimer timer;
+        for(int i = 0; i < samples; ++i)
+            envir.sampleEnvirLight(rng, dirs[i], pdfs[i]);
+        stats.ns = timer.ms() * 1e6 / samples;
+
+        double sum = 0, sum2 = 0;
+        for(int i = 0; i < samples; ++i)
+        {
+            if(pdfs[i] <= 0)
+            {
+                ++stats.zeroPdfs;
+                continue;
+            }
+
+            // only directions rounding into a neighbor patch may disagree
+            const float pdf = envir.pdfEnvirLight(dirs[i]);
+            if(std::abs(pdf - pdfs[i]) > 1e-3f * pdfs[i])
+                stats.pdfMismatch += 1.0 / samples;
+
+            const double value = luminance(envir.evalEnvirLight(dirs[i])) / pdfs[i];
+            sum  += value;
+            sum2 += value * value;
+        }
+
+        const double mean = sum / samples;
+        stats.mean        = mean / reference;
+        stats.relVariance = (sum2 / samples - mean * mean) / (reference * reference);
+        return stats;
+    }
+
+    // directions with radiance but a zero pdf, which light sampling misses
+    int countUncovered(const EnvirMap &envir, int count)
+    {
+        uint32_t rng = 7;
+        int result = 0;
+        for(int i = 0; i < count; ++i)
+        {
+            const Float3 dir = sampleSphere(rng);
+            if(luminance(envir.evalEnvirLight(dir)) > 0 && envir.pdfEnvirLight(dir) <= 0)
+                ++result;
+        }
+        return result;
+    }
+
+    void printStats(const std::string &name, double buildMs, const SamplingStats &s, int uncovered)
+    {
+        std::cout << "    " << name << ": build " << buildMs << " ms, "
+                  << s.ns << " ns/sample, mean " << s.mean
+                  << ", rel variance " << s.relVariance
+                  << ", pdf mismatches " << s.pdfMismatch
+                  << ", zero pdfs " << s.zeroPdfs
+                  << ", uncovered " << uncovered << std::endl;
+    }
+}
+
+void benchEnvirSampling(const ToolOptions &options)
+{
+    const std::vector<int> widths    = parseList(options.get("sizes", "2048,8192"));
+    const std::vector<int> warpSizes = parseList(options.get("warp-sizes", "256,1024,4096"));
+    const int tableSize = options.getInt("table", 200);
+    const int samples   = options.getInt("samples", 1000000);
+    const int coverage  = options.getInt("coverage", 1000000);
+
+    for(int width : widths)
+    {
+        const Int2 size(width, width / 2);
+        const EnvirMap::Texels texels = createProceduralSky(size);
+        const double reference = computeReference(texels);
+
+        std::cout << size.x << "x" << size.y << " procedural sky:" << std::endl;
+
+        // alias table, as built by EnvirMap::initialize
+
+        {
+            ToolTimer timer;
+            const auto probs = computeEnvirImportance(texels, { tableSize, tableSize });
+            AliasTable aliasTable;
+            aliasTable.initialize(probs.raw_data(), probs.size().product());
+            const double buildMs = timer.ms();
+
+            EnvirMap envir;
+            envir.initialize(texels, { tableSize, tableSize });
+
+            printStats(
+                "alias " + std::to_string(tableSize) + "^2", buildMs,
+                runSampling(envir, samples, reference), countUncovered(envir, coverage));
+        }
+
+        for(int warpSize : warpSizes)
+        {
+            const int actualSize = EnvirMipWarp::getTableSize(size, warpSize);
+            if(actualSize != warpSize)
+                continue;
+
+            ToolTimer timer;
+            EnvirMipWarp warp;
+            warp.build(texels, warpSize);
+            const double buildMs = timer.ms();
+
+            EnvirMap envir;
+            envir.setSampling(EnvirSampling::MipWarp, warpSize);
+            envir.initialize(texels, { tableSize, tableSize });
+
+            printStats(
+                "mip-warp " + std::to_string(warpSize) + "^2", buildMs,
+                runSampling(envir, samples, reference), countUncovered(envir, coverage));
+
+            // a local edit, e.g. a moved sun: a 64^2 texel block brightened,
+            // then the pyramid updated against rebuilt from scratch
+
+            EnvirMap::Texels edited = texels;
+            const Int2 lower(size.x / 3, size.y / 4);
+            const Int2 upper = lower + Int2((std::min)(64, size.x - lower.x) - 1,
+                                            (std::min)(64, size.y - lower.y) - 1);
+            for(int y = lower.y; y <= upper.y; ++y)
+            {
+                for(int x = lower.x; x <= upper.x; ++x)
+                    edited(y, x) = agz::math::color3f(100, 100, 100);
+            }
+
+            timer.restart();
+            warp.update(edited, lower, upper);
+            const double updateMs = timer.ms();
+
+            timer.restart();
+            EnvirMipWarp rebuilt;
+            rebuilt.build(edited, warpSize);
+            const double rebuildMs = timer.ms();
+
+            float maxDiff = 0;
+            for(int level = 0; level < warp.getLevelCount(); ++level)
+            {
+                const auto &a = warp.getLevel(level);
+                const auto &b = rebuilt.getLevel(level);
+                for(size_t i = 0; i < a.size(); ++i)
+                    maxDiff = (std::max)(maxDiff, std::abs(a[i] - b[i]) / (std::max)(1e-20f, b[i]));
+            }
+
+            std::cout << "        64^2 texel edit: update " << updateMs
+                      << " ms, rebuild " << rebuildMs
+                      << " ms, max rel diff " << maxDiff << std::endl;
+        }
+    }
+}
@@ -0,0 +1,178 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "bench.h"
+
+namespace
+{
+    void setupRenderer(CPUVolumeRenderer &renderer, const ToolScene &scene)
+    {
+        renderer.initialize(scene.size);
+        renderer.setSimdLevel(SimdLevel::Scalar);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+        renderer.setDirectLight(scene.direct);
+    }
+
+    struct Stats
+    {
+        double sampleVariance = 0; // of the luminance of a sample, mean over pixels
+        double mean           = 0; // of the pixel luminances
+        double meanError      = 0; // standard error of mean
+    };
+
+    // of the samples added to the output since previous / previousMoments
+    Stats computeStats(
+        const std::vector<Float4> &output,   const std::vector<Float2> &moments,
+        const std::vector<Float4> &previous, const std::vector<Float2> &previousMoments)
+    {
+        Stats stats;
+        double meanVariance = 0;
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const double n  = output[i].w - previous[i].w;
+            const double m1 = (moments[i].x - previousMoments[i].x) / n;
+            const double m2 = (moments[i].y - previousMoments[i].y) / n;
+            const double variance = n > 1 ? (std::max)(0.0, m2 - m1 * m1) * n / (n - 1) : 0.0;
+
+            stats.sampleVariance += variance;
+            stats.mean           += m1;
+            meanVariance         += variance / n;
+        }
+        stats.sampleVariance /= output.size();
+        stats.mean           /= output.size();
+        stats.meanError       = std::sqrt(meanVariance) / output.size();
+        return stats;
+    }
+
+    // renders frames, returning the statistics of their samples alone and
+    // the mean frame time
+    Stats renderFrames(CPUVolumeRenderer &renderer, int frames, double &ms)
+    {
+        const std::vector<Float4> previous = renderer.getOutput();
+        const std::vector<Float2> previousMoments = renderer.getMoments();
+
+        ms = 0;
+        for(int i = 0; i < frames; ++i)
+        {
+            renderer.render();
+            ms += renderer.getFrameMs();
+        }
+        ms /= frames;
+
+        return computeStats(renderer.getOutput(), renderer.getMoments(), previous, previousMoments);
+    }
+
+    // a tree refined evenly below a single cell, with the energy of one
+    // direction and a vanishing one of another, has empty halves and halves
+    // lost to rounding at every level. samples near the ends of the unit
+    // square must not land in them
+    void checkDegenerateTree()
+    {
+        const Float3 dir = Float3(0.01f, 0.001f, -1).normalize();
+
+        DirectionalTree stats;
+        stats.record(dir, 1);
+
+        DirectionalTree tree;
+        tree.build(stats, 0, 8);
+        tree.record(dir, 3.7f);
+        tree.record(Float3(0.01f, -0.001f, 1).normalize(), 1e-30f);
+
+        int bad = 0, count = 0;
+        for(int i = -32; i < 32; ++i)
+        {
+            for(int j = -32; j < 32; ++j)
+            {
+                const Float2 u(
+                    i < 0 ? (i + 32) * 0x1p-24f : 1 - (i + 1) * 0x1p-24f,
+                    j < 0 ? (j + 32) * 0x1p-24f : 1 - (j + 1) * 0x1p-24f);
+                float pdf;
+                const Float3 d = tree.sample(u, pdf);
+                if(!std::isfinite(d.x) || !std::isfinite(d.y) || !std::isfinite(d.z) ||
+                   !(pdf > 0) || !std::isfinite(pdf))
+                    ++bad;
+                ++count;
+            }
+        }
+        std::cout << "samples of a tree with empty halves at " << tree.getNodeCount()
+                  << " nodes: " << bad << " of " << count << " invalid" << std::endl;
+    }
+}
+
+void benchGuiding(const ToolOptions &options)
+{
+    checkDegenerateTree();
+
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    // multiple scattering is what guiding is for, so paths are long by default
+    scene.size = Int2(options.getInt("width", 160), options.getInt("height", 120));
+    scene.maxDepth = options.getInt("depth", 32);
+    scene.camera.setWOverH(float(scene.size.x) / scene.size.y);
+    scene.camera.recalculateMatrics();
+
+    const int frames = options.getInt("frames", 16);
+
+    PathGuidingParams params = scene.guiding;
+    params.enabled = true;
+
+    std::cout << scene.size.x << "x" << scene.size.y << ", depth " << scene.maxDepth
+              << ", direct light " << getDirectLightSamplingName(scene.direct.sampling)
+              << ", guide fraction " << params.guideFraction << std::endl;
+
+    CPUVolumeRenderer unguided;
+    setupRenderer(unguided, scene);
+    unguided.render();
+
+    double unguidedMs;
+    const Stats base = renderFrames(unguided, frames, unguidedMs);
+    std::cout << "unguided: variance " << base.sampleVariance << ", "
+              << unguidedMs << " ms/frame" << std::endl;
+
+    // each training pass samples the distributions of the previous one, so
+    // its variance shows how far they have converged
+
+    CPUVolumeRenderer guided;
+    setupRenderer(guided, scene);
+    guided.setPathGuiding(params);
+
+    std::cout << "training passes:" << std::endl;
+    for(int pass = 0; pass < params.trainingIterations; ++pass)
+    {
+        const int passFrames = params.firstIterationFrames << pass;
+
+        double ms;
+        const Stats stats = renderFrames(guided, passFrames, ms);
+        const PathGuide &guide = guided.getPathGuide();
+
+        std::cout << "    pass " << pass << ": " << passFrames << " frames, "
+                  << guide.getRecordedSampleCount() << " samples recorded, "
+                  << guide.getLeafCount() << " spatial leaves, "
+                  << guide.getDirectionalNodeCount() << " directional nodes, variance "
+                  << stats.sampleVariance << " (" << stats.sampleVariance / base.sampleVariance
+                  << "x unguided), " << ms << " ms/frame" << std::endl;
+    }
+
+    // the learned distributions, frozen
+
+    double guidedMs;
+    const Stats stats = renderFrames(guided, frames, guidedMs);
+
+    const double z = (stats.mean - base.mean) /
+        std::sqrt(stats.meanError * stats.meanError + base.meanError * base.meanError + 1e-30);
+
+    std::cout << "after training, " << 2 * frames << " spp:" << std::endl
+              << "    variance " << base.sampleVariance << " vs " << stats.sampleVariance
+              << " guided (" << base.sampleVariance / stats.sampleVariance << "x lower)" << std::endl
+              << "    " << unguidedMs << " vs " << guidedMs << " ms/frame, variance x time "
+              << (stats.sampleVariance * guidedMs) / (base.sampleVariance * unguidedMs)
+              << " of unguided" << std::endl
+              << "    mean " << base.mean << " +- " << base.meanError << " vs " << stats.mean
+              << " +- " << stats.meanError << " guided (z = " << z << ")" << std::endl;
+}
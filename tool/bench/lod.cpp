@@ -0,0 +1,276 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "../../src/core/rng.h"
+#include "bench.h"
+
+namespace
+{
+    // set-associative lru cache of 64 byte lines, fed with voxel addresses
+    class CacheModel
+    {
+    public:
+
+        CacheModel(size_t bytes, int ways)
+            : ways_(ways), sets_(bytes / 64 / ways), tags_(sets_ * ways, ~uint64_t(0))
+        {
+
+        }
+
+        void access(uint64_t address)
+        {
+            const uint64_t line = address / 64;
+            uint64_t *set = &tags_[(line % sets_) * ways_];
+
+            ++accesses_;
+            int hit = ways_ - 1;
+            for(int i = 0; i < ways_; ++i)
+            {
+                if(set[i] == line)
+                {
+                    hit = i;
+                    break;
+                }
+            }
+            if(set[hit] != line)
+                ++misses_;
+
+            // move to the front, dropping the last way on a miss
+            for(int i = hit; i > 0; --i)
+                set[i] = set[i - 1];
+            set[0] = line;
+        }
+
+        double getMissRate() const
+        {
+            return double(misses_) / (std::max<uint64_t>)(1, accesses_);
+        }
+
+    private:
+
+        int    ways_;
+        size_t sets_;
+
+        std::vector<uint64_t> tags_;
+
+        uint64_t accesses_ = 0;
+        uint64_t misses_   = 0;
+    };
+
+    // feeds the 8 voxels read by trilinear filtering at a level, with the
+    // levels laid out one after another like a mipped texture
+    void touchVoxels(
+        const DensityMipChain &mips, const std::vector<uint64_t> &levelBases,
+        const Float3 &uvw, int level, CacheModel &l1, CacheModel &l2)
+    {
+        const Int3 &size = mips.getSize(level);
+        const int   sizes[3]  = { size.x, size.y, size.z };
+        const float coords[3] = { uvw.x, uvw.y, uvw.z };
+
+        int i0[3], i1[3];
+        for(int i = 0; i < 3; ++i)
+        {
+            const int ix = static_cast<int>(std::floor(coords[i] * sizes[i] - 0.5f));
+            i0[i] = (std::max)(0, (std::min)(sizes[i] - 1, ix));
+            i1[i] = (std::max)(0, (std::min)(sizes[i] - 1, ix + 1));
+        }
+
+        for(int z : { i0[2], i1[2] })
+        {
+            for(int y : { i0[1], i1[1] })
+            {
+                for(int x : { i0[0], i1[0] })
+                {
+                    const uint64_t address = levelBases[level] +
+                        ((uint64_t(z) * size.y + y) * size.x + x) * sizeof(float);
+                    l1.access(address);
+                    l2.access(address);
+                }
+            }
+        }
+    }
+
+    // lookups along random rays with exponential steps, like delta tracking
+    std::vector<Float3> generateLookups(const VolumeMedium &medium, int count)
+    {
+        std::vector<Float3> result;
+        result.reserve(count);
+
+        const Float3 extent = medium.getUpper() - medium.getLower();
+        const float meanStep = 1 / (std::max)(0.001f, medium.getMaxDensity());
+
+        uint32_t rng = 1;
+        while(static_cast<int>(result.size()) < count)
+        {
+            const Float3 a(randFloat(rng), randFloat(rng), randFloat(rng));
+            const Float3 b(randFloat(rng), randFloat(rng), randFloat(rng));
+            const float length = ((b - a) * extent).length();
+
+            float t = 0;
+            while(static_cast<int>(result.size()) < count)
+            {
+                t -= std::log(1 - randFloat(rng)) * meanStep;
+                if(t >= length)
+                    break;
+                result.push_back(a + (t / length) * (b - a));
+            }
+        }
+
+        return result;
+    }
+
+    // mean residual and ratio tracking transmittance along random chords of
+    // the bounds at a level. residual tracking must fall back rather than
+    // weigh coarser densities against the level 0 majorant cells
+    void compareTransmittance(const VolumeMedium &medium, float lod, int rayCount, int estimates)
+    {
+        const VolumeMedium lodMedium = medium.atLod(lod);
+        const Float3 lower = medium.getLower(), extent = medium.getUpper() - lower;
+
+        uint32_t rayRng = 3, ratioRng = 5, residualRng = 11;
+        double ratio = 0, ratio2 = 0, residual = 0, residual2 = 0;
+        for(int i = 0; i < rayCount; ++i)
+        {
+            const Float3 a = lower + extent * Float3(randFloat(rayRng), randFloat(rayRng), randFloat(rayRng));
+            const Float3 b = lower + extent * Float3(randFloat(rayRng), randFloat(rayRng), randFloat(rayRng));
+            for(int j = 0; j < estimates; ++j)
+            {
+                const double r = lodMedium.estimateTransmittanceRoulette(a, b, ratioRng);
+                const double s = lodMedium.estimateTransmittanceResidual(a, b, residualRng);
+                ratio     += r;
+                ratio2    += r * r;
+                residual  += s;
+                residual2 += s * s;
+            }
+        }
+
+        const double n = double(rayCount) * estimates;
+        const double ratioMean = ratio / n, residualMean = residual / n;
+        const double variance = ((std::max)(0.0, ratio2 / n - ratioMean * ratioMean) +
+                                 (std::max)(0.0, residual2 / n - residualMean * residualMean)) / (n - 1);
+        const double z = (residualMean - ratioMean) / std::sqrt(variance + 1e-30);
+
+        std::cout << "transmittance at lod " << lod << ": ratio " << ratioMean << ", residual "
+                  << residualMean << " (z = " << z << ")" << std::endl;
+    }
+}
+
+void benchLod(const ToolOptions &options)
+{
+    const int lookupCount = options.getInt("lookups", 4000000);
+    const int frames      = options.getInt("frames", 4);
+
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    ToolTimer buildTimer;
+    DensityMipChain mips;
+    mips.build(scene.density);
+    const double buildMs = buildTimer.ms();
+
+    std::cout << mips.getLevelCount() << " levels built in " << buildMs << " ms, "
+              << mips.getByteSize() / 1024.0 << " KB of mean and max mips above "
+              << scene.density.getByteSize() / 1024.0 << " KB" << std::endl;
+
+    // the max mips are conservative majorants of the full resolution
+    float maxViolation = 0;
+    for(int level = 1; level < mips.getLevelCount(); ++level)
+    {
+        const Int3 &size = mips.getSize(level);
+        uint32_t rng = 7;
+        for(int i = 0; i < 20000; ++i)
+        {
+            const Float3 uvw(randFloat(rng), randFloat(rng), randFloat(rng));
+            const int x = (std::min)(size.x - 1, static_cast<int>(uvw.x * size.x));
+            const int y = (std::min)(size.y - 1, static_cast<int>(uvw.y * size.y));
+            const int z = (std::min)(size.z - 1, static_cast<int>(uvw.z * size.z));
+            maxViolation = (std::max)(
+                maxViolation, mips.sample(uvw, 0) - mips.getMajorant(level, x, y, z));
+        }
+    }
+    std::cout << "max mip majorant violation " << maxViolation << std::endl;
+
+    // lookups at fixed levels
+
+    const std::vector<Float3> lookups = generateLookups(scene.medium, lookupCount);
+
+    std::vector<uint64_t> levelBases(mips.getLevelCount());
+    for(int level = 1; level < mips.getLevelCount(); ++level)
+    {
+        const Int3 &size = mips.getSize(level - 1);
+        levelBases[level] = levelBases[level - 1] + size.product() * sizeof(float);
+    }
+
+    double baseRate = 0;
+    for(int level = 0; level < (std::min)(4, mips.getLevelCount()); ++level)
+    {
+        CacheModel l1(32 << 10, 8), l2(256 << 10, 8);
+        for(auto &p : lookups)
+            touchVoxels(mips, levelBases, p, level, l1, l2);
+
+        double sum = 0;
+        ToolTimer timer;
+        for(auto &p : lookups)
+            sum += mips.sample(p, level);
+        const double rate = lookups.size() / timer.ms() / 1000;
+        if(!level)
+            baseRate = rate;
+
+        const Int3 &size = mips.getSize(level);
+        std::cout << "level " << level << " (" << size.x << "x" << size.y << "x" << size.z
+                  << "): " << rate << " M lookups/s (" << rate / baseRate
+                  << "x), simulated miss rate L1 32K " << 100 * l1.getMissRate()
+                  << "%, L2 256K " << 100 * l2.getMissRate()
+                  << "% (sum " << sum << ")" << std::endl;
+    }
+
+    // residual tracking against ratio tracking with lod on
+    const int rayCount = options.getInt("rays", 4000);
+    for(float lod : { 0.0f, 0.5f, 1.0f, 2.0f, 3.0f })
+        compareTransmittance(scene.medium, lod, rayCount, 16);
+
+    // renders with the same random sequences, compared to full resolution
+
+    std::vector<Float4> reference;
+    for(auto mode : { DensityLodMode::Off, DensityLodMode::Depth, DensityLodMode::Footprint })
+    {
+        DensityLodParams lod = scene.lod;
+        lod.mode = mode;
+
+        CPUVolumeRenderer renderer;
+        renderer.initialize(scene.size);
+        renderer.setSimdLevel(SimdLevel::Scalar);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setDensityLod(lod);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+
+        ToolTimer timer;
+        for(int i = 0; i < frames; ++i)
+            renderer.render();
+        const double rate = renderer.getPathCount() / (timer.ms() / 1000);
+
+        double meanDiff = 0;
+        const auto &output = renderer.getOutput();
+        if(reference.empty())
+        {
+            reference = output;
+        }
+        else
+        {
+            for(size_t i = 0; i < output.size(); ++i)
+            {
+                const Float4 d = output[i] - reference[i];
+                meanDiff += (std::abs(d.x) + std::abs(d.y) + std::abs(d.z)) / 3 / output[i].w;
+            }
+            meanDiff /= output.size();
+        }
+
+        std::cout << "render, lod " << getDensityLodModeName(mode) << ": "
+                  << rate << " paths/sec, mean abs diff to full resolution "
+                  << meanDiff << std::endl;
+    }
+}
@@ -0,0 +1,75 @@
+#include <cstring>
+#include <iostream>
+
+#include "bench.h"
+
+namespace
+{
+    struct Benchmark
+    {
+        const char *name;
+        const char *desc;
+        void (*func)(const ToolOptions &);
+    };
+
+    const Benchmark BENCHMARKS[] =
+    {
+        { "tracking",      "density lookups of global vs local majorant tracking", &benchTracking      },
+        { "decomposition", "density lookups and time of decomposition tracking, dense and sparse", &benchDecomposition },
+        { "simd",          "paths/sec per core of scalar and packet tracing",      &benchSimd          },
+        { "transmittance", "variance x cost of shadow ray transmittance estimators", &benchTransmittance },
+        { "bricks",        "memory and lookup throughput of dense vs bricked density", &benchBricks        },
+        { "streaming",     "hit rate, bytes paged and stalls of the brick cache",   &benchStreaming     },
+        { "quantize",      "memory and error of quantized density and albedo",      &benchQuantize      },
+        { "lod",           "cache misses and throughput of density mip lookups",    &benchLod           },
+        { "envir",         "build time of the environment importance table",        &benchEnvir         },
+        { "envir-cache",   "cold and cache-hit load times of an environment map",   &benchEnvirCache    },
+        { "envir-sampling", "build time, pdf checks and variance of envir sampling", &benchEnvirSampling },
+        { "scheduler",     "scaling, overhead and priorities of the task scheduler", &benchScheduler     },
+        { "adaptive",      "time to a target rmse of uniform vs adaptive sampling",  &benchAdaptive      },
+        { "samplers",      "error vs spp of random and low-discrepancy samplers",   &benchSamplers      },
+        { "denoise",       "spp to a target rmse / ssim of raw vs denoised output", &benchDenoise       },
+        { "reprojection",  "error per frame of a camera orbit, discard vs reproject", &benchReprojection  },
+        { "resolution",    "frame time and error of whole vs dynamic resolution frames", &benchResolution    },
+        { "restir",        "bias and equal-time error of envir reservoir resampling", &benchReSTIR        },
+        { "mis",           "variance x time of light, mis and product direct light sampling over g", &benchMIS           },
+        { "guiding",       "variance per training pass and after it of path guiding", &benchGuiding       },
+        { "trans-cache",   "bias, error and speed of the cached envir transmittance", &benchTransCache    },
+    };
+
+    void printUsage()
+    {
+        std::cout << "usage: VolumeBench <benchmark> [--key value]..." << std::endl;
+        for(auto &b : BENCHMARKS)
+            std::cout << "    " << b.name << ": " << b.desc << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        printUsage();
+        return 1;
+    }
+
+    for(auto &b : BENCHMARKS)
+    {
+        if(std::strcmp(b.name, argv[1]))
+            continue;
+
+        try
+        {
+            b.func(ToolOptions(argc - 2, argv + 2));
+        }
+        catch(const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    printUsage();
+    return 1;
+}
@@ -0,0 +1,149 @@
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "bench.h"
+
+namespace
+{
+    std::vector<float> parseList(const std::string &str)
+    {
+        std::vector<float> result;
+        std::stringstream stream(str);
+        std::string item;
+        while(std::getline(stream, item, ','))
+            result.push_back(std::stof(item));
+        return result;
+    }
+
+    void setupRenderer(CPUVolumeRenderer &renderer, const ToolScene &scene)
+    {
+        renderer.initialize(scene.size);
+        renderer.setSimdLevel(SimdLevel::Scalar);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+    }
+
+    struct Stats
+    {
+        double sampleVariance = 0; // of the luminance of a sample, mean over pixels
+        double mean           = 0; // of the pixel luminances
+        double meanError      = 0; // standard error of mean
+    };
+
+    Stats computeStats(const std::vector<Float4> &output, const std::vector<Float2> &moments)
+    {
+        Stats stats;
+        double meanVariance = 0;
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const double n = output[i].w;
+            const double mean = moments[i].x / n;
+            const double variance = n > 1 ?
+                (std::max)(0.0, moments[i].y / n - mean * mean) * n / (n - 1) : 0.0;
+
+            stats.sampleVariance += variance;
+            stats.mean           += mean;
+            meanVariance         += variance / n;
+        }
+        stats.sampleVariance /= output.size();
+        stats.mean           /= output.size();
+        stats.meanError       = std::sqrt(meanVariance) / output.size();
+        return stats;
+    }
+
+    struct Config
+    {
+        const char       *name;
+        DirectLightParams params;
+    };
+}
+
+void benchMIS(const ToolOptions &options)
+{
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    scene.size = Int2(options.getInt("width", 160), options.getInt("height", 120));
+    scene.camera.setWOverH(float(scene.size.x) / scene.size.y);
+    scene.camera.recalculateMatrics();
+
+    const int frames = options.getInt("frames", 16);
+    const std::vector<float> gs = parseList(options.get("gs", "-0.9,0,0.5,0.9,0.99"));
+
+    std::vector<Config> configs;
+    configs.push_back({ "light", {} });
+
+    DirectLightParams params;
+    params.sampling         = DirectLightSampling::MIS;
+    params.heuristic        = MISHeuristic::Balance;
+    params.productTableSize = scene.direct.productTableSize;
+    configs.push_back({ "mis balance", params });
+
+    params.heuristic = MISHeuristic::Power;
+    configs.push_back({ "mis power", params });
+
+    params.sampling = DirectLightSampling::Product;
+    configs.push_back({ "product + mis power", params });
+
+    // the product pyramid is built once, outside of the timed frames
+    ToolTimer timer;
+    {
+        EnvirProductSampler product;
+        product.build(scene.envir, params.productTableSize);
+    }
+    std::cout << scene.size.x << "x" << scene.size.y << ", " << 2 * frames
+              << " spp per estimator, scalar tracer, depth " << scene.maxDepth
+              << ", product pyramid of " << params.productTableSize << "^2 built in "
+              << timer.ms() << " ms" << std::endl
+              << "luminance variance per sample x ms per sample, relative to light "
+                 "sampling (lower is better), and mean luminance against it:" << std::endl;
+
+    for(float g : gs)
+    {
+        scene.medium.setG(g);
+        std::cout << "g = " << g << ":" << std::endl;
+
+        double baseCost = 0;
+        Stats base;
+        for(size_t c = 0; c < configs.size(); ++c)
+        {
+            CPUVolumeRenderer renderer;
+            setupRenderer(renderer, scene);
+            renderer.setDirectLight(configs[c].params);
+
+            // the first frame builds the product pyramid
+            renderer.render();
+            double ms = 0;
+            for(int i = 1; i < frames; ++i)
+            {
+                renderer.render();
+                ms += renderer.getFrameMs();
+            }
+            ms /= frames - 1;
+
+            const Stats stats = computeStats(renderer.getOutput(), renderer.getMoments());
+            const double cost = stats.sampleVariance * ms;
+            if(c == 0)
+            {
+                base     = stats;
+                baseCost = cost;
+            }
+
+            std::cout << "    " << configs[c].name << ": variance " << stats.sampleVariance
+                      << ", " << ms << " ms/frame, variance x time " << cost / baseCost
+                      << ", mean " << stats.mean << " +- " << stats.meanError;
+            if(c)
+            {
+                std::cout << " (z = " << (stats.mean - base.mean) /
+                    std::sqrt(stats.meanError * stats.meanError + base.meanError * base.meanError + 1e-30)
+                          << ")";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
@@ -0,0 +1,140 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "../../src/core/rng.h"
+#include "bench.h"
+
+namespace
+{
+    struct Ray
+    {
+        Float3 uvwA, uvwB;
+        float  length;
+    };
+
+    std::vector<Ray> generateRays(const VolumeMedium &medium, int count)
+    {
+        std::vector<Ray> rays;
+        uint32_t rng = 1;
+
+        while(static_cast<int>(rays.size()) < count)
+        {
+            const Float3 a = Float3(randFloat(rng), randFloat(rng), randFloat(rng));
+            const Float3 b = Float3(randFloat(rng), randFloat(rng), randFloat(rng));
+            const Float3 extent = medium.getUpper() - medium.getLower();
+            rays.push_back({ a, b, ((b - a) * extent).length() });
+        }
+
+        return rays;
+    }
+
+    // exp(-optical depth) with midpoint quadrature at a quarter voxel
+    double computeTransmittance(const VolumeMedium &medium, const Ray &ray)
+    {
+        const Int3 &size = medium.getDensity()->getSize();
+        const Float3 voxels = (ray.uvwB - ray.uvwA) * Float3(
+            float(size.x), float(size.y), float(size.z));
+
+        const int steps = (std::max)(1, static_cast<int>(4 * voxels.length()));
+        const float dt = ray.length / steps;
+
+        double opticalDepth = 0;
+        for(int i = 0; i < steps; ++i)
+        {
+            const float t = (i + 0.5f) / steps;
+            opticalDepth += medium.sampleDensity(ray.uvwA + t * (ray.uvwB - ray.uvwA)) * dt;
+        }
+
+        return std::exp(-opticalDepth);
+    }
+}
+
+void benchQuantize(const ToolOptions &options)
+{
+    const int rayCount = options.getInt("rays", 4000);
+
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    const Grid &density = scene.density;
+    const size_t voxelCount = density.getVoxelCount();
+    const float  maxValue   = density.getMaxValue();
+
+    BrickGrid bricks;
+    bricks.build(density);
+
+    const std::vector<Ray> rays = generateRays(scene.medium, rayCount);
+    std::vector<double> reference(rays.size());
+    for(size_t i = 0; i < rays.size(); ++i)
+        reference[i] = computeTransmittance(scene.medium, rays[i]);
+
+    std::cout << "density " << density.getSize().x << "x" << density.getSize().y << "x"
+              << density.getSize().z << ", max " << maxValue << ", " << rays.size()
+              << " rays for transmittance at density scale "
+              << scene.medium.getDensityScale() << std::endl;
+
+    for(auto encoding : { DensityEncoding::Float32, DensityEncoding::Half,
+                          DensityEncoding::Unorm16, DensityEncoding::Unorm8 })
+    {
+        const Grid decoded = roundTripDensity(density, encoding);
+
+        double maxErr = 0, sumErr2 = 0;
+        for(size_t i = 0; i < voxelCount; ++i)
+        {
+            const double err = std::abs(double(decoded.getData()[i]) - density.getData()[i]);
+            maxErr   = (std::max)(maxErr, err);
+            sumErr2 += err * err;
+        }
+
+        VolumeMedium medium = scene.medium;
+        medium.setDensity(&decoded);
+
+        double maxTrErr = 0, sumTrErr = 0;
+        for(size_t i = 0; i < rays.size(); ++i)
+        {
+            const double err = std::abs(computeTransmittance(medium, rays[i]) - reference[i]);
+            maxTrErr  = (std::max)(maxTrErr, err);
+            sumTrErr += err;
+        }
+
+        const size_t texelSize  = getDensityTexelSize(encoding);
+        const double denseMB    = voxelCount * texelSize / (1024.0 * 1024.0);
+        const double bricksMB   = (double(bricks.getBrickCount()) * BRICK_VOXEL_COUNT * texelSize +
+            bricks.getBrickResolution().product() * sizeof(int32_t)) / (1024.0 * 1024.0);
+
+        std::cout << getDensityEncodingName(encoding)
+                  << ": dense " << denseMB << " MB (" << 4.0 / texelSize << "x smaller)"
+                  << ", bricked " << bricksMB << " MB"
+                  << ", voxel max err " << maxErr / maxValue * 100
+                  << "%, rmse " << std::sqrt(sumErr2 / voxelCount) / maxValue * 100
+                  << "% of max, transmittance mean err " << sumTrErr / rays.size()
+                  << ", max err " << maxTrErr << std::endl;
+    }
+
+    // albedo
+
+    const Grid &albedo = scene.albedo;
+    Float3 constant;
+    if(findConstantAlbedo(albedo, constant))
+    {
+        std::cout << "albedo: constant (" << constant.x << ", " << constant.y << ", "
+                  << constant.z << "), no texture instead of "
+                  << albedo.getByteSize() << " bytes" << std::endl;
+    }
+
+    const Grid decodedAlbedo = roundTripAlbedo(albedo, AlbedoEncoding::SRGB8);
+    double maxLinearErr = 0;
+    for(size_t i = 0; i < 4 * albedo.getVoxelCount(); ++i)
+    {
+        if(i % 4 == 3)
+            continue;
+        maxLinearErr = (std::max)(maxLinearErr, std::abs(
+            std::pow(double(decodedAlbedo.getData()[i]), 2.2) -
+            std::pow(double(albedo.getData()[i]), 2.2)));
+    }
+
+    std::cout << "albedo srgb8: " << albedo.getVoxelCount() * sizeof(uint32_t)
+              << " bytes instead of " << albedo.getByteSize()
+              << " (4x smaller), max linear err " << maxLinearErr << std::endl;
+}
@@ -0,0 +1,143 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "bench.h"
+
+namespace
+{
+    std::vector<Float3> resolve(const std::vector<Float4> &output)
+    {
+        std::vector<Float3> result(output.size());
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            result[i] = o.w > 0 ? Float3(o.x, o.y, o.z) / o.w : Float3(0);
+        }
+        return result;
+    }
+
+    double computeRMSE(const std::vector<Float4> &output, const std::vector<Float3> &reference)
+    {
+        double sum = 0;
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            const Float3 d = Float3(o.x, o.y, o.z) / o.w - reference[i];
+            sum += (d.x * d.x + d.y * d.y + d.z * d.z) / 3;
+        }
+        return std::sqrt(sum / output.size());
+    }
+
+    // orbit around the volume, starting at the camera of the tool scene
+    Camera createCamera(const ToolScene &scene, float angle)
+    {
+        Camera camera = scene.camera;
+        camera.setPosition(Float3(4 * std::sin(angle), 0, -4 * std::cos(angle)));
+        camera.setDirection(PI / 2 + angle, 0);
+        camera.recalculateMatrics();
+        return camera;
+    }
+
+    void setupRenderer(CPUVolumeRenderer &renderer, const ToolScene &scene)
+    {
+        renderer.initialize(scene.size);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+    }
+}
+
+void benchReprojection(const ToolOptions &options)
+{
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    scene.size = Int2(options.getInt("width", 160), options.getInt("height", 120));
+    scene.camera.setWOverH(float(scene.size.x) / scene.size.y);
+    scene.camera.recalculateMatrics();
+
+    const int referenceFrames = options.getInt("reference-frames", 128);
+    const int warmupFrames    = options.getInt("warmup-frames", 16);
+    const int motionFrames    = options.getInt("motion-frames", 16);
+    const float angleStep     = options.getFloat("angle-step", 0.01f);
+
+    TemporalReprojectionParams params;
+    params.enabled           = true;
+    params.maxHistorySamples = options.getInt("max-history", params.maxHistorySamples);
+    params.depthTolerance    = options.getFloat("depth-tolerance", params.depthTolerance);
+
+    // a reference of each camera of the path, the first one being the
+    // camera of the warmup frames
+
+    ToolTimer timer;
+    std::vector<std::vector<Float3>> references;
+    for(int k = 0; k <= motionFrames; ++k)
+    {
+        CPUVolumeRenderer renderer;
+        setupRenderer(renderer, scene);
+        renderer.setCamera(createCamera(scene, k * angleStep));
+        renderer.setSeed(1);
+        for(int i = 0; i < referenceFrames; ++i)
+            renderer.render();
+        references.push_back(resolve(renderer.getOutput()));
+    }
+
+    std::cout << scene.size.x << "x" << scene.size.y << " references of "
+              << 2 * referenceFrames << " spp for " << motionFrames + 1
+              << " cameras in " << timer.ms() << " ms" << std::endl
+              << warmupFrames << " frames at rest, then an orbit of " << angleStep
+              << " rad per frame" << std::endl;
+
+    std::vector<double> errors[2], ms[2];
+    for(int mode = 0; mode < 2; ++mode)
+    {
+        CPUVolumeRenderer renderer;
+        setupRenderer(renderer, scene);
+        if(mode)
+            renderer.setTemporalReprojection(params);
+
+        renderer.setCamera(createCamera(scene, 0));
+        for(int i = 0; i < warmupFrames; ++i)
+            renderer.render();
+        errors[mode].push_back(computeRMSE(renderer.getOutput(), references[0]));
+        ms[mode].push_back(0);
+
+        for(int k = 1; k <= motionFrames; ++k)
+        {
+            renderer.setCamera(createCamera(scene, k * angleStep));
+
+            timer.restart();
+            renderer.render();
+            ms[mode].push_back(timer.ms());
+
+            errors[mode].push_back(computeRMSE(renderer.getOutput(), references[k]));
+        }
+    }
+
+    std::cout << "rmse per frame, discard vs reproject (max history "
+              << params.maxHistorySamples << ", depth tolerance "
+              << params.depthTolerance << "):" << std::endl;
+
+    double sums[2] = { 0, 0 }, msSums[2] = { 0, 0 };
+    for(int k = 0; k <= motionFrames; ++k)
+    {
+        std::cout << "    " << (k ? "move " + std::to_string(k) : std::string("rest"))
+                  << ": " << errors[0][k] << " vs " << errors[1][k] << std::endl;
+        if(k)
+        {
+            for(int mode = 0; mode < 2; ++mode)
+            {
+                sums[mode]   += errors[mode][k];
+                msSums[mode] += ms[mode][k];
+            }
+        }
+    }
+
+    std::cout << "mean rmse while moving: " << sums[0] / motionFrames << " vs "
+              << sums[1] / motionFrames << " (" << sums[0] / sums[1] << "x)" << std::endl
+              << "ms/frame while moving: " << msSums[0] / motionFrames << " vs "
+              << msSums[1] / motionFrames << std::endl;
+}
@@ -0,0 +1,166 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "bench.h"
+
+namespace
+{
+    std::vector<Float3> resolve(const std::vector<Float4> &output)
+    {
+        std::vector<Float3> result(output.size());
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            result[i] = o.w > 0 ? Float3(o.x, o.y, o.z) / o.w : Float3(0);
+        }
+        return result;
+    }
+
+    double computeRMSE(const std::vector<Float3> &image, const std::vector<Float3> &reference)
+    {
+        double sum = 0;
+        for(size_t i = 0; i < image.size(); ++i)
+        {
+            const Float3 d = image[i] - reference[i];
+            sum += (d.x * d.x + d.y * d.y + d.z * d.z) / 3;
+        }
+        return std::sqrt(sum / image.size());
+    }
+
+    // orbit around the volume, starting at the camera of the tool scene
+    Camera createCamera(const ToolScene &scene, float angle)
+    {
+        Camera camera = scene.camera;
+        camera.setPosition(Float3(4 * std::sin(angle), 0, -4 * std::cos(angle)));
+        camera.setDirection(PI / 2 + angle, 0);
+        camera.recalculateMatrics();
+        return camera;
+    }
+
+    void setupRenderer(CPUVolumeRenderer &renderer, const ToolScene &scene)
+    {
+        renderer.initialize(scene.size);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+    }
+
+    struct FrameStats
+    {
+        double ms;
+        int    stride;
+        double rmse;
+    };
+}
+
+void benchResolution(const ToolOptions &options)
+{
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    scene.size = Int2(options.getInt("width", 160), options.getInt("height", 120));
+    scene.camera.setWOverH(float(scene.size.x) / scene.size.y);
+    scene.camera.recalculateMatrics();
+
+    const int referenceFrames = options.getInt("reference-frames", 64);
+    const int warmupFrames    = options.getInt("warmup-frames", 8);
+    const int motionFrames    = options.getInt("motion-frames", 8);
+    const int restFrames      = options.getInt("rest-frames", 8);
+    const float angleStep     = options.getFloat("angle-step", 0.02f);
+    const bool reproject      = options.getInt("reproject", 1) != 0;
+
+    TemporalReprojectionParams reprojection;
+    reprojection.enabled = reproject;
+
+    // references of the cameras of the orbit. the rest frames see the last
+
+    ToolTimer timer;
+    std::vector<std::vector<Float3>> references;
+    for(int k = 1; k <= motionFrames; ++k)
+    {
+        CPUVolumeRenderer renderer;
+        setupRenderer(renderer, scene);
+        renderer.setCamera(createCamera(scene, k * angleStep));
+        renderer.setSeed(1);
+        for(int i = 0; i < referenceFrames; ++i)
+            renderer.render();
+        references.push_back(resolve(renderer.getOutput()));
+    }
+
+    std::cout << scene.size.x << "x" << scene.size.y << " references of "
+              << 2 * referenceFrames << " spp for " << motionFrames
+              << " cameras in " << timer.ms() << " ms" << std::endl;
+
+    // the budget defaults to half of a whole frame
+
+    double fullFrameMs = 0;
+    std::vector<FrameStats> stats[2];
+    DynamicResolutionParams params;
+
+    for(int mode = 0; mode < 2; ++mode)
+    {
+        CPUVolumeRenderer renderer;
+        setupRenderer(renderer, scene);
+        renderer.setTemporalReprojection(reprojection);
+
+        renderer.setCamera(createCamera(scene, 0));
+        for(int i = 0; i < warmupFrames; ++i)
+        {
+            renderer.render();
+            if(!mode)
+                fullFrameMs += renderer.getFrameMs() / warmupFrames;
+        }
+
+        if(mode)
+        {
+            params.enabled       = true;
+            params.frameBudgetMs = options.getFloat("budget-ms", float(fullFrameMs / 2));
+            params.maxStride     = options.getInt("max-stride", params.maxStride);
+            renderer.setDynamicResolution(params);
+        }
+
+        std::vector<Float4> upsampled;
+        for(int k = 1; k <= motionFrames + restFrames; ++k)
+        {
+            renderer.setCamera(createCamera(scene, (std::min)(k, motionFrames) * angleStep));
+            renderer.render();
+
+            renderer.getUpsampledOutput(upsampled);
+            const double rmse = computeRMSE(
+                resolve(upsampled), references[(std::min)(k, motionFrames) - 1]);
+
+            stats[mode].push_back({ renderer.getFrameMs(), renderer.getInterleaveStride(), rmse });
+        }
+    }
+
+    std::cout << "whole frames " << fullFrameMs << " ms at rest, budget "
+              << params.frameBudgetMs << " ms, reprojection " << (reproject ? "on" : "off")
+              << std::endl << "whole vs dynamic frames, ms / stride / rmse:" << std::endl;
+
+    double msSums[2][2] = {}, rmseSums[2][2] = {};
+    for(int k = 0; k < motionFrames + restFrames; ++k)
+    {
+        const bool moving = k < motionFrames;
+        std::cout << "    " << (moving ? "move " : "rest ")
+                  << (moving ? k + 1 : k + 1 - motionFrames) << ":";
+        for(int mode = 0; mode < 2; ++mode)
+        {
+            const FrameStats &s = stats[mode][k];
+            std::cout << (mode ? " vs " : " ") << s.ms << " / " << s.stride << " / " << s.rmse;
+            msSums[mode][moving]   += s.ms;
+            rmseSums[mode][moving] += s.rmse;
+        }
+        std::cout << std::endl;
+    }
+
+    for(int moving = 1; moving >= 0; --moving)
+    {
+        const int count = moving ? motionFrames : restFrames;
+        std::cout << (moving ? "moving" : "at rest") << ": "
+                  << msSums[0][moving] / count << " vs " << msSums[1][moving] / count << " ms/frame, rmse "
+                  << rmseSums[0][moving] / count << " vs " << rmseSums[1][moving] / count << std::endl;
+    }
+}
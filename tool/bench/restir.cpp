@@ -0,0 +1,214 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "bench.h"
+
+namespace
+{
+    std::vector<Float3> resolve(const std::vector<Float4> &output)
+    {
+        std::vector<Float3> result(output.size());
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            result[i] = o.w > 0 ? Float3(o.x, o.y, o.z) / o.w : Float3(0);
+        }
+        return result;
+    }
+
+    double computeRMSE(const std::vector<Float4> &output, const std::vector<Float3> &reference)
+    {
+        double sum = 0;
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            const Float3 d = Float3(o.x, o.y, o.z) / o.w - reference[i];
+            sum += (d.x * d.x + d.y * d.y + d.z * d.z) / 3;
+        }
+        return std::sqrt(sum / output.size());
+    }
+
+    // of the samples of the last frame alone, from the difference of the
+    // accumulated outputs
+    double computeFrameRMSE(
+        const std::vector<Float4> &output, const std::vector<Float4> &previous,
+        const std::vector<Float3> &reference)
+    {
+        double sum = 0;
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 o = output[i] - previous[i];
+            const Float3 d = Float3(o.x, o.y, o.z) / o.w - reference[i];
+            sum += (d.x * d.x + d.y * d.y + d.z * d.z) / 3;
+        }
+        return std::sqrt(sum / output.size());
+    }
+
+    double computeMeanLuminance(const std::vector<Float4> &output)
+    {
+        double sum = 0;
+        for(auto &o : output)
+            sum += (0.2126 * o.x + 0.7152 * o.y + 0.0722 * o.z) / o.w;
+        return sum / output.size();
+    }
+
+    void setupRenderer(CPUVolumeRenderer &renderer, const ToolScene &scene)
+    {
+        renderer.initialize(scene.size);
+        renderer.setSimdLevel(SimdLevel::Scalar);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+    }
+
+    struct Config
+    {
+        const char  *name;
+        ReSTIRParams params;
+    };
+}
+
+void benchReSTIR(const ToolOptions &options)
+{
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    scene.size = Int2(options.getInt("width", 160), options.getInt("height", 120));
+    scene.camera.setWOverH(float(scene.size.x) / scene.size.y);
+    scene.camera.recalculateMatrics();
+
+    const int referenceFrames = options.getInt("reference-frames", 512);
+    const int biasSeeds       = options.getInt("bias-seeds", 16);
+    const int biasFrames      = options.getInt("bias-frames", 8);
+    const int budgetFrames    = options.getInt("budget-frames", 16);
+
+    // the baseline, then reservoirs without reuse, with temporal reuse and
+    // with both, from the options of the tool scene
+
+    std::vector<Config> configs;
+    configs.push_back({ "nee", {} });
+
+    ReSTIRParams params = scene.restir;
+    params.enabled          = true;
+    params.temporalReuse    = false;
+    params.spatialNeighbors = 0;
+    configs.push_back({ "ris", params });
+
+    params.temporalReuse = true;
+    configs.push_back({ "ris + temporal", params });
+
+    params.spatialNeighbors = (std::max)(1, scene.restir.spatialNeighbors);
+    configs.push_back({ "ris + temporal + spatial", params });
+
+    ToolTimer timer;
+    CPUVolumeRenderer referenceRenderer;
+    setupRenderer(referenceRenderer, scene);
+    referenceRenderer.setSeed(1);
+    for(int i = 0; i < referenceFrames; ++i)
+        referenceRenderer.render();
+    const std::vector<Float3> reference = resolve(referenceRenderer.getOutput());
+
+    std::cout << scene.size.x << "x" << scene.size.y << " reference of "
+              << 2 * referenceFrames << " spp in " << timer.ms() << " ms, "
+              << params.candidates << " candidates, " << params.spatialNeighbors
+              << " neighbors within " << params.spatialRadius << " pixels" << std::endl;
+
+    // unbiasedness: the image mean of independent runs against the one of
+    // the current estimator, in standard errors of the difference
+
+    std::cout << "image mean luminance over " << biasSeeds << " seeds of "
+              << 2 * biasFrames << " spp:" << std::endl;
+
+    double baseMean = 0, baseVar = 0;
+    for(size_t c = 0; c < configs.size(); ++c)
+    {
+        double sum = 0, sqSum = 0;
+        for(int seed = 0; seed < biasSeeds; ++seed)
+        {
+            CPUVolumeRenderer renderer;
+            setupRenderer(renderer, scene);
+            renderer.setReSTIR(configs[c].params);
+            renderer.setSeed(1000 + seed);
+            for(int i = 0; i < biasFrames; ++i)
+                renderer.render();
+
+            const double mean = computeMeanLuminance(renderer.getOutput());
+            sum   += mean;
+            sqSum += mean * mean;
+        }
+
+        const double mean = sum / biasSeeds;
+        const double var  = (std::max)(0.0, sqSum / biasSeeds - mean * mean) / (biasSeeds - 1);
+        std::cout << "    " << configs[c].name << ": " << mean << " +- " << std::sqrt(var);
+        if(c == 0)
+        {
+            baseMean = mean;
+            baseVar  = var;
+        }
+        else
+        {
+            std::cout << ", z = " << (mean - baseMean) / std::sqrt(var + baseVar + 1e-30);
+        }
+        std::cout << ", reference " << computeMeanLuminance(referenceRenderer.getOutput()) << std::endl;
+    }
+
+    // equal time: every configuration renders until the time the baseline
+    // takes for budgetFrames frames. the error of single frames is what
+    // reuse is for, as accumulating correlated frames gains less
+
+    double budgetMs = 0;
+    std::cout << "rmse of single frames, and accumulated at equal spp ("
+              << 2 * budgetFrames << ") and at the time of the baseline:" << std::endl;
+
+    for(size_t c = 0; c < configs.size(); ++c)
+    {
+        CPUVolumeRenderer renderer;
+        setupRenderer(renderer, scene);
+        renderer.setReSTIR(configs[c].params);
+
+        double ms = 0, equalSppRMSE = 0, equalTimeRMSE = 0, frameRMSESum = 0;
+        int frames = 0, equalTimeFrames = 0;
+        std::vector<Float4> previous(renderer.getOutput().size(), Float4(0));
+        while(frames < budgetFrames || (c > 0 && !equalTimeFrames))
+        {
+            timer.restart();
+            renderer.render();
+            ms += timer.ms();
+            ++frames;
+
+            if(frames <= budgetFrames)
+            {
+                frameRMSESum += computeFrameRMSE(renderer.getOutput(), previous, reference);
+                previous = renderer.getOutput();
+            }
+
+            if(frames == budgetFrames)
+            {
+                equalSppRMSE = computeRMSE(renderer.getOutput(), reference);
+                if(c == 0)
+                    budgetMs = ms;
+            }
+
+            // the first frame ending after the budget
+            if(c > 0 && !equalTimeFrames && ms >= budgetMs)
+            {
+                equalTimeRMSE   = computeRMSE(renderer.getOutput(), reference);
+                equalTimeFrames = frames;
+            }
+        }
+        if(c == 0)
+        {
+            equalTimeRMSE   = equalSppRMSE;
+            equalTimeFrames = budgetFrames;
+        }
+
+        std::cout << "    " << configs[c].name << ": frame " << frameRMSESum / budgetFrames
+                  << ", " << equalSppRMSE << " at "
+                  << 2 * budgetFrames << " spp, " << equalTimeRMSE << " at "
+                  << 2 * equalTimeFrames << " spp in " << budgetMs << " ms ("
+                  << ms / frames << " ms/frame)" << std::endl;
+    }
+}
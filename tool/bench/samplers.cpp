@@ -0,0 +1,258 @@
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "bench.h"
+
+namespace
+{
+    std::vector<SamplerType> parseSamplerList(const std::string &str)
+    {
+        std::vector<SamplerType> result;
+        std::stringstream stream(str);
+        std::string item;
+        while(std::getline(stream, item, ','))
+            result.push_back(parseSamplerType(item));
+        return result;
+    }
+
+    // least squares slope of log(error) over log(spp). -0.5 is the rate of
+    // independent samples
+    double fitSlope(const std::vector<int> &spps, const std::vector<double> &errors)
+    {
+        double sx = 0, sy = 0, sxx = 0, sxy = 0;
+        int n = 0;
+        for(size_t i = 0; i < spps.size(); ++i)
+        {
+            if(errors[i] <= 0)
+                continue;
+            const double x = std::log(double(spps[i])), y = std::log(errors[i]);
+            sx += x; sy += y; sxx += x * x; sxy += x * y;
+            ++n;
+        }
+        return n > 1 ? (n * sxy - sx * sy) / (n * sxx - sx * sx) : 0;
+    }
+
+    // integrands over the unit square with known integrals: smooth, and
+    // with a diagonal discontinuity
+    float evalSmooth(const Float2 &u)
+    {
+        return std::sin(PI * u.x) * std::sin(PI * u.y);
+    }
+
+    float evalStep(const Float2 &u)
+    {
+        return u.x + u.y < 1 ? 1.0f : 0.0f;
+    }
+
+    // rms error over pixels of the estimate of the integral at each spp
+    template<typename Func>
+    std::vector<double> runIntegrand(
+        const PixelSampler &sampler, const Func &func, double reference,
+        const std::vector<int> &spps, const Int2 &pixels, int dim)
+    {
+        std::vector<double> sumSquares(spps.size());
+        for(int y = 0; y < pixels.y; ++y)
+        {
+            for(int x = 0; x < pixels.x; ++x)
+            {
+                double sum = 0;
+                size_t next = 0;
+                for(int i = 0; i < spps.back(); ++i)
+                {
+                    sum += func(sampler.get2D({ x, y }, i, dim));
+                    if(i + 1 == spps[next])
+                    {
+                        const double error = sum / spps[next] - reference;
+                        sumSquares[next++] += error * error;
+                    }
+                }
+            }
+        }
+
+        std::vector<double> result(spps.size());
+        for(size_t i = 0; i < spps.size(); ++i)
+            result[i] = std::sqrt(sumSquares[i] / pixels.product());
+        return result;
+    }
+
+    std::vector<Float3> resolve(const std::vector<Float4> &output)
+    {
+        std::vector<Float3> result(output.size());
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            result[i] = o.w > 0 ? Float3(o.x, o.y, o.z) / o.w : Float3(0);
+        }
+        return result;
+    }
+
+    // mean squared error against the reference, of the image and of its
+    // 4x4 box-filtered error. blue noise errors mostly cancel in the latter
+    void computeErrors(
+        const std::vector<Float4> &output, const std::vector<Float3> &reference,
+        const Int2 &size, double &mse, double &filteredMSE)
+    {
+        constexpr int BOX = 4;
+
+        std::vector<float> errors(output.size());
+        mse = 0;
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            const Float3 d = Float3(o.x, o.y, o.z) / o.w - reference[i];
+            errors[i] = (d.x + d.y + d.z) / 3;
+            mse += (d.x * d.x + d.y * d.y + d.z * d.z) / 3;
+        }
+        mse /= output.size();
+
+        filteredMSE = 0;
+        int boxCount = 0;
+        for(int by = 0; by + BOX <= size.y; by += BOX)
+        {
+            for(int bx = 0; bx + BOX <= size.x; bx += BOX)
+            {
+                double sum = 0;
+                for(int y = by; y < by + BOX; ++y)
+                {
+                    for(int x = bx; x < bx + BOX; ++x)
+                        sum += errors[y * size.x + x];
+                }
+                const double mean = sum / (BOX * BOX);
+                filteredMSE += mean * mean;
+                ++boxCount;
+            }
+        }
+        filteredMSE /= (std::max)(1, boxCount);
+    }
+
+    void setupRenderer(CPUVolumeRenderer &renderer, const ToolScene &scene)
+    {
+        renderer.initialize(scene.size);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+    }
+
+    void printErrors(
+        const std::string &name, const std::vector<int> &spps, const std::vector<double> &errors)
+    {
+        std::cout << "    " << name << ":";
+        for(size_t i = 0; i < spps.size(); ++i)
+            std::cout << (i ? ", " : " ") << spps[i] << " spp " << errors[i];
+        std::cout << ", slope " << fitSlope(spps, errors) << std::endl;
+    }
+}
+
+void benchSamplers(const ToolOptions &options)
+{
+    const std::vector<SamplerType> samplers = parseSamplerList(
+        options.get("samplers", "random,sobol,lattice,bluenoise"));
+    const int maxSpp = options.getInt("max-spp", 128);
+
+    // the samplers alone on two integrands, over 64x64 pixels
+
+    std::vector<int> integrandSpps;
+    for(int spp = 1; spp <= options.getInt("integrand-max-spp", 1024); spp *= 2)
+        integrandSpps.push_back(spp);
+
+    for(auto [name, dim] : { std::pair("free flight / scatter", int(SAMPLE_DIM_FREE_FLIGHT)),
+                             std::pair("light at bounce 2",
+                                       SAMPLE_DIMS_PER_BOUNCE + SAMPLE_DIM_LIGHT) })
+    {
+        std::cout << "integrands in dimensions " << dim << "-" << dim + 1
+                  << " (" << name << "), rmse over 64x64 pixels:" << std::endl;
+        for(SamplerType type : samplers)
+        {
+            PixelSampler sampler;
+            sampler.setType(type);
+
+            const std::string typeName = getSamplerTypeName(type);
+            printErrors(typeName + " smooth", integrandSpps, runIntegrand(
+                sampler, evalSmooth, 4 / (PI * PI), integrandSpps, { 64, 64 }, dim));
+            printErrors(typeName + " step", integrandSpps, runIntegrand(
+                sampler, evalStep, 0.5, integrandSpps, { 64, 64 }, dim));
+        }
+    }
+
+    // the renderer, with all samplers on the scalar tracer
+
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    scene.size = Int2(options.getInt("width", 160), options.getInt("height", 120));
+    scene.camera.setWOverH(float(scene.size.x) / scene.size.y);
+    scene.camera.recalculateMatrics();
+
+    const int referenceFrames = options.getInt("reference-frames", 512);
+
+    ToolTimer timer;
+    CPUVolumeRenderer referenceRenderer;
+    setupRenderer(referenceRenderer, scene);
+    referenceRenderer.setSeed(1);
+    for(int i = 0; i < referenceFrames; ++i)
+        referenceRenderer.render();
+    const std::vector<Float3> reference = resolve(referenceRenderer.getOutput());
+
+    std::cout << scene.size.x << "x" << scene.size.y << " reference of "
+              << 2 * referenceFrames << " spp in " << timer.ms() << " ms" << std::endl;
+
+    std::vector<int> spps;
+    for(int spp = 2; spp <= maxSpp; spp *= 2)
+        spps.push_back(spp);
+
+    // the noise of the reference adds to the squared errors. it is
+    // estimated from the error of independent samples at 2 spp, and removed
+
+    double referenceMSE = -1;
+
+    for(SamplerType type : samplers)
+    {
+        CPUVolumeRenderer renderer;
+        setupRenderer(renderer, scene);
+        renderer.setSimdLevel(SimdLevel::Scalar);
+        renderer.setSampler(type);
+
+        std::vector<double> mses, filteredMSEs;
+        double ms = 0;
+
+        for(int frame = 1; 2 * frame <= maxSpp; ++frame)
+        {
+            timer.restart();
+            renderer.render();
+            ms += timer.ms();
+
+            if((frame & (frame - 1)) == 0)
+            {
+                double mse, filteredMSE;
+                computeErrors(renderer.getOutput(), reference, scene.size, mse, filteredMSE);
+                mses.push_back(mse);
+                filteredMSEs.push_back(filteredMSE);
+            }
+        }
+
+        if(referenceMSE < 0 && type == SamplerType::Random)
+            referenceMSE = mses.front() * spps.front() / (2.0 * referenceFrames);
+
+        std::vector<double> errors, filteredErrors;
+        for(size_t i = 0; i < mses.size(); ++i)
+        {
+            errors.push_back(std::sqrt((std::max)(0.0, mses[i] - (std::max)(0.0, referenceMSE))));
+            filteredErrors.push_back(std::sqrt(filteredMSEs[i]));
+        }
+
+        std::cout << getSamplerTypeName(type) << ", " << ms / (maxSpp / 2)
+                  << " ms/frame:" << std::endl;
+        printErrors("rmse", spps, errors);
+        printErrors("4x4 filtered rmse", spps, filteredErrors);
+    }
+
+    if(referenceMSE >= 0)
+    {
+        std::cout << "reference rmse " << std::sqrt(referenceMSE)
+                  << " removed from the rmse in quadrature" << std::endl;
+    }
+}
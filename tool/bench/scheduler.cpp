@@ -0,0 +1,217 @@
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "../../src/core/task_scheduler.h"
+#include "bench.h"
+
+namespace
+{
+    std::vector<int> parseList(const std::string &str)
+    {
+        std::vector<int> result;
+        std::stringstream stream(str);
+        std::string item;
+        while(std::getline(stream, item, ','))
+            result.push_back(std::stoi(item));
+        return result;
+    }
+
+    // 1, 2, 4, ... up to the hardware thread count, which is always included
+    std::vector<int> getDefaultThreadCounts()
+    {
+        const int maxCount = static_cast<int>((std::max)(1u, std::thread::hardware_concurrency()));
+
+        std::vector<int> result;
+        for(int count = 1; count < maxCount; count *= 2)
+            result.push_back(count);
+        result.push_back(maxCount);
+        return result;
+    }
+
+    // what the host code did before the scheduler: threads spawned per call
+    template<typename Func>
+    void spawnFor(int beg, int end, const Func &func)
+    {
+        const int threadCount = static_cast<int>((std::max)(1u, std::thread::hardware_concurrency()));
+
+        std::atomic<int> next = beg;
+        std::vector<std::thread> threads;
+        for(int i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back([&]
+            {
+                for(int j = next++; j < end; j = next++)
+                    func(j);
+            });
+        }
+        for(auto &t : threads)
+            t.join();
+    }
+
+    // a few microseconds of arithmetic the compiler cannot drop
+    float spin(int iterations, float seed)
+    {
+        float x = seed;
+        for(int i = 0; i < iterations; ++i)
+            x = x * 0.999f + 0.001f;
+        return x;
+    }
+
+    struct StageTimes
+    {
+        double parse      = 0;
+        double majorants  = 0;
+        double mips       = 0;
+        double importance = 0;
+        double render     = 0;
+    };
+
+    StageTimes runStages(
+        const std::string &densityFilename, const EnvirMap::Texels &sky,
+        const ToolScene &scene, int frames)
+    {
+        StageTimes result;
+
+        ToolTimer timer;
+        const Grid density = Grid::loadTextParallel(densityFilename, GridFormat::R32F);
+        result.parse = timer.ms();
+
+        timer.restart();
+        MajorantGrid majorants;
+        majorants.build(density);
+        result.majorants = timer.ms();
+
+        timer.restart();
+        DensityMipChain mips;
+        mips.build(density);
+        result.mips = timer.ms();
+
+        timer.restart();
+        computeEnvirImportance(sky, { 200, 200 });
+        result.importance = timer.ms();
+
+        CPUVolumeRenderer renderer;
+        renderer.initialize(scene.size);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+
+        timer.restart();
+        for(int i = 0; i < frames; ++i)
+            renderer.render();
+        result.render = timer.ms() / frames;
+
+        return result;
+    }
+
+    void benchOverhead()
+    {
+        // many short loops, like the per-row passes of small envir maps
+
+        constexpr int CALLS = 200, ITEMS = 64;
+        std::atomic<float> sink = 0;
+
+        ToolTimer timer;
+        for(int i = 0; i < CALLS; ++i)
+            spawnFor(0, ITEMS, [&](int j) { sink = sink + spin(100, float(j)); });
+        const double spawnUs = timer.ms() * 1000 / CALLS;
+
+        timer.restart();
+        for(int i = 0; i < CALLS; ++i)
+            parallelFor(0, ITEMS, [&](int j) { sink = sink + spin(100, float(j)); });
+        const double poolUs = timer.ms() * 1000 / CALLS;
+
+        std::cout << "loop of " << ITEMS << " short items: threads per call "
+                  << spawnUs << " us, task scheduler " << poolUs << " us" << std::endl;
+
+        // nested loops against the same work as one flat loop
+
+        constexpr int OUTER = 64, INNER = 256;
+
+        timer.restart();
+        parallelFor(0, OUTER * INNER, [&](int j) { sink = sink + spin(2000, float(j)); });
+        const double flatMs = timer.ms();
+
+        timer.restart();
+        parallelFor(0, OUTER, [&](int i)
+        {
+            parallelFor(0, INNER, [&](int j) { sink = sink + spin(2000, float(i + j)); });
+        });
+        const double nestedMs = timer.ms();
+
+        std::cout << OUTER << "x" << INNER << " nested loop " << nestedMs
+                  << " ms, flat loop " << flatMs << " ms" << std::endl;
+    }
+
+    // latency of a short loop submitted behind a flood of background tasks
+    double measureLatency(TaskPriority priority, int floodTasks, int floodIterations)
+    {
+        std::atomic<float> sink = 0;
+
+        TaskGroup flood(TaskPriority::Background);
+        for(int i = 0; i < floodTasks; ++i)
+            flood.run([&, i] { sink = sink + spin(floodIterations, float(i)); });
+
+        ToolTimer timer;
+        {
+            TaskGroup group(priority);
+            for(int i = 0; i < 64; ++i)
+                group.run([&, i] { sink = sink + spin(1000, float(i)); });
+            group.wait();
+        }
+        const double result = timer.ms();
+
+        flood.wait();
+        return result;
+    }
+}
+
+void benchScheduler(const ToolOptions &options)
+{
+    const std::vector<int> threadCounts = options.has("threads") ?
+        parseList(options.get("threads", "")) : getDefaultThreadCounts();
+    const std::string densityFilename = options.get("density", "./asset/density.txt");
+    const int frames = options.getInt("frames", 2);
+
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    const EnvirMap::Texels sky = createProceduralSky({ 4096, 2048 });
+
+    // the whole host pipeline on 1..n workers. rendering is per frame
+
+    StageTimes base;
+    for(int threadCount : threadCounts)
+    {
+        TaskScheduler::setGlobalWorkerCount(threadCount);
+        const StageTimes t = runStages(densityFilename, sky, scene, frames);
+        if(threadCount == threadCounts.front())
+            base = t;
+
+        std::cout << threadCount << " workers:"
+                  << " parse " << t.parse << " ms (" << base.parse / t.parse << "x),"
+                  << " majorants " << t.majorants << " ms (" << base.majorants / t.majorants << "x),"
+                  << " mips " << t.mips << " ms (" << base.mips / t.mips << "x),"
+                  << " importance " << t.importance << " ms (" << base.importance / t.importance << "x),"
+                  << " render " << t.render << " ms (" << base.render / t.render << "x)" << std::endl;
+    }
+
+    TaskScheduler::setGlobalWorkerCount(0);
+    benchOverhead();
+
+    // the interactive loop skips ahead of the queued background tasks
+
+    const int floodTasks = 8 * TaskScheduler::getGlobal().getWorkerCount();
+    const int floodIterations = options.getInt("flood-iterations", 1000000);
+    for(auto priority : { TaskPriority::Background, TaskPriority::Interactive })
+    {
+        std::cout << getTaskPriorityName(priority) << " loop behind " << floodTasks
+                  << " background tasks: " << measureLatency(priority, floodTasks, floodIterations)
+                  << " ms" << std::endl;
+    }
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+
+#include "../../src/core/cpu_renderer.h"
+#include "bench.h"
+
+void benchSimd(const ToolOptions &options)
+{
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    const int frames = options.getInt("frames", 4);
+
+    std::vector<Float4> reference;
+    double scalarRate = 0;
+
+    for(auto level : { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512 })
+    {
+        if(!isSimdLevelSupported(level))
+        {
+            std::cout << getSimdLevelName(level) << ": not supported" << std::endl;
+            continue;
+        }
+
+        CPUVolumeRenderer renderer;
+        renderer.initialize(scene.size);
+        renderer.setSimdLevel(level);
+        renderer.setThreadCount(1);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+
+        ToolTimer timer;
+        for(int i = 0; i < frames; ++i)
+            renderer.render();
+        const double rate = renderer.getPathCount() / (timer.ms() / 1000);
+
+        // same random sequences per pixel, so images differ only by the
+        // approximated log/sin/cos of the packet kernels
+
+        double meanDiff = 0;
+        const auto &output = renderer.getOutput();
+        if(reference.empty())
+        {
+            reference = output;
+            scalarRate = rate;
+        }
+        else
+        {
+            for(size_t i = 0; i < output.size(); ++i)
+            {
+                const Float4 d = output[i] - reference[i];
+                meanDiff += (std::abs(d.x) + std::abs(d.y) + std::abs(d.z)) / 3 / output[i].w;
+            }
+            meanDiff /= output.size();
+        }
+
+        std::cout << getSimdLevelName(level) << ": " << rate << " paths/sec/core ("
+                  << rate / scalarRate << "x), mean abs diff to scalar "
+                  << meanDiff << std::endl;
+    }
+}
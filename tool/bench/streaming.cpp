@@ -0,0 +1,235 @@
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "../../src/core/cpu_renderer.h"
+#include "../../src/core/rng.h"
+#include "bench.h"
+
+namespace
+{
+    // orbits the volume close enough for the frustum to see a part of it
+    void setOrbitCamera(Camera &camera, int frame, int frameCount, float radius)
+    {
+        const float angle = 2 * PI * frame / frameCount;
+        const Float3 eye(radius * std::sin(angle), 0.3f, -radius * std::cos(angle));
+        const Float3 dir = (-eye).normalize();
+
+        camera.setPosition(eye);
+        camera.setDirection(std::atan2(dir.z, dir.x), std::asin(dir.y));
+        camera.recalculateMatrics();
+    }
+
+    std::vector<int> parseList(const std::string &str)
+    {
+        std::vector<int> result;
+        std::stringstream stream(str);
+        std::string item;
+        while(std::getline(stream, item, ','))
+            result.push_back(std::stoi(item));
+        return result;
+    }
+
+    // 1, 2, 4, ... up to the hardware thread count, which is always included
+    std::vector<int> getDefaultThreadCounts()
+    {
+        const int maxCount = static_cast<int>((std::max)(1u, std::thread::hardware_concurrency()));
+
+        std::vector<int> result;
+        for(int count = 1; count < maxCount; count *= 2)
+            result.push_back(count);
+        result.push_back(maxCount);
+        return result;
+    }
+
+    // M lookups/s of threadCount threads sampling the medium at random
+    // points, each its own sequence
+    double measureLookups(const VolumeMedium &medium, int threadCount, int lookupsPerThread)
+    {
+        std::vector<double> sums(threadCount);
+        std::vector<std::thread> threads;
+
+        ToolTimer timer;
+        for(int i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back([&, i]
+            {
+                uint32_t rng = static_cast<uint32_t>(i + 1);
+                double sum = 0;
+                for(int j = 0; j < lookupsPerThread; ++j)
+                    sum += medium.sampleDensity(Float3(randFloat(rng), randFloat(rng), randFloat(rng)));
+                sums[i] = sum;
+            });
+        }
+        for(auto &t : threads)
+            t.join();
+
+        return double(threadCount) * lookupsPerThread / timer.ms() / 1000;
+    }
+
+    // lookups of threadCount threads through a cache that holds few of the
+    // bricks, so that slots are evicted and reloaded under the lookups
+    // without the lock. returns the count of values that differ from the
+    // ones of a single thread through a cache holding all of them
+    uint64_t countRacedLookups(
+        const BrickFile &file, int threadCount, int lookupsPerThread, size_t capacityBytes)
+    {
+        std::vector<Float3> points(size_t(threadCount) * lookupsPerThread);
+        uint32_t rng = 1;
+        for(auto &p : points)
+            p = Float3(randFloat(rng), randFloat(rng), randFloat(rng));
+
+        BrickCache fullCache;
+        fullCache.initialize(file, size_t(file.getBrickCount()) * BRICK_VOXEL_COUNT * sizeof(float));
+
+        std::vector<float> expected(points.size());
+        for(size_t i = 0; i < points.size(); ++i)
+            expected[i] = fullCache.sample(points[i]);
+
+        BrickCache cache;
+        cache.initialize(file, capacityBytes);
+
+        std::vector<uint64_t> mismatches(threadCount);
+        std::vector<std::thread> threads;
+        for(int i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back([&, i]
+            {
+                for(int j = 0; j < lookupsPerThread; ++j)
+                {
+                    const size_t k = size_t(i) * lookupsPerThread + j;
+                    if(cache.sample(points[k]) != expected[k])
+                        ++mismatches[i];
+                }
+            });
+        }
+        for(auto &t : threads)
+            t.join();
+
+        uint64_t result = 0;
+        for(uint64_t m : mismatches)
+            result += m;
+
+        const BrickCacheStats stats = cache.getStats();
+        std::cout << threadCount << " threads through a cache of "
+                  << cache.getCapacity() / (BRICK_VOXEL_COUNT * sizeof(float))
+                  << " of " << file.getBrickCount() << " bricks: " << result << " wrong of "
+                  << points.size() << " lookups, " << stats.evictions << " evictions" << std::endl;
+        return result;
+    }
+}
+
+void benchStreaming(const ToolOptions &options)
+{
+    const int   frames = options.getInt("frames", 12);
+    const float radius = options.getFloat("radius", 2.5f);
+
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    const std::string filename = options.get(
+        "file", (std::filesystem::temp_directory_path() / "bench_density.vbrick").string());
+    saveBrickFile(scene.density, filename);
+
+    BrickFile file;
+    file.open(filename);
+
+    const size_t totalBytes = size_t(file.getBrickCount()) * BRICK_VOXEL_COUNT * sizeof(float);
+    std::cout << file.getBrickCount() << " bricks, "
+              << totalBytes / (1024.0 * 1024.0) << " MB of voxels, "
+              << file.getTableByteSize() / 1024.0 << " KB resident table, "
+              << frames << " frames orbiting at " << radius << std::endl;
+
+    // every configuration starts cold and renders the same camera path.
+    // the scalar tracer is used throughout, as the cache has no packet path
+
+    auto renderOrbit = [&](const VolumeMedium &medium, BrickCache *prefetchCache)
+    {
+        CPUVolumeRenderer renderer;
+        renderer.initialize(scene.size);
+        renderer.setSimdLevel(SimdLevel::Scalar);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(medium);
+
+        ToolTimer timer;
+        for(int i = 0; i < frames; ++i)
+        {
+            setOrbitCamera(scene.camera, i, frames, radius);
+            if(prefetchCache)
+            {
+                prefetchCache->prefetchFrustum(
+                    scene.camera.getPosition(), scene.camera.getFrustumDirections(),
+                    medium.getLower(), medium.getUpper());
+            }
+            renderer.setCamera(scene.camera);
+            renderer.render();
+        }
+        return timer.ms() / frames;
+    };
+
+    std::cout << "in-memory dense grid: " << renderOrbit(scene.medium, nullptr)
+              << " ms/frame" << std::endl;
+
+    for(float fraction : { 0.1f, 0.25f, 0.5f, 1.0f })
+    {
+        for(bool prefetch : { false, true })
+        {
+            BrickCache cache;
+            cache.initialize(file, static_cast<size_t>(fraction * totalBytes));
+
+            VolumeMedium medium = scene.medium;
+            medium.setDensity(nullptr);
+            medium.setBrickGrid(nullptr);
+            medium.setBrickCache(&cache);
+
+            const double ms = renderOrbit(medium, prefetch ? &cache : nullptr);
+
+            const BrickCacheStats stats = cache.getStats();
+            const uint64_t lookups = stats.hits + stats.misses;
+            std::cout << "cache " << 100 * fraction << "%"
+                      << (prefetch ? ", frustum prefetch" : ", on demand     ")
+                      << ": hit rate " << 100.0 * stats.hits / (std::max<uint64_t>)(1, lookups)
+                      << "%, paged " << stats.bytesPaged / (1024.0 * 1024.0) << " MB ("
+                      << stats.prefetches << " prefetched), stall "
+                      << stats.stallMs << " ms, " << ms << " ms/frame" << std::endl;
+        }
+    }
+
+    // lookups of resident bricks from several threads, against the dense
+    // grid, which needs no synchronization
+
+    const std::vector<int> threadCounts = options.has("threads") ?
+        parseList(options.get("threads", "")) : getDefaultThreadCounts();
+    const int lookupsPerThread = options.getInt("lookups", 2000000);
+
+    BrickCache cache;
+    cache.initialize(file, totalBytes);
+
+    VolumeMedium cachedMedium = scene.medium;
+    cachedMedium.setDensity(nullptr);
+    cachedMedium.setBrickGrid(nullptr);
+    cachedMedium.setBrickCache(&cache);
+    measureLookups(cachedMedium, 1, lookupsPerThread);
+
+    for(int threadCount : threadCounts)
+    {
+        const double dense  = measureLookups(scene.medium, threadCount, lookupsPerThread);
+        const double cached = measureLookups(cachedMedium, threadCount, lookupsPerThread);
+        std::cout << threadCount << " threads, resident bricks: " << cached
+                  << " M lookups/s through the cache vs " << dense << " dense ("
+                  << cached / dense << "x)" << std::endl;
+    }
+
+    // the same lookups while bricks are evicted under them must still
+    // read the voxels of their own brick
+
+    const size_t stressBytes = static_cast<size_t>(options.getFloat("stress-fraction", 0.05f) * totalBytes);
+    for(int threadCount : threadCounts)
+        countRacedLookups(file, threadCount, lookupsPerThread / 4, stressBytes);
+
+    file.close();
+    std::filesystem::remove(filename);
+}
@@ -0,0 +1,120 @@
+#include <iostream>
+
+#include "../../src/core/rng.h"
+#include "bench.h"
+
+namespace
+{
+    struct PathStats
+    {
+        TrackingStats tracking;
+        uint64_t      scatterCount = 0;
+        double        transmittance = 0;
+        double        ms = 0;
+    };
+
+    Float3 sampleSphere(uint32_t &rng)
+    {
+        const float z = 2 * randFloat(rng) - 1;
+        const float r = std::sqrt((std::max)(0.0f, 1 - z * z));
+        const float phi = 2 * PI * randFloat(rng);
+        return Float3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    // random walks shaped like the ones in raw.hlsl: one free-flight and one
+    // shadow-ray transmittance estimate per bounce
+    template<bool DDA>
+    PathStats runPaths(const VolumeMedium &medium, int pathCount, int maxDepth)
+    {
+        PathStats result;
+        ToolTimer timer;
+
+        for(int p = 0; p < pathCount; ++p)
+        {
+            uint32_t rng = static_cast<uint32_t>(p + 1);
+
+            const Float3 eye = 4.0f * sampleSphere(rng);
+            Float3 d = (0.5f * sampleSphere(rng) - eye).normalize();
+
+            Float3 o;
+            if(!medium.findEntry(eye, d, o))
+                continue;
+
+            for(int depth = 0; depth < maxDepth; ++depth)
+            {
+                const Float2 incts = medium.intersectRayBox(o, d);
+                if(incts.x + 0.001f >= incts.y)
+                    break;
+
+                const Float3 b = o + (incts.y - 0.001f) * d;
+
+                Float3 scatterPos;
+                const bool scattered = DDA ?
+                    medium.deltaTrackDDA(o, b, rng, scatterPos, &result.tracking) :
+                    medium.deltaTrack(o, b, rng, scatterPos, &result.tracking);
+                if(!scattered)
+                    break;
+                ++result.scatterCount;
+
+                const Float3 wi = sampleSphere(rng);
+                const Float2 shadowIncts = medium.intersectRayBox(scatterPos, wi);
+                if(shadowIncts.x < shadowIncts.y)
+                {
+                    const Float3 sa = scatterPos + shadowIncts.x * wi;
+                    const Float3 sb = scatterPos + shadowIncts.y * wi;
+                    result.transmittance += DDA ?
+                        medium.estimateTransmittanceDDA(sa, sb, rng, &result.tracking) :
+                        medium.estimateTransmittance(sa, sb, rng, &result.tracking);
+                }
+
+                o = scatterPos;
+                d = medium.samplePhaseFunction(-d, rng);
+            }
+        }
+
+        result.ms = timer.ms();
+        return result;
+    }
+
+    void print(const char *name, const PathStats &stats, int pathCount)
+    {
+        std::cout << name
+                  << ": lookups/path " << double(stats.tracking.densityLookups) / pathCount
+                  << ", scatters/path " << double(stats.scatterCount) / pathCount
+                  << ", mean shadow transmittance "
+                  << stats.transmittance / (std::max)(uint64_t(1), stats.scatterCount)
+                  << ", " << stats.ms * 1000 / pathCount << " us/path" << std::endl;
+    }
+}
+
+void benchTracking(const ToolOptions &options)
+{
+    const int pathCount = options.getInt("paths", 200000);
+    const int maxDepth  = options.getInt("depth", 5);
+    const int cellSize  = options.getInt("cell", MAJORANT_CELL_SIZE);
+
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    ToolTimer buildTimer;
+    MajorantGrid &majorants = scene.majorants;
+    majorants.build(scene.density, cellSize);
+    const double buildMs = buildTimer.ms();
+
+    const VolumeMedium &medium = scene.medium;
+
+    const Int3 &res = majorants.getResolution();
+    std::cout << "majorant grid: " << res.x << "x" << res.y << "x" << res.z
+              << ", built in " << buildMs << " ms" << std::endl;
+
+    const PathStats global = runPaths<false>(medium, pathCount, maxDepth);
+    const PathStats local  = runPaths<true>(medium, pathCount, maxDepth);
+
+    print("global majorant", global, pathCount);
+    print("local majorants", local, pathCount);
+
+    std::cout << "lookup reduction: "
+              << double(global.tracking.densityLookups) /
+                 (std::max)(uint64_t(1), local.tracking.densityLookups)
+              << "x" << std::endl;
+}
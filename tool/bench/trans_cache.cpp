@@ -0,0 +1,321 @@
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "../../src/core/cpu_renderer.h"
+#include "../../src/core/rng.h"
+#include "bench.h"
+
+namespace
+{
+    std::vector<Float3> resolve(const std::vector<Float4> &output)
+    {
+        std::vector<Float3> result(output.size());
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            result[i] = o.w > 0 ? Float3(o.x, o.y, o.z) / o.w : Float3(0);
+        }
+        return result;
+    }
+
+    double computeRMSE(const std::vector<Float4> &output, const std::vector<Float3> &reference)
+    {
+        double sum = 0;
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const Float4 &o = output[i];
+            const Float3 d = Float3(o.x, o.y, o.z) / o.w - reference[i];
+            sum += (d.x * d.x + d.y * d.y + d.z * d.z) / 3;
+        }
+        return std::sqrt(sum / output.size());
+    }
+
+    struct Stats
+    {
+        double mean      = 0; // of the pixel luminances
+        double meanError = 0; // standard error of mean
+    };
+
+    Stats computeStats(const std::vector<Float4> &output, const std::vector<Float2> &moments)
+    {
+        Stats stats;
+        double meanVariance = 0;
+        for(size_t i = 0; i < output.size(); ++i)
+        {
+            const double n = output[i].w;
+            const double mean = moments[i].x / n;
+            const double variance = n > 1 ?
+                (std::max)(0.0, moments[i].y / n - mean * mean) * n / (n - 1) : 0.0;
+
+            stats.mean   += mean;
+            meanVariance += variance / n;
+        }
+        stats.mean     /= output.size();
+        stats.meanError = std::sqrt(meanVariance) / output.size();
+        return stats;
+    }
+
+    void setupRenderer(CPUVolumeRenderer &renderer, const ToolScene &scene)
+    {
+        renderer.initialize(scene.size);
+        renderer.setSimdLevel(SimdLevel::Scalar);
+        renderer.setTracer(scene.maxDepth);
+        renderer.setTransmittanceEstimator(TransmittanceEstimator::RatioRoulette);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+    }
+
+    double renderFrames(CPUVolumeRenderer &renderer, int frames)
+    {
+        double ms = 0;
+        for(int i = 0; i < frames; ++i)
+        {
+            renderer.render();
+            ms += renderer.getFrameMs();
+        }
+        return ms / frames;
+    }
+
+    Float3 sampleSphere(uint32_t &rng)
+    {
+        const float z = 2 * randFloat(rng) - 1;
+        const float r = std::sqrt((std::max)(0.0f, 1 - z * z));
+        const float phi = 2 * PI * randFloat(rng);
+        return Float3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    struct ShadowQuery
+    {
+        Float3 pos;
+        Float3 wi;
+    };
+
+    // cached against tracked transmittance toward light samples in cached
+    // lobes, from first scatterings of rays toward the volume
+    void compareTransmittance(
+        const VolumeMedium &medium, const EnvirMap &envir, const TransmittanceCache &cache,
+        int pointCount, int referenceEstimates)
+    {
+        uint32_t rng = 1;
+
+        std::vector<ShadowQuery> queries;
+        for(int p = 0; p < pointCount; ++p)
+        {
+            const Float3 eye = 4.0f * sampleSphere(rng);
+            const Float3 d = (0.5f * sampleSphere(rng) - eye).normalize();
+
+            Float3 o, pos;
+            if(!medium.findEntry(eye, d, o))
+                continue;
+            const Float2 incts = medium.intersectRayBox(o, d);
+            if(!medium.deltaTrack(o, o + (incts.y - 0.001f) * d, rng, pos))
+                continue;
+
+            for(int i = 0; i < 64; ++i)
+            {
+                Float3 wi; float pdf, trans;
+                envir.sampleEnvirLight(rng, wi, pdf);
+                if(cache.lookup(pos, wi, trans))
+                {
+                    queries.push_back({ pos, wi });
+                    break;
+                }
+            }
+        }
+
+        const size_t n = queries.size();
+        if(n < 2)
+            return;
+
+        std::vector<float> cached(n), tracked(n);
+
+        ToolTimer cacheTimer;
+        for(size_t i = 0; i < n; ++i)
+            cache.lookup(queries[i].pos, queries[i].wi, cached[i]);
+        const double cacheMs = cacheTimer.ms();
+
+        // single estimates, whose error is that of tracking one shadow ray
+        ToolTimer trackedTimer;
+        for(size_t i = 0; i < n; ++i)
+        {
+            const ShadowQuery &q = queries[i];
+            const Float2 incts = medium.intersectRayBox(q.pos, q.wi);
+            tracked[i] = medium.estimateTransmittanceRoulette(
+                q.pos + incts.x * q.wi, q.pos + incts.y * q.wi, rng);
+        }
+        const double trackedMs = trackedTimer.ms();
+
+        double bias = 0, cacheError2 = 0, trackedError2 = 0, reference = 0;
+        for(size_t i = 0; i < n; ++i)
+        {
+            const ShadowQuery &q = queries[i];
+            const Float2 incts = medium.intersectRayBox(q.pos, q.wi);
+
+            double mean = 0;
+            for(int j = 0; j < referenceEstimates; ++j)
+            {
+                mean += medium.estimateTransmittanceRoulette(
+                    q.pos + incts.x * q.wi, q.pos + incts.y * q.wi, rng);
+            }
+            mean /= referenceEstimates;
+
+            bias          += cached[i] - mean;
+            cacheError2   += (cached[i] - mean) * (cached[i] - mean);
+            trackedError2 += (tracked[i] - mean) * (tracked[i] - mean);
+            reference     += mean;
+        }
+
+        const double meanBias = bias / n;
+        const double biasError = std::sqrt((std::max)(0.0, cacheError2 / n - meanBias * meanBias) / (n - 1));
+
+        // the reference estimates are independent of the single tracked
+        // one, so their variance is added to its error and removed here
+        const double referenceVariance = trackedError2 / n / (referenceEstimates + 1);
+        const double cacheVariance = (std::max)(0.0, cacheError2 / n - referenceVariance);
+        const double trackedVariance = trackedError2 / n - referenceVariance;
+
+        std::cout << "transmittance at " << n << " first scatterings, toward light samples in cached lobes:"
+                  << std::endl
+                  << "    mean " << reference / n << " (" << referenceEstimates
+                  << " tracked estimates each), cached - tracked " << meanBias << " +- " << biasError
+                  << std::endl
+                  << "    rmse " << std::sqrt(cacheVariance) << " cached vs "
+                  << std::sqrt(trackedVariance) << " of one tracked shadow ray" << std::endl
+                  << "    " << cacheMs * 1e6 / n << " ns per lookup vs " << trackedMs * 1e6 / n
+                  << " ns per shadow ray" << std::endl;
+    }
+}
+
+void benchTransCache(const ToolOptions &options)
+{
+    ToolScene scene;
+    loadToolScene(options, scene);
+
+    scene.size = Int2(options.getInt("width", 160), options.getInt("height", 120));
+    scene.camera.setWOverH(float(scene.size.x) / scene.size.y);
+    scene.camera.recalculateMatrics();
+
+    const int frames    = options.getInt("frames", 16);
+    const int refFrames = options.getInt("ref-frames", 256);
+
+    TransmittanceCacheParams params = scene.transCache;
+    params.enabled = true;
+
+    TransmittanceCache cache;
+    cache.initialize(scene.envir, params);
+    cache.build(scene.medium);
+
+    const Int3 &res = cache.getResolution();
+    std::cout << cache.getLobeCount() << " lobes of " << params.lobeAngle << " rad covering "
+              << 100 * cache.getCoverage() << "% of the light samples, " << res.x << "x" << res.y
+              << "x" << res.z << " nodes each, " << cache.getByteSize() / 1024 << " KB, built in "
+              << cache.getBuildMs() << " ms" << std::endl;
+
+    compareTransmittance(
+        scene.medium, scene.envir, cache,
+        options.getInt("points", 4000), options.getInt("estimates", 64));
+
+    // images, all with the unbiased estimator for the shadow rays not in
+    // the cache. the reference has none in the cache
+
+    CPUVolumeRenderer reference;
+    setupRenderer(reference, scene);
+    renderFrames(reference, refFrames);
+    const std::vector<Float3> referenceImage = resolve(reference.getOutput());
+    const Stats referenceStats = computeStats(reference.getOutput(), reference.getMoments());
+
+    CPUVolumeRenderer tracked;
+    setupRenderer(tracked, scene);
+    const double trackedMs = renderFrames(tracked, frames);
+
+    CPUVolumeRenderer cached;
+    setupRenderer(cached, scene);
+    cached.setTransmittanceCache(params);
+    cached.waitTransmittanceCache();
+    const double cachedMs = renderFrames(cached, frames);
+
+    std::cout << "images of " << 2 * frames << " spp against " << 2 * refFrames
+              << " spp tracked, mean luminance " << referenceStats.mean << " +- "
+              << referenceStats.meanError << ":" << std::endl;
+
+    auto printImage = [&](const char *name, const CPUVolumeRenderer &renderer, double ms)
+    {
+        const Stats stats = computeStats(renderer.getOutput(), renderer.getMoments());
+        const double rmse = computeRMSE(renderer.getOutput(), referenceImage);
+        const double z = (stats.mean - referenceStats.mean) / std::sqrt(
+            stats.meanError * stats.meanError + referenceStats.meanError * referenceStats.meanError + 1e-30);
+
+        std::cout << "    " << name << ": " << ms << " ms/frame, rmse " << rmse
+                  << ", rmse^2 x time " << rmse * rmse * ms << ", mean " << stats.mean
+                  << " (" << 100 * (stats.mean / referenceStats.mean - 1) << "%, z = " << z << ")"
+                  << std::endl;
+    };
+    printImage("tracked", tracked, trackedMs);
+    printImage("cached ", cached, cachedMs);
+
+    // the cache is kept while only the camera and the envir intensity change,
+    // and setEnvir rebuilds it even with the same envir
+
+    const TransmittanceCache *built = cached.getTransmittanceCache();
+
+    Camera camera = scene.camera;
+    camera.setPosition(Float3(0.5f, 0, -4));
+    camera.recalculateMatrics();
+    cached.setCamera(camera);
+    cached.render();
+    const bool keptOnMove = cached.getTransmittanceCache() == built;
+
+    scene.envir.setIntensity(2);
+    cached.render();
+    const bool keptOnIntensity = cached.getTransmittanceCache() == built;
+
+    scene.medium.setDensityScale(2 * scene.medium.getDensityScale());
+    cached.render();
+    const bool rebuiltOnScale = cached.getTransmittanceCache() != built;
+
+    ToolTimer timer;
+    cached.waitTransmittanceCache();
+    const double rebuildMs = timer.ms();
+
+    built = cached.getTransmittanceCache();
+    cached.setEnvir(scene.envir);
+    cached.render();
+    const bool rebuiltOnEnvir = cached.getTransmittanceCache() != built;
+    cached.waitTransmittanceCache();
+
+    std::cout << "kept on camera move " << keptOnMove << ", kept on envir intensity "
+              << keptOnIntensity << ", rebuilt on density scale " << rebuiltOnScale
+              << " (background build finished " << rebuildMs << " ms after the frame), rebuilt on setEnvir "
+              << rebuiltOnEnvir << std::endl;
+
+    // a volume whose grids are freed right after it is replaced, like the
+    // previous one of an asynchronous load. setVolume must not return
+    // before the build reading them has stopped
+    if(scene.density.getVoxelCount())
+    {
+        auto density = std::make_unique<Grid>(Grid::fromData(
+            GridFormat::R32F, scene.density.getSize(),
+            std::vector<float>(scene.density.getData(), scene.density.getData() + scene.density.getVoxelCount())));
+
+        VolumeMedium medium = scene.medium;
+        medium.setBrickGrid(nullptr);
+        medium.setDensity(density.get());
+
+        cached.setVolume(medium);
+        cached.render();
+
+        ToolTimer swapTimer;
+        cached.setVolume(scene.medium);
+        const double swapMs = swapTimer.ms();
+        density.reset();
+
+        cached.render();
+        cached.waitTransmittanceCache();
+        std::cout << "setVolume during a build waited " << swapMs
+                  << " ms for it to stop, then the cache was rebuilt for the new volume "
+                  << (cached.getTransmittanceCache() != nullptr) << std::endl;
+    }
+}
@@ -0,0 +1,167 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "../../src/core/rng.h"
+#include "bench.h"
+
+namespace
+{
+    struct Segment
+    {
+        Float3 a, b;
+        double reference = 0;
+    };
+
+    struct EstimatorStats
+    {
+        double variance = 0; // mean per-segment variance of single estimates
+        double bias     = 0; // mean signed error of the per-segment means
+        double lookups  = 0; // per estimate
+        double us       = 0; // per estimate
+    };
+
+    Float3 sampleSphere(uint32_t &rng)
+    {
+        const float z = 2 * randFloat(rng) - 1;
+        const float r = std::sqrt((std::max)(0.0f, 1 - z * z));
+        const float phi = 2 * PI * randFloat(rng);
+        return Float3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    // shadow rays from first scattering events of camera-like paths, which
+    // concentrates them where the renderer estimates transmittance
+    std::vector<Segment> generateSegments(const VolumeMedium &medium, int count)
+    {
+        std::vector<Segment> segments;
+        uint32_t rng = 1;
+
+        while(static_cast<int>(segments.size()) < count)
+        {
+            const Float3 eye = 4.0f * sampleSphere(rng);
+            const Float3 d = (0.5f * sampleSphere(rng) - eye).normalize();
+
+            Float3 o;
+            if(!medium.findEntry(eye, d, o))
+                continue;
+
+            const Float2 incts = medium.intersectRayBox(o, d);
+            Float3 scatterPos;
+            if(!medium.deltaTrack(o, o + (incts.y - 0.001f) * d, rng, scatterPos))
+                continue;
+
+            const Float3 wi = sampleSphere(rng);
+            const Float2 shadowIncts = medium.intersectRayBox(scatterPos, wi);
+            if(shadowIncts.x >= shadowIncts.y)
+                continue;
+
+            segments.push_back({
+                scatterPos + shadowIncts.x * wi, scatterPos + shadowIncts.y * wi });
+        }
+
+        return segments;
+    }
+
+    // exp(-optical depth) with midpoint quadrature at a quarter voxel
+    double computeReference(const VolumeMedium &medium, const Segment &segment)
+    {
+        const Int3 &size = medium.getDensity()->getSize();
+        const Float3 uvwA = medium.toTexCoord(segment.a);
+        const Float3 uvwB = medium.toTexCoord(segment.b);
+        const Float3 voxels = (uvwB - uvwA) * Float3(
+            float(size.x), float(size.y), float(size.z));
+
+        const float length = (segment.b - segment.a).length();
+        const int steps = (std::max)(1, static_cast<int>(4 * voxels.length()));
+        const float dt = length / steps;
+
+        double opticalDepth = 0;
+        for(int i = 0; i < steps; ++i)
+        {
+            const float t = (i + 0.5f) / steps;
+            opticalDepth += medium.sampleDensity(uvwA + t * (uvwB - uvwA)) * dt;
+        }
+
+        return std::exp(-opticalDepth);
+    }
+
+    EstimatorStats runEstimator(
+        const VolumeMedium &medium, TransmittanceEstimator estimator,
+        const std::vector<Segment> &segments, int samples)
+    {
+        EstimatorStats result;
+        TrackingStats tracking;
+        uint32_t rng = 1;
+
+        double seconds = 0;
+        for(auto &segment : segments)
+        {
+            double sum = 0, sum2 = 0;
+
+            ToolTimer timer;
+            for(int i = 0; i < samples; ++i)
+            {
+                const double value = medium.estimateTransmittance(
+                    estimator, segment.a, segment.b, rng, &tracking);
+                sum  += value;
+                sum2 += value * value;
+            }
+            seconds += timer.ms() / 1000;
+
+            const double mean = sum / samples;
+            result.variance += (sum2 - samples * mean * mean) / (samples - 1);
+            result.bias     += mean - segment.reference;
+        }
+
+        const double estimates = double(segments.size()) * samples;
+        result.variance /= segments.size();
+        result.bias     /= segments.size();
+        result.lookups   = tracking.densityLookups / estimates;
+        result.us        = seconds * 1e6 / estimates;
+        return result;
+    }
+}
+
+void benchTransmittance(const ToolOptions &options)
+{
+    const int segmentCount = options.getInt("segments", 2000);
+    const int samples      = (std::max)(2, options.getInt("samples", 256));
+    const int cellSize     = options.getInt("cell", MAJORANT_CELL_SIZE);
+
+    ToolScene scene;
+    loadToolScene(options, scene);
+    scene.majorants.build(scene.density, cellSize);
+    const VolumeMedium &medium = scene.medium;
+
+    std::vector<Segment> segments = generateSegments(medium, segmentCount);
+    for(auto &s : segments)
+        s.reference = computeReference(medium, s);
+
+    std::cout << segments.size() << " shadow segments, "
+              << samples << " estimates each, density scale "
+              << medium.getDensityScale() << std::endl;
+
+    // cost is measured in time, so the efficiency compares
+    // 1 / (mse * time) against the shader's current estimator
+
+    double baseline = 0;
+    for(auto estimator : { TransmittanceEstimator::RatioCutoff,
+                           TransmittanceEstimator::RatioRoulette,
+                           TransmittanceEstimator::ResidualRatio })
+    {
+        const EstimatorStats stats = runEstimator(medium, estimator, segments, samples);
+
+        const double mse = stats.variance + stats.bias * stats.bias;
+        const double efficiency = 1 / (mse * stats.us);
+        if(estimator == TransmittanceEstimator::RatioCutoff)
+            baseline = efficiency;
+
+        std::cout << getTransmittanceEstimatorName(estimator)
+                  << ": variance " << stats.variance
+                  << ", bias " << stats.bias
+                  << ", lookups " << stats.lookups
+                  << ", " << stats.us << " us"
+                  << ", variance x cost " << stats.variance * stats.us
+                  << ", efficiency " << efficiency / baseline << "x" << std::endl;
+    }
+}
@@ -0,0 +1,219 @@
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "../src/core/brick_file.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double elapsedMs(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(
+            Clock::now() - start).count();
+    }
+
+    // reads every voxel so that lazily mapped pages are actually paged in
+    float touch(const Grid &grid)
+    {
+        const float *data = grid.getData();
+        const size_t count = grid.getVoxelCount() * grid.getChannels();
+
+        float sum = 0;
+        for(size_t i = 0; i < count; ++i)
+            sum += data[i];
+        return sum;
+    }
+
+    template<typename Func>
+    double bestOf(int repeat, Func &&func)
+    {
+        double best = std::numeric_limits<double>::max();
+        for(int i = 0; i < repeat; ++i)
+        {
+            const auto start = Clock::now();
+            func();
+            best = (std::min)(best, elapsedMs(start));
+        }
+        return best;
+    }
+
+    void convert(const std::string &input, const std::string &output, GridFormat format)
+    {
+        const auto start = Clock::now();
+        const Grid grid = Grid::loadTextParallel(input, format);
+        grid.saveBinary(output);
+
+        std::cout << "converted " << input << " -> " << output << " ("
+                  << grid.getSize().x << "x" << grid.getSize().y << "x"
+                  << grid.getSize().z << ", max " << grid.getMaxValue()
+                  << ") in " << elapsedMs(start) << " ms" << std::endl;
+    }
+
+    void convertToBricks(const std::string &input, const std::string &output)
+    {
+        const auto start = Clock::now();
+        const Grid grid = Grid::load(input, GridFormat::R32F);
+        saveBrickFile(grid, output);
+
+        BrickFile file;
+        file.open(output);
+        const Int3 &res = file.getBrickResolution();
+
+        std::cout << "converted " << input << " -> " << output << " ("
+                  << res.x << "x" << res.y << "x" << res.z << " bricks, "
+                  << file.getBrickCount() << " occupied) in "
+                  << elapsedMs(start) << " ms" << std::endl;
+    }
+
+    void bench(const std::string &text, const std::string &binary, GridFormat format)
+    {
+        constexpr int REPEAT = 5;
+
+        float textSum = 0, binarySum = 0;
+        const double textMs = bestOf(REPEAT, [&]
+        {
+            textSum = touch(Grid::loadText(text, format));
+        });
+        const double binaryMs = bestOf(REPEAT, [&]
+        {
+            binarySum = touch(Grid::loadBinary(binary));
+        });
+
+        if(textSum != binarySum)
+            std::cout << "warning: grid contents differ" << std::endl;
+
+        std::cout << "text   loader: " << textMs   << " ms" << std::endl;
+        std::cout << "binary loader: " << binaryMs << " ms" << std::endl;
+        std::cout << "speedup: " << textMs / binaryMs << "x" << std::endl;
+    }
+
+    std::string getLoadError(const std::string &filename, bool parallel)
+    {
+        try
+        {
+            if(parallel)
+                (void)Grid::loadTextParallel(filename, GridFormat::R32F);
+            else
+                (void)Grid::loadText(filename, GridFormat::R32F);
+        }
+        catch(const std::exception &e)
+        {
+            return e.what();
+        }
+        return {};
+    }
+
+    // both parsers must reject the same malformed grids with the same error
+    void checkMalformedText(const std::string &dir)
+    {
+        const std::pair<const char *, const char *> cases[] = {
+            { "inf",       "2 1 1\n0.5 inf\n"  },
+            { "-inf",      "2 1 1\n-inf 0.5\n" },
+            { "nan",       "2 1 1\nnan 0.5\n"  },
+            { "overflow",  "2 1 1\n0.5 1e99\n" },
+            { "truncated", "3 1 1\n0.5 0.25\n" }
+        };
+
+        const std::string filename = (std::filesystem::path(dir) / "malformed_grid.txt").string();
+        for(auto &[name, content] : cases)
+        {
+            std::ofstream(filename, std::ios::binary) << content;
+
+            const std::string serial = getLoadError(filename, false);
+            const std::string parallel = getLoadError(filename, true);
+            if(serial.empty() || serial != parallel)
+            {
+                std::cout << "error: " << name << " token: ifstream parser \"" << serial
+                          << "\", parallel parser \"" << parallel << "\"" << std::endl;
+            }
+        }
+        std::filesystem::remove(filename);
+    }
+
+    void benchText(const std::string &text, GridFormat format)
+    {
+        constexpr int REPEAT = 5;
+
+        const double megaBytes = static_cast<double>(
+            std::filesystem::file_size(text)) / (1024 * 1024);
+
+        const Grid reference = Grid::loadText(text, format);
+        const Grid parallel  = Grid::loadTextParallel(text, format);
+        if(reference.getMaxValue() != parallel.getMaxValue() ||
+           std::memcmp(reference.getData(), parallel.getData(), reference.getByteSize()))
+            std::cout << "error: parallel parser is not bit-identical" << std::endl;
+        checkMalformedText(std::filesystem::temp_directory_path().string());
+
+        const double serialMs = bestOf(REPEAT, [&]
+        {
+            (void)Grid::loadText(text, format);
+        });
+        const double parallelMs = bestOf(REPEAT, [&]
+        {
+            (void)Grid::loadTextParallel(text, format);
+        });
+
+        std::cout << "ifstream parser: " << megaBytes / serialMs * 1000 << " MB/s" << std::endl;
+        std::cout << "parallel parser: " << megaBytes / parallelMs * 1000 << " MB/s" << std::endl;
+    }
+
+    void printUsage()
+    {
+        std::cout << "usage:" << std::endl
+                  << "    GridConverter [--albedo] input.txt output.vgrid" << std::endl
+                  << "    GridConverter --bricks input.txt|input.vgrid output.vbrick" << std::endl
+                  << "    GridConverter [--albedo] --bench input.txt input.vgrid" << std::endl
+                  << "    GridConverter [--albedo] --bench-text input.txt" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    GridFormat format = GridFormat::R32F;
+    bool isBench = false, isTextBench = false, isBricks = false;
+
+    std::vector<std::string> files;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!std::strcmp(argv[i], "--albedo"))
+            format = GridFormat::RGBA32F;
+        else if(!std::strcmp(argv[i], "--bench"))
+            isBench = true;
+        else if(!std::strcmp(argv[i], "--bench-text"))
+            isTextBench = true;
+        else if(!std::strcmp(argv[i], "--bricks"))
+            isBricks = true;
+        else
+            files.emplace_back(argv[i]);
+    }
+
+    if(files.size() != (isTextBench ? 1 : 2))
+    {
+        printUsage();
+        return 1;
+    }
+
+    try
+    {
+        if(isTextBench)
+            benchText(files[0], format);
+        else if(isBench)
+            bench(files[0], files[1], format);
+        else if(isBricks)
+            convertToBricks(files[0], files[1]);
+        else
+            convert(files[0], files[1], format);
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
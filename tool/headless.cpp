@@ -0,0 +1,209 @@
+#include <iostream>
+
+#include "../src/core/cpu_renderer.h"
+#include "../src/core/image_io.h"
+#include "scene.h"
+
+namespace
+{
+    void printUsage()
+    {
+        std::cout << "usage: HeadlessRenderer [--key value]..." << std::endl
+                  << "    --help        print this and exit" << std::endl
+                  << "    --frames n    progressive frames to accumulate (2 spp each)" << std::endl
+                  << "    --adaptive 1  spend the samples of each frame on unconverged pixels" << std::endl
+                  << "    --adaptive-threshold e --adaptive-min n --adaptive-max n" << std::endl
+                  << "    --sampler name  random, sobol, lattice or bluenoise (scalar tracer)" << std::endl
+                  << "    --direct name   light, mis or product sampling of the direct light (scalar tracer)" << std::endl
+                  << "    --mis-heuristic balance/power --product-size n" << std::endl
+                  << "    --guiding 1   learn where light comes from and guide the bounces (scalar tracer)" << std::endl
+                  << "    --guide-fraction a --guide-iterations n --guide-first-frames n" << std::endl
+                  << "    --guide-spatial n --guide-directional r" << std::endl
+                  << "    --denoise 1   a-trous filter the output, guided by the first scattering" << std::endl
+                  << "    --denoise-iterations n --denoise-sigma-lum s --denoise-sigma-depth s" << std::endl
+                  << "    --denoise-sigma-albedo s --denoise-sigma-trans s" << std::endl
+                  << "    --restir 1    resample the envir light of the first scattering (scalar tracer)" << std::endl
+                  << "    --restir-candidates n --restir-temporal 0/1 --restir-neighbors n" << std::endl
+                  << "    --restir-radius r --restir-history n" << std::endl
+                  << "    --trans-cache 1  cached transmittance toward the dominant envir patches (scalar tracer)" << std::endl
+                  << "    --trans-cache-lobes n --trans-cache-angle radians --trans-cache-res n" << std::endl
+                  << "    --threads n   task scheduler workers rendering tiles, 0 for all" << std::endl
+                  << "    --simd name   scalar, sse4.1, avx2 or avx512. widest supported by default" << std::endl
+                  << "    --transmittance name  cutoff, roulette or residual" << std::endl
+                  << "    --free-flight name    delta or decomposition" << std::endl
+                  << "    --output file .pfm for radiance, .ppm for tonemapped" << std::endl
+                  << "    --exposure e  exposure of .ppm outputs" << std::endl
+                  << "    and the scene options:" << std::endl
+                  << "    --density --albedo --envir --scale --g --intensity --depth --width --height --bricked" << std::endl
+                  << "    --stream file.vbrick  page the density in from a brick file" << std::endl
+                  << "    --cache-mb n  brick cache size of --stream" << std::endl
+                  << "    --density-encoding float|half|unorm16|unorm8 --albedo-encoding float|srgb8" << std::endl
+                  << "    --lod off|depth|footprint  coarser density mips for deep bounces" << std::endl
+                  << "    --lod-start --lod-per-bounce --lod-spread --lod-max" << std::endl
+                  << "    --envir-cache dir  load --envir through a .venv cache directory" << std::endl
+                  << "    --envir-sampling alias|mipwarp --envir-warp-size n" << std::endl;
+    }
+
+    SimdLevel parseSimdLevel(const std::string &name)
+    {
+        for(auto level : { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512 })
+        {
+            if(name == getSimdLevelName(level))
+                return level;
+        }
+        throw std::runtime_error("unknown simd level: " + name);
+    }
+
+    TransmittanceEstimator parseTransmittanceEstimator(const std::string &name)
+    {
+        for(auto estimator : { TransmittanceEstimator::RatioCutoff,
+                               TransmittanceEstimator::RatioRoulette,
+                               TransmittanceEstimator::ResidualRatio })
+        {
+            if(name == getTransmittanceEstimatorName(estimator))
+                return estimator;
+        }
+        throw std::runtime_error("unknown transmittance estimator: " + name);
+    }
+
+    FreeFlightSampler parseFreeFlightSampler(const std::string &name)
+    {
+        for(auto sampler : { FreeFlightSampler::Delta, FreeFlightSampler::Decomposition })
+        {
+            if(name == getFreeFlightSamplerName(sampler))
+                return sampler;
+        }
+        throw std::runtime_error("unknown free-flight sampler: " + name);
+    }
+
+    bool endsWith(const std::string &str, const std::string &suffix)
+    {
+        return str.size() >= suffix.size() &&
+               str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        const ToolOptions options(argc - 1, argv + 1);
+        if(options.has("help"))
+        {
+            printUsage();
+            return 0;
+        }
+
+        ToolTimer loadTimer;
+        ToolScene scene;
+        loadToolScene(options, scene);
+        std::cout << "scene loaded in " << loadTimer.ms() << " ms" << std::endl;
+
+        CPUVolumeRenderer renderer;
+        renderer.initialize(scene.size);
+        renderer.setThreadCount(options.getInt("threads", 0));
+        if(options.has("simd"))
+            renderer.setSimdLevel(parseSimdLevel(options.get("simd", "")));
+        renderer.setTracer(scene.maxDepth);
+        renderer.setTransmittanceEstimator(parseTransmittanceEstimator(
+            options.get("transmittance", "cutoff")));
+        renderer.setFreeFlightSampler(parseFreeFlightSampler(
+            options.get("free-flight", "delta")));
+        renderer.setDensityLod(scene.lod);
+        renderer.setAdaptiveSampling(scene.adaptive);
+        renderer.setSampler(scene.sampler);
+        renderer.setDirectLight(scene.direct);
+        renderer.setPathGuiding(scene.guiding);
+        renderer.setReSTIR(scene.restir);
+        renderer.setTransmittanceCache(scene.transCache);
+        renderer.setCamera(scene.camera);
+        renderer.setEnvir(scene.envir);
+        renderer.setVolume(scene.medium);
+
+        // built before the timed frames, which would otherwise track shadow
+        // rays until it is done
+        if(scene.transCache.enabled)
+        {
+            renderer.waitTransmittanceCache();
+
+            const TransmittanceCache *cache = renderer.getTransmittanceCache();
+            std::cout << "transmittance cache: " << cache->getLobeCount() << " lobes covering "
+                      << 100 * cache->getCoverage() << "% of the light samples, "
+                      << cache->getByteSize() / 1024 << " KB, built in "
+                      << cache->getBuildMs() << " ms" << std::endl;
+        }
+
+        const int frames = options.getInt("frames", 64);
+
+        const bool isStreaming = options.has("stream");
+
+        ToolTimer timer;
+        for(int i = 0; i < frames; ++i)
+        {
+            // what the next frame sees is requested before it starts
+            if(isStreaming)
+            {
+                scene.brickCache.prefetchFrustum(
+                    scene.camera.getPosition(), scene.camera.getFrustumDirections(),
+                    scene.medium.getLower(), scene.medium.getUpper());
+            }
+            renderer.render();
+        }
+        const double seconds = timer.ms() / 1000;
+
+        const uint64_t paths = renderer.getPathCount();
+        // the level the frames were traced at
+        const SimdLevel simdLevel = renderer.usedPackets() ? renderer.getSimdLevel() : SimdLevel::Scalar;
+        std::cout << getSimdLevelName(simdLevel) << ": "
+                  << frames << " frames in " << seconds << " s, "
+                  << paths / seconds << " samples/sec" << std::endl;
+
+        if(scene.adaptive.enabled)
+        {
+            std::cout << "adaptive sampling: " << renderer.getConvergedPixelCount()
+                      << " of " << scene.size.product() << " pixels converged" << std::endl;
+        }
+
+        if(isStreaming)
+        {
+            const BrickCacheStats stats = scene.brickCache.getStats();
+            std::cout << "brick cache: hit rate "
+                      << 100.0 * stats.hits / (std::max<uint64_t>)(1, stats.hits + stats.misses)
+                      << "%, " << stats.bytesPaged / (1024.0 * 1024.0) << " MB paged ("
+                      << stats.prefetches << " bricks prefetched), "
+                      << stats.evictions << " evictions, stall "
+                      << stats.stallMs << " ms" << std::endl;
+        }
+
+        std::vector<Float4> denoised;
+        if(scene.denoise)
+        {
+            Denoiser denoiser;
+            denoiser.setParams(scene.denoiser);
+
+            ToolTimer denoiseTimer;
+            denoiser.denoise(
+                scene.size, renderer.getOutput(), renderer.getMoments(),
+                renderer.getFeatures(), denoised);
+            std::cout << "denoised in " << denoiseTimer.ms() << " ms" << std::endl;
+        }
+        const std::vector<Float4> &pixels = scene.denoise ? denoised : renderer.getOutput();
+
+        const std::string output = options.get("output", "output.ppm");
+        if(endsWith(output, ".pfm"))
+        {
+            saveAccumulatedToPFM(output, scene.size, pixels);
+        }
+        else
+        {
+            saveAccumulatedToPPM(
+                output, scene.size, pixels, options.getFloat("exposure", 1));
+        }
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        printUsage();
+        return 1;
+    }
+}
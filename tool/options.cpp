@@ -0,0 +1,63 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "options.h"
+
+ToolOptions::ToolOptions(int argc, char *argv[])
+{
+    auto isKey = [](const char *arg)
+    {
+        return !std::strncmp(arg, "--", 2);
+    };
+
+    for(int i = 0; i < argc; ++i)
+    {
+        if(!isKey(argv[i]))
+            throw std::runtime_error(std::string("invalid option: ") + argv[i]);
+
+        // a flag without value, such as --help, is followed by the next key
+        // or the end of the arguments
+        const char *key = argv[i] + 2;
+        const bool hasValue = i + 1 < argc && !isKey(argv[i + 1]);
+        values_[key] = hasValue ? argv[++i] : "";
+    }
+}
+
+bool ToolOptions::has(const std::string &key) const
+{
+    return values_.contains(key);
+}
+
+std::string ToolOptions::get(const std::string &key, const std::string &defaultValue) const
+{
+    const auto it = values_.find(key);
+    return it != values_.end() ? it->second : defaultValue;
+}
+
+int ToolOptions::getInt(const std::string &key, int defaultValue) const
+{
+    const auto it = values_.find(key);
+    return it != values_.end() ? std::stoi(it->second) : defaultValue;
+}
+
+float ToolOptions::getFloat(const std::string &key, float defaultValue) const
+{
+    const auto it = values_.find(key);
+    return it != values_.end() ? std::stof(it->second) : defaultValue;
+}
+
+ToolTimer::ToolTimer()
+{
+    restart();
+}
+
+void ToolTimer::restart()
+{
+    start_ = std::chrono::steady_clock::now();
+}
+
+double ToolTimer::ms() const
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_).count();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+
+class ToolOptions
+{
+public:
+
+    // parses '--key value' pairs. a key without value, e.g. '--help', maps
+    // to an empty string
+    ToolOptions(int argc, char *argv[]);
+
+    bool has(const std::string &key) const;
+
+    std::string get(const std::string &key, const std::string &defaultValue) const;
+
+    int getInt(const std::string &key, int defaultValue) const;
+
+    float getFloat(const std::string &key, float defaultValue) const;
+
+private:
+
+    std::map<std::string, std::string> values_;
+};
+
+class ToolTimer
+{
+public:
+
+    ToolTimer();
+
+    void restart();
+
+    double ms() const;
+
+private:
+
+    std::chrono::steady_clock::time_point start_;
+};
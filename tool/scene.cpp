@@ -0,0 +1,262 @@
+#include "../src/core/task_scheduler.h"
+#include "scene.h"
+
+void loadToolScene(const ToolOptions &options, ToolScene &scene)
+{
+    // the loads and preprocessing steps run as a task graph, so that the
+    // envir light and albedo load while the density is parsed, and the
+    // majorants and mips of the density are built side by side
+
+    TaskGraph graph;
+
+    graph.add([&]
+    {
+        scene.envir.setSampling(
+            parseEnvirSampling(options.get("envir-sampling", "alias")),
+            options.getInt("envir-warp-size", 1024));
+
+        if(options.has("envir") && options.has("envir-cache"))
+        {
+            scene.envir.initialize(EnvirCache(options.get("envir-cache", "")).load(
+                options.get("envir", ""), { 200, 200 }, options.getInt("envir-warp-size", 1024)));
+        }
+        else if(options.has("envir"))
+            scene.envir.load(options.get("envir", ""), { 200, 200 });
+        else
+            scene.envir.initialize(createProceduralSky({ 512, 256 }), { 200, 200 });
+    });
+
+    graph.add([&]
+    {
+        scene.albedo = Grid::load(
+            options.get("albedo", "./asset/albedo.txt"), GridFormat::RGBA32F);
+        if(options.has("albedo-encoding"))
+        {
+            scene.albedo = roundTripAlbedo(
+                scene.albedo, parseAlbedoEncoding(options.get("albedo-encoding", "")));
+        }
+    });
+
+    if(options.has("stream"))
+    {
+        const auto file = graph.add([&]
+        {
+            scene.brickFile.open(options.get("stream", ""));
+        });
+
+        graph.addDependency(file, graph.add([&]
+        {
+            scene.brickCache.initialize(
+                scene.brickFile, size_t(options.getInt("cache-mb", 64)) << 20);
+        }));
+
+        graph.addDependency(file, graph.add([&]
+        {
+            scene.majorants.build(scene.brickFile);
+        }));
+    }
+    else
+    {
+        const auto density = graph.add([&]
+        {
+            scene.density = Grid::load(
+                options.get("density", "./asset/density.txt"), GridFormat::R32F);
+            if(options.has("density-encoding"))
+            {
+                scene.density = roundTripDensity(
+                    scene.density, parseDensityEncoding(options.get("density-encoding", "")));
+            }
+        });
+
+        graph.addDependency(density, graph.add([&]
+        {
+            scene.majorants.build(scene.density);
+        }));
+
+        graph.addDependency(density, graph.add([&]
+        {
+            scene.mips.build(scene.density);
+        }));
+
+        if(options.getInt("bricked", 0))
+        {
+            graph.addDependency(density, graph.add([&]
+            {
+                scene.bricks.build(scene.density);
+            }));
+        }
+    }
+
+    graph.run();
+
+    if(options.has("stream"))
+        scene.medium.setBrickCache(&scene.brickCache);
+    else
+    {
+        scene.medium.setDensity(&scene.density);
+        scene.medium.setMipChain(&scene.mips);
+        if(options.getInt("bricked", 0))
+            scene.medium.setBrickGrid(&scene.bricks);
+    }
+
+    const Float3 extent = Float3(1.98f, 1.98f, 0.78f);
+
+    scene.medium.setAlbedo(&scene.albedo);
+    scene.medium.setMajorantGrid(&scene.majorants);
+    scene.medium.setBoundingBox(-extent, extent);
+    scene.medium.setDensityScale(options.getFloat("scale", 10));
+    scene.medium.setG(options.getFloat("g", 0));
+
+    scene.envir.setIntensity(options.getFloat("intensity", 1));
+
+    scene.size = Int2(options.getInt("width", 640), options.getInt("height", 480));
+    scene.maxDepth = options.getInt("depth", 5);
+
+    scene.lod.mode          = parseDensityLodMode(options.get("lod", "off"));
+    scene.lod.startDepth    = options.getInt("lod-start", scene.lod.startDepth);
+    scene.lod.perBounce     = options.getFloat("lod-per-bounce", scene.lod.perBounce);
+    scene.lod.scatterSpread = options.getFloat("lod-spread", scene.lod.scatterSpread);
+    scene.lod.maxLod        = options.getFloat("lod-max", scene.lod.maxLod);
+
+    scene.adaptive.enabled    = options.getInt("adaptive", 0) != 0;
+    scene.adaptive.threshold  = options.getFloat("adaptive-threshold", scene.adaptive.threshold);
+    scene.adaptive.minSamples = options.getInt("adaptive-min", scene.adaptive.minSamples);
+    scene.adaptive.maxSamples = options.getInt("adaptive-max", scene.adaptive.maxSamples);
+
+    scene.sampler = parseSamplerType(options.get("sampler", "random"));
+
+    scene.direct.sampling         = parseDirectLightSampling(options.get("direct", "light"));
+    scene.direct.heuristic        = parseMISHeuristic(options.get("mis-heuristic", "power"));
+    scene.direct.productTableSize = options.getInt("product-size", scene.direct.productTableSize);
+
+    scene.guiding.enabled              = options.getInt("guiding", 0) != 0;
+    scene.guiding.guideFraction        = options.getFloat("guide-fraction", scene.guiding.guideFraction);
+    scene.guiding.trainingIterations   = options.getInt("guide-iterations", scene.guiding.trainingIterations);
+    scene.guiding.firstIterationFrames = options.getInt("guide-first-frames", scene.guiding.firstIterationFrames);
+    scene.guiding.spatialThreshold     = options.getInt("guide-spatial", scene.guiding.spatialThreshold);
+    scene.guiding.directionalThreshold = options.getFloat("guide-directional", scene.guiding.directionalThreshold);
+
+    scene.denoise = options.getInt("denoise", 0) != 0;
+    scene.denoiser.iterations         = options.getInt("denoise-iterations", scene.denoiser.iterations);
+    scene.denoiser.sigmaLuminance     = options.getFloat("denoise-sigma-lum", scene.denoiser.sigmaLuminance);
+    scene.denoiser.sigmaDepth         = options.getFloat("denoise-sigma-depth", scene.denoiser.sigmaDepth);
+    scene.denoiser.sigmaAlbedo        = options.getFloat("denoise-sigma-albedo", scene.denoiser.sigmaAlbedo);
+    scene.denoiser.sigmaTransmittance = options.getFloat("denoise-sigma-trans", scene.denoiser.sigmaTransmittance);
+
+    scene.restir.enabled          = options.getInt("restir", 0) != 0;
+    scene.restir.candidates       = options.getInt("restir-candidates", scene.restir.candidates);
+    scene.restir.temporalReuse    = options.getInt("restir-temporal", 1) != 0;
+    scene.restir.spatialNeighbors = options.getInt("restir-neighbors", scene.restir.spatialNeighbors);
+    scene.restir.spatialRadius    = options.getInt("restir-radius", scene.restir.spatialRadius);
+    scene.restir.historyLimit     = options.getInt("restir-history", scene.restir.historyLimit);
+
+    scene.transCache.enabled    = options.getInt("trans-cache", 0) != 0;
+    scene.transCache.lobeCount  = options.getInt("trans-cache-lobes", scene.transCache.lobeCount);
+    scene.transCache.lobeAngle  = options.getFloat("trans-cache-angle", scene.transCache.lobeAngle);
+    scene.transCache.resolution = options.getInt("trans-cache-res", scene.transCache.resolution);
+
+    scene.camera.setPosition(Float3(0, 0, -4));
+    scene.camera.setDirection(3.1415926f / 2, 0);
+    scene.camera.setPerspective(60.0f, 0.1f, 100.0f);
+    scene.camera.setWOverH(float(scene.size.x) / scene.size.y);
+    scene.camera.recalculateMatrics();
+}
+
+EnvirMap::Texels createProceduralSky(const Int2 &size)
+{
+    const Float3 sunDir = Float3(0.4f, 0.8f, -0.3f).normalize();
+
+    EnvirMap::Texels texels(size.y, size.x);
+    for(int y = 0; y < size.y; ++y)
+    {
+        for(int x = 0; x < size.x; ++x)
+        {
+            // inverse of the mapping in evalEnvirLight
+            const float phi   = 2 * PI * (x + 0.5f) / size.x;
+            const float theta = PI * (0.5f - (y + 0.5f) / size.y);
+            const Float3 dir(
+                std::cos(theta) * std::cos(phi), std::sin(theta),
+                std::cos(theta) * std::sin(phi));
+
+            const float up  = (std::max)(0.0f, dir.y);
+            const float sun = dot(dir, sunDir) > 0.995f ? 200.0f : 0.0f;
+
+            texels(y, x) = agz::math::color3f(
+                0.3f + 0.3f * up + sun, 0.4f + 0.4f * up + sun, 0.5f + 0.7f * up + sun);
+        }
+    }
+    return texels;
+}
+
+DensityEncoding parseDensityEncoding(const std::string &name)
+{
+    for(auto encoding : { DensityEncoding::Float32, DensityEncoding::Half,
+                          DensityEncoding::Unorm16, DensityEncoding::Unorm8 })
+    {
+        if(name == getDensityEncodingName(encoding))
+            return encoding;
+    }
+    throw std::runtime_error("unknown density encoding: " + name);
+}
+
+AlbedoEncoding parseAlbedoEncoding(const std::string &name)
+{
+    for(auto encoding : { AlbedoEncoding::Float32, AlbedoEncoding::SRGB8 })
+    {
+        if(name == getAlbedoEncodingName(encoding))
+            return encoding;
+    }
+    throw std::runtime_error("unknown albedo encoding: " + name);
+}
+
+DensityLodMode parseDensityLodMode(const std::string &name)
+{
+    for(auto mode : { DensityLodMode::Off, DensityLodMode::Depth, DensityLodMode::Footprint })
+    {
+        if(name == getDensityLodModeName(mode))
+            return mode;
+    }
+    throw std::runtime_error("unknown density lod mode: " + name);
+}
+
+EnvirSampling parseEnvirSampling(const std::string &name)
+{
+    for(auto sampling : { EnvirSampling::AliasTable, EnvirSampling::MipWarp })
+    {
+        if(name == getEnvirSamplingName(sampling))
+            return sampling;
+    }
+    throw std::runtime_error("unknown envir sampling: " + name);
+}
+
+SamplerType parseSamplerType(const std::string &name)
+{
+    for(auto type : { SamplerType::Random, SamplerType::Sobol,
+                      SamplerType::Lattice, SamplerType::BlueNoise })
+    {
+        if(name == getSamplerTypeName(type))
+            return type;
+    }
+    throw std::runtime_error("unknown sampler: " + name);
+}
+
+DirectLightSampling parseDirectLightSampling(const std::string &name)
+{
+    for(auto sampling : { DirectLightSampling::Light, DirectLightSampling::MIS,
+                          DirectLightSampling::Product })
+    {
+        if(name == getDirectLightSamplingName(sampling))
+            return sampling;
+    }
+    throw std::runtime_error("unknown direct light sampling: " + name);
+}
+
+MISHeuristic parseMISHeuristic(const std::string &name)
+{
+    for(auto heuristic : { MISHeuristic::Balance, MISHeuristic::Power })
+    {
+        if(name == getMISHeuristicName(heuristic))
+            return heuristic;
+    }
+    throw std::runtime_error("unknown mis heuristic: " + name);
+}
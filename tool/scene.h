@@ -0,0 +1,84 @@
+#pragma once
+
+#include "../src/core/camera.h"
+#include "../src/core/cpu_renderer.h"
+#include "../src/core/envir_cache.h"
+#include "../src/core/medium.h"
+#include "../src/core/quantize.h"
+#include "options.h"
+
+// the scene set up by ReSTIRVolumeDemo::initialize, configurable with
+//     --density file --albedo file --envir file.hdr --scale s --g g
+//     --intensity i --depth n --width w --height h --bricked 0/1
+//     --stream file.vbrick --cache-mb n
+//     --density-encoding float/half/unorm16/unorm8 --albedo-encoding float/srgb8
+//     --lod off/depth/footprint --lod-start n --lod-per-bounce l
+//     --lod-spread s --lod-max l --envir-cache dir
+//     --envir-sampling alias/mipwarp --envir-warp-size n
+//     --adaptive 0/1 --adaptive-threshold e --adaptive-min n --adaptive-max n
+//     --sampler random/sobol/lattice/bluenoise
+//     --direct light/mis/product --mis-heuristic balance/power --product-size n
+//     --guiding 0/1 --guide-fraction a --guide-iterations n --guide-first-frames n
+//     --guide-spatial n --guide-directional r
+//     --denoise 0/1 --denoise-iterations n --denoise-sigma-lum s
+//     --denoise-sigma-depth s --denoise-sigma-albedo s --denoise-sigma-trans s
+//     --restir 0/1 --restir-candidates n --restir-temporal 0/1
+//     --restir-neighbors n --restir-radius r --restir-history n
+//     --trans-cache 0/1 --trans-cache-lobes n --trans-cache-angle a --trans-cache-res n
+// without --envir a procedural sky with a sun is used. with --envir-cache
+// the envir texels and tables are loaded from a .venv file in dir, which
+// is built on the first load of the .hdr. with --stream the
+// density is paged in from the brick file through a cache of n MB instead
+// of being loaded, and the dense grid stays empty. encodings replace the
+// grids by their decoded values, which is what the shader samples
+struct ToolScene
+{
+    Grid         density;
+    Grid         albedo;
+    MajorantGrid majorants;
+    BrickGrid    bricks;
+    DensityMipChain mips;
+    BrickFile    brickFile;
+    BrickCache   brickCache;
+    VolumeMedium medium;
+    EnvirMap     envir;
+    Camera       camera;
+
+    Int2 size;
+    int  maxDepth = 5;
+
+    DensityLodParams lod;
+
+    AdaptiveSamplingParams adaptive;
+
+    SamplerType sampler = SamplerType::Random;
+
+    DirectLightParams direct;
+
+    PathGuidingParams guiding;
+
+    bool           denoise = false;
+    DenoiserParams denoiser;
+
+    ReSTIRParams restir;
+
+    TransmittanceCacheParams transCache;
+};
+
+void loadToolScene(const ToolOptions &options, ToolScene &scene);
+
+EnvirMap::Texels createProceduralSky(const Int2 &size);
+
+DensityEncoding parseDensityEncoding(const std::string &name);
+
+AlbedoEncoding parseAlbedoEncoding(const std::string &name);
+
+DensityLodMode parseDensityLodMode(const std::string &name);
+
+EnvirSampling parseEnvirSampling(const std::string &name);
+
+SamplerType parseSamplerType(const std::string &name);
+
+DirectLightSampling parseDirectLightSampling(const std::string &name);
+
+MISHeuristic parseMISHeuristic(const std::string &name);